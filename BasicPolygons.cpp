@@ -1,7 +1,7 @@
 #include "BasicPolygons.h"
 #include "gfxMaths.h"
 
-void GfxSphere::GenerateSphereVertices_Internal(uint32_t numRings, uint32_t numSegments,
+void GfxSphere::GenerateMesh(uint32_t numRings, uint32_t numSegments,
 	float radius, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
 {
 	vertices.clear();
@@ -47,18 +47,7 @@ void GfxSphere::GenerateSphereVertices_Internal(uint32_t numRings, uint32_t numS
 	}
 }
 
-GfxSphere::GfxSphere(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelineLayout) :
-	GfxObject(graphicsPipeline, graphicsPipelineLayout)
-{
-	GenerateSphereVertices_Internal(20, 20, 1.0f, vertices, indices);
-
-	CreateVertexBuffer();
-	CreateIndexBuffer();
-}
-
-
-GfxCube::GfxCube(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelineLayout)
-	: GfxObject(graphicsPipeline, graphicsPipelineLayout)
+void GfxCube::GenerateMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
 {
 	vertices =
 	{
@@ -93,13 +82,6 @@ GfxCube::GfxCube(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelineL
 		{{0.5,-0.5,0.5},	RED, {0.0f, 1.0f} , {0.0,0.0,1.0}},
 	};
 
-	glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-2, 0, 0));
-
-	for (int i = 0; i<vertices.size(); ++i) 
-	{
-		vertices[i].position = translationMatrix * glm::vec4(vertices[i].position,1);
-	}
-
 	indices =
 	{
 		0,1,2,2,3,0,
@@ -109,13 +91,9 @@ GfxCube::GfxCube(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelineL
 		16,17,18,18,19,16,
 		20,21,22,22,23,20,
 	};
-
-	CreateVertexBuffer();
-	CreateIndexBuffer();
 }
 
-GfxPlane::GfxPlane(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelineLayout)
-	: GfxObject(graphicsPipeline, graphicsPipelineLayout)
+void GfxPlane::GenerateMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
 {
 	vertices =
 	{
@@ -125,22 +103,8 @@ GfxPlane::GfxPlane(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelin
 		{{0.5,0.5,0.5},		WHITE, {0.0f, 1.0f} , {0.0,1.0,0.0}},
 	};
 
-
-	glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0, -3, 0));
-	glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(25, 0, 25));
-
-	glm::mat4 transSacaleMat = translationMatrix * scaleMatrix;
-
-	for (int i = 0; i < vertices.size(); ++i)
-	{
-		vertices[i].position = transSacaleMat * glm::vec4(vertices[i].position, 1);
-	}
-
 	indices =
 	{
 		0,1,2,2,3,0,
 	};
-
-	CreateVertexBuffer();
-	CreateIndexBuffer();
 }
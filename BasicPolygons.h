@@ -1,23 +1,29 @@
-#include "GfxObject.h"
+#pragma once
+#include <vector>
+#include <cstdint>
 
-class GfxSphere : public GfxObject
+struct Vertex;
+
+//Object space geometry of the basic shapes, placed in the world by the model matrix given to GfxScene::Create
+
+class GfxSphere
 {
 
 public:
 
-	void GenerateSphereVertices_Internal(uint32_t numRings, uint32_t numSegments,
+	static void GenerateMesh(uint32_t numRings, uint32_t numSegments,
 		float radius, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
-	GfxSphere(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelineLayout);
 };
 
-class GfxCube : public GfxObject
+class GfxCube
 {
 public:
-	GfxCube(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelineLayout);
+	static void GenerateMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
 };
 
-class GfxPlane : public GfxObject
+class GfxPlane
 {
 public:
-	GfxPlane(VkPipeline graphicsPipeline, VkPipelineLayout graphicsPipelineLayout);
+	//Unit quad at y=0.5 facing +Y
+	static void GenerateMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
 };
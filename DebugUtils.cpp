@@ -200,6 +200,34 @@ void DebugUtils::SetVulkanObjectName(VkRenderPass renderpass, const char* Name)
     }
 }
 
+void DebugUtils::SetVulkanObjectName(VkQueryPool queryPool, const char* Name)
+{
+    if (vkDebugMarkerSetObjectNameEXT)
+    {
+        DebugMarkerSetObjectName((uint64_t)queryPool, VK_DEBUG_REPORT_OBJECT_TYPE_QUERY_POOL_EXT, Name);
+        return;
+    }
+
+    if (vkSetDebugUtilsObjectNameEXT)
+    {
+        DebugUtilsSetObjectName((uint64_t)queryPool, VK_OBJECT_TYPE_QUERY_POOL, Name);
+    }
+}
+
+void DebugUtils::SetVulkanObjectName(VkPipelineCache pipelineCache, const char* Name)
+{
+    if (vkDebugMarkerSetObjectNameEXT)
+    {
+        DebugMarkerSetObjectName((uint64_t)pipelineCache, VK_DEBUG_REPORT_OBJECT_TYPE_PIPELINE_CACHE_EXT, Name);
+        return;
+    }
+
+    if (vkSetDebugUtilsObjectNameEXT)
+    {
+        DebugUtilsSetObjectName((uint64_t)pipelineCache, VK_OBJECT_TYPE_PIPELINE_CACHE, Name);
+    }
+}
+
 void DebugUtils::DebugMarkerSetObjectName(uint64_t object, VkDebugReportObjectTypeEXT oType, const char* Name)
 {
     VkDebugMarkerObjectNameInfoEXT nameInfo = {};
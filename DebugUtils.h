@@ -28,6 +28,8 @@ public:
 	void SetVulkanObjectName(VkDescriptorPool descriptorPool, const char* Name);
 	void SetVulkanObjectName(VkFramebuffer frameBuffer, const char* Name);
 	void SetVulkanObjectName(VkRenderPass renderpass, const char* Name);
+	void SetVulkanObjectName(VkQueryPool queryPool, const char* Name);
+	void SetVulkanObjectName(VkPipelineCache pipelineCache, const char* Name);
 
 private:
 	void DebugMarkerSetObjectName(uint64_t object, VkDebugReportObjectTypeEXT oType, const char* Name);
@@ -0,0 +1,503 @@
+#include "GfxBvh.h"
+#include "GfxScene.h"
+#include "GfxFrustum.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+static float SurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    glm::vec3 size = boundsMax - boundsMin;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+//Returns false when the box is outside a plane of mask, clears the bits of the planes it is fully inside of
+static bool ClassifyAabb(const GfxFrustum& frustum, uint32_t& planeMask, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    for (uint32_t p = 0; p < 6; ++p)
+    {
+        if ((planeMask & (1u << p)) == 0)
+        {
+            continue;
+        }
+
+        const glm::vec4& plane = frustum.planes[p];
+        glm::vec3 farCorner(plane.x >= 0.0f ? boundsMax.x : boundsMin.x, plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+            plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+        glm::vec3 nearCorner(plane.x >= 0.0f ? boundsMin.x : boundsMax.x, plane.y >= 0.0f ? boundsMin.y : boundsMax.y,
+            plane.z >= 0.0f ? boundsMin.z : boundsMax.z);
+
+        if (glm::dot(glm::vec3(plane), farCorner) + plane.w < 0.0f)
+        {
+            return false;
+        }
+        if (glm::dot(glm::vec3(plane), nearCorner) + plane.w >= 0.0f)
+        {
+            planeMask &= ~(1u << p);
+        }
+    }
+    return true;
+}
+
+//Entry distance of the ray in the box, negative when missed
+static float IntersectRayAabb(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance,
+    const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    float entry = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float t0 = (boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+        float t1 = (boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+        entry = std::max(entry, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+    return entry <= exit ? entry : -1.0f;
+}
+
+void GfxBvh::SetScene(const GfxScene& scene)
+{
+    bool sameObjects = gatheredScene == &scene && gatheredStructureVersion == scene.GetStructureVersion();
+    if (sameObjects && gatheredBoundsVersion == scene.GetBoundsVersion())
+    {
+        return;
+    }
+
+    if (!sameObjects)
+    {
+        Resize(scene.GetObjectCount());
+    }
+    const std::vector<glm::vec3>& boundsMin = scene.GetWorldBoundsMin();
+    const std::vector<glm::vec3>& boundsMax = scene.GetWorldBoundsMax();
+    for (uint32_t i = 0; i < scene.GetObjectCount(); ++i)
+    {
+        SetBounds(i, boundsMin[i], boundsMax[i]);
+    }
+
+    if (sameObjects)
+    {
+        Refit();
+    }
+    else
+    {
+        Build();
+    }
+
+    gatheredScene = &scene;
+    gatheredStructureVersion = scene.GetStructureVersion();
+    gatheredBoundsVersion = scene.GetBoundsVersion();
+}
+
+void GfxBvh::Resize(uint32_t count)
+{
+    itemBoundsMin.assign(count, glm::vec3(0.0f));
+    itemBoundsMax.assign(count, glm::vec3(0.0f));
+    nodes.clear();
+    items.clear();
+    gatheredScene = nullptr;
+}
+
+void GfxBvh::SetBounds(uint32_t item, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    itemBoundsMin[item] = boundsMin;
+    itemBoundsMax[item] = boundsMax;
+}
+
+void GfxBvh::Build()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    uint32_t itemCount = GetItemCount();
+    items.resize(itemCount);
+    std::iota(items.begin(), items.end(), 0u);
+    itemCentroids.resize(itemCount);
+    for (uint32_t i = 0; i < itemCount; ++i)
+    {
+        itemCentroids[i] = (itemBoundsMin[i] + itemBoundsMax[i]) * 0.5f;
+    }
+
+    //A binary tree with one item per leaf at worst, SplitNode can keep indices into nodes
+    nodes.clear();
+    nodes.reserve(std::max(itemCount * 2, 1u));
+    if (itemCount > 0)
+    {
+        nodes.emplace_back();
+        nodes[0].firstItem = 0;
+        nodes[0].itemCount = itemCount;
+
+        //Explicit stack, degenerate scenes (every object at the same spot) would recurse as deep as the item count
+        traversalStack.clear();
+        traversalStack.push_back(0);
+        while (!traversalStack.empty())
+        {
+            uint32_t nodeIndex = traversalStack.back();
+            traversalStack.pop_back();
+            SplitNode(nodeIndex);
+            if (nodes[nodeIndex].leftChild != 0)
+            {
+                traversalStack.push_back(nodes[nodeIndex].leftChild);
+                traversalStack.push_back(nodes[nodeIndex].leftChild + 1);
+            }
+        }
+    }
+    buildCost = ComputeCost();
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    ++stats.builds;
+    stats.buildMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void GfxBvh::SplitNode(uint32_t nodeIndex)
+{
+    ComputeNodeBounds(nodes[nodeIndex]);
+    uint32_t firstItem = nodes[nodeIndex].firstItem;
+    uint32_t itemCount = nodes[nodeIndex].itemCount;
+    if (itemCount <= BVH_MAX_LEAF_ITEMS)
+    {
+        return;
+    }
+
+    glm::vec3 centroidMin = itemCentroids[items[firstItem]];
+    glm::vec3 centroidMax = centroidMin;
+    for (uint32_t i = firstItem; i < firstItem + itemCount; ++i)
+    {
+        centroidMin = glm::min(centroidMin, itemCentroids[items[i]]);
+        centroidMax = glm::max(centroidMax, itemCentroids[items[i]]);
+    }
+
+    //Cost of a split relative to a leaf, both scaled by the node area: 1 traversal step + items tested in each child
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f)
+        {
+            continue;
+        }
+
+        uint32_t binCounts[BVH_SAH_BINS] = {};
+        glm::vec3 binMin[BVH_SAH_BINS];
+        glm::vec3 binMax[BVH_SAH_BINS];
+        for (uint32_t b = 0; b < BVH_SAH_BINS; ++b)
+        {
+            binMin[b] = glm::vec3(std::numeric_limits<float>::max());
+            binMax[b] = glm::vec3(-std::numeric_limits<float>::max());
+        }
+
+        float binScale = BVH_SAH_BINS / extent;
+        for (uint32_t i = firstItem; i < firstItem + itemCount; ++i)
+        {
+            uint32_t item = items[i];
+            uint32_t bin = std::min<uint32_t>(BVH_SAH_BINS - 1, static_cast<uint32_t>((itemCentroids[item][axis] - centroidMin[axis]) * binScale));
+            ++binCounts[bin];
+            binMin[bin] = glm::min(binMin[bin], itemBoundsMin[item]);
+            binMax[bin] = glm::max(binMax[bin], itemBoundsMax[item]);
+        }
+
+        //Left side sweep, then the right side sweep evaluates every plane between bins
+        float leftArea[BVH_SAH_BINS - 1];
+        uint32_t leftCount[BVH_SAH_BINS - 1];
+        glm::vec3 sweepMin = binMin[0];
+        glm::vec3 sweepMax = binMax[0];
+        uint32_t sweepCount = 0;
+        for (uint32_t b = 0; b < BVH_SAH_BINS - 1; ++b)
+        {
+            sweepMin = glm::min(sweepMin, binMin[b]);
+            sweepMax = glm::max(sweepMax, binMax[b]);
+            sweepCount += binCounts[b];
+            leftArea[b] = sweepCount > 0 ? SurfaceArea(sweepMin, sweepMax) : 0.0f;
+            leftCount[b] = sweepCount;
+        }
+
+        sweepMin = binMin[BVH_SAH_BINS - 1];
+        sweepMax = binMax[BVH_SAH_BINS - 1];
+        sweepCount = 0;
+        for (uint32_t b = BVH_SAH_BINS - 1; b > 0; --b)
+        {
+            sweepMin = glm::min(sweepMin, binMin[b]);
+            sweepMax = glm::max(sweepMax, binMax[b]);
+            sweepCount += binCounts[b];
+            if (sweepCount == 0 || leftCount[b - 1] == 0)
+            {
+                continue;
+            }
+
+            float cost = leftCount[b - 1] * leftArea[b - 1] + sweepCount * SurfaceArea(sweepMin, sweepMax);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    float nodeArea = SurfaceArea(nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax);
+    if (bestAxis < 0 || bestCost + nodeArea >= itemCount * nodeArea)
+    {
+        return;
+    }
+
+    float binScale = BVH_SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    auto middle = std::partition(items.begin() + firstItem, items.begin() + firstItem + itemCount,
+        [&](uint32_t item)
+        {
+            uint32_t bin = std::min<uint32_t>(BVH_SAH_BINS - 1, static_cast<uint32_t>((itemCentroids[item][bestAxis] - centroidMin[bestAxis]) * binScale));
+            return bin < bestSplit;
+        });
+    uint32_t leftItemCount = static_cast<uint32_t>(middle - (items.begin() + firstItem));
+
+    uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[leftChild].firstItem = firstItem;
+    nodes[leftChild].itemCount = leftItemCount;
+    nodes[leftChild + 1].firstItem = firstItem + leftItemCount;
+    nodes[leftChild + 1].itemCount = itemCount - leftItemCount;
+    nodes[nodeIndex].leftChild = leftChild;
+}
+
+void GfxBvh::ComputeNodeBounds(GfxBvhNode& node) const
+{
+    node.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    node.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; ++i)
+    {
+        node.boundsMin = glm::min(node.boundsMin, itemBoundsMin[items[i]]);
+        node.boundsMax = glm::max(node.boundsMax, itemBoundsMax[items[i]]);
+    }
+}
+
+float GfxBvh::ComputeCost() const
+{
+    if (nodes.empty())
+    {
+        return 0.0f;
+    }
+
+    float cost = 0.0f;
+    for (const GfxBvhNode& node : nodes)
+    {
+        float area = SurfaceArea(node.boundsMin, node.boundsMax);
+        cost += node.leftChild != 0 ? area : area * node.itemCount;
+    }
+
+    float rootArea = SurfaceArea(nodes[0].boundsMin, nodes[0].boundsMax);
+    return rootArea > 0.0f ? cost / rootArea : 0.0f;
+}
+
+bool GfxBvh::Refit()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    //Children are always created after their parent, a reverse walk sees them first
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        GfxBvhNode& node = nodes[i];
+        if (node.leftChild == 0)
+        {
+            ComputeNodeBounds(node);
+        }
+        else
+        {
+            node.boundsMin = glm::min(nodes[node.leftChild].boundsMin, nodes[node.leftChild + 1].boundsMin);
+            node.boundsMax = glm::max(nodes[node.leftChild].boundsMax, nodes[node.leftChild + 1].boundsMax);
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    ++stats.refits;
+    stats.refitMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+    if (ComputeCost() > buildCost * BVH_REBUILD_COST_RATIO)
+    {
+        Build();
+        return true;
+    }
+    return false;
+}
+
+uint32_t GfxBvh::QueryFrustum(const GfxFrustum& frustum, std::vector<uint32_t>& visibleItems)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    visibleItems.clear();
+    ++stats.frustumQueries;
+    if (nodes.empty())
+    {
+        return 0;
+    }
+
+    //Node index and the planes still to be tested against its subtree
+    traversalStack.clear();
+    traversalStack.push_back(0x3F);
+    while (!traversalStack.empty())
+    {
+        uint32_t entry = traversalStack.back();
+        traversalStack.pop_back();
+        uint32_t planeMask = entry & 0x3F;
+        const GfxBvhNode& node = nodes[entry >> 6];
+        ++stats.nodesVisited;
+
+        if (!ClassifyAabb(frustum, planeMask, node.boundsMin, node.boundsMax))
+        {
+            continue;
+        }
+
+        if (planeMask == 0)
+        {
+            visibleItems.insert(visibleItems.end(), items.begin() + node.firstItem, items.begin() + node.firstItem + node.itemCount);
+            stats.itemsAcceptedInside += node.itemCount;
+        }
+        else if (node.leftChild == 0)
+        {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; ++i)
+            {
+                uint32_t itemMask = planeMask;
+                if (ClassifyAabb(frustum, itemMask, itemBoundsMin[items[i]], itemBoundsMax[items[i]]))
+                {
+                    visibleItems.push_back(items[i]);
+                }
+            }
+            stats.itemsTested += node.itemCount;
+        }
+        else
+        {
+            traversalStack.push_back((node.leftChild << 6) | planeMask);
+            traversalStack.push_back(((node.leftChild + 1) << 6) | planeMask);
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    stats.queryMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    return static_cast<uint32_t>(visibleItems.size());
+}
+
+uint32_t GfxBvh::QueryAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& overlappingItems)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    overlappingItems.clear();
+    ++stats.aabbQueries;
+    if (nodes.empty())
+    {
+        return 0;
+    }
+
+    auto overlaps = [&](const glm::vec3& otherMin, const glm::vec3& otherMax)
+    {
+        return otherMin.x <= boundsMax.x && otherMax.x >= boundsMin.x && otherMin.y <= boundsMax.y && otherMax.y >= boundsMin.y &&
+            otherMin.z <= boundsMax.z && otherMax.z >= boundsMin.z;
+    };
+
+    traversalStack.clear();
+    traversalStack.push_back(0);
+    while (!traversalStack.empty())
+    {
+        const GfxBvhNode& node = nodes[traversalStack.back()];
+        traversalStack.pop_back();
+        ++stats.nodesVisited;
+
+        if (!overlaps(node.boundsMin, node.boundsMax))
+        {
+            continue;
+        }
+
+        if (node.leftChild == 0)
+        {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; ++i)
+            {
+                if (overlaps(itemBoundsMin[items[i]], itemBoundsMax[items[i]]))
+                {
+                    overlappingItems.push_back(items[i]);
+                }
+            }
+            stats.itemsTested += node.itemCount;
+        }
+        else
+        {
+            traversalStack.push_back(node.leftChild);
+            traversalStack.push_back(node.leftChild + 1);
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    stats.queryMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    return static_cast<uint32_t>(overlappingItems.size());
+}
+
+bool GfxBvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, GfxBvhRayHit& hit)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    ++stats.rayQueries;
+    hit = GfxBvhRayHit();
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    //Zero components give infinities, the slab test still rejects or accepts them correctly
+    glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    float closest = maxDistance;
+
+    traversalStack.clear();
+    traversalStack.push_back(0);
+    while (!traversalStack.empty())
+    {
+        const GfxBvhNode& node = nodes[traversalStack.back()];
+        traversalStack.pop_back();
+        ++stats.nodesVisited;
+
+        if (IntersectRayAabb(origin, inverseDirection, closest, node.boundsMin, node.boundsMax) < 0.0f)
+        {
+            continue;
+        }
+
+        if (node.leftChild == 0)
+        {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; ++i)
+            {
+                float distance = IntersectRayAabb(origin, inverseDirection, closest, itemBoundsMin[items[i]], itemBoundsMax[items[i]]);
+                if (distance >= 0.0f)
+                {
+                    closest = distance;
+                    hit.item = items[i];
+                    hit.distance = distance;
+                }
+            }
+            stats.itemsTested += node.itemCount;
+        }
+        else
+        {
+            //Nearest child popped first so its hits shorten the far child test
+            uint32_t nearChild = node.leftChild;
+            uint32_t farChild = node.leftChild + 1;
+            float leftDistance = IntersectRayAabb(origin, inverseDirection, closest, nodes[nearChild].boundsMin, nodes[nearChild].boundsMax);
+            float rightDistance = IntersectRayAabb(origin, inverseDirection, closest, nodes[farChild].boundsMin, nodes[farChild].boundsMax);
+            if (rightDistance >= 0.0f && (leftDistance < 0.0f || rightDistance < leftDistance))
+            {
+                std::swap(nearChild, farChild);
+            }
+            traversalStack.push_back(farChild);
+            traversalStack.push_back(nearChild);
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    stats.queryMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    return hit.item != UINT32_MAX;
+}
+
+void GfxBvh::PrintStats(const char* name)
+{
+    uint64_t queries = std::max<uint64_t>(stats.frustumQueries + stats.aabbQueries + stats.rayQueries, 1);
+    std::cout << CYAN_TEXT << "BVH " << name << ": " << GetItemCount() << " items, " << GetNodeCount() << " nodes, "
+        << stats.builds << " builds (" << stats.buildMs / std::max<uint64_t>(stats.builds, 1) << "ms), "
+        << stats.refits << " refits (" << stats.refitMs / std::max<uint64_t>(stats.refits, 1) << "ms), "
+        << stats.nodesVisited / queries << " nodes visited and " << stats.itemsTested / queries << " items tested per query, "
+        << stats.itemsAcceptedInside / queries << " accepted without test, " << stats.queryMs / queries << "ms per query" << RESET_TEXT << std::endl;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+class GfxScene;
+struct GfxFrustum;
+
+//Items a leaf can hold before the build tries to split it
+#define BVH_MAX_LEAF_ITEMS 4
+//Centroid bins per axis evaluated by the SAH build
+#define BVH_SAH_BINS 16
+//Refits keep the topology, past this SAH cost growth over the last build the tree is rebuilt instead
+#define BVH_REBUILD_COST_RATIO 1.5f
+
+struct GfxBvhNode
+{
+	glm::vec3 boundsMin;
+	//0 for leaves, root is never a child. Right child is leftChild + 1
+	uint32_t leftChild = 0;
+	glm::vec3 boundsMax;
+	//Items of the whole subtree are contiguous in the item list
+	uint32_t firstItem = 0;
+	uint32_t itemCount = 0;
+};
+
+struct GfxBvhRayHit
+{
+	uint32_t item = UINT32_MAX;
+	float distance = 0.0f;
+};
+
+struct GfxBvhStats
+{
+	uint64_t builds = 0;
+	uint64_t refits = 0;
+	uint64_t frustumQueries = 0;
+	uint64_t aabbQueries = 0;
+	uint64_t rayQueries = 0;
+	uint64_t nodesVisited = 0;
+	uint64_t itemsTested = 0;
+	//Items accepted with their whole subtree inside the frustum, without a test of their own
+	uint64_t itemsAcceptedInside = 0;
+	double buildMs = 0.0;
+	double refitMs = 0.0;
+	double queryMs = 0.0;
+};
+
+//Bounding volume hierarchy over world space AABBs, items are scene dense indices or the indices given to SetBounds.
+//Built top down with a binned surface area heuristic, moved items are refit bottom up and the tree is rebuilt
+//once refits made it too loose. Frustum queries stop testing a subtree as soon as it is fully inside,
+//so visibility cost follows what is on screen rather than the scene size.
+class GfxBvh
+{
+public:
+	//Builds when objects were created or destroyed, refits when only their world bounds changed. Items are scene dense indices
+	void SetScene(const GfxScene& scene);
+
+	//Raw access for bounds that do not come from a GfxScene (benchmark), call Build or Refit after the bounds changed
+	void Resize(uint32_t count);
+	void SetBounds(uint32_t item, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void Build();
+	//Returns true when the tree was rebuilt because it became too loose
+	bool Refit();
+
+	//Items whose AABB is not fully outside a plane, unordered
+	uint32_t QueryFrustum(const GfxFrustum& frustum, std::vector<uint32_t>& visibleItems);
+	uint32_t QueryAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& overlappingItems);
+	//Closest item AABB hit by the ray within maxDistance, direction does not need to be normalized
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, GfxBvhRayHit& hit);
+
+	uint32_t GetItemCount() const { return static_cast<uint32_t>(itemBoundsMin.size()); }
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+	const GfxBvhStats& GetStats() const { return stats; }
+	void PrintStats(const char* name);
+
+private:
+	//Splits a node over its item range with the best binned SAH plane, leaves it a leaf when no split is cheaper
+	void SplitNode(uint32_t nodeIndex);
+	void ComputeNodeBounds(GfxBvhNode& node) const;
+	float ComputeCost() const;
+
+	std::vector<GfxBvhNode> nodes;
+	//Item indices, reordered by the build so every node covers a contiguous range
+	std::vector<uint32_t> items;
+	std::vector<glm::vec3> itemBoundsMin;
+	std::vector<glm::vec3> itemBoundsMax;
+	std::vector<glm::vec3> itemCentroids;
+	std::vector<uint32_t> traversalStack;
+	//SAH cost right after the last build
+	float buildCost = 0.0f;
+
+	//Scene and versions the tree was built or refit from
+	const GfxScene* gatheredScene = nullptr;
+	uint32_t gatheredStructureVersion = 0;
+	uint32_t gatheredBoundsVersion = 0;
+
+	GfxBvhStats stats;
+};
@@ -0,0 +1,132 @@
+#include "GfxCommandBufferCache.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <stdexcept>
+
+void GfxCommandBufferCache::Init(uint32_t imageCount, uint32_t framesInFlight, uint32_t queueFamilyIndex, uint32_t passCount, uint32_t workerCount)
+{
+    this->framesInFlight = framesInFlight;
+    this->workerCount = workerCount;
+
+    //Buffers are reset one by one when their key changes, never as a whole pool
+    VkCommandPoolCreateInfo commandPoolCreateInfo{};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+    if (vkCreateCommandPool(gfxCtx->logicalDevice, &commandPoolCreateInfo, gfxCtx->allocationCallbacks, &commandPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating cached command buffers pool!");
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers(static_cast<size_t>(imageCount) * framesInFlight);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+    if (vkAllocateCommandBuffers(gfxCtx->logicalDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error allocating cached command buffers!");
+    }
+
+    entries.assign(commandBuffers.size(), Entry());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        entries[i].commandBuffer = commandBuffers[i];
+        entries[i].secondaryCommandBuffers.resize(static_cast<size_t>(passCount) * workerCount);
+    }
+
+    //Each worker only touches its own pool, the pass buffers of an entry come from all of them
+    workerCommandPools.resize(workerCount);
+    VkCommandBufferAllocateInfo secondaryAllocInfo{};
+    secondaryAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    secondaryAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    secondaryAllocInfo.commandBufferCount = 1;
+    for (uint32_t worker = 0; worker < workerCount; ++worker)
+    {
+        if (vkCreateCommandPool(gfxCtx->logicalDevice, &commandPoolCreateInfo, gfxCtx->allocationCallbacks, &workerCommandPools[worker]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error creating cached secondary command buffers pool!");
+        }
+
+        secondaryAllocInfo.commandPool = workerCommandPools[worker];
+        for (Entry& entry : entries)
+        {
+            for (uint32_t pass = 0; pass < passCount; ++pass)
+            {
+                if (vkAllocateCommandBuffers(gfxCtx->logicalDevice, &secondaryAllocInfo, &entry.secondaryCommandBuffers[static_cast<size_t>(pass) * workerCount + worker]) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Error allocating cached secondary command buffers!");
+                }
+            }
+        }
+    }
+}
+
+void GfxCommandBufferCache::Cleanup()
+{
+    //Frees the buffers allocated from it
+    vkDestroyCommandPool(gfxCtx->logicalDevice, commandPool, gfxCtx->allocationCallbacks);
+    commandPool = VK_NULL_HANDLE;
+    for (VkCommandPool workerCommandPool : workerCommandPools)
+    {
+        vkDestroyCommandPool(gfxCtx->logicalDevice, workerCommandPool, gfxCtx->allocationCallbacks);
+    }
+    workerCommandPools.clear();
+    entries.clear();
+}
+
+void GfxCommandBufferCache::Invalidate(const char* reason)
+{
+    uint32_t dropped = 0;
+    for (Entry& entry : entries)
+    {
+        dropped += entry.valid ? 1 : 0;
+        entry.valid = false;
+    }
+    stats.invalidations += dropped;
+
+    if (dropped > 0)
+    {
+        std::cout << YELLOW_TEXT << "Cached command buffers: " << dropped << " dropped, " << reason << RESET_TEXT << std::endl;
+    }
+}
+
+VkCommandBuffer GfxCommandBufferCache::Acquire(uint32_t imageIndex, uint32_t frameIndex, uint64_t key, bool& needsRecording)
+{
+    Entry& entry = entries[static_cast<size_t>(imageIndex) * framesInFlight + frameIndex];
+    if (entry.valid && entry.key == key)
+    {
+        ++stats.hits;
+        needsRecording = false;
+        return entry.commandBuffer;
+    }
+
+    ++stats.misses;
+    vkResetCommandBuffer(entry.commandBuffer, 0);
+    //The caller records it right away, from now on it matches key
+    entry.key = key;
+    entry.valid = true;
+    needsRecording = true;
+    return entry.commandBuffer;
+}
+
+const VkCommandBuffer* GfxCommandBufferCache::GetSecondaryCommandBuffers(uint32_t imageIndex, uint32_t frameIndex, uint32_t pass) const
+{
+    const Entry& entry = entries[static_cast<size_t>(imageIndex) * framesInFlight + frameIndex];
+    return &entry.secondaryCommandBuffers[static_cast<size_t>(pass) * workerCount];
+}
+
+void GfxCommandBufferCache::PrintStats()
+{
+    uint64_t frames = stats.hits + stats.misses;
+    double hitRate = frames > 0 ? 100.0 * stats.hits / frames : 0.0;
+    double averageMs = stats.misses > 0 ? stats.recordingMs / stats.misses : 0.0;
+    std::cout << CYAN_TEXT << "Cached command buffers: " << entries.size() << " entries, " << stats.hits << " hits, " << stats.misses
+        << " misses (" << hitRate << "% reused), " << stats.invalidations << " invalidated, " << averageMs << "ms per recording" << RESET_TEXT << std::endl;
+}
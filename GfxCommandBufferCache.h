@@ -0,0 +1,78 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+//FNV-1a over everything that ends up baked in a recording, equal hashes mean the cached commands are still valid
+struct GfxRecordingHash
+{
+	uint64_t value = 14695981039346656037ull;
+
+	void Add(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			value = (value ^ bytes[i]) * 1099511628211ull;
+		}
+	}
+
+	template<typename T>
+	void Add(const T& data) { Add(&data, sizeof(T)); }
+};
+
+struct GfxCommandBufferCacheStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	//Entries dropped by Invalidate, not counting the key mismatches
+	uint64_t invalidations = 0;
+	double recordingMs = 0.0;
+};
+
+//Primary command buffers kept recorded per swapchain image and frame slot. A frame asks for its entry with the
+//hash of the state it would record, the buffer is submitted again as is when the hash matches and handed back
+//reset for recording otherwise. Entries of a slot are only touched after its fence was waited, so reusing or
+//resetting them never races the GPU. Every entry also owns the secondary buffers its primary executes, one per
+//pass and recording worker, allocated from a pool per worker so the workers can record them at the same time.
+class GfxCommandBufferCache
+{
+public:
+	//workerCount matches the GfxParallelRecorder filling the secondary buffers
+	void Init(uint32_t imageCount, uint32_t framesInFlight, uint32_t queueFamilyIndex, uint32_t passCount, uint32_t workerCount);
+	void Cleanup();
+
+	//Swapchain, framebuffers, pipelines or descriptor sets bound by the recordings were recreated
+	void Invalidate(const char* reason);
+
+	//needsRecording is set when the returned buffer was reset and has to be recorded before submitting
+	VkCommandBuffer Acquire(uint32_t imageIndex, uint32_t frameIndex, uint64_t key, bool& needsRecording);
+	//workerCount buffers for GfxParallelRecorder::RecordPass, re-recorded along with the primary of the entry
+	const VkCommandBuffer* GetSecondaryCommandBuffers(uint32_t imageIndex, uint32_t frameIndex, uint32_t pass) const;
+	//Time spent recording a missed entry, for the stats
+	void AddRecordingTime(double ms) { stats.recordingMs += ms; }
+
+	const GfxCommandBufferCacheStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	struct Entry
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		//[pass * workerCount + worker]
+		std::vector<VkCommandBuffer> secondaryCommandBuffers;
+		uint64_t key = 0;
+		bool valid = false;
+	};
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	//[worker], secondary buffers are reset by the worker beginning them
+	std::vector<VkCommandPool> workerCommandPools;
+	//[image * framesInFlight + frame]
+	std::vector<Entry> entries;
+	uint32_t framesInFlight = 1;
+	uint32_t workerCount = 1;
+
+	GfxCommandBufferCacheStats stats;
+};
@@ -1,5 +1,16 @@
 #include <vulkan/vulkan_core.h>
 
+class GfxMemoryAllocator;
+class GfxFrameAllocator;
+class GfxStagingRing;
+class GfxUploadContext;
+class GfxGeometryArena;
+class GfxResidencyManager;
+class GfxDefragmenter;
+class GfxHostAllocator;
+class GfxTransformBuffer;
+class GfxPipelineCache;
+
 class GfxContext
 {
     public:
@@ -7,4 +18,22 @@ class GfxContext
         VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
         VkCommandPool commandPool;
         VkQueue graphicsQueue;
+        //VK_NULL_HANDLE when the device has no dedicated transfer family
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        GfxMemoryAllocator* memoryAllocator = nullptr;
+        GfxFrameAllocator* frameAllocator = nullptr;
+        GfxStagingRing* stagingRing = nullptr;
+        GfxUploadContext* uploadContext = nullptr;
+        GfxUploadContext* transferContext = nullptr;
+        GfxGeometryArena* geometryArena = nullptr;
+        GfxResidencyManager* residencyManager = nullptr;
+        GfxDefragmenter* defragmenter = nullptr;
+        GfxHostAllocator* hostAllocator = nullptr;
+        GfxTransformBuffer* transformBuffer = nullptr;
+        GfxPipelineCache* pipelineCache = nullptr;
+        //Device support for indirect draws, the count variant is nullptr without VK_KHR_draw_indirect_count
+        bool multiDrawIndirect = false;
+        PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+        //Passed to every vkCreate*/vkDestroy*, nullptr lets the driver use its own heap
+        const VkAllocationCallbacks* allocationCallbacks = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "GfxCpuCulling.h"
+#include "GfxScene.h"
+#include "GfxFrustum.h"
+#include "GfxBvh.h"
+#include "gfxMaths.h"
+#include "ColorsDef.h"
+
+#include <immintrin.h>
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#if CPU_CULLING_SIMD_WIDTH == 8
+typedef __m256 SimdFloat;
+static inline SimdFloat SimdLoad(const float* values) { return _mm256_loadu_ps(values); }
+static inline SimdFloat SimdSet(float value) { return _mm256_set1_ps(value); }
+static inline SimdFloat SimdZero() { return _mm256_setzero_ps(); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a, b); }
+static inline SimdFloat SimdOr(SimdFloat a, SimdFloat b) { return _mm256_or_ps(a, b); }
+static inline SimdFloat SimdLess(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline int SimdMask(SimdFloat a) { return _mm256_movemask_ps(a); }
+#else
+typedef __m128 SimdFloat;
+static inline SimdFloat SimdLoad(const float* values) { return _mm_loadu_ps(values); }
+static inline SimdFloat SimdSet(float value) { return _mm_set1_ps(value); }
+static inline SimdFloat SimdZero() { return _mm_setzero_ps(); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm_add_ps(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a, b); }
+static inline SimdFloat SimdOr(SimdFloat a, SimdFloat b) { return _mm_or_ps(a, b); }
+static inline SimdFloat SimdLess(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a, b); }
+static inline int SimdMask(SimdFloat a) { return _mm_movemask_ps(a); }
+#endif
+
+void GfxCpuCulling::Init(uint32_t passCount)
+{
+    stats.assign(passCount, GfxCpuCullingStats());
+    Resize(0);
+}
+
+void GfxCpuCulling::SetScene(const GfxScene& scene)
+{
+    if (gatheredScene == &scene && gatheredStructureVersion == scene.GetStructureVersion() &&
+        gatheredBoundsVersion == scene.GetBoundsVersion())
+    {
+        return;
+    }
+
+    const std::vector<glm::vec4>& spheres = scene.GetWorldBoundingSpheres();
+    const std::vector<glm::vec3>& boundsMin = scene.GetWorldBoundsMin();
+    const std::vector<glm::vec3>& boundsMax = scene.GetWorldBoundsMax();
+    Resize(scene.GetObjectCount());
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        SetBounds(i, spheres[i], boundsMin[i], boundsMax[i]);
+    }
+
+    gatheredScene = &scene;
+    gatheredStructureVersion = scene.GetStructureVersion();
+    gatheredBoundsVersion = scene.GetBoundsVersion();
+}
+
+void GfxCpuCulling::Resize(uint32_t count)
+{
+    objectCount = count;
+    size_t paddedCount = (static_cast<size_t>(count) + CPU_CULLING_SIMD_WIDTH - 1) / CPU_CULLING_SIMD_WIDTH * CPU_CULLING_SIMD_WIDTH;
+    for (std::vector<float>* values : { &centerX, &centerY, &centerZ, &radius, &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+    {
+        values->assign(paddedCount, 0.0f);
+    }
+    gatheredScene = nullptr;
+}
+
+void GfxCpuCulling::SetBounds(uint32_t index, const glm::vec4& boundingSphere, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    centerX[index] = boundingSphere.x;
+    centerY[index] = boundingSphere.y;
+    centerZ[index] = boundingSphere.z;
+    radius[index] = boundingSphere.w;
+    minX[index] = boundsMin.x;
+    minY[index] = boundsMin.y;
+    minZ[index] = boundsMin.z;
+    maxX[index] = boundsMax.x;
+    maxY[index] = boundsMax.y;
+    maxZ[index] = boundsMax.z;
+}
+
+uint32_t GfxCpuCulling::Cull(uint32_t pass, const GfxFrustum& frustum, std::vector<uint32_t>& visibleIndices)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    //Plane constants broadcast once, the box corner furthest along each plane normal is picked per plane, not per object
+    SimdFloat planeX[6], planeY[6], planeZ[6], planeW[6];
+    const float* cornerX[6];
+    const float* cornerY[6];
+    const float* cornerZ[6];
+    for (int p = 0; p < 6; ++p)
+    {
+        const glm::vec4& plane = frustum.planes[p];
+        planeX[p] = SimdSet(plane.x);
+        planeY[p] = SimdSet(plane.y);
+        planeZ[p] = SimdSet(plane.z);
+        planeW[p] = SimdSet(plane.w);
+        cornerX[p] = plane.x >= 0.0f ? maxX.data() : minX.data();
+        cornerY[p] = plane.y >= 0.0f ? maxY.data() : minY.data();
+        cornerZ[p] = plane.z >= 0.0f ? maxZ.data() : minZ.data();
+    }
+
+    visibleIndices.clear();
+    visibleIndices.reserve(objectCount);
+    const SimdFloat zero = SimdZero();
+
+    for (uint32_t i = 0; i < objectCount; i += CPU_CULLING_SIMD_WIDTH)
+    {
+        SimdFloat x = SimdLoad(&centerX[i]);
+        SimdFloat y = SimdLoad(&centerY[i]);
+        SimdFloat z = SimdLoad(&centerZ[i]);
+        SimdFloat r = SimdLoad(&radius[i]);
+
+        SimdFloat outside = zero;
+        for (int p = 0; p < 6; ++p)
+        {
+            SimdFloat sphereDistance = SimdAdd(SimdAdd(SimdAdd(SimdMul(planeX[p], x), SimdMul(planeY[p], y)), SimdMul(planeZ[p], z)), planeW[p]);
+            outside = SimdOr(outside, SimdLess(SimdAdd(sphereDistance, r), zero));
+
+            SimdFloat boxDistance = SimdAdd(SimdAdd(SimdAdd(SimdMul(planeX[p], SimdLoad(&cornerX[p][i])),
+                SimdMul(planeY[p], SimdLoad(&cornerY[p][i]))), SimdMul(planeZ[p], SimdLoad(&cornerZ[p][i]))), planeW[p]);
+            outside = SimdOr(outside, SimdLess(boxDistance, zero));
+        }
+
+        //Padding lanes of the last iteration are dropped
+        uint32_t laneCount = std::min<uint32_t>(CPU_CULLING_SIMD_WIDTH, objectCount - i);
+        uint32_t visibleMask = ~static_cast<uint32_t>(SimdMask(outside)) & ((1u << laneCount) - 1u);
+        for (uint32_t lane = 0; visibleMask != 0; ++lane, visibleMask >>= 1)
+        {
+            if (visibleMask & 1u)
+            {
+                visibleIndices.push_back(i + lane);
+            }
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    GfxCpuCullingStats& passStats = stats[pass];
+    ++passStats.culls;
+    passStats.testedObjects += objectCount;
+    passStats.visibleObjects += visibleIndices.size();
+    passStats.cullingMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+    return static_cast<uint32_t>(visibleIndices.size());
+}
+
+uint32_t GfxCpuCulling::CullScalar(const GfxFrustum& frustum, std::vector<uint32_t>& visibleIndices) const
+{
+    visibleIndices.clear();
+    visibleIndices.reserve(objectCount);
+
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; ++p)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            float sphereDistance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+            float boxDistance = plane.x * (plane.x >= 0.0f ? maxX[i] : minX[i]) + plane.y * (plane.y >= 0.0f ? maxY[i] : minY[i]) +
+                plane.z * (plane.z >= 0.0f ? maxZ[i] : minZ[i]) + plane.w;
+            outside = sphereDistance + radius[i] < 0.0f || boxDistance < 0.0f;
+        }
+
+        if (!outside)
+        {
+            visibleIndices.push_back(i);
+        }
+    }
+    return static_cast<uint32_t>(visibleIndices.size());
+}
+
+void GfxCpuCulling::PrintStats(const char* const* passNames)
+{
+    for (uint32_t pass = 0; pass < stats.size(); ++pass)
+    {
+        const GfxCpuCullingStats& passStats = stats[pass];
+        uint64_t culls = std::max<uint64_t>(passStats.culls, 1);
+        std::cout << CYAN_TEXT << "CPU culling " << passNames[pass] << ": " << passStats.visibleObjects / culls << "/"
+            << passStats.testedObjects / culls << " objects visible per frame, " << passStats.cullingMs / culls << "ms per cull ("
+            << CPU_CULLING_SIMD_WIDTH << " wide)" << RESET_TEXT << std::endl;
+    }
+}
+
+void RunFrustumCullingBenchmark()
+{
+    const uint32_t objectCounts[] = { 10000, 100000, 1000000 };
+
+    //Camera in the middle of a 1km cube of objects, roughly a tenth of them end up visible
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+    projection[1][1] *= -1;
+    GfxFrustum frustum = GfxFrustum::FromViewProjection(projection * view);
+
+    std::cout << MAGENTA_TEXT << "Frustum culling benchmark (sphere + AABB, " << CPU_CULLING_SIMD_WIDTH << " wide)" << RESET_TEXT << std::endl;
+    for (uint32_t objectCount : objectCounts)
+    {
+        std::mt19937 rndEngine(1234);
+        std::uniform_real_distribution<float> positionDist(-500.0f, 500.0f);
+        std::uniform_real_distribution<float> extentDist(0.5f, 5.0f);
+
+        GfxCpuCulling culling;
+        culling.Init(1);
+        culling.Resize(objectCount);
+        GfxBvh bvh;
+        bvh.Resize(objectCount);
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            glm::vec3 center(positionDist(rndEngine), positionDist(rndEngine), positionDist(rndEngine));
+            glm::vec3 extents(extentDist(rndEngine), extentDist(rndEngine), extentDist(rndEngine));
+            culling.SetBounds(i, glm::vec4(center, glm::length(extents)), center - extents, center + extents);
+            bvh.SetBounds(i, center - extents, center + extents);
+        }
+        bvh.Build();
+
+        //Same amount of tested objects for every size
+        const uint32_t iterations = std::max<uint32_t>(10, 10000000 / objectCount);
+        std::vector<uint32_t> simdVisible;
+        std::vector<uint32_t> scalarVisible;
+
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            culling.Cull(0, frustum, simdVisible);
+        }
+        double simdMs = culling.GetStats(0).cullingMs / iterations;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            culling.CullScalar(frustum, scalarVisible);
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double scalarMs = std::chrono::duration<double, std::milli>(endTime - startTime).count() / iterations;
+
+        std::vector<uint32_t> bvhVisible;
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            bvh.QueryFrustum(frustum, bvhVisible);
+        }
+        double bvhMs = bvh.GetStats().queryMs / iterations;
+        //Spheres enclose the boxes here, the box only test of the BVH has to find the same set
+        std::sort(bvhVisible.begin(), bvhVisible.end());
+
+        if (simdVisible != scalarVisible || bvhVisible != scalarVisible)
+        {
+            throw std::runtime_error("Error SIMD or BVH frustum culling differs from the scalar path!");
+        }
+
+        std::cout << "  " << objectCount << " objects, " << simdVisible.size() << " visible: " << simdMs << "ms SIMD, "
+            << scalarMs << "ms scalar";
+        if (simdMs > 0.0)
+        {
+            std::cout << " (" << scalarMs / simdMs << "x)";
+        }
+        std::cout << ", " << bvhMs << "ms BVH (" << bvh.GetStats().buildMs << "ms build)";
+        std::cout << ", " << objectCount / std::max(simdMs * 1000.0, 1e-6) << " objects/us" << std::endl;
+    }
+}
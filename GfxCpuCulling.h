@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+class GfxScene;
+struct GfxFrustum;
+
+//Objects tested per SIMD iteration, 8 with AVX (/arch:AVX or above) and 4 with SSE2
+#if defined(__AVX__)
+#define CPU_CULLING_SIMD_WIDTH 8
+#else
+#define CPU_CULLING_SIMD_WIDTH 4
+#endif
+
+struct GfxCpuCullingStats
+{
+	uint64_t culls = 0;
+	uint64_t testedObjects = 0;
+	uint64_t visibleObjects = 0;
+	double cullingMs = 0.0;
+};
+
+//World space bounding spheres and boxes of the scene kept as structure of arrays so that the frustum test
+//runs over CPU_CULLING_SIMD_WIDTH objects at once. An object is visible when both its sphere and its box
+//are not fully outside any plane. Arrays are padded to the SIMD width, padding is never reported visible.
+class GfxCpuCulling
+{
+public:
+	void Init(uint32_t passCount);
+
+	//Gathers the bounds again only when the scene objects or their world bounds changed, indices are scene dense indices
+	void SetScene(const GfxScene& scene);
+
+	//Raw access for bounds that do not come from a GfxScene (benchmark)
+	void Resize(uint32_t count);
+	void SetBounds(uint32_t index, const glm::vec4& boundingSphere, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	uint32_t GetObjectCount() const { return objectCount; }
+
+	//Fills visibleIndices with the indices of the visible objects in increasing order, returns their count
+	uint32_t Cull(uint32_t pass, const GfxFrustum& frustum, std::vector<uint32_t>& visibleIndices);
+	//Same result one object at a time, reference for the benchmark
+	uint32_t CullScalar(const GfxFrustum& frustum, std::vector<uint32_t>& visibleIndices) const;
+
+	const GfxCpuCullingStats& GetStats(uint32_t pass) const { return stats[pass]; }
+	void PrintStats(const char* const* passNames);
+
+private:
+	uint32_t objectCount = 0;
+	std::vector<float> centerX, centerY, centerZ, radius;
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+
+	//Scene and versions the arrays were gathered from
+	const GfxScene* gatheredScene = nullptr;
+	uint32_t gatheredStructureVersion = 0;
+	uint32_t gatheredBoundsVersion = 0;
+
+	std::vector<GfxCpuCullingStats> stats;
+};
+
+//Culls random bounds at 10k, 100k and 1M objects with the SIMD and the scalar path and with a GfxBvh
+void RunFrustumCullingBenchmark();
@@ -0,0 +1,188 @@
+#include "GfxDefragmenter.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "GfxUploadContext.h"
+#include "DebugUtils.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+void GfxMovableBuffer::Init(VkBuffer* buffer, GfxAllocation* allocation, VkDeviceSize size, VkBufferUsageFlags usage, const char* Name)
+{
+    this->buffer = buffer;
+    this->allocation = allocation;
+    this->size = size;
+    this->usage = usage;
+    name = Name;
+}
+
+VkMemoryRequirements GfxMovableBuffer::GetMovableRequirements() const
+{
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(gfxCtx->logicalDevice, *buffer, &memoryRequirements);
+    return memoryRequirements;
+}
+
+std::function<void()> GfxMovableBuffer::Move(VkCommandBuffer commandBuffer, const GfxAllocation& newAllocation)
+{
+    VkBufferCreateInfo createBuffer{};
+    createBuffer.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createBuffer.size = size;
+    createBuffer.usage = usage;
+    createBuffer.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer newBuffer;
+    if (vkCreateBuffer(gfxCtx->logicalDevice, &createBuffer, gfxCtx->allocationCallbacks, &newBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating moved buffer!");
+    }
+    if (vkBindBufferMemory(gfxCtx->logicalDevice, newBuffer, newAllocation.memory, newAllocation.offset) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error binding moved buffer memory!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(newBuffer, name);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, *buffer, newBuffer, 1, &copyRegion);
+
+    VkBuffer oldBuffer = *buffer;
+    GfxAllocation oldAllocation = *allocation;
+    *buffer = newBuffer;
+    *allocation = newAllocation;
+
+    return [oldBuffer, oldAllocation]() mutable { DestroyBuffer_Internal(oldBuffer, oldAllocation); };
+}
+
+void GfxDefragmenter::Init(uint32_t framesInFlight, VkDeviceSize bytesPerFrame)
+{
+    this->framesInFlight = framesInFlight;
+    this->bytesPerFrame = bytesPerFrame;
+    frameNumber = 0;
+    running = false;
+    stats = GfxDefragmentationStats();
+}
+
+void GfxDefragmenter::Cleanup()
+{
+    //Called after the device is idle
+    ReleaseCompleted(true);
+    movables.clear();
+}
+
+void GfxDefragmenter::Register(GfxMovable* movable)
+{
+    movables.push_back(movable);
+}
+
+void GfxDefragmenter::Unregister(GfxMovable* movable)
+{
+    auto it = std::find(movables.begin(), movables.end(), movable);
+    if (it != movables.end())
+    {
+        movables.erase(it);
+    }
+}
+
+void GfxDefragmenter::Start()
+{
+    if (running || reportPending)
+    {
+        return;
+    }
+
+    gfxCtx->memoryAllocator->PrintFragmentation("before compaction");
+    stats = GfxDefragmentationStats();
+    running = true;
+}
+
+void GfxDefragmenter::Update()
+{
+    ++frameNumber;
+    ReleaseCompleted(false);
+
+    //Old resources hold their blocks until released, report once they are all gone
+    if (reportPending && pendingReleases.empty())
+    {
+        reportPending = false;
+        gfxCtx->memoryAllocator->PrintFragmentation("after compaction");
+    }
+
+    if (!running)
+    {
+        return;
+    }
+
+    GfxMemoryAllocator* allocator = gfxCtx->memoryAllocator;
+
+    //Sparsest blocks first, those are the ones that can be emptied
+    std::vector<std::pair<float, GfxMovable*>> candidates;
+    for (GfxMovable* movable : movables)
+    {
+        if (movable->GetMovableAllocation().block != nullptr)
+        {
+            candidates.push_back({ allocator->GetBlockOccupancy(movable->GetMovableAllocation()), movable });
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<float, GfxMovable*>& a, const std::pair<float, GfxMovable*>& b) { return a.first < b.first; });
+
+    //Copies are submitted without waiting, the frame submitted after them on the same queue sees the results
+    GfxUploadContext* uploadContext = gfxCtx->uploadContext;
+    uploadContext->BeginBatch();
+
+    VkDeviceSize movedBytes = 0;
+    uint32_t moves = 0;
+    for (const std::pair<float, GfxMovable*>& candidate : candidates)
+    {
+        GfxMovable* movable = candidate.second;
+        VkDeviceSize size = movable->GetMovableAllocation().size;
+        if (moves > 0 && movedBytes + size > bytesPerFrame)
+        {
+            continue;
+        }
+
+        GfxAllocation newAllocation;
+        if (!allocator->AllocateForMove(movable->GetMovableAllocation(), movable->GetMovableRequirements(), newAllocation))
+        {
+            continue;
+        }
+
+        PendingRelease pendingRelease;
+        pendingRelease.frame = frameNumber;
+        pendingRelease.release = movable->Move(uploadContext->GetCommandBuffer(), newAllocation);
+        pendingReleases.push_back(pendingRelease);
+
+        movedBytes += size;
+        ++moves;
+    }
+
+    uploadContext->EndBatch();
+
+    if (moves == 0)
+    {
+        running = false;
+        reportPending = true;
+        std::cout << CYAN_TEXT << "Compaction done: " << stats.moves << " moves (" << stats.movedBytes / 1024
+            << "KB) in " << stats.steps << " frames" << RESET_TEXT << std::endl;
+        return;
+    }
+
+    ++stats.steps;
+    stats.moves += moves;
+    stats.movedBytes += movedBytes;
+}
+
+void GfxDefragmenter::ReleaseCompleted(bool all)
+{
+    //The frame that moved a resource and the ones before it are done framesInFlight frames later
+    while (!pendingReleases.empty() && (all || pendingReleases.front().frame + framesInFlight <= frameNumber))
+    {
+        pendingReleases.front().release();
+        pendingReleases.pop_front();
+    }
+}
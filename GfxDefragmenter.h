@@ -0,0 +1,92 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include "GfxMemoryAllocator.h"
+
+//GPU copy budget of one defragmentation step, a single resource bigger than this still moves alone
+#define DEFRAG_BYTES_PER_FRAME (8ull * 1024ull * 1024ull)
+
+//Resource the defragmenter can move to another block. Only for resources the GPU never writes
+//outside uploads, the copy would miss the writes of frames in flight otherwise.
+class GfxMovable
+{
+public:
+	virtual ~GfxMovable() = default;
+
+	virtual const GfxAllocation& GetMovableAllocation() const = 0;
+	virtual VkMemoryRequirements GetMovableRequirements() const = 0;
+	//Binds a new resource to newAllocation, records the copy and starts using it right away.
+	//Returns what releases the old resource once no frame in flight uses it.
+	virtual std::function<void()> Move(VkCommandBuffer commandBuffer, const GfxAllocation& newAllocation) = 0;
+	virtual const char* GetMovableName() const = 0;
+};
+
+//Buffer filled only by uploads (geometry, constants) that can be copied to a new VkBuffer
+class GfxMovableBuffer : public GfxMovable
+{
+public:
+	//The buffer needs VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+	void Init(VkBuffer* buffer, GfxAllocation* allocation, VkDeviceSize size, VkBufferUsageFlags usage, const char* Name);
+
+	const GfxAllocation& GetMovableAllocation() const override { return *allocation; }
+	VkMemoryRequirements GetMovableRequirements() const override;
+	std::function<void()> Move(VkCommandBuffer commandBuffer, const GfxAllocation& newAllocation) override;
+	const char* GetMovableName() const override { return name; }
+
+private:
+	VkBuffer* buffer = nullptr;
+	GfxAllocation* allocation = nullptr;
+	VkDeviceSize size = 0;
+	VkBufferUsageFlags usage = 0;
+	const char* name = "Unknown";
+};
+
+struct GfxDefragmentationStats
+{
+	uint32_t steps = 0;
+	uint32_t moves = 0;
+	VkDeviceSize movedBytes = 0;
+};
+
+//Incremental compaction: every frame moves live resources out of the sparsest blocks into denser ones
+//with GPU copies up to bytesPerFrame, old resources are released after the frames in flight finish.
+//Blocks emptied by the moves are released by the allocator.
+class GfxDefragmenter
+{
+public:
+	void Init(uint32_t framesInFlight, VkDeviceSize bytesPerFrame = DEFRAG_BYTES_PER_FRAME);
+	void Cleanup();
+
+	void Register(GfxMovable* movable);
+	void Unregister(GfxMovable* movable);
+
+	//Reports the current fragmentation and starts moving on the next Update
+	void Start();
+	bool IsRunning() const { return running; }
+	//After the frame fence wait, before recording anything that uses the movable resources
+	void Update();
+
+	const GfxDefragmentationStats& GetStats() const { return stats; }
+
+private:
+	struct PendingRelease
+	{
+		uint64_t frame = 0;
+		std::function<void()> release;
+	};
+
+	void ReleaseCompleted(bool all);
+
+	std::vector<GfxMovable*> movables;
+	std::deque<PendingRelease> pendingReleases;
+
+	uint32_t framesInFlight = 1;
+	VkDeviceSize bytesPerFrame = DEFRAG_BYTES_PER_FRAME;
+	uint64_t frameNumber = 0;
+	bool running = false;
+	bool reportPending = false;
+
+	GfxDefragmentationStats stats;
+};
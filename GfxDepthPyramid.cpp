@@ -0,0 +1,303 @@
+#include "GfxDepthPyramid.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "DebugUtils.h"
+#include "GfxPipelineCache.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <string>
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+
+static VkPipeline CreatePyramidPipeline(VkShaderModule shaderModule, VkPipelineLayout pipelineLayout, const char* Name)
+{
+    VkPipelineShaderStageCreateInfo shaderStageCreateInfo{};
+    shaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageCreateInfo.module = shaderModule;
+    shaderStageCreateInfo.pName = "main";
+
+    VkComputePipelineCreateInfo computePipelineInfo{};
+    computePipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    computePipelineInfo.layout = pipelineLayout;
+    computePipelineInfo.stage = shaderStageCreateInfo;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (gfxCtx->pipelineCache->CreateComputePipeline(computePipelineInfo, pipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating depth pyramid pipeline!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(pipeline, Name);
+    return pipeline;
+}
+
+static VkImageView CreatePyramidView(VkImage image, uint32_t baseLevel, uint32_t levelCount, const char* Name)
+{
+    VkImageViewCreateInfo imageViewCreateInfo{};
+    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCreateInfo.image = image;
+    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageViewCreateInfo.subresourceRange.baseMipLevel = baseLevel;
+    imageViewCreateInfo.subresourceRange.levelCount = levelCount;
+    imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+    imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+    VkImageView imageView = VK_NULL_HANDLE;
+    if (vkCreateImageView(gfxCtx->logicalDevice, &imageViewCreateInfo, gfxCtx->allocationCallbacks, &imageView) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating depth pyramid image view!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(imageView, Name);
+    return imageView;
+}
+
+void GfxDepthPyramid::Init(VkShaderModule reduceShaderModule, VkShaderModule msaaShaderModule)
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetCreateInfo{};
+    descriptorSetCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetCreateInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    descriptorSetCreateInfo.pBindings = bindings.data();
+    CreateDescriptorSetLayout(descriptorSetCreateInfo, descriptorSetLayout, "depthPyramidDescriptorSetLayout");
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(GfxDepthPyramidConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(gfxCtx->logicalDevice, &pipelineLayoutCreateInfo, gfxCtx->allocationCallbacks, &pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating depth pyramid pipeline layout!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(pipelineLayout, "depthPyramidPipelineLayout");
+
+    reducePipeline = CreatePyramidPipeline(reduceShaderModule, pipelineLayout, "depthPyramidPipeline");
+    msaaPipeline = CreatePyramidPipeline(msaaShaderModule, pipelineLayout, "depthPyramidMsaaPipeline");
+}
+
+void GfxDepthPyramid::Cleanup()
+{
+    DestroyResources();
+    vkDestroyPipeline(gfxCtx->logicalDevice, reducePipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, msaaPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, pipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, descriptorSetLayout, gfxCtx->allocationCallbacks);
+}
+
+void GfxDepthPyramid::CreateResources(VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight, VkSampleCountFlagBits depthSamples)
+{
+    this->depthWidth = depthWidth;
+    this->depthHeight = depthHeight;
+    this->depthSamples = depthSamples;
+    width = std::max(depthWidth / 2, 1u);
+    height = std::max(depthHeight / 2, 1u);
+    levelCount = 1;
+    while ((std::max(width, height) >> levelCount) > 0)
+    {
+        ++levelCount;
+    }
+
+    CreateImage_Internal(width, height, levelCount, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        pyramidImage, pyramidAllocation, "depthPyramidImage");
+
+    pyramidView = CreatePyramidView(pyramidImage, 0, levelCount, "depthPyramidImageView");
+    levelViews.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        std::string viewName = "depthPyramidLevelView" + std::to_string(level);
+        levelViews[level] = CreatePyramidView(pyramidImage, level, 1, viewName.c_str());
+    }
+
+    std::array<VkDescriptorPoolSize, 2> descriptorPoolSizes{};
+    descriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    descriptorPoolSizes[0].descriptorCount = levelCount;
+    descriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorPoolSizes[1].descriptorCount = levelCount;
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
+    descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSizes.data();
+    descriptorPoolCreateInfo.maxSets = levelCount;
+    CreateDescriptorPool(descriptorPoolCreateInfo, descriptorPool, "depthPyramidDescriptorPool");
+
+    std::vector<VkDescriptorSetLayout> layouts(levelCount, descriptorSetLayout);
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = descriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = levelCount;
+    descriptorSetAllocateInfo.pSetLayouts = layouts.data();
+    descriptorSets.resize(levelCount);
+    AllocateDescriptorSets(descriptorSetAllocateInfo, descriptorSets, "depthPyramidDescriptorSet");
+
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        //Level 0 reads the depth buffer between the two barriers of RecordBuild
+        VkDescriptorImageInfo sourceInfo{};
+        sourceInfo.imageView = level == 0 ? depthView : levelViews[level - 1];
+        sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo destinationInfo{};
+        destinationInfo.imageView = levelViews[level];
+        destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkWriteDescriptorSet, 2> writeDescriptorSet{};
+        for (uint32_t i = 0; i < writeDescriptorSet.size(); ++i)
+        {
+            writeDescriptorSet[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSet[i].dstSet = descriptorSets[level];
+            writeDescriptorSet[i].dstBinding = i;
+            writeDescriptorSet[i].dstArrayElement = 0;
+            writeDescriptorSet[i].descriptorCount = 1;
+        }
+        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        writeDescriptorSet[0].pImageInfo = &sourceInfo;
+        writeDescriptorSet[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writeDescriptorSet[1].pImageInfo = &destinationInfo;
+
+        //Without a depth view the pyramid is never built, it only gives readers something valid to bind
+        uint32_t firstWrite = (level == 0 && depthView == VK_NULL_HANDLE) ? 1 : 0;
+        vkUpdateDescriptorSets(gfxCtx->logicalDevice, static_cast<uint32_t>(writeDescriptorSet.size()) - firstWrite,
+            writeDescriptorSet.data() + firstWrite, 0, nullptr);
+    }
+
+    //Never leaves GENERAL, readers may bind it before the first build
+    VkCommandBuffer commandBuffer = BeginSingleTimeCommandBuffer_Internal();
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = pyramidImage;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = levelCount;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+    EndSingleTimeCommandBuffer_Internal(commandBuffer);
+
+    ++stats.recreations;
+}
+
+void GfxDepthPyramid::DestroyResources()
+{
+    if (pyramidImage == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    //Frees the sets allocated from it
+    vkDestroyDescriptorPool(gfxCtx->logicalDevice, descriptorPool, gfxCtx->allocationCallbacks);
+    descriptorPool = VK_NULL_HANDLE;
+    descriptorSets.clear();
+    for (VkImageView levelView : levelViews)
+    {
+        vkDestroyImageView(gfxCtx->logicalDevice, levelView, gfxCtx->allocationCallbacks);
+    }
+    levelViews.clear();
+    vkDestroyImageView(gfxCtx->logicalDevice, pyramidView, gfxCtx->allocationCallbacks);
+    pyramidView = VK_NULL_HANDLE;
+    DestroyImage_Internal(pyramidImage, pyramidAllocation);
+}
+
+void GfxDepthPyramid::RecordBuild(VkCommandBuffer commandBuffer, VkImage depthImage, VkImageAspectFlags depthAspect)
+{
+    VkImageMemoryBarrier depthBarrier{};
+    depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier.image = depthImage;
+    depthBarrier.subresourceRange.aspectMask = depthAspect;
+    depthBarrier.subresourceRange.baseMipLevel = 0;
+    depthBarrier.subresourceRange.levelCount = 1;
+    depthBarrier.subresourceRange.baseArrayLayer = 0;
+    depthBarrier.subresourceRange.layerCount = 1;
+    depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    //Compute in the source scope also orders the pyramid writes after the previous frame second phase culling reads
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+    VkMemoryBarrier levelBarrier{};
+    levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    uint32_t sourceWidth = depthWidth;
+    uint32_t sourceHeight = depthHeight;
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        GfxDepthPyramidConstants constants{};
+        constants.sourceWidth = sourceWidth;
+        constants.sourceHeight = sourceHeight;
+        constants.destinationWidth = std::max(width >> level, 1u);
+        constants.destinationHeight = std::max(height >> level, 1u);
+        constants.sampleCount = level == 0 ? static_cast<uint32_t>(depthSamples) : 1;
+
+        VkPipeline pipeline = (level == 0 && depthSamples != VK_SAMPLE_COUNT_1_BIT) ? msaaPipeline : reducePipeline;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GfxDepthPyramidConstants), &constants);
+        vkCmdDispatch(commandBuffer, (constants.destinationWidth + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+            (constants.destinationHeight + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE, 1);
+
+        //Next level reads this one, after the last level it is the second phase culling
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+        sourceWidth = constants.destinationWidth;
+        sourceHeight = constants.destinationHeight;
+    }
+
+    //Back to the layout the color pass leaves, the second phase pass loads it once the level 0 reads are done
+    depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthBarrier.srcAccessMask = 0;
+    depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+}
+
+void GfxDepthPyramid::MarkBuilt()
+{
+    ++stats.builds;
+}
+
+void GfxDepthPyramid::PrintStats()
+{
+    std::cout << CYAN_TEXT << "Depth pyramid: " << width << "x" << height << ", " << levelCount << " levels, "
+        << stats.builds << " builds, " << stats.recreations << " times created" << RESET_TEXT << std::endl;
+}
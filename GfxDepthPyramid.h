@@ -0,0 +1,80 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <vector>
+#include "GfxMemoryAllocator.h"
+
+//Threads per group side of depthPyramid.hlsl
+#define DEPTH_PYRAMID_GROUP_SIZE 8
+
+//Push constants of depthPyramid.hlsl
+struct GfxDepthPyramidConstants
+{
+	uint32_t sourceWidth;
+	uint32_t sourceHeight;
+	uint32_t destinationWidth;
+	uint32_t destinationHeight;
+	uint32_t sampleCount;
+};
+
+struct GfxDepthPyramidStats
+{
+	uint64_t builds = 0;
+	uint32_t recreations = 0;
+};
+
+//Hierarchical depth: mip chain of the farthest depth under each texel, level 0 is half the depth buffer size.
+//Built by compute from a depth attachment once the pass writing it ended, anything whose nearest depth
+//is farther than the texels covering it is hidden behind what that pass drew.
+//Stays in VK_IMAGE_LAYOUT_GENERAL, readers Load() it with explicit levels through GetView.
+class GfxDepthPyramid
+{
+public:
+	//msaaShaderModule builds level 0 of multisampled depth buffers, the modules can be destroyed once this returns
+	void Init(VkShaderModule reduceShaderModule, VkShaderModule msaaShaderModule);
+	void Cleanup();
+
+	//Sized after the depth buffer, recreated with it. The previous content is dropped.
+	//A null depthView still creates the pyramid for readers to bind, RecordBuild must not be called then
+	void CreateResources(VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight, VkSampleCountFlagBits depthSamples);
+	void DestroyResources();
+
+	//Outside of a render pass, after the pass that left depthImage in VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL.
+	//depthImage goes back to that layout, compute recorded after it can read the pyramid without a barrier
+	void RecordBuild(VkCommandBuffer commandBuffer, VkImage depthImage, VkImageAspectFlags depthAspect);
+	//The frame recording RecordBuild was submitted
+	void MarkBuilt();
+
+	VkImageView GetView() const { return pyramidView; }
+	uint32_t GetWidth() const { return width; }
+	uint32_t GetHeight() const { return height; }
+	uint32_t GetLevelCount() const { return levelCount; }
+	uint32_t GetDepthWidth() const { return depthWidth; }
+	uint32_t GetDepthHeight() const { return depthHeight; }
+	void PrintStats();
+
+private:
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline reducePipeline = VK_NULL_HANDLE;
+	VkPipeline msaaPipeline = VK_NULL_HANDLE;
+
+	VkImage pyramidImage = VK_NULL_HANDLE;
+	GfxAllocation pyramidAllocation;
+	//Every level, for readers
+	VkImageView pyramidView = VK_NULL_HANDLE;
+	//[level], written by the level pass and read by the next one
+	std::vector<VkImageView> levelViews;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	//[level]
+	std::vector<VkDescriptorSet> descriptorSets;
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t levelCount = 0;
+	uint32_t depthWidth = 0;
+	uint32_t depthHeight = 0;
+	VkSampleCountFlagBits depthSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	GfxDepthPyramidStats stats;
+};
@@ -0,0 +1,303 @@
+#include "GfxDrawList.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "GfxGeometryArena.h"
+#include "GfxInstancedMesh.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+
+void GfxDrawList::Begin(uint32_t pass, const glm::mat4& viewMatrix, float nearDepth, float farDepth)
+{
+    this->pass = pass;
+    this->viewMatrix = viewMatrix;
+    this->nearDepth = nearDepth;
+    this->farDepth = farDepth;
+
+    items.clear();
+    pipelineHandles.clear();
+    materialHandles.clear();
+    geometryHandles.clear();
+
+    ++stats.frames;
+}
+
+void GfxDrawList::Add(const GfxMeshRange& mesh, uint32_t transformIndex, const glm::vec3& position,
+    VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, uint32_t dynamicOffset)
+{
+    GfxDrawItem item;
+    item.pipeline = pipeline;
+    item.pipelineLayout = pipelineLayout;
+    item.descriptorSet = descriptorSet;
+    item.dynamicOffset = dynamicOffset;
+    item.transformIndex = transformIndex;
+    item.vertexBuffer = gfxCtx->geometryArena->GetVertexBuffer();
+    item.indexBuffer = gfxCtx->geometryArena->GetIndexBuffer();
+    item.indexCount = mesh.indices.count;
+    item.firstIndex = mesh.indices.offset;
+    item.vertexOffset = static_cast<int32_t>(mesh.vertices.offset);
+
+    AddItem(item, position);
+}
+
+void GfxDrawList::AddInstanced(const GfxInstancedMesh& instancedMesh, const GfxInstanceBatch& batch, VkBuffer instanceBuffer,
+    VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, uint32_t dynamicOffset)
+{
+    const GfxMeshRange& mesh = instancedMesh.GetMesh();
+
+    GfxDrawItem item;
+    item.pipeline = pipeline;
+    item.pipelineLayout = pipelineLayout;
+    item.descriptorSet = descriptorSet;
+    item.dynamicOffset = dynamicOffset;
+    item.vertexBuffer = gfxCtx->geometryArena->GetVertexBuffer();
+    item.indexBuffer = gfxCtx->geometryArena->GetIndexBuffer();
+    item.instanceBuffer = instanceBuffer;
+    item.indexCount = mesh.indices.count;
+    item.firstIndex = mesh.indices.offset;
+    item.vertexOffset = static_cast<int32_t>(mesh.vertices.offset);
+    item.instanceCount = batch.instanceCount;
+    item.firstInstance = batch.firstInstance;
+
+    AddItem(item, batch.center);
+}
+
+void GfxDrawList::AddIndirect(VkBuffer indirectBuffer, VkBuffer indirectCountBuffer, uint32_t maxDrawCount,
+    VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, uint32_t dynamicOffset)
+{
+    if (maxDrawCount == 0)
+    {
+        return;
+    }
+
+    GfxDrawItem item;
+    item.pipeline = pipeline;
+    item.pipelineLayout = pipelineLayout;
+    item.descriptorSet = descriptorSet;
+    item.dynamicOffset = dynamicOffset;
+    item.vertexBuffer = gfxCtx->geometryArena->GetVertexBuffer();
+    item.indexBuffer = gfxCtx->geometryArena->GetIndexBuffer();
+    item.indirectBuffer = indirectBuffer;
+    item.indirectCountBuffer = indirectCountBuffer;
+    item.maxDrawCount = maxDrawCount;
+
+    //No single depth, the GPU decides what is drawn
+    AddItem(item, glm::vec3(0.0f));
+}
+
+void GfxDrawList::AddItem(GfxDrawItem& item, const glm::vec3& position)
+{
+    glm::vec4 viewPosition = viewMatrix * glm::vec4(position, 1.0f);
+    float depth = std::min(std::max((-viewPosition.z - nearDepth) / (farDepth - nearDepth), 0.0f), 1.0f);
+    uint64_t depthKey = static_cast<uint64_t>(depth * static_cast<float>((1u << DRAW_KEY_DEPTH_BITS) - 1));
+
+    uint64_t geometryId = GetKeyId(geometryHandles, (uint64_t)item.vertexBuffer, DRAW_KEY_GEOMETRY_BITS);
+    uint64_t materialId = GetKeyId(materialHandles, (uint64_t)item.descriptorSet, DRAW_KEY_MATERIAL_BITS);
+    uint64_t pipelineId = GetKeyId(pipelineHandles, (uint64_t)item.pipeline, DRAW_KEY_PIPELINE_BITS);
+
+    item.sortKey = depthKey;
+    item.sortKey |= geometryId << DRAW_KEY_DEPTH_BITS;
+    item.sortKey |= materialId << (DRAW_KEY_DEPTH_BITS + DRAW_KEY_GEOMETRY_BITS);
+    item.sortKey |= pipelineId << (DRAW_KEY_DEPTH_BITS + DRAW_KEY_GEOMETRY_BITS + DRAW_KEY_MATERIAL_BITS);
+    item.sortKey |= static_cast<uint64_t>(pass) << (DRAW_KEY_DEPTH_BITS + DRAW_KEY_GEOMETRY_BITS + DRAW_KEY_MATERIAL_BITS + DRAW_KEY_PIPELINE_BITS);
+
+    items.push_back(item);
+}
+
+uint32_t GfxDrawList::GetKeyId(std::vector<uint64_t>& handles, uint64_t handle, uint32_t bits)
+{
+    for (uint32_t i = 0; i < handles.size(); ++i)
+    {
+        if (handles[i] == handle)
+        {
+            return i;
+        }
+    }
+
+    //Past the field size states share the last id, Record still compares the real handles
+    uint32_t maxId = (1u << bits) - 1;
+    if (handles.size() > maxId)
+    {
+        return maxId;
+    }
+    handles.push_back(handle);
+    return static_cast<uint32_t>(handles.size() - 1);
+}
+
+void GfxDrawList::Sort()
+{
+    std::sort(items.begin(), items.end(),
+        [](const GfxDrawItem& a, const GfxDrawItem& b) { return a.sortKey < b.sortKey; });
+}
+
+void GfxDrawList::Record(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end, VkExtent2D extent)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    GfxDrawListStats recordStats;
+    recordStats.draws = end - begin;
+
+    //Same for every draw, set once instead of per object
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.extent = extent;
+    scissor.offset = { 0, 0 };
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    recordStats.dynamicStateSets = 2;
+    recordStats.dynamicStateSetsSkipped = 2 * (recordStats.draws - 1);
+
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+    VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+    uint32_t boundDynamicOffset = 0;
+    VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+    VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+    VkBuffer boundInstanceBuffer = VK_NULL_HANDLE;
+    uint32_t pushedTransformIndex = DRAW_ITEM_NO_TRANSFORM;
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        const GfxDrawItem& item = items[i];
+
+        if (item.pipeline != boundPipeline)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, item.pipeline);
+            boundPipeline = item.pipeline;
+            ++recordStats.pipelineBinds;
+        }
+        else
+        {
+            ++recordStats.pipelineBindsSkipped;
+        }
+
+        if (item.vertexBuffer != boundVertexBuffer || item.indexBuffer != boundIndexBuffer)
+        {
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &item.vertexBuffer, &offset);
+            vkCmdBindIndexBuffer(commandBuffer, item.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            boundVertexBuffer = item.vertexBuffer;
+            boundIndexBuffer = item.indexBuffer;
+            ++recordStats.geometryBinds;
+        }
+        else
+        {
+            ++recordStats.geometryBindsSkipped;
+        }
+
+        if (item.instanceBuffer != VK_NULL_HANDLE)
+        {
+            if (item.instanceBuffer != boundInstanceBuffer)
+            {
+                VkDeviceSize offset = 0;
+                vkCmdBindVertexBuffers(commandBuffer, 1, 1, &item.instanceBuffer, &offset);
+                boundInstanceBuffer = item.instanceBuffer;
+                ++recordStats.geometryBinds;
+            }
+            else
+            {
+                ++recordStats.geometryBindsSkipped;
+            }
+        }
+
+        //Frame constants are shared by every draw, only a new layout or material rebinds
+        if (item.pipelineLayout != boundLayout || item.descriptorSet != boundDescriptorSet || item.dynamicOffset != boundDynamicOffset)
+        {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                item.pipelineLayout, 0, 1, &item.descriptorSet, 1, &item.dynamicOffset);
+            if (item.pipelineLayout != boundLayout)
+            {
+                pushedTransformIndex = DRAW_ITEM_NO_TRANSFORM;
+            }
+            boundLayout = item.pipelineLayout;
+            boundDescriptorSet = item.descriptorSet;
+            boundDynamicOffset = item.dynamicOffset;
+            ++recordStats.descriptorBinds;
+        }
+        else
+        {
+            ++recordStats.descriptorBindsSkipped;
+        }
+
+        if (item.transformIndex != DRAW_ITEM_NO_TRANSFORM && item.transformIndex != pushedTransformIndex)
+        {
+            vkCmdPushConstants(commandBuffer, item.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &item.transformIndex);
+            pushedTransformIndex = item.transformIndex;
+            ++recordStats.pushConstants;
+        }
+
+        if (item.indirectBuffer != VK_NULL_HANDLE)
+        {
+            RecordIndirect(commandBuffer, item);
+            ++recordStats.indirectDraws;
+            continue;
+        }
+
+        vkCmdDrawIndexed(commandBuffer, item.indexCount, item.instanceCount, item.firstIndex, item.vertexOffset, item.firstInstance);
+        recordStats.instances += item.instanceCount;
+    }
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.draws += recordStats.draws;
+    stats.instances += recordStats.instances;
+    stats.indirectDraws += recordStats.indirectDraws;
+    stats.pipelineBinds += recordStats.pipelineBinds;
+    stats.pipelineBindsSkipped += recordStats.pipelineBindsSkipped;
+    stats.descriptorBinds += recordStats.descriptorBinds;
+    stats.descriptorBindsSkipped += recordStats.descriptorBindsSkipped;
+    stats.geometryBinds += recordStats.geometryBinds;
+    stats.geometryBindsSkipped += recordStats.geometryBindsSkipped;
+    stats.pushConstants += recordStats.pushConstants;
+    stats.dynamicStateSets += recordStats.dynamicStateSets;
+    stats.dynamicStateSetsSkipped += recordStats.dynamicStateSetsSkipped;
+}
+
+void GfxDrawList::RecordIndirect(VkCommandBuffer commandBuffer, const GfxDrawItem& item)
+{
+    uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (gfxCtx->cmdDrawIndexedIndirectCount != nullptr && item.indirectCountBuffer != VK_NULL_HANDLE)
+    {
+        gfxCtx->cmdDrawIndexedIndirectCount(commandBuffer, item.indirectBuffer, 0, item.indirectCountBuffer, 0, item.maxDrawCount, stride);
+    }
+    else if (gfxCtx->multiDrawIndirect)
+    {
+        //Commands past the count are zero filled, they draw nothing
+        vkCmdDrawIndexedIndirect(commandBuffer, item.indirectBuffer, 0, item.maxDrawCount, stride);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < item.maxDrawCount; ++i)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, item.indirectBuffer, static_cast<VkDeviceSize>(i) * stride, 1, stride);
+        }
+    }
+}
+
+void GfxDrawList::PrintStats(const char* label)
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    uint64_t frames = std::max<uint64_t>(stats.frames, 1);
+    uint64_t issued = stats.pipelineBinds + stats.descriptorBinds + stats.geometryBinds + stats.dynamicStateSets;
+    uint64_t skipped = stats.pipelineBindsSkipped + stats.descriptorBindsSkipped + stats.geometryBindsSkipped + stats.dynamicStateSetsSkipped;
+
+    std::cout << CYAN_TEXT << label << " draw list: " << stats.draws / frames << " draws (" << stats.instances / frames << " instances, "
+        << stats.indirectDraws / frames << " GPU culled indirect) per frame, per frame binds issued/skipped: pipeline "
+        << stats.pipelineBinds / frames << "/" << stats.pipelineBindsSkipped / frames << ", descriptor "
+        << stats.descriptorBinds / frames << "/" << stats.descriptorBindsSkipped / frames << ", geometry "
+        << stats.geometryBinds / frames << "/" << stats.geometryBindsSkipped / frames << ", transform push constants "
+        << stats.pushConstants / frames << ", viewport+scissor "
+        << stats.dynamicStateSets / frames << "/" << stats.dynamicStateSetsSkipped / frames
+        << " (" << issued / frames << " state commands instead of " << (issued + skipped) / frames << ")" << RESET_TEXT << std::endl;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <mutex>
+#include <glm/glm.hpp>
+
+class GfxInstancedMesh;
+struct GfxMeshRange;
+struct GfxInstanceBatch;
+
+//Sort key, most significant first: pass | pipeline | material (descriptor set) | geometry buffers | depth
+#define DRAW_KEY_PASS_BITS 4
+#define DRAW_KEY_PIPELINE_BITS 12
+#define DRAW_KEY_MATERIAL_BITS 16
+#define DRAW_KEY_GEOMETRY_BITS 8
+#define DRAW_KEY_DEPTH_BITS 24
+
+#define DRAW_ITEM_NO_TRANSFORM UINT32_MAX
+
+struct GfxDrawItem
+{
+	uint64_t sortKey = 0;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	uint32_t dynamicOffset = 0;
+	//Pushed as the only vertex push constant, instanced draws read their transforms from the instance buffer instead
+	uint32_t transformIndex = DRAW_ITEM_NO_TRANSFORM;
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	//Bound at binding 1 for instanced draws
+	VkBuffer instanceBuffer = VK_NULL_HANDLE;
+	uint32_t indexCount = 0;
+	uint32_t firstIndex = 0;
+	int32_t vertexOffset = 0;
+	uint32_t instanceCount = 1;
+	uint32_t firstInstance = 0;
+	//GPU written VkDrawIndexedIndirectCommand array replacing the fields above, with an optional draw count
+	VkBuffer indirectBuffer = VK_NULL_HANDLE;
+	VkBuffer indirectCountBuffer = VK_NULL_HANDLE;
+	uint32_t maxDrawCount = 0;
+};
+
+struct GfxDrawListStats
+{
+	uint64_t frames = 0;
+	uint64_t draws = 0;
+	uint64_t instances = 0;
+	uint64_t indirectDraws = 0;
+	uint64_t pipelineBinds = 0;
+	uint64_t pipelineBindsSkipped = 0;
+	uint64_t descriptorBinds = 0;
+	uint64_t descriptorBindsSkipped = 0;
+	uint64_t geometryBinds = 0;
+	uint64_t geometryBindsSkipped = 0;
+	uint64_t pushConstants = 0;
+	uint64_t dynamicStateSets = 0;
+	uint64_t dynamicStateSetsSkipped = 0;
+};
+
+//Draws of one pass sorted by state so that recording only emits a bind when the state actually changes.
+//Opaque draws go front to back inside the same state, there are no blended objects yet.
+//Built on the main thread, Record can run on several threads over disjoint ranges.
+class GfxDrawList
+{
+public:
+	//depth is the view space distance along -Z of viewMatrix, quantized over [nearDepth, farDepth]
+	void Begin(uint32_t pass, const glm::mat4& viewMatrix, float nearDepth, float farDepth);
+	//dynamicOffset points at the frame constants, transformIndex goes through a push constant. position is only used for depth sorting
+	void Add(const GfxMeshRange& mesh, uint32_t transformIndex, const glm::vec3& position,
+		VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, uint32_t dynamicOffset);
+	//One draw for the whole batch, dynamicOffset points at the frame constants
+	void AddInstanced(const GfxInstancedMesh& instancedMesh, const GfxInstanceBatch& batch, VkBuffer instanceBuffer,
+		VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, uint32_t dynamicOffset);
+	//Every command of indirectBuffer as one item, transforms come through firstInstance
+	void AddIndirect(VkBuffer indirectBuffer, VkBuffer indirectCountBuffer, uint32_t maxDrawCount,
+		VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, uint32_t dynamicOffset);
+	void Sort();
+
+	//Records draws [begin, end) into a command buffer with no state bound yet
+	void Record(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end, VkExtent2D extent);
+
+	uint32_t GetDrawCount() const { return static_cast<uint32_t>(items.size()); }
+	const GfxDrawListStats& GetStats() const { return stats; }
+	void PrintStats(const char* label);
+
+private:
+	void AddItem(GfxDrawItem& item, const glm::vec3& position);
+	//Count variant when the device has it, one multi draw over every command otherwise
+	void RecordIndirect(VkCommandBuffer commandBuffer, const GfxDrawItem& item);
+	//Small ids so handles fit in the key, assigned in first seen order every Begin
+	uint32_t GetKeyId(std::vector<uint64_t>& handles, uint64_t handle, uint32_t bits);
+
+	std::vector<GfxDrawItem> items;
+	uint32_t pass = 0;
+	glm::mat4 viewMatrix = glm::mat4(1.0f);
+	float nearDepth = 0.0f;
+	float farDepth = 1.0f;
+
+	std::vector<uint64_t> pipelineHandles;
+	std::vector<uint64_t> materialHandles;
+	std::vector<uint64_t> geometryHandles;
+
+	std::mutex statsMutex;
+	GfxDrawListStats stats;
+};
@@ -0,0 +1,85 @@
+#include "GfxFrameAllocator.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void GfxFrameAllocator::Init(uint32_t frameCount, VkDeviceSize frameSize, VkBufferUsageFlags usageFlags, const char* Name)
+{
+    const VkPhysicalDeviceLimits& limits = gfxCtx->memoryAllocator->GetLimits();
+
+    alignment = 1;
+    if (usageFlags & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+    {
+        alignment = std::max(alignment, limits.minUniformBufferOffsetAlignment);
+    }
+    if (usageFlags & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+    {
+        alignment = std::max(alignment, limits.minStorageBufferOffsetAlignment);
+    }
+
+    this->frameCount = frameCount;
+    //Keep every frame region aligned so block offsets stay aligned in all the slots
+    this->frameSize = AlignUp(frameSize, alignment);
+
+    VkDeviceSize bufferSize = this->frameSize * frameCount;
+    if (bufferSize > UINT32_MAX)
+    {
+        throw std::runtime_error("Error frame allocator too big for 32 bit dynamic offsets!");
+    }
+
+    std::string memoryName = std::string(Name) + "Memory";
+    //Written once and read by the GPU every frame, device local host visible memory when the device has budget for it
+    CreateBuffer_Internal(bufferSize, usageFlags, GfxMemoryUsage::CPU_TO_GPU,
+        buffer, bufferAllocation, Name, memoryName.c_str());
+
+    if (bufferAllocation.mappedData == nullptr)
+    {
+        throw std::runtime_error("Error frame allocator buffer is not mapped!");
+    }
+
+    frameStart = 0;
+    head = 0;
+    peakUsedBytes = 0;
+}
+
+void GfxFrameAllocator::Cleanup()
+{
+    std::cout << CYAN_TEXT << "Frame allocator peak usage: " << peakUsedBytes << " / "
+        << frameSize << " bytes per frame" << RESET_TEXT << std::endl;
+
+    DestroyBuffer_Internal(buffer, bufferAllocation);
+}
+
+void GfxFrameAllocator::BeginFrame(uint32_t frameIndex)
+{
+    peakUsedBytes = std::max(peakUsedBytes, GetFrameUsedBytes());
+
+    frameStart = frameSize * (frameIndex % frameCount);
+    head = frameStart;
+}
+
+GfxFrameAllocation GfxFrameAllocator::Allocate(VkDeviceSize size)
+{
+    VkDeviceSize offset = AlignUp(head, alignment);
+    if (offset + size > frameStart + frameSize)
+    {
+        throw std::runtime_error("Error frame allocator out of memory, increase FRAME_ALLOCATOR_SIZE!");
+    }
+
+    head = offset + size;
+
+    GfxFrameAllocation allocation;
+    allocation.data = static_cast<char*>(bufferAllocation.mappedData) + offset;
+    allocation.dynamicOffset = static_cast<uint32_t>(offset);
+    return allocation;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <cstring>
+#include "GfxMemoryAllocator.h"
+
+//Bytes each frame in flight can bump-allocate before the allocator runs out
+#define FRAME_ALLOCATOR_SIZE (2ull * 1024ull * 1024ull)
+
+struct GfxFrameAllocation
+{
+	//Persistently mapped, valid until the same frame slot begins again
+	void* data = nullptr;
+	//Offset to pass to vkCmdBindDescriptorSets for *_DYNAMIC descriptors
+	uint32_t dynamicOffset = 0;
+};
+
+//Linear allocator over a single persistently mapped buffer split in one region per frame in flight.
+//Descriptors point at offset 0 of the buffer and every block is selected with a dynamic offset,
+//so one descriptor set serves any number of draws.
+class GfxFrameAllocator
+{
+public:
+	void Init(uint32_t frameCount, VkDeviceSize frameSize, VkBufferUsageFlags usageFlags, const char* Name = "FrameAllocator");
+	void Cleanup();
+
+	//Call once the fence of frameIndex has been waited, it recycles everything allocated in that slot
+	void BeginFrame(uint32_t frameIndex);
+
+	GfxFrameAllocation Allocate(VkDeviceSize size);
+
+	template<typename T>
+	uint32_t Push(const T& data)
+	{
+		GfxFrameAllocation allocation = Allocate(sizeof(T));
+		memcpy(allocation.data, &data, sizeof(T));
+		return allocation.dynamicOffset;
+	}
+
+	VkBuffer GetBuffer() const { return buffer; }
+	VkDeviceSize GetAlignment() const { return alignment; }
+	VkDeviceSize GetFrameUsedBytes() const { return head - frameStart; }
+	VkDeviceSize GetFrameSize() const { return frameSize; }
+
+private:
+	VkBuffer buffer = VK_NULL_HANDLE;
+	GfxAllocation bufferAllocation;
+
+	uint32_t frameCount = 0;
+	VkDeviceSize frameSize = 0;
+	VkDeviceSize alignment = 1;
+
+	VkDeviceSize frameStart = 0;
+	VkDeviceSize head = 0;
+	VkDeviceSize peakUsedBytes = 0;
+};
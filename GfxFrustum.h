@@ -0,0 +1,46 @@
+#pragma once
+#include <glm/glm.hpp>
+
+//Frustum planes in world space, xyz points inside and w is the distance so dot(xyz, p) + w >= 0 is inside.
+//Order: left, right, bottom, top, near, far
+struct GfxFrustum
+{
+	glm::vec4 planes[6];
+
+	//From a projection * view matrix with Vulkan clip space (depth 0..1)
+	static GfxFrustum FromViewProjection(const glm::mat4& viewProjection)
+	{
+		//glm is column major, row i gathers element i of every column
+		glm::vec4 rows[4];
+		for (int row = 0; row < 4; ++row)
+		{
+			rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+		}
+
+		GfxFrustum frustum;
+		frustum.planes[0] = rows[3] + rows[0];
+		frustum.planes[1] = rows[3] - rows[0];
+		frustum.planes[2] = rows[3] + rows[1];
+		frustum.planes[3] = rows[3] - rows[1];
+		frustum.planes[4] = rows[2];
+		frustum.planes[5] = rows[3] - rows[2];
+
+		for (int i = 0; i < 6; ++i)
+		{
+			frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+		}
+		return frustum;
+	}
+
+	bool IsSphereVisible(const glm::vec3& center, float radius) const
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
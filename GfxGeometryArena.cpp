@@ -0,0 +1,271 @@
+#include "GfxGeometryArena.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "GfxStagingRing.h"
+#include "GfxResidencyManager.h"
+#include "GfxDefragmenter.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+
+void GfxRangeAllocator::Init(uint32_t capacity)
+{
+    this->capacity = capacity;
+    usedCount = 0;
+    freeRanges.clear();
+    freeRanges.push_back({ 0, capacity });
+}
+
+bool GfxRangeAllocator::Allocate(uint32_t count, GfxRange& range)
+{
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+    {
+        if (it->count < count)
+        {
+            continue;
+        }
+
+        range.offset = it->offset;
+        range.count = count;
+
+        it->offset += count;
+        it->count -= count;
+        if (it->count == 0)
+        {
+            freeRanges.erase(it);
+        }
+
+        usedCount += count;
+        return true;
+    }
+
+    return false;
+}
+
+void GfxRangeAllocator::Free(GfxRange& range)
+{
+    if (range.count == 0)
+    {
+        return;
+    }
+
+    auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), range,
+        [](const GfxRange& a, const GfxRange& b) { return a.offset < b.offset; });
+
+    bool mergePrevious = next != freeRanges.begin() && (next - 1)->offset + (next - 1)->count == range.offset;
+    bool mergeNext = next != freeRanges.end() && range.offset + range.count == next->offset;
+
+    if (mergePrevious && mergeNext)
+    {
+        (next - 1)->count += range.count + next->count;
+        freeRanges.erase(next);
+    }
+    else if (mergePrevious)
+    {
+        (next - 1)->count += range.count;
+    }
+    else if (mergeNext)
+    {
+        next->offset = range.offset;
+        next->count += range.count;
+    }
+    else
+    {
+        freeRanges.insert(next, range);
+    }
+
+    usedCount -= range.count;
+    range = GfxRange();
+}
+
+uint32_t GfxRangeAllocator::GetLargestFreeRange() const
+{
+    uint32_t largest = 0;
+    for (const GfxRange& range : freeRanges)
+    {
+        largest = std::max(largest, range.count);
+    }
+    return largest;
+}
+
+void GfxGeometryArena::Init(uint32_t vertexCapacity, uint32_t indexCapacity, uint32_t vertexStride, uint32_t pulledVertexStride)
+{
+    this->vertexStride = vertexStride;
+    this->pulledVertexStride = pulledVertexStride;
+
+    //Transfer source so the defragmenter can copy them to another block, Bind picks up the new buffers
+    VkDeviceSize vertexBufferSize = static_cast<VkDeviceSize>(vertexCapacity) * vertexStride;
+    VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    CreateBuffer_Internal(vertexBufferSize, vertexUsage,
+        GfxMemoryUsage::GPU_STREAMED, vertexBuffer, vertexBufferAllocation,
+        "GeometryArenaVertexBuffer", "GeometryArenaVertexBufferMemory");
+    vertexRanges.Init(vertexCapacity);
+    movableVertexBuffer.Init(&vertexBuffer, &vertexBufferAllocation, vertexBufferSize, vertexUsage, "GeometryArenaVertexBuffer");
+
+    VkDeviceSize indexBufferSize = static_cast<VkDeviceSize>(indexCapacity) * sizeof(uint32_t);
+    VkBufferUsageFlags indexUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    CreateBuffer_Internal(indexBufferSize, indexUsage,
+        GfxMemoryUsage::GPU_STREAMED, indexBuffer, indexBufferAllocation,
+        "GeometryArenaIndexBuffer", "GeometryArenaIndexBufferMemory");
+    indexRanges.Init(indexCapacity);
+    movableIndexBuffer.Init(&indexBuffer, &indexBufferAllocation, indexBufferSize, indexUsage, "GeometryArenaIndexBuffer");
+
+    if (pulledVertexStride > 0)
+    {
+        VkDeviceSize pulledVertexBufferSize = static_cast<VkDeviceSize>(vertexCapacity) * pulledVertexStride;
+        VkBufferUsageFlags pulledVertexUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        CreateBuffer_Internal(pulledVertexBufferSize, pulledVertexUsage,
+            GfxMemoryUsage::GPU_STREAMED, pulledVertexBuffer, pulledVertexBufferAllocation,
+            "GeometryArenaPulledVertexBuffer", "GeometryArenaPulledVertexBufferMemory");
+        movablePulledVertexBuffer.Init(&pulledVertexBuffer, &pulledVertexBufferAllocation, pulledVertexBufferSize, pulledVertexUsage,
+            "GeometryArenaPulledVertexBuffer");
+    }
+
+    if (gfxCtx->defragmenter != nullptr)
+    {
+        gfxCtx->defragmenter->Register(&movableVertexBuffer);
+        gfxCtx->defragmenter->Register(&movableIndexBuffer);
+        if (pulledVertexStride > 0)
+        {
+            gfxCtx->defragmenter->Register(&movablePulledVertexBuffer);
+        }
+    }
+
+    meshCount = 0;
+}
+
+void GfxGeometryArena::Cleanup()
+{
+    PrintStats();
+
+    if (gfxCtx->defragmenter != nullptr)
+    {
+        gfxCtx->defragmenter->Unregister(&movableVertexBuffer);
+        gfxCtx->defragmenter->Unregister(&movableIndexBuffer);
+        if (pulledVertexStride > 0)
+        {
+            gfxCtx->defragmenter->Unregister(&movablePulledVertexBuffer);
+        }
+    }
+
+    DestroyBuffer_Internal(vertexBuffer, vertexBufferAllocation);
+    DestroyBuffer_Internal(indexBuffer, indexBufferAllocation);
+    if (pulledVertexStride > 0)
+    {
+        DestroyBuffer_Internal(pulledVertexBuffer, pulledVertexBufferAllocation);
+    }
+}
+
+GfxMeshRange GfxGeometryArena::AllocateMesh(const void* vertexData, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount,
+    const char* Name, const void* pulledVertexData)
+{
+    GfxMeshRange mesh;
+    //When full, meshes not drawn by any frame in flight go back to host memory until there is room
+    while (!AllocateRanges(vertexCount, indexCount, mesh))
+    {
+        if (gfxCtx->residencyManager == nullptr || !gfxCtx->residencyManager->EvictLeastRecentlyUsed(GfxStreamableType::MESH))
+        {
+            throw std::runtime_error(std::string("Error geometry arena out of space allocating ") + Name + "!");
+        }
+    }
+
+    gfxCtx->stagingRing->UploadBuffer(vertexBuffer, static_cast<VkDeviceSize>(mesh.vertices.offset) * vertexStride,
+        vertexData, static_cast<VkDeviceSize>(vertexCount) * vertexStride);
+    gfxCtx->stagingRing->UploadBuffer(indexBuffer, static_cast<VkDeviceSize>(mesh.indices.offset) * sizeof(uint32_t),
+        indexData, static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t));
+    if (pulledVertexStride > 0 && pulledVertexData != nullptr)
+    {
+        gfxCtx->stagingRing->UploadBuffer(pulledVertexBuffer, static_cast<VkDeviceSize>(mesh.vertices.offset) * pulledVertexStride,
+            pulledVertexData, static_cast<VkDeviceSize>(vertexCount) * pulledVertexStride);
+    }
+
+    ++meshCount;
+    ++rangesVersion;
+    return mesh;
+}
+
+bool GfxGeometryArena::AllocateRanges(uint32_t vertexCount, uint32_t indexCount, GfxMeshRange& mesh)
+{
+    if (!vertexRanges.Allocate(vertexCount, mesh.vertices))
+    {
+        return false;
+    }
+    if (!indexRanges.Allocate(indexCount, mesh.indices))
+    {
+        vertexRanges.Free(mesh.vertices);
+        return false;
+    }
+    return true;
+}
+
+void GfxGeometryArena::FreeMesh(GfxMeshRange& mesh)
+{
+    if (!mesh.IsValid())
+    {
+        return;
+    }
+
+    vertexRanges.Free(mesh.vertices);
+    indexRanges.Free(mesh.indices);
+    --meshCount;
+    ++rangesVersion;
+}
+
+VkDeviceSize GfxGeometryArena::GetMeshBytes(const GfxMeshRange& mesh) const
+{
+    return static_cast<VkDeviceSize>(mesh.vertices.count) * (vertexStride + pulledVertexStride) +
+        static_cast<VkDeviceSize>(mesh.indices.count) * sizeof(uint32_t);
+}
+
+void GfxGeometryArena::RecordMeshReadback(VkCommandBuffer commandBuffer, const GfxMeshRange& mesh, VkBuffer dstBuffer)
+{
+    VkDeviceSize vertexBytes = static_cast<VkDeviceSize>(mesh.vertices.count) * vertexStride;
+    VkDeviceSize pulledVertexBytes = static_cast<VkDeviceSize>(mesh.vertices.count) * pulledVertexStride;
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = static_cast<VkDeviceSize>(mesh.vertices.offset) * vertexStride;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = vertexBytes;
+    vkCmdCopyBuffer(commandBuffer, vertexBuffer, dstBuffer, 1, &copyRegion);
+
+    if (pulledVertexStride > 0)
+    {
+        copyRegion.srcOffset = static_cast<VkDeviceSize>(mesh.vertices.offset) * pulledVertexStride;
+        copyRegion.dstOffset = vertexBytes;
+        copyRegion.size = pulledVertexBytes;
+        vkCmdCopyBuffer(commandBuffer, pulledVertexBuffer, dstBuffer, 1, &copyRegion);
+    }
+
+    copyRegion.srcOffset = static_cast<VkDeviceSize>(mesh.indices.offset) * sizeof(uint32_t);
+    copyRegion.dstOffset = vertexBytes + pulledVertexBytes;
+    copyRegion.size = static_cast<VkDeviceSize>(mesh.indices.count) * sizeof(uint32_t);
+    vkCmdCopyBuffer(commandBuffer, indexBuffer, dstBuffer, 1, &copyRegion);
+
+    //The ranges are freed right after, uploads reusing them must not overwrite them before they are read
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void GfxGeometryArena::Bind(VkCommandBuffer commandBuffer)
+{
+    VkBuffer vertexBuffers[] = { vertexBuffer };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void GfxGeometryArena::PrintStats()
+{
+    std::cout << CYAN_TEXT << "Geometry arena: " << meshCount << " meshes, vertices "
+        << vertexRanges.GetUsedCount() << "/" << vertexRanges.GetCapacity()
+        << " (" << vertexRanges.GetFreeRangeCount() << " free ranges), indices "
+        << indexRanges.GetUsedCount() << "/" << indexRanges.GetCapacity()
+        << " (" << indexRanges.GetFreeRangeCount() << " free ranges)" << RESET_TEXT << std::endl;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include "GfxMemoryAllocator.h"
+#include "GfxDefragmenter.h"
+
+//Elements the shared geometry buffers can hold, every scene object and instanced mesh allocates its ranges from them
+#define GEOMETRY_ARENA_VERTEX_CAPACITY (1024u * 1024u)
+#define GEOMETRY_ARENA_INDEX_CAPACITY (4u * 1024u * 1024u)
+
+struct GfxRange
+{
+	uint32_t offset = 0;
+	uint32_t count = 0;
+};
+
+//First fit free-list over element ranges, adjacent free ranges are merged on Free
+class GfxRangeAllocator
+{
+public:
+	void Init(uint32_t capacity);
+	bool Allocate(uint32_t count, GfxRange& range);
+	void Free(GfxRange& range);
+
+	uint32_t GetCapacity() const { return capacity; }
+	uint32_t GetUsedCount() const { return usedCount; }
+	uint32_t GetLargestFreeRange() const;
+	uint32_t GetFreeRangeCount() const { return static_cast<uint32_t>(freeRanges.size()); }
+
+private:
+	//Sorted by offset
+	std::vector<GfxRange> freeRanges;
+	uint32_t capacity = 0;
+	uint32_t usedCount = 0;
+};
+
+//Where a mesh lives inside the arena, what vkCmdDrawIndexed needs
+struct GfxMeshRange
+{
+	GfxRange vertices;
+	GfxRange indices;
+
+	bool IsValid() const { return indices.count > 0; }
+};
+
+//One device local vertex buffer and one index buffer shared by every mesh.
+//Passes bind them once and draws select the mesh with vertexOffset/firstIndex.
+//Optionally a second vertex stream in a storage buffer, same vertex indices with its own stride,
+//read by vertex pulling shaders with SV_VertexID instead of going through the vertex input.
+class GfxGeometryArena
+{
+public:
+	//pulledVertexStride 0 for no pulled vertex stream
+	void Init(uint32_t vertexCapacity, uint32_t indexCapacity, uint32_t vertexStride, uint32_t pulledVertexStride = 0);
+	void Cleanup();
+
+	//Uploads through the staging ring, indices are relative to the mesh first vertex.
+	//Evicts least recently used meshes when full and throws if that is not enough
+	//pulledVertexData holds vertexCount vertices of the pulled stride, nullptr leaves them unwritten for meshes
+	//never drawn by vertex pulling pipelines
+	GfxMeshRange AllocateMesh(const void* vertexData, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount,
+		const char* Name = "Unknown", const void* pulledVertexData = nullptr);
+	//The caller has to make sure no frame in flight still draws the mesh
+	void FreeMesh(GfxMeshRange& mesh);
+	//Bytes of the mesh vertices, pulled vertices and indices, the layout RecordMeshReadback writes
+	VkDeviceSize GetMeshBytes(const GfxMeshRange& mesh) const;
+	//Copies the mesh ranges to dstBuffer packed as vertices, pulled vertices, indices, so AllocateMesh can take them back
+	void RecordMeshReadback(VkCommandBuffer commandBuffer, const GfxMeshRange& mesh, VkBuffer dstBuffer);
+
+	void Bind(VkCommandBuffer commandBuffer);
+
+	VkBuffer GetVertexBuffer() const { return vertexBuffer; }
+	VkBuffer GetIndexBuffer() const { return indexBuffer; }
+	uint32_t GetVertexStride() const { return vertexStride; }
+	uint32_t GetPulledVertexStride() const { return pulledVertexStride; }
+	bool HasPulledVertices() const { return pulledVertexStride > 0; }
+	//Moved by the defragmenter, descriptors writing it compare against the last handle they wrote
+	VkBuffer GetPulledVertexBuffer() const { return pulledVertexBuffer; }
+	VkDeviceSize GetPulledVertexBufferSize() const { return static_cast<VkDeviceSize>(vertexRanges.GetCapacity()) * pulledVertexStride; }
+	//Bumped whenever a mesh range is allocated or freed, GPU side copies of the ranges compare against it
+	uint32_t GetRangesVersion() const { return rangesVersion; }
+
+	void PrintStats();
+
+private:
+	bool AllocateRanges(uint32_t vertexCount, uint32_t indexCount, GfxMeshRange& mesh);
+
+	uint32_t vertexStride = 0;
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	GfxAllocation vertexBufferAllocation;
+	GfxRangeAllocator vertexRanges;
+	GfxMovableBuffer movableVertexBuffer;
+
+	uint32_t pulledVertexStride = 0;
+	VkBuffer pulledVertexBuffer = VK_NULL_HANDLE;
+	GfxAllocation pulledVertexBufferAllocation;
+	GfxMovableBuffer movablePulledVertexBuffer;
+
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	GfxAllocation indexBufferAllocation;
+	GfxRangeAllocator indexRanges;
+	GfxMovableBuffer movableIndexBuffer;
+
+	uint32_t meshCount = 0;
+	uint32_t rangesVersion = 0;
+};
@@ -0,0 +1,454 @@
+#include "GfxGpuCulling.h"
+#include "GfxScene.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "GfxGeometryArena.h"
+#include "GfxTransformBuffer.h"
+#include "GfxFrustum.h"
+#include "GfxDepthPyramid.h"
+#include "DebugUtils.h"
+#include "GfxPipelineCache.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <string>
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+
+void GfxGpuCulling::Init(VkShaderModule cullShaderModule, uint32_t maxObjects, uint32_t framesInFlight, uint32_t passCount)
+{
+    this->maxObjects = maxObjects;
+    this->framesInFlight = framesInFlight;
+    this->passCount = passCount;
+    //The second phase needs its own commands and counts, the first phase ones are still drawn from
+    uint32_t setCount = framesInFlight * (passCount + 1);
+
+    stats = GfxGpuCullingStats();
+    stats.testedObjects.assign(passCount, 0);
+    stats.visibleDraws.assign(passCount, 0);
+    stats.frustumCulled.assign(passCount, 0);
+    stats.occlusionCulled.assign(passCount, 0);
+    stats.lastFrameVisible.assign(passCount, 0);
+    stats.secondPhaseDraws.assign(passCount, 0);
+    stats.occlusionTestedObjects.assign(passCount, 0);
+    stats.occlusionFrames.assign(passCount, 0);
+
+    //Storage buffers first, the depth pyramid last
+    const uint32_t storageBufferBindingCount = 6;
+    std::array<VkDescriptorSetLayoutBinding, storageBufferBindingCount + 1> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i < storageBufferBindingCount ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetCreateInfo{};
+    descriptorSetCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetCreateInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    descriptorSetCreateInfo.pBindings = bindings.data();
+    CreateDescriptorSetLayout(descriptorSetCreateInfo, descriptorSetLayout, "gpuCullingDescriptorSetLayout");
+
+    std::array<VkDescriptorPoolSize, 2> descriptorPoolSizes{};
+    descriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorPoolSizes[0].descriptorCount = storageBufferBindingCount * setCount;
+    descriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    descriptorPoolSizes[1].descriptorCount = setCount;
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
+    descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSizes.data();
+    descriptorPoolCreateInfo.maxSets = setCount;
+    CreateDescriptorPool(descriptorPoolCreateInfo, descriptorPool, "gpuCullingDescriptorPool");
+
+    std::vector<VkDescriptorSetLayout> layouts(setCount, descriptorSetLayout);
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = descriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = setCount;
+    descriptorSetAllocateInfo.pSetLayouts = layouts.data();
+    descriptorSets.resize(setCount);
+    AllocateDescriptorSets(descriptorSetAllocateInfo, descriptorSets, "gpuCullingDescriptorSet");
+
+    VkDeviceSize objectBufferSize = static_cast<VkDeviceSize>(std::max(maxObjects, 1u)) * sizeof(GfxGpuCullObject);
+    VkDeviceSize indirectBufferSize = static_cast<VkDeviceSize>(std::max(maxObjects, 1u)) * sizeof(VkDrawIndexedIndirectCommand);
+    VkDeviceSize countBufferSize = GPU_CULLING_COUNTER_COUNT * sizeof(uint32_t);
+    VkDeviceSize visibilityBufferSize = static_cast<VkDeviceSize>(std::max(maxObjects, 1u)) * sizeof(uint32_t);
+
+    objectBuffers.resize(framesInFlight);
+    objectBufferAllocations.resize(framesInFlight);
+    objectVersions.assign(framesInFlight, 0);
+    rangesVersions.assign(framesInFlight, 0);
+    for (uint32_t frame = 0; frame < framesInFlight; ++frame)
+    {
+        std::string bufferName = "gpuCullingObjectBuffer" + std::to_string(frame + 1);
+        std::string memoryName = bufferName + "Memory";
+        CreateBuffer_Internal(objectBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GfxMemoryUsage::CPU_TO_GPU,
+            objectBuffers[frame], objectBufferAllocations[frame], bufferName.c_str(), memoryName.c_str());
+
+        if (objectBufferAllocations[frame].mappedData == nullptr)
+        {
+            throw std::runtime_error("Error GPU culling object buffer is not mapped!");
+        }
+    }
+
+    indirectBuffers.resize(setCount);
+    indirectBufferAllocations.resize(setCount);
+    countBuffers.resize(setCount);
+    countBufferAllocations.resize(setCount);
+    countsWritten.assign(setCount, false);
+    constantsBuffers.resize(setCount);
+    constantsBufferAllocations.resize(setCount);
+    occlusionActive.assign(setCount, false);
+    secondPhasePasses.assign(framesInFlight, UINT32_MAX);
+    for (uint32_t i = 0; i < setCount; ++i)
+    {
+        std::string bufferName = "gpuCullingIndirectBuffer" + std::to_string(i + 1);
+        std::string memoryName = bufferName + "Memory";
+        CreateBuffer_Internal(indirectBufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            GfxMemoryUsage::GPU_ONLY, indirectBuffers[i], indirectBufferAllocations[i], bufferName.c_str(), memoryName.c_str());
+
+        bufferName = "gpuCullingCountBuffer" + std::to_string(i + 1);
+        memoryName = bufferName + "Memory";
+        CreateBuffer_Internal(countBufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            GfxMemoryUsage::CPU_ONLY, countBuffers[i], countBufferAllocations[i], bufferName.c_str(), memoryName.c_str());
+
+        bufferName = "gpuCullingConstantsBuffer" + std::to_string(i + 1);
+        memoryName = bufferName + "Memory";
+        CreateBuffer_Internal(sizeof(GfxGpuCullConstants), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            GfxMemoryUsage::CPU_TO_GPU, constantsBuffers[i], constantsBufferAllocations[i], bufferName.c_str(), memoryName.c_str());
+
+        if (countBufferAllocations[i].mappedData == nullptr || constantsBufferAllocations[i].mappedData == nullptr)
+        {
+            throw std::runtime_error("Error GPU culling count or constants buffer is not mapped!");
+        }
+    }
+
+    //Starts with nothing visible, the first occlusion tested frame draws every object in its second phase
+    CreateBuffer_Internal(visibilityBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        GfxMemoryUsage::GPU_ONLY, visibilityBuffer, visibilityBufferAllocation, "gpuCullingVisibilityBuffer", "gpuCullingVisibilityBufferMemory");
+    VkCommandBuffer fillCommandBuffer = BeginSingleTimeCommandBuffer_Internal();
+    vkCmdFillBuffer(fillCommandBuffer, visibilityBuffer, 0, visibilityBufferSize, 0);
+    EndSingleTimeCommandBuffer_Internal(fillCommandBuffer);
+
+    for (uint32_t index = 0; index < setCount; ++index)
+    {
+        uint32_t frame = index < framesInFlight * passCount ? index / passCount : index - framesInFlight * passCount;
+
+        std::array<VkDescriptorBufferInfo, storageBufferBindingCount> bufferInfos{};
+        bufferInfos[0].buffer = objectBuffers[frame];
+        bufferInfos[0].range = objectBufferSize;
+        bufferInfos[1].buffer = gfxCtx->transformBuffer->GetBuffer(frame);
+        bufferInfos[1].range = gfxCtx->transformBuffer->GetBufferSize();
+        bufferInfos[2].buffer = indirectBuffers[index];
+        bufferInfos[2].range = indirectBufferSize;
+        bufferInfos[3].buffer = countBuffers[index];
+        bufferInfos[3].range = countBufferSize;
+        bufferInfos[4].buffer = constantsBuffers[index];
+        bufferInfos[4].range = sizeof(GfxGpuCullConstants);
+        bufferInfos[5].buffer = visibilityBuffer;
+        bufferInfos[5].range = visibilityBufferSize;
+
+        //The depth pyramid comes with SetDepthPyramid
+        std::array<VkWriteDescriptorSet, storageBufferBindingCount> writeDescriptorSet{};
+        for (uint32_t i = 0; i < writeDescriptorSet.size(); ++i)
+        {
+            writeDescriptorSet[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSet[i].dstSet = descriptorSets[index];
+            writeDescriptorSet[i].dstBinding = i;
+            writeDescriptorSet[i].dstArrayElement = 0;
+            writeDescriptorSet[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writeDescriptorSet[i].descriptorCount = 1;
+            writeDescriptorSet[i].pBufferInfo = &bufferInfos[i];
+        }
+
+        vkUpdateDescriptorSets(gfxCtx->logicalDevice, static_cast<uint32_t>(writeDescriptorSet.size()),
+            writeDescriptorSet.data(), 0, nullptr);
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+    pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+
+    if (vkCreatePipelineLayout(gfxCtx->logicalDevice, &pipelineLayoutCreateInfo, gfxCtx->allocationCallbacks, &pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating GPU culling pipeline layout!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(pipelineLayout, "gpuCullingPipelineLayout");
+
+    VkPipelineShaderStageCreateInfo shaderStageCreateInfo{};
+    shaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageCreateInfo.module = cullShaderModule;
+    shaderStageCreateInfo.pName = "main";
+
+    VkComputePipelineCreateInfo computePipelineInfo{};
+    computePipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    computePipelineInfo.layout = pipelineLayout;
+    computePipelineInfo.stage = shaderStageCreateInfo;
+
+    if (gfxCtx->pipelineCache->CreateComputePipeline(computePipelineInfo, pipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating GPU culling pipeline!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(pipeline, "gpuCullingPipeline");
+}
+
+void GfxGpuCulling::Cleanup()
+{
+    vkDestroyPipeline(gfxCtx->logicalDevice, pipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, pipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorPool(gfxCtx->logicalDevice, descriptorPool, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, descriptorSetLayout, gfxCtx->allocationCallbacks);
+
+    for (uint32_t i = 0; i < objectBuffers.size(); ++i)
+    {
+        DestroyBuffer_Internal(objectBuffers[i], objectBufferAllocations[i]);
+    }
+    for (uint32_t i = 0; i < indirectBuffers.size(); ++i)
+    {
+        DestroyBuffer_Internal(indirectBuffers[i], indirectBufferAllocations[i]);
+        DestroyBuffer_Internal(countBuffers[i], countBufferAllocations[i]);
+        DestroyBuffer_Internal(constantsBuffers[i], constantsBufferAllocations[i]);
+    }
+    DestroyBuffer_Internal(visibilityBuffer, visibilityBufferAllocation);
+    objectBuffers.clear();
+    indirectBuffers.clear();
+    countBuffers.clear();
+    constantsBuffers.clear();
+}
+
+void GfxGpuCulling::SetScene(const GfxScene* drawnScene)
+{
+    scene = drawnScene;
+    //Every slot uploads on its next BeginFrame
+    objectVersions.assign(framesInFlight, UINT32_MAX);
+}
+
+void GfxGpuCulling::SetDepthPyramid(const GfxDepthPyramid* pyramid)
+{
+    depthPyramid = pyramid;
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView = pyramid->GetView();
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets(descriptorSets.size());
+    for (uint32_t i = 0; i < writeDescriptorSets.size(); ++i)
+    {
+        writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[i].dstSet = descriptorSets[i];
+        writeDescriptorSets[i].dstBinding = 6;
+        writeDescriptorSets[i].dstArrayElement = 0;
+        writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        writeDescriptorSets[i].descriptorCount = 1;
+        writeDescriptorSets[i].pImageInfo = &imageInfo;
+    }
+    vkUpdateDescriptorSets(gfxCtx->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()),
+        writeDescriptorSets.data(), 0, nullptr);
+}
+
+uint32_t GfxGpuCulling::GetMaxDrawCount() const
+{
+    return scene != nullptr ? scene->GetObjectCount() : 0;
+}
+
+void GfxGpuCulling::BeginFrame(uint32_t frameIndex)
+{
+    ++stats.frames;
+
+    //The slot fence was waited, the counts written by its last culling are final
+    for (uint32_t pass = 0; pass < passCount; ++pass)
+    {
+        uint32_t index = frameIndex * passCount + pass;
+        if (countsWritten[index])
+        {
+            const uint32_t* counters = static_cast<const uint32_t*>(countBufferAllocations[index].mappedData);
+            stats.visibleDraws[pass] += counters[GPU_CULLING_DRAW_COUNT];
+            stats.frustumCulled[pass] += counters[GPU_CULLING_FRUSTUM_CULLED];
+            stats.occlusionCulled[pass] += counters[GPU_CULLING_OCCLUSION_CULLED];
+            stats.lastFrameVisible[pass] += counters[GPU_CULLING_LAST_FRAME_VISIBLE];
+            uint32_t objectCount = static_cast<const GfxGpuCullConstants*>(constantsBufferAllocations[index].mappedData)->objectCount;
+            stats.testedObjects[pass] += objectCount;
+            if (occlusionActive[index])
+            {
+                stats.occlusionTestedObjects[pass] += objectCount;
+                ++stats.occlusionFrames[pass];
+            }
+        }
+    }
+
+    //Newly visible objects of the occlusion culled pass, drawn after the pyramid build
+    uint32_t secondPhaseIndex = GetSecondPhaseIndex(frameIndex);
+    uint32_t secondPhasePass = secondPhasePasses[frameIndex];
+    if (secondPhasePass != UINT32_MAX && countsWritten[secondPhaseIndex])
+    {
+        const uint32_t* counters = static_cast<const uint32_t*>(countBufferAllocations[secondPhaseIndex].mappedData);
+        stats.visibleDraws[secondPhasePass] += counters[GPU_CULLING_DRAW_COUNT];
+        stats.secondPhaseDraws[secondPhasePass] += counters[GPU_CULLING_DRAW_COUNT];
+        stats.occlusionCulled[secondPhasePass] += counters[GPU_CULLING_OCCLUSION_CULLED];
+    }
+
+    if (scene != nullptr && (objectVersions[frameIndex] != scene->GetStructureVersion() ||
+        rangesVersions[frameIndex] != gfxCtx->geometryArena->GetRangesVersion()))
+    {
+        UploadObjects(frameIndex);
+    }
+}
+
+void GfxGpuCulling::UploadObjects(uint32_t frameIndex)
+{
+    uint32_t objectCount = scene->GetObjectCount();
+    if (objectCount > maxObjects)
+    {
+        throw std::runtime_error("Error too many objects for GPU culling!");
+    }
+
+    const std::vector<glm::vec3>& localBoundsMin = scene->GetLocalBoundsMin();
+    const std::vector<glm::vec3>& localBoundsMax = scene->GetLocalBoundsMax();
+    const std::vector<uint32_t>& transformIndices = scene->GetTransformIndices();
+    const std::vector<GfxMeshRange>& meshes = scene->GetMeshes();
+    const std::vector<uint32_t>& flags = scene->GetFlags();
+
+    GfxGpuCullObject* cullObjects = static_cast<GfxGpuCullObject*>(objectBufferAllocations[frameIndex].mappedData);
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        glm::vec3 center = (localBoundsMin[i] + localBoundsMax[i]) * 0.5f;
+        float radius = glm::length(localBoundsMax[i] - localBoundsMin[i]) * 0.5f;
+
+        //Hidden objects get an empty range, the shader skips them
+        GfxGpuCullObject cullObject;
+        cullObject.boundingSphere = glm::vec4(center, radius);
+        cullObject.transformIndex = transformIndices[i];
+        cullObject.indexCount = (flags[i] & SCENE_OBJECT_HIDDEN) ? 0 : meshes[i].indices.count;
+        cullObject.firstIndex = meshes[i].indices.offset;
+        cullObject.vertexOffset = static_cast<int32_t>(meshes[i].vertices.offset);
+        cullObjects[i] = cullObject;
+    }
+
+    objectVersions[frameIndex] = scene->GetStructureVersion();
+    rangesVersions[frameIndex] = gfxCtx->geometryArena->GetRangesVersion();
+    ++stats.objectUploads;
+}
+
+void GfxGpuCulling::SetView(uint32_t frameIndex, uint32_t pass, const glm::mat4& viewProjection, bool occlusionCulling)
+{
+    uint32_t index = frameIndex * passCount + pass;
+
+    GfxGpuCullConstants constants{};
+    GfxFrustum frustum = GfxFrustum::FromViewProjection(viewProjection);
+    for (int i = 0; i < 6; ++i)
+    {
+        constants.frustumPlanes[i] = frustum.planes[i];
+    }
+    constants.objectCount = GetMaxDrawCount();
+
+    //The second phase tests against the pyramid built from the first phase depth, drawn with this very view
+    occlusionActive[index] = occlusionCulling && depthPyramid != nullptr;
+    constants.occlusionEnabled = occlusionActive[index] ? 1 : 0;
+    constants.phase = GPU_CULLING_PHASE_FIRST;
+
+    //The slot fence was waited, the previous dispatch reading it is done
+    *static_cast<GfxGpuCullConstants*>(constantsBufferAllocations[index].mappedData) = constants;
+
+    if (occlusionActive[index])
+    {
+        constants.occlusionViewProjection = viewProjection;
+        constants.depthWidth = depthPyramid->GetDepthWidth();
+        constants.depthHeight = depthPyramid->GetDepthHeight();
+        constants.pyramidWidth = depthPyramid->GetWidth();
+        constants.pyramidHeight = depthPyramid->GetHeight();
+        constants.pyramidLevelCount = depthPyramid->GetLevelCount();
+        constants.phase = GPU_CULLING_PHASE_SECOND;
+        *static_cast<GfxGpuCullConstants*>(constantsBufferAllocations[GetSecondPhaseIndex(frameIndex)].mappedData) = constants;
+        secondPhasePasses[frameIndex] = pass;
+    }
+    else if (secondPhasePasses[frameIndex] == pass)
+    {
+        secondPhasePasses[frameIndex] = UINT32_MAX;
+    }
+}
+
+void GfxGpuCulling::RecordCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t pass)
+{
+    RecordDispatch(commandBuffer, frameIndex * passCount + pass);
+}
+
+void GfxGpuCulling::RecordSecondPhaseCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    RecordDispatch(commandBuffer, GetSecondPhaseIndex(frameIndex));
+}
+
+void GfxGpuCulling::RecordDispatch(VkCommandBuffer commandBuffer, uint32_t index)
+{
+    uint32_t objectCount = GetMaxDrawCount();
+    if (objectCount == 0)
+    {
+        return;
+    }
+
+    //Entries past the visible count stay zero, draws with no instances
+    vkCmdFillBuffer(commandBuffer, indirectBuffers[index], 0, static_cast<VkDeviceSize>(objectCount) * sizeof(VkDrawIndexedIndirectCommand), 0);
+    vkCmdFillBuffer(commandBuffer, countBuffers[index], 0, GPU_CULLING_COUNTER_COUNT * sizeof(uint32_t), 0);
+
+    VkMemoryBarrier fillBarrier{};
+    fillBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    fillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    fillBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &fillBarrier, 0, nullptr, 0, nullptr);
+
+    //The object count is baked in the dispatch size, a structure change records the frame again
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[index], 0, nullptr);
+    vkCmdDispatch(commandBuffer, (objectCount + GPU_CULLING_GROUP_SIZE - 1) / GPU_CULLING_GROUP_SIZE, 1, 1);
+
+    countsWritten[index] = true;
+}
+
+void GfxGpuCulling::RecordDrawBarrier(VkCommandBuffer commandBuffer)
+{
+    //The count is also read back on the host once the frame fence signals
+    VkMemoryBarrier drawBarrier{};
+    drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
+
+void GfxGpuCulling::PrintStats(const char* const* passNames)
+{
+    uint64_t frames = std::max<uint64_t>(stats.frames, 1);
+    std::cout << CYAN_TEXT << "GPU culling: " << GetMaxDrawCount() << " objects, " << stats.objectUploads << " object list uploads";
+    for (uint32_t pass = 0; pass < passCount; ++pass)
+    {
+        std::cout << ", " << passNames[pass] << " " << stats.visibleDraws[pass] / frames << " visible";
+    }
+    std::cout << " per frame" << RESET_TEXT << std::endl;
+
+    //Occlusion ratios only over the frames the test ran in
+    for (uint32_t pass = 0; pass < passCount; ++pass)
+    {
+        double tested = static_cast<double>(std::max<uint64_t>(stats.testedObjects[pass], 1));
+        std::cout << CYAN_TEXT << "  " << passNames[pass] << ": " << 100.0 * stats.frustumCulled[pass] / tested << "% frustum culled";
+        if (stats.occlusionFrames[pass] > 0)
+        {
+            double occlusionTested = static_cast<double>(std::max<uint64_t>(stats.occlusionTestedObjects[pass], 1));
+            std::cout << ", " << 100.0 * stats.occlusionCulled[pass] / occlusionTested << "% occlusion culled, "
+                << 100.0 * stats.lastFrameVisible[pass] / occlusionTested << "% drawn from last frame visible set, "
+                << 100.0 * stats.secondPhaseDraws[pass] / occlusionTested << "% uncovered and drawn by the second phase ("
+                << stats.occlusionFrames[pass] << " of " << stats.frames << " frames occlusion tested)";
+        }
+        std::cout << RESET_TEXT << std::endl;
+    }
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GfxMemoryAllocator.h"
+
+class GfxScene;
+class GfxDepthPyramid;
+
+//Threads per group of cullObjects.hlsl
+#define GPU_CULLING_GROUP_SIZE 64
+
+//What the cull shader reads per object, matches CullObject in cullObjects.hlsl
+struct GfxGpuCullObject
+{
+	//Object space center and radius
+	glm::vec4 boundingSphere;
+	uint32_t transformIndex;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+};
+
+//Constants buffer of the cull shader, rewritten every frame so recorded dispatches stay valid when the view moves
+struct GfxGpuCullConstants
+{
+	glm::vec4 frustumPlanes[6];
+	//View projection the depth pyramid was drawn with, the one of this frame
+	glm::mat4 occlusionViewProjection;
+	uint32_t objectCount;
+	//0 tests the frustum only
+	uint32_t occlusionEnabled;
+	uint32_t depthWidth;
+	uint32_t depthHeight;
+	uint32_t pyramidWidth;
+	uint32_t pyramidHeight;
+	uint32_t pyramidLevelCount;
+	//GfxGpuCullingPhase
+	uint32_t phase;
+};
+
+//Occlusion culled passes run the cull shader twice, around the depth pyramid build
+enum GfxGpuCullingPhase : uint32_t
+{
+	//Frustum test only, with occlusion only the objects visible last frame are drawn
+	GPU_CULLING_PHASE_FIRST = 0,
+	//Objects the first phase skipped against the pyramid of its depth, writes the visibility of next frame
+	GPU_CULLING_PHASE_SECOND
+};
+
+//Count buffer entries, the draw count comes first so the buffer is the indirect count as is
+enum GfxGpuCullingCounter : uint32_t
+{
+	GPU_CULLING_DRAW_COUNT = 0,
+	GPU_CULLING_FRUSTUM_CULLED,
+	//Second phase only
+	GPU_CULLING_OCCLUSION_CULLED,
+	//First phase only, drawn untested because they were visible last frame
+	GPU_CULLING_LAST_FRAME_VISIBLE,
+	GPU_CULLING_COUNTER_COUNT
+};
+
+struct GfxGpuCullingStats
+{
+	uint64_t frames = 0;
+	uint64_t objectUploads = 0;
+	//[pass]
+	std::vector<uint64_t> testedObjects;
+	std::vector<uint64_t> visibleDraws;
+	std::vector<uint64_t> frustumCulled;
+	std::vector<uint64_t> occlusionCulled;
+	std::vector<uint64_t> lastFrameVisible;
+	//Drawn by the second phase, uncovered this frame
+	std::vector<uint64_t> secondPhaseDraws;
+	std::vector<uint64_t> occlusionTestedObjects;
+	//Frames of each pass the occlusion test ran in
+	std::vector<uint64_t> occlusionFrames;
+};
+
+//Culls every object against a frustum per pass in a compute shader that writes compacted
+//VkDrawIndexedIndirectCommand entries plus a draw count. firstInstance of each command is the object
+//transform index, the indirect vertex shaders read it back through SV_InstanceID.
+//Unused entries are zero filled so vkCmdDrawIndexedIndirect over maxDrawCount works without the count extension.
+//With a depth pyramid one pass can also drop hidden objects in two phases: the first draws the objects visible last frame,
+//the pyramid is built from that depth, then the second tests the remaining objects against it with the same view and
+//draws the ones that pass in a pass loading the first one attachments. An object uncovered this frame is drawn this frame.
+class GfxGpuCulling
+{
+public:
+	void Init(VkShaderModule cullShaderModule, uint32_t maxObjects, uint32_t framesInFlight, uint32_t passCount);
+	void Cleanup();
+
+	//Objects drawn by the indirect path, uploaded again whenever the scene structure or the geometry arena changes
+	void SetScene(const GfxScene* drawnScene);
+	//Bound to every set, call again with no frame in flight once the pyramid resources were recreated
+	void SetDepthPyramid(const GfxDepthPyramid* pyramid);
+
+	//After the fence of frameIndex has been waited: reads back last counts of that slot and refreshes its object list
+	void BeginFrame(uint32_t frameIndex);
+
+	//Every frame after BeginFrame, for each pass RecordCulling recorded. occlusionCulling splits the pass in two phases,
+	//only one pass may use it since the last frame visibility is shared
+	void SetView(uint32_t frameIndex, uint32_t pass, const glm::mat4& viewProjection, bool occlusionCulling);
+	//Outside of a render pass, before the draws of pass consume the commands
+	void RecordCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t pass);
+	//When occlusion is active, after the depth pyramid was built from the first phase draws of the occlusion culled pass
+	void RecordSecondPhaseCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	//Makes the commands of every culled pass visible to the indirect draws
+	void RecordDrawBarrier(VkCommandBuffer commandBuffer);
+
+	VkBuffer GetIndirectBuffer(uint32_t frameIndex, uint32_t pass) const { return indirectBuffers[frameIndex * passCount + pass]; }
+	VkBuffer GetCountBuffer(uint32_t frameIndex, uint32_t pass) const { return countBuffers[frameIndex * passCount + pass]; }
+	VkBuffer GetSecondPhaseIndirectBuffer(uint32_t frameIndex) const { return indirectBuffers[GetSecondPhaseIndex(frameIndex)]; }
+	VkBuffer GetSecondPhaseCountBuffer(uint32_t frameIndex) const { return countBuffers[GetSecondPhaseIndex(frameIndex)]; }
+	uint32_t GetMaxDrawCount() const;
+	bool IsOcclusionActive(uint32_t frameIndex, uint32_t pass) const { return occlusionActive[frameIndex * passCount + pass]; }
+	void PrintStats(const char* const* passNames);
+
+private:
+	void UploadObjects(uint32_t frameIndex);
+	void RecordDispatch(VkCommandBuffer commandBuffer, uint32_t index);
+	//Second phase sets follow the frameIndex * passCount + pass ones, one per frame slot
+	uint32_t GetSecondPhaseIndex(uint32_t frameIndex) const { return framesInFlight * passCount + frameIndex; }
+
+	const GfxScene* scene = nullptr;
+	const GfxDepthPyramid* depthPyramid = nullptr;
+	uint32_t maxObjects = 0;
+	uint32_t framesInFlight = 0;
+	uint32_t passCount = 0;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	//One per frame slot and pass, then one per frame slot for the second phase
+	std::vector<VkDescriptorSet> descriptorSets;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	std::vector<VkBuffer> objectBuffers;
+	std::vector<GfxAllocation> objectBufferAllocations;
+	//Scene structure version and geometry arena ranges version each frame slot buffer holds
+	std::vector<uint32_t> objectVersions;
+	std::vector<uint32_t> rangesVersions;
+
+	std::vector<VkBuffer> indirectBuffers;
+	std::vector<GfxAllocation> indirectBufferAllocations;
+	//Host visible so the visible count can be read back once the slot fence is waited
+	std::vector<VkBuffer> countBuffers;
+	std::vector<GfxAllocation> countBufferAllocations;
+	std::vector<bool> countsWritten;
+	//Host visible, written by SetView
+	std::vector<VkBuffer> constantsBuffers;
+	std::vector<GfxAllocation> constantsBufferAllocations;
+	std::vector<bool> occlusionActive;
+	//[frame] pass the second phase set culls, UINT32_MAX when occlusion is off
+	std::vector<uint32_t> secondPhasePasses;
+	//One flag per transform index, 1 when the object passed the second phase occlusion test last frame
+	VkBuffer visibilityBuffer = VK_NULL_HANDLE;
+	GfxAllocation visibilityBufferAllocation;
+
+	GfxGpuCullingStats stats;
+};
@@ -0,0 +1,113 @@
+#include "GfxGpuTimer.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "GfxMemoryAllocator.h"
+#include "DebugUtils.h"
+
+#include <vector>
+#include <stdexcept>
+
+void GfxGpuTimer::Init(uint32_t framesInFlight, uint32_t timerCount, uint32_t queueFamilyIndex)
+{
+    this->framesInFlight = framesInFlight;
+    this->timerCount = timerCount;
+    recorded.assign(framesInFlight, false);
+    lastMs.assign(timerCount, 0.0);
+    lastValid.assign(timerCount, false);
+
+    //timestampComputeAndGraphics alone does not guarantee the family of our queue writes timestamps, zero valid bits means it does not
+    const VkPhysicalDeviceLimits& limits = gfxCtx->memoryAllocator->GetLimits();
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gfxCtx->physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(gfxCtx->physicalDevice, &queueFamilyCount, queueFamilies.data());
+    uint32_t timestampValidBits = queueFamilyIndex < queueFamilyCount ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+
+    supported = limits.timestampComputeAndGraphics == VK_TRUE && timestampValidBits > 0;
+    timestampPeriod = static_cast<double>(limits.timestampPeriod);
+    timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+    if (!supported)
+    {
+        return;
+    }
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo{};
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCreateInfo.queryCount = framesInFlight * timerCount * 2;
+
+    if (vkCreateQueryPool(gfxCtx->logicalDevice, &queryPoolCreateInfo, gfxCtx->allocationCallbacks, &queryPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating GPU timer query pool!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(queryPool, "gpuTimerQueryPool");
+}
+
+void GfxGpuTimer::Cleanup()
+{
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(gfxCtx->logicalDevice, queryPool, gfxCtx->allocationCallbacks);
+        queryPool = VK_NULL_HANDLE;
+    }
+}
+
+void GfxGpuTimer::BeginFrame(uint32_t frameIndex)
+{
+    lastValid.assign(timerCount, false);
+    if (!supported || !recorded[frameIndex])
+    {
+        return;
+    }
+
+    std::vector<uint64_t> timestamps(static_cast<size_t>(timerCount) * 2);
+    VkResult result = vkGetQueryPoolResults(gfxCtx->logicalDevice, queryPool, frameIndex * timerCount * 2, timerCount * 2,
+        timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    //Not ready when a timer was not written in that frame
+    if (result != VK_SUCCESS)
+    {
+        return;
+    }
+
+    for (uint32_t timer = 0; timer < timerCount; ++timer)
+    {
+        //Masked so a counter wrapping between the two writes still gives the right difference
+        uint64_t ticks = (timestamps[timer * 2 + 1] - timestamps[timer * 2]) & timestampMask;
+        lastMs[timer] = static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+        lastValid[timer] = true;
+    }
+}
+
+void GfxGpuTimer::RecordReset(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    if (!supported)
+    {
+        return;
+    }
+    vkCmdResetQueryPool(commandBuffer, queryPool, frameIndex * timerCount * 2, timerCount * 2);
+    recorded[frameIndex] = true;
+}
+
+void GfxGpuTimer::RecordStart(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t timer)
+{
+    if (!supported)
+    {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, (frameIndex * timerCount + timer) * 2);
+}
+
+void GfxGpuTimer::RecordEnd(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t timer)
+{
+    if (!supported)
+    {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, (frameIndex * timerCount + timer) * 2 + 1);
+}
+
+bool GfxGpuTimer::GetLastMs(uint32_t timer, double& ms) const
+{
+    ms = lastMs[timer];
+    return lastValid[timer];
+}
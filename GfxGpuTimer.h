@@ -0,0 +1,41 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <vector>
+
+//GPU durations measured with timestamp pairs, one query pool slice per frame in flight. Results of a frame slot
+//are read once its fence was waited, so reading never stalls. Recordings can be submitted again as is.
+class GfxGpuTimer
+{
+public:
+	//queueFamilyIndex is the family of the queue the timestamps are written on
+	void Init(uint32_t framesInFlight, uint32_t timerCount, uint32_t queueFamilyIndex);
+	void Cleanup();
+
+	//False when the graphics queue has no timestamps, every Record call is then a no-op
+	bool IsSupported() const { return supported; }
+
+	//After the fence of frameIndex was waited, reads what its last submission measured
+	void BeginFrame(uint32_t frameIndex);
+	//Outside of a render pass, before the first RecordStart of the frame
+	void RecordReset(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	void RecordStart(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t timer);
+	void RecordEnd(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t timer);
+
+	//Duration read by the last BeginFrame, false when that slot had not measured it yet
+	bool GetLastMs(uint32_t timer, double& ms) const;
+
+private:
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	uint32_t framesInFlight = 1;
+	uint32_t timerCount = 1;
+	bool supported = false;
+	//Nanoseconds per timestamp tick
+	double timestampPeriod = 1.0;
+	//Bits of the timestamps the queue family writes, the rest are undefined
+	uint64_t timestampMask = ~0ull;
+	//[frame], set once something was recorded for the slot
+	std::vector<bool> recorded;
+	std::vector<double> lastMs;
+	std::vector<bool> lastValid;
+};
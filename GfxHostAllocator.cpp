@@ -0,0 +1,332 @@
+#include "GfxHostAllocator.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+//Lives right before every pointer handed to the driver, 32 bytes keep the payload 16 aligned
+struct HostAllocationHeader
+{
+    void* base;
+    size_t size;
+    uint32_t sizeClass;
+    uint32_t scope;
+};
+#define HOST_ALLOCATION_HEADER_SIZE 32
+#define HOST_ALLOCATION_MIN_ALIGNMENT 16
+//Chunk start reserved for the link to the next chunk, keeps the slots 16 aligned
+#define HOST_ALLOCATOR_CHUNK_HEADER 64
+//sizeClass of requests that went straight to the system heap
+#define HOST_ALLOCATOR_SYSTEM_CLASS HOST_ALLOCATOR_CLASS_COUNT
+
+static const char* scopeNames[HOST_ALLOCATION_SCOPE_COUNT] = { "Command", "Object", "Cache", "Device", "Instance" };
+
+static HostAllocationHeader* GetHeader(void* memory)
+{
+    return reinterpret_cast<HostAllocationHeader*>(static_cast<char*>(memory) - HOST_ALLOCATION_HEADER_SIZE);
+}
+
+GfxHostAllocator::GfxHostAllocator()
+{
+    size_t slotSize = HOST_ALLOCATOR_MIN_SLOT;
+    for (SizeClass& sizeClass : sizeClasses)
+    {
+        sizeClass.slotSize = slotSize;
+        slotSize *= 2;
+    }
+
+    callbacks.pUserData = this;
+    callbacks.pfnAllocation = AllocationCallback;
+    callbacks.pfnReallocation = ReallocationCallback;
+    callbacks.pfnFree = FreeCallback;
+    callbacks.pfnInternalAllocation = InternalAllocationCallback;
+    callbacks.pfnInternalFree = InternalFreeCallback;
+}
+
+GfxHostAllocator::~GfxHostAllocator()
+{
+    //Only after the instance is destroyed, no slot is in use anymore
+    while (chunks != nullptr)
+    {
+        void* next = *static_cast<void**>(chunks);
+        free(chunks);
+        chunks = next;
+    }
+}
+
+void* GfxHostAllocator::Allocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    if (size == 0)
+    {
+        return nullptr;
+    }
+
+    //Worst case padding to reach the alignment from a 16 aligned base
+    alignment = std::max<size_t>(alignment, HOST_ALLOCATION_MIN_ALIGNMENT);
+    size_t requiredSize = HOST_ALLOCATION_HEADER_SIZE + size + alignment - HOST_ALLOCATION_MIN_ALIGNMENT;
+
+    uint32_t sizeClassIndex = HOST_ALLOCATOR_SYSTEM_CLASS;
+    for (uint32_t i = 0; i < HOST_ALLOCATOR_CLASS_COUNT; ++i)
+    {
+        if (requiredSize <= sizeClasses[i].slotSize)
+        {
+            sizeClassIndex = i;
+            break;
+        }
+    }
+
+    void* base = sizeClassIndex == HOST_ALLOCATOR_SYSTEM_CLASS ? malloc(requiredSize) : AllocateSlot(sizeClassIndex);
+    if (base == nullptr)
+    {
+        return nullptr;
+    }
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(base) + HOST_ALLOCATION_HEADER_SIZE;
+    address = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    void* memory = reinterpret_cast<void*>(address);
+
+    HostAllocationHeader* header = GetHeader(memory);
+    header->base = base;
+    header->size = size;
+    header->sizeClass = sizeClassIndex;
+    header->scope = static_cast<uint32_t>(scope);
+
+    if (sizeClassIndex == HOST_ALLOCATOR_SYSTEM_CLASS)
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        ++stats.systemAllocations;
+    }
+    return memory;
+}
+
+void* GfxHostAllocator::Reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    HostAllocationHeader* header = GetHeader(original);
+    size_t oldSize = header->size;
+
+    //Still fits its slot with the same alignment, nothing to move
+    uintptr_t address = reinterpret_cast<uintptr_t>(original);
+    alignment = std::max<size_t>(alignment, HOST_ALLOCATION_MIN_ALIGNMENT);
+    if (header->sizeClass != HOST_ALLOCATOR_SYSTEM_CLASS && (address & (alignment - 1)) == 0 &&
+        address + size <= reinterpret_cast<uintptr_t>(header->base) + sizeClasses[header->sizeClass].slotSize)
+    {
+        header->size = size;
+        header->scope = static_cast<uint32_t>(scope);
+        return original;
+    }
+
+    //On failure the original stays valid, as the spec requires
+    void* memory = Allocate(size, alignment, scope);
+    if (memory == nullptr)
+    {
+        return nullptr;
+    }
+    memcpy(memory, original, std::min(oldSize, size));
+    Free(original);
+    return memory;
+}
+
+void GfxHostAllocator::Free(void* memory)
+{
+    HostAllocationHeader* header = GetHeader(memory);
+    if (header->sizeClass == HOST_ALLOCATOR_SYSTEM_CLASS)
+    {
+        free(header->base);
+    }
+    else
+    {
+        FreeSlot(header->sizeClass, header->base);
+    }
+}
+
+void* GfxHostAllocator::AllocateSlot(uint32_t sizeClassIndex)
+{
+    SizeClass& sizeClass = sizeClasses[sizeClassIndex];
+    {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        if (sizeClass.freeList != nullptr)
+        {
+            void* slot = sizeClass.freeList;
+            sizeClass.freeList = *static_cast<void**>(slot);
+
+            std::lock_guard<std::mutex> statsLock(statsMutex);
+            ++stats.poolHits;
+            return slot;
+        }
+    }
+
+    char* chunk = static_cast<char*>(malloc(HOST_ALLOCATOR_CHUNK_SIZE));
+    if (chunk == nullptr)
+    {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(chunkMutex);
+        *reinterpret_cast<void**>(chunk) = chunks;
+        chunks = chunk;
+    }
+
+    //The first slot is returned, the rest go to the free list
+    size_t slotCount = (HOST_ALLOCATOR_CHUNK_SIZE - HOST_ALLOCATOR_CHUNK_HEADER) / sizeClass.slotSize;
+    char* firstSlot = chunk + HOST_ALLOCATOR_CHUNK_HEADER;
+    {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        for (size_t i = slotCount - 1; i > 0; --i)
+        {
+            void* slot = firstSlot + i * sizeClass.slotSize;
+            *static_cast<void**>(slot) = sizeClass.freeList;
+            sizeClass.freeList = slot;
+        }
+    }
+
+    std::lock_guard<std::mutex> statsLock(statsMutex);
+    ++stats.systemAllocations;
+    stats.chunkBytes += HOST_ALLOCATOR_CHUNK_SIZE;
+    return firstSlot;
+}
+
+void GfxHostAllocator::FreeSlot(uint32_t sizeClassIndex, void* slot)
+{
+    SizeClass& sizeClass = sizeClasses[sizeClassIndex];
+    std::lock_guard<std::mutex> lock(sizeClass.mutex);
+    *static_cast<void**>(slot) = sizeClass.freeList;
+    sizeClass.freeList = slot;
+}
+
+void* VKAPI_CALL GfxHostAllocator::AllocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    GfxHostAllocator* allocator = static_cast<GfxHostAllocator*>(userData);
+    void* memory = allocator->Allocate(size, alignment, scope);
+    if (memory != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(allocator->statsMutex);
+        GfxHostScopeStats& scopeStats = allocator->stats.scopes[scope];
+        ++scopeStats.allocations;
+        scopeStats.allocatedBytes += size;
+        scopeStats.liveBytes += size;
+        scopeStats.peakBytes = std::max(scopeStats.peakBytes, scopeStats.liveBytes);
+    }
+    return memory;
+}
+
+void* VKAPI_CALL GfxHostAllocator::ReallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    if (original == nullptr)
+    {
+        return AllocationCallback(userData, size, alignment, scope);
+    }
+    if (size == 0)
+    {
+        FreeCallback(userData, original);
+        return nullptr;
+    }
+
+    GfxHostAllocator* allocator = static_cast<GfxHostAllocator*>(userData);
+    HostAllocationHeader* header = GetHeader(original);
+    size_t oldSize = header->size;
+    uint32_t oldScope = header->scope;
+
+    void* memory = allocator->Reallocate(original, size, alignment, scope);
+    if (memory != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(allocator->statsMutex);
+        allocator->stats.scopes[oldScope].liveBytes -= oldSize;
+        GfxHostScopeStats& scopeStats = allocator->stats.scopes[scope];
+        ++scopeStats.reallocations;
+        scopeStats.allocatedBytes += size;
+        scopeStats.liveBytes += size;
+        scopeStats.peakBytes = std::max(scopeStats.peakBytes, scopeStats.liveBytes);
+    }
+    return memory;
+}
+
+void VKAPI_CALL GfxHostAllocator::FreeCallback(void* userData, void* memory)
+{
+    if (memory == nullptr)
+    {
+        return;
+    }
+
+    GfxHostAllocator* allocator = static_cast<GfxHostAllocator*>(userData);
+    HostAllocationHeader* header = GetHeader(memory);
+    {
+        std::lock_guard<std::mutex> lock(allocator->statsMutex);
+        GfxHostScopeStats& scopeStats = allocator->stats.scopes[header->scope];
+        ++scopeStats.frees;
+        scopeStats.liveBytes -= header->size;
+    }
+    allocator->Free(memory);
+}
+
+void VKAPI_CALL GfxHostAllocator::InternalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+    GfxHostAllocator* allocator = static_cast<GfxHostAllocator*>(userData);
+    std::lock_guard<std::mutex> lock(allocator->statsMutex);
+    ++allocator->stats.scopes[scope].internalAllocations;
+    allocator->stats.scopes[scope].internalBytes += size;
+}
+
+void VKAPI_CALL GfxHostAllocator::InternalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+    GfxHostAllocator* allocator = static_cast<GfxHostAllocator*>(userData);
+    std::lock_guard<std::mutex> lock(allocator->statsMutex);
+    allocator->stats.scopes[scope].internalBytes -= size;
+}
+
+GfxHostAllocatorStats GfxHostAllocator::GetStats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
+
+void GfxHostAllocator::PrintStats(const char* label)
+{
+    GfxHostAllocatorStats current = GetStats();
+
+    std::cout << CYAN_TEXT << "Host allocations " << label << ":" << std::endl;
+    for (uint32_t scope = 0; scope < HOST_ALLOCATION_SCOPE_COUNT; ++scope)
+    {
+        const GfxHostScopeStats& scopeStats = current.scopes[scope];
+        if (scopeStats.allocations == 0 && scopeStats.reallocations == 0 && scopeStats.internalAllocations == 0)
+        {
+            continue;
+        }
+        std::cout << "  " << scopeNames[scope] << ": " << scopeStats.allocations << " allocs, "
+            << scopeStats.reallocations << " reallocs, " << scopeStats.frees << " frees, "
+            << scopeStats.allocatedBytes / 1024 << "KB allocated, " << scopeStats.liveBytes / 1024 << "KB live, "
+            << scopeStats.peakBytes / 1024 << "KB peak";
+        if (scopeStats.internalAllocations > 0)
+        {
+            std::cout << ", " << scopeStats.internalAllocations << " internal (" << scopeStats.internalBytes / 1024 << "KB live)";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "  Pool hits " << current.poolHits << ", system allocations " << current.systemAllocations
+        << ", chunks " << current.chunkBytes / 1024 << "KB" << RESET_TEXT << std::endl;
+}
+
+void GfxHostAllocator::PrintDelta(const char* label, const GfxHostAllocatorStats& before)
+{
+    GfxHostAllocatorStats current = GetStats();
+
+    std::cout << YELLOW_TEXT << "Host allocations during " << label << ":";
+    for (uint32_t scope = 0; scope < HOST_ALLOCATION_SCOPE_COUNT; ++scope)
+    {
+        const GfxHostScopeStats& scopeStats = current.scopes[scope];
+        const GfxHostScopeStats& scopeBefore = before.scopes[scope];
+        uint64_t calls = (scopeStats.allocations - scopeBefore.allocations) + (scopeStats.reallocations - scopeBefore.reallocations)
+            + (scopeStats.frees - scopeBefore.frees);
+        if (calls == 0)
+        {
+            continue;
+        }
+        int64_t liveDelta = static_cast<int64_t>(scopeStats.liveBytes) - static_cast<int64_t>(scopeBefore.liveBytes);
+        std::cout << " " << scopeNames[scope] << " " << calls << " calls "
+            << (scopeStats.allocatedBytes - scopeBefore.allocatedBytes) << "B (live " << (liveDelta >= 0 ? "+" : "") << liveDelta << "B)";
+    }
+    std::cout << ", pool hits " << current.poolHits - before.poolHits
+        << ", system allocations " << current.systemAllocations - before.systemAllocations << RESET_TEXT << std::endl;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <array>
+#include <mutex>
+
+//Slot sizes are powers of two from HOST_ALLOCATOR_MIN_SLOT to HOST_ALLOCATOR_MAX_SLOT, bigger requests go to the system heap
+#define HOST_ALLOCATOR_MIN_SLOT 64
+#define HOST_ALLOCATOR_MAX_SLOT (16u * 1024u)
+#define HOST_ALLOCATOR_CLASS_COUNT 9
+#define HOST_ALLOCATOR_CHUNK_SIZE (256u * 1024u)
+#define HOST_ALLOCATION_SCOPE_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+
+struct GfxHostScopeStats
+{
+	uint64_t allocations = 0;
+	uint64_t reallocations = 0;
+	uint64_t frees = 0;
+	uint64_t allocatedBytes = 0;
+	uint64_t liveBytes = 0;
+	uint64_t peakBytes = 0;
+	//Driver allocations the callbacks never see (executable memory), reported through the notifications
+	uint64_t internalAllocations = 0;
+	uint64_t internalBytes = 0;
+};
+
+struct GfxHostAllocatorStats
+{
+	std::array<GfxHostScopeStats, HOST_ALLOCATION_SCOPE_COUNT> scopes;
+	//Requests served from a free slot versus ones that had to reach the system heap (new chunk or big request)
+	uint64_t poolHits = 0;
+	uint64_t systemAllocations = 0;
+	uint64_t chunkBytes = 0;
+};
+
+//Host memory the driver asks for through VkAllocationCallbacks. Small requests come from per size class
+//free lists refilled in chunks, so the create/destroy churn of pipelines and swapchain objects reuses slots
+//instead of reaching the system heap. Calls and bytes are counted per VkSystemAllocationScope.
+//Thread safe, drivers may call it from any thread that creates objects.
+class GfxHostAllocator
+{
+public:
+	GfxHostAllocator();
+	~GfxHostAllocator();
+
+	//Pass to every vkCreate*/vkAllocate* and matching vkDestroy*/vkFree*
+	const VkAllocationCallbacks* GetCallbacks() const { return &callbacks; }
+
+	GfxHostAllocatorStats GetStats();
+	void PrintStats(const char* label);
+	//What happened since the snapshot, to measure one operation (pipeline creation, swapchain recreation)
+	void PrintDelta(const char* label, const GfxHostAllocatorStats& before);
+
+private:
+	struct SizeClass
+	{
+		std::mutex mutex;
+		void* freeList = nullptr;
+		size_t slotSize = 0;
+	};
+
+	void* Allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void* Reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void Free(void* memory);
+
+	void* AllocateSlot(uint32_t sizeClass);
+	void FreeSlot(uint32_t sizeClass, void* slot);
+
+	static VKAPI_ATTR void* VKAPI_CALL AllocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void* VKAPI_CALL ReallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL FreeCallback(void* userData, void* memory);
+	static VKAPI_ATTR void VKAPI_CALL InternalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL InternalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+	VkAllocationCallbacks callbacks{};
+	std::array<SizeClass, HOST_ALLOCATOR_CLASS_COUNT> sizeClasses;
+
+	//Chunks live until the allocator is destroyed, slots go back to the free lists
+	std::mutex chunkMutex;
+	void* chunks = nullptr;
+
+	std::mutex statsMutex;
+	GfxHostAllocatorStats stats;
+};
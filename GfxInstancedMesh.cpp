@@ -0,0 +1,124 @@
+#include "GfxInstancedMesh.h"
+#include "gfxMaths.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+GfxInstancedMesh::GfxInstancedMesh() = default;
+GfxInstancedMesh::~GfxInstancedMesh() = default;
+
+void GfxInstancedMesh::Init(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t maxInstances,
+    uint32_t framesInFlight, const char* Name)
+{
+    name = Name;
+    this->maxInstances = maxInstances;
+    instances.clear();
+    instances.reserve(maxInstances);
+    batches.clear();
+
+    //Not registered with the residency manager, the shared geometry stays resident
+    mesh = gfxCtx->geometryArena->AllocateMesh(vertices.data(), static_cast<uint32_t>(vertices.size()),
+        indices.data(), static_cast<uint32_t>(indices.size()), Name);
+
+    instanceBuffers.resize(framesInFlight);
+    instanceBufferAllocations.resize(framesInFlight);
+    bufferVersions.assign(framesInFlight, 0);
+    version = 1;
+    batchesVersion = 0;
+
+    std::string bufferName = std::string(Name) + "InstanceBuffer";
+    VkDeviceSize bufferSize = static_cast<VkDeviceSize>(std::max(maxInstances, 1u)) * sizeof(InstanceData);
+    for (uint32_t i = 0; i < framesInFlight; ++i)
+    {
+        std::string frameBufferName = bufferName + std::to_string(i + 1);
+        std::string memoryName = frameBufferName + "Memory";
+        CreateBuffer_Internal(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, GfxMemoryUsage::CPU_TO_GPU,
+            instanceBuffers[i], instanceBufferAllocations[i], frameBufferName.c_str(), memoryName.c_str());
+
+        if (instanceBufferAllocations[i].mappedData == nullptr)
+        {
+            throw std::runtime_error("Error instance buffer is not mapped!");
+        }
+    }
+}
+
+void GfxInstancedMesh::Cleanup()
+{
+    for (uint32_t i = 0; i < instanceBuffers.size(); ++i)
+    {
+        DestroyBuffer_Internal(instanceBuffers[i], instanceBufferAllocations[i]);
+    }
+    instanceBuffers.clear();
+    instanceBufferAllocations.clear();
+
+    gfxCtx->geometryArena->FreeMesh(mesh);
+}
+
+uint32_t GfxInstancedMesh::AddInstance(const glm::mat4& modelMatrix, const glm::vec4& color)
+{
+    if (instances.size() >= maxInstances)
+    {
+        throw std::runtime_error(std::string("Error too many instances in ") + name + "!");
+    }
+
+    InstanceData instance;
+    instance.modelMatrix = modelMatrix;
+    instance.color = color;
+    instances.push_back(instance);
+    ++version;
+
+    return static_cast<uint32_t>(instances.size() - 1);
+}
+
+void GfxInstancedMesh::SetInstance(uint32_t index, const glm::mat4& modelMatrix, const glm::vec4& color)
+{
+    instances[index].modelMatrix = modelMatrix;
+    instances[index].color = color;
+    ++version;
+}
+
+uint32_t GfxInstancedMesh::GetInstanceCount() const
+{
+    return static_cast<uint32_t>(instances.size());
+}
+
+void GfxInstancedMesh::BeginFrame(uint32_t frameIndex)
+{
+    if (batchesVersion != version)
+    {
+        UpdateBatches();
+        batchesVersion = version;
+    }
+
+    //The slot fence was waited, no frame in flight reads this buffer anymore
+    if (bufferVersions[frameIndex] != version)
+    {
+        memcpy(instanceBufferAllocations[frameIndex].mappedData, instances.data(), instances.size() * sizeof(InstanceData));
+        bufferVersions[frameIndex] = version;
+    }
+}
+
+void GfxInstancedMesh::UpdateBatches()
+{
+    uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+    batches.clear();
+
+    for (uint32_t firstInstance = 0; firstInstance < instanceCount; firstInstance += INSTANCED_BATCH_SIZE)
+    {
+        GfxInstanceBatch batch;
+        batch.firstInstance = firstInstance;
+        batch.instanceCount = std::min(instanceCount - firstInstance, static_cast<uint32_t>(INSTANCED_BATCH_SIZE));
+
+        for (uint32_t i = firstInstance; i < firstInstance + batch.instanceCount; ++i)
+        {
+            batch.center += glm::vec3(instances[i].modelMatrix[3]);
+        }
+        batch.center /= static_cast<float>(batch.instanceCount);
+
+        batches.push_back(batch);
+    }
+}
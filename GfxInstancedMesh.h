@@ -0,0 +1,67 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GfxGeometryArena.h"
+#include "GfxMemoryAllocator.h"
+
+struct Vertex;
+struct InstanceData;
+
+//Instances drawn by one vkCmdDrawIndexed, bigger batches sort worse by depth and cull coarser
+#define INSTANCED_BATCH_SIZE 16384
+
+struct GfxInstanceBatch
+{
+	uint32_t firstInstance = 0;
+	uint32_t instanceCount = 0;
+	//Average instance position, used for depth sorting
+	glm::vec3 center = glm::vec3(0.0f);
+};
+
+//One mesh in the geometry arena drawn many times with a per instance transform and color.
+//Instances live in a host visible vertex buffer per frame in flight that is rewritten only when
+//they changed since that frame slot was last used, so every batch is a single instanced draw.
+class GfxInstancedMesh
+{
+public:
+	//Out of line, InstanceData is only complete in the translation unit
+	GfxInstancedMesh();
+	~GfxInstancedMesh();
+
+	void Init(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t maxInstances,
+		uint32_t framesInFlight, const char* Name = "Unknown");
+	void Cleanup();
+
+	//Returns the instance index, throws past maxInstances
+	uint32_t AddInstance(const glm::mat4& modelMatrix, const glm::vec4& color);
+	void SetInstance(uint32_t index, const glm::mat4& modelMatrix, const glm::vec4& color);
+
+	//After the fence of frameIndex has been waited, refreshes the instance buffer of that slot if needed
+	void BeginFrame(uint32_t frameIndex);
+
+	const GfxMeshRange& GetMesh() const { return mesh; }
+	uint32_t GetInstanceCount() const;
+	const std::vector<GfxInstanceBatch>& GetBatches() const { return batches; }
+	//Changes whenever BeginFrame rebuilt the batches
+	uint32_t GetBatchesVersion() const { return batchesVersion; }
+	VkBuffer GetInstanceBuffer(uint32_t frameIndex) const { return instanceBuffers[frameIndex]; }
+	const char* GetName() const { return name; }
+
+private:
+	void UpdateBatches();
+
+	GfxMeshRange mesh;
+	std::vector<InstanceData> instances;
+	std::vector<GfxInstanceBatch> batches;
+	uint32_t maxInstances = 0;
+
+	std::vector<VkBuffer> instanceBuffers;
+	std::vector<GfxAllocation> instanceBufferAllocations;
+	//Instances version each frame slot buffer holds
+	std::vector<uint32_t> bufferVersions;
+	uint32_t version = 0;
+	uint32_t batchesVersion = 0;
+
+	const char* name = "Unknown";
+};
@@ -0,0 +1,105 @@
+#include "GfxJobPool.h"
+
+#include <algorithm>
+
+void GfxJobPool::Init(uint32_t workerCount)
+{
+    this->workerCount = std::max(workerCount, 1u);
+    job = nullptr;
+    generation = 0;
+    busyWorkers = 0;
+    quit = false;
+    workerException = nullptr;
+
+    //Worker 0 is the thread calling Run
+    threads.resize(this->workerCount);
+    for (uint32_t i = 1; i < this->workerCount; ++i)
+    {
+        threads[i] = std::thread(&GfxJobPool::WorkerLoop, this, i);
+    }
+}
+
+void GfxJobPool::Cleanup()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    workAvailable.notify_all();
+
+    for (std::thread& thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+    threads.clear();
+}
+
+void GfxJobPool::Run(const GfxWorkerJob& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        busyWorkers = workerCount - 1;
+        ++generation;
+    }
+    workAvailable.notify_all();
+
+    RunJob(0);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        workDone.wait(lock, [this]() { return busyWorkers == 0; });
+        this->job = nullptr;
+    }
+
+    if (workerException != nullptr)
+    {
+        std::exception_ptr exception = workerException;
+        workerException = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+void GfxJobPool::WorkerLoop(uint32_t workerIndex)
+{
+    uint64_t seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workAvailable.wait(lock, [this, seenGeneration]() { return quit || generation != seenGeneration; });
+            if (quit)
+            {
+                return;
+            }
+            seenGeneration = generation;
+        }
+
+        RunJob(workerIndex);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0)
+        {
+            workDone.notify_one();
+        }
+    }
+}
+
+void GfxJobPool::RunJob(uint32_t workerIndex)
+{
+    try
+    {
+        (*job)(workerIndex);
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (workerException == nullptr)
+        {
+            workerException = std::current_exception();
+        }
+    }
+}
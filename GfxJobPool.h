@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+//Worker threads of the pool the app shares, the calling thread counts as one of them
+#define JOB_POOL_MAX_WORKERS 4
+
+//Runs on every worker of a Run with its index, worker 0 is the thread calling Run
+typedef std::function<void(uint32_t workerIndex)> GfxWorkerJob;
+
+//Fork join pool behind the parallel recording, the software occlusion rasterizer and the scene graph update.
+//Run hands the same job to every worker, each one picks its share by index, and blocks until all of them
+//returned. Only one thread may call Run at a time, users that run one after the other can share a pool.
+class GfxJobPool
+{
+public:
+	//workerCount includes the calling thread, 1 runs everything on it
+	void Init(uint32_t workerCount);
+	void Cleanup();
+
+	//Calls job(i) once for every worker i, the first exception a worker throws is rethrown here
+	void Run(const GfxWorkerJob& job);
+
+	uint32_t GetWorkerCount() const { return workerCount; }
+
+private:
+	void WorkerLoop(uint32_t workerIndex);
+	void RunJob(uint32_t workerIndex);
+
+	std::vector<std::thread> threads;
+	uint32_t workerCount = 1;
+	//Valid while Run waits for the workers
+	const GfxWorkerJob* job = nullptr;
+
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workDone;
+	//Bumped every Run, a worker runs the job once per generation
+	uint64_t generation = 0;
+	uint32_t busyWorkers = 0;
+	bool quit = false;
+	std::exception_ptr workerException;
+};
@@ -0,0 +1,917 @@
+#include "GfxMemoryAllocator.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "DebugUtils.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//Resources of different tiling closer than bufferImageGranularity can't share the same "page"
+static bool IsOnSamePage(VkDeviceSize resourceAOffset, VkDeviceSize resourceASize, VkDeviceSize resourceBOffset, VkDeviceSize pageSize)
+{
+    VkDeviceSize resourceAEndPage = (resourceAOffset + resourceASize - 1) & ~(pageSize - 1);
+    VkDeviceSize resourceBStartPage = resourceBOffset & ~(pageSize - 1);
+    return resourceAEndPage == resourceBStartPage;
+}
+
+static uint32_t CountBits(uint32_t value)
+{
+    uint32_t count = 0;
+    for (; value != 0; value &= value - 1)
+    {
+        ++count;
+    }
+    return count;
+}
+
+static bool HasTilingConflict(GfxResourceTiling tilingA, GfxResourceTiling tilingB)
+{
+    if (tilingA == GfxResourceTiling::FREE || tilingB == GfxResourceTiling::FREE)
+    {
+        return false;
+    }
+    return tilingA != tilingB;
+}
+
+void GfxMemoryAllocator::Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice logicalDevice, bool memoryBudgetSupported)
+{
+    device = logicalDevice;
+    this->physicalDevice = physicalDevice;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    VkPhysicalDeviceProperties physicalDeviceProperties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+    limits = physicalDeviceProperties.limits;
+    bufferImageGranularity = std::max<VkDeviceSize>(limits.bufferImageGranularity, 1);
+
+    if (memoryBudgetSupported)
+    {
+        getMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(instance,
+            "vkGetPhysicalDeviceMemoryProperties2KHR");
+    }
+    this->memoryBudgetSupported = getMemoryProperties2 != nullptr;
+
+    deviceLocalHeapIndex = 0;
+    VkDeviceSize deviceLocalHeapSize = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+    {
+        const VkMemoryHeap& heap = memoryProperties.memoryHeaps[i];
+        if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heap.size > deviceLocalHeapSize)
+        {
+            deviceLocalHeapIndex = i;
+            deviceLocalHeapSize = heap.size;
+        }
+    }
+
+    UpdateBudget();
+}
+
+void GfxMemoryAllocator::Cleanup()
+{
+    GfxMemoryStats stats = GetStats();
+    if (stats.allocationCount > 0)
+    {
+        std::cerr << YELLOW_TEXT << "Memory allocator destroyed with " << stats.allocationCount
+            << " live allocations (" << stats.usedBytes << " bytes)" << RESET_TEXT << std::endl;
+    }
+
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+    {
+        for (GfxMemoryBlock* block : pools[i])
+        {
+            DestroyBlock(block);
+        }
+        pools[i].clear();
+    }
+}
+
+void GfxMemoryAllocator::AllocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags memoryFlags, GfxAllocation& allocation,
+    const char* Name)
+{
+    VkMemoryRequirements bufferMemoryRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &bufferMemoryRequirements);
+
+    uint32_t memoryTypeIndex = FindMemoryTypeIndex(bufferMemoryRequirements.memoryTypeBits, memoryFlags);
+    if (!Allocate(bufferMemoryRequirements, memoryTypeIndex, GfxResourceTiling::LINEAR, false, allocation, Name))
+    {
+        throw std::runtime_error("Error allocating buffer memory!");
+    }
+
+    if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error binding buffer memory!");
+    }
+}
+
+void GfxMemoryAllocator::AllocateBufferMemory(VkBuffer buffer, GfxMemoryUsage memoryUsage, GfxAllocation& allocation,
+    const char* Name)
+{
+    VkMemoryRequirements bufferMemoryRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &bufferMemoryRequirements);
+
+    AllocateForUsage(bufferMemoryRequirements, memoryUsage, GfxResourceTiling::LINEAR, false, allocation, Name);
+
+    if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error binding buffer memory!");
+    }
+}
+
+void GfxMemoryAllocator::AllocateImageMemory(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags memoryFlags,
+    GfxAllocation& allocation, const char* Name, bool forceDedicated)
+{
+    VkMemoryRequirements imageMemoryRequirements;
+    vkGetImageMemoryRequirements(device, image, &imageMemoryRequirements);
+
+    uint32_t memoryTypeIndex = FindMemoryTypeIndex(imageMemoryRequirements.memoryTypeBits, memoryFlags);
+    //Lazily allocated memory is committed per VkDeviceMemory, sharing a block would defeat it
+    bool dedicated = forceDedicated || (memoryFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) ||
+        imageMemoryRequirements.size >= GetPreferredBlockSize(memoryTypeIndex) / DEDICATED_IMAGE_BLOCK_FRACTION;
+
+    GfxResourceTiling resourceTiling = tiling == VK_IMAGE_TILING_OPTIMAL ? GfxResourceTiling::OPTIMAL : GfxResourceTiling::LINEAR;
+    if (!Allocate(imageMemoryRequirements, memoryTypeIndex, resourceTiling, dedicated, allocation, Name))
+    {
+        throw std::runtime_error("Error allocating image memory!");
+    }
+
+    if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error binding image memory!");
+    }
+}
+
+void GfxMemoryAllocator::AllocateImageMemory(VkImage image, VkImageTiling tiling, GfxMemoryUsage memoryUsage,
+    GfxAllocation& allocation, const char* Name)
+{
+    VkMemoryRequirements imageMemoryRequirements;
+    vkGetImageMemoryRequirements(device, image, &imageMemoryRequirements);
+
+    GfxResourceTiling resourceTiling = tiling == VK_IMAGE_TILING_OPTIMAL ? GfxResourceTiling::OPTIMAL : GfxResourceTiling::LINEAR;
+    AllocateForUsage(imageMemoryRequirements, memoryUsage, resourceTiling, true, allocation, Name);
+
+    if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error binding image memory!");
+    }
+}
+
+void GfxMemoryAllocator::AllocateForUsage(const VkMemoryRequirements& memoryRequirements, GfxMemoryUsage memoryUsage,
+    GfxResourceTiling tiling, bool isImage, GfxAllocation& allocation, const char* Name)
+{
+    //A failed vkAllocateMemory marks the heap as full, so the next choice avoids it
+    for (uint32_t attempt = 0; attempt < memoryProperties.memoryHeapCount; ++attempt)
+    {
+        uint32_t memoryTypeIndex = ChooseMemoryTypeIndex(memoryRequirements.memoryTypeBits, memoryUsage, memoryRequirements.size);
+        if (memoryTypeIndex == UINT32_MAX)
+        {
+            break;
+        }
+
+        bool dedicated = isImage &&
+            memoryRequirements.size >= GetPreferredBlockSize(memoryTypeIndex) / DEDICATED_IMAGE_BLOCK_FRACTION;
+        if (Allocate(memoryRequirements, memoryTypeIndex, tiling, dedicated, allocation, Name))
+        {
+            VkMemoryPropertyFlags propertyFlags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+            bool preferredDeviceLocal = memoryUsage == GfxMemoryUsage::GPU_STREAMED || memoryUsage == GfxMemoryUsage::CPU_TO_GPU;
+            if (preferredDeviceLocal && !(propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+            {
+                std::lock_guard<std::mutex> lock(allocatorMutex);
+                ++fallbackCount;
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(allocatorMutex);
+        uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+        heapBudgets[heapIndex].budget = GetHeapBudget_Locked(heapIndex).usage;
+        std::cerr << YELLOW_TEXT << "Heap " << heapIndex << " out of memory allocating " << Name
+            << ", trying another heap" << RESET_TEXT << std::endl;
+    }
+
+    throw std::runtime_error(std::string("Error no memory type left for ") + Name + "!");
+}
+
+uint32_t GfxMemoryAllocator::ChooseMemoryTypeIndex(uint32_t typeFilter, GfxMemoryUsage memoryUsage, VkDeviceSize size)
+{
+    VkMemoryPropertyFlags requiredFlags = 0;
+    VkMemoryPropertyFlags preferredFlags = 0;
+    //Lazily allocated types only make sense for transient attachments, those use the flags path
+    VkMemoryPropertyFlags avoidedFlags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    switch (memoryUsage)
+    {
+    case GfxMemoryUsage::GPU_ONLY:
+        requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        //Leave the small host visible device local heap to CPU_TO_GPU
+        avoidedFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        break;
+    case GfxMemoryUsage::GPU_STREAMED:
+        preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        avoidedFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        break;
+    case GfxMemoryUsage::CPU_TO_GPU:
+        requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        avoidedFlags |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+    case GfxMemoryUsage::CPU_ONLY:
+        requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        avoidedFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        break;
+    case GfxMemoryUsage::GPU_EVICTED:
+        avoidedFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        break;
+    }
+
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    uint32_t bestIndex = UINT32_MAX;
+    uint32_t bestCost = UINT32_MAX;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    {
+        VkMemoryPropertyFlags propertyFlags = memoryProperties.memoryTypes[i].propertyFlags;
+        if (!(typeFilter & (1 << i)) || (propertyFlags & requiredFlags) != requiredFlags)
+        {
+            continue;
+        }
+
+        uint32_t cost = CountBits(preferredFlags & ~propertyFlags) + CountBits(avoidedFlags & propertyFlags);
+        //Going over budget makes the driver page behind our back, a slower heap is better
+        GfxHeapBudget heapBudget = GetHeapBudget_Locked(memoryProperties.memoryTypes[i].heapIndex);
+        if (heapBudget.usage + size > heapBudget.budget)
+        {
+            cost += 4;
+        }
+
+        if (cost < bestCost)
+        {
+            bestIndex = i;
+            bestCost = cost;
+        }
+    }
+
+    return bestIndex;
+}
+
+bool GfxMemoryAllocator::Allocate(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex,
+    GfxResourceTiling tiling, bool dedicated, GfxAllocation& allocation, const char* Name)
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    VkDeviceSize blockSize = GetPreferredBlockSize(memoryTypeIndex);
+
+    allocation = GfxAllocation{};
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.size = memoryRequirements.size;
+
+    if (dedicated || memoryRequirements.size > blockSize)
+    {
+        VkMemoryAllocateInfo allocateMemory{};
+        allocateMemory.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateMemory.allocationSize = memoryRequirements.size;
+        allocateMemory.memoryTypeIndex = memoryTypeIndex;
+
+        if (vkAllocateMemory(device, &allocateMemory, gfxCtx->allocationCallbacks, &allocation.memory) != VK_SUCCESS)
+        {
+            allocation = GfxAllocation{};
+            return false;
+        }
+        if (IsHostVisible(memoryTypeIndex) && vkMapMemory(device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mappedData) != VK_SUCCESS)
+        {
+            vkFreeMemory(device, allocation.memory, gfxCtx->allocationCallbacks);
+            allocation = GfxAllocation{};
+            throw std::runtime_error(std::string("Error mapping dedicated memory of ") + Name + "!");
+        }
+        ++vkAllocateMemoryCalls;
+        AddHeapBytes(memoryTypeIndex, memoryRequirements.size, true);
+
+        DebugUtils::getInstance().SetVulkanObjectName(allocation.memory, Name);
+
+        ++dedicatedCount;
+        dedicatedBytes += memoryRequirements.size;
+        return true;
+    }
+
+    std::vector<GfxMemoryBlock*>& pool = pools[memoryTypeIndex];
+    for (GfxMemoryBlock* block : pool)
+    {
+        if (block->size - block->usedBytes >= memoryRequirements.size &&
+            AllocateFromBlock(block, memoryRequirements.size, memoryRequirements.alignment, tiling, allocation))
+        {
+            return true;
+        }
+    }
+
+    GfxMemoryBlock* newBlock = CreateBlock(memoryTypeIndex, blockSize);
+    if (newBlock == nullptr)
+    {
+        allocation = GfxAllocation{};
+        return false;
+    }
+    pool.push_back(newBlock);
+
+    if (!AllocateFromBlock(newBlock, memoryRequirements.size, memoryRequirements.alignment, tiling, allocation))
+    {
+        throw std::runtime_error("Error sub-allocating from a new memory block!");
+    }
+    return true;
+}
+
+bool GfxMemoryAllocator::AllocateFromBlock(GfxMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment,
+    GfxResourceTiling tiling, GfxAllocation& allocation)
+{
+    std::vector<GfxSubAllocation>& subAllocations = block->subAllocations;
+
+    for (size_t i = 0; i < subAllocations.size(); ++i)
+    {
+        const GfxSubAllocation freeRange = subAllocations[i];
+        if (freeRange.tiling != GfxResourceTiling::FREE || freeRange.size < size)
+        {
+            continue;
+        }
+
+        VkDeviceSize offset = AlignUp(freeRange.offset, alignment);
+
+        //Free ranges are always merged, so neighbours are used allocations
+        if (i > 0)
+        {
+            const GfxSubAllocation& previous = subAllocations[i - 1];
+            if (HasTilingConflict(previous.tiling, tiling) &&
+                IsOnSamePage(previous.offset, previous.size, offset, bufferImageGranularity))
+            {
+                offset = AlignUp(offset, bufferImageGranularity);
+            }
+        }
+
+        VkDeviceSize freeRangeEnd = freeRange.offset + freeRange.size;
+        if (offset + size > freeRangeEnd)
+        {
+            continue;
+        }
+
+        if (i + 1 < subAllocations.size())
+        {
+            const GfxSubAllocation& next = subAllocations[i + 1];
+            if (HasTilingConflict(next.tiling, tiling) &&
+                IsOnSamePage(offset, size, next.offset, bufferImageGranularity))
+            {
+                continue;
+            }
+        }
+
+        //Split the free range in [padding][allocation][remaining]
+        std::vector<GfxSubAllocation> replacement;
+        if (offset > freeRange.offset)
+        {
+            replacement.push_back({ freeRange.offset, offset - freeRange.offset, GfxResourceTiling::FREE });
+        }
+        replacement.push_back({ offset, size, tiling });
+        if (offset + size < freeRangeEnd)
+        {
+            replacement.push_back({ offset + size, freeRangeEnd - (offset + size), GfxResourceTiling::FREE });
+        }
+
+        subAllocations.erase(subAllocations.begin() + i);
+        subAllocations.insert(subAllocations.begin() + i, replacement.begin(), replacement.end());
+
+        ++block->usedCount;
+        block->usedBytes += size;
+
+        allocation.memory = block->memory;
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.memoryTypeIndex = block->memoryTypeIndex;
+        allocation.block = block;
+        allocation.mappedData = block->mappedData ? static_cast<char*>(block->mappedData) + offset : nullptr;
+        return true;
+    }
+
+    return false;
+}
+
+void GfxMemoryAllocator::Free(GfxAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    GfxMemoryBlock* block = allocation.block;
+    if (block == nullptr)
+    {
+        if (allocation.mappedData)
+        {
+            vkUnmapMemory(device, allocation.memory);
+        }
+        vkFreeMemory(device, allocation.memory, gfxCtx->allocationCallbacks);
+        AddHeapBytes(allocation.memoryTypeIndex, allocation.size, false);
+        --dedicatedCount;
+        dedicatedBytes -= allocation.size;
+        allocation = GfxAllocation{};
+        return;
+    }
+
+    std::vector<GfxSubAllocation>& subAllocations = block->subAllocations;
+    auto it = std::lower_bound(subAllocations.begin(), subAllocations.end(), allocation.offset,
+        [](const GfxSubAllocation& subAllocation, VkDeviceSize offset) { return subAllocation.offset < offset; });
+
+    if (it == subAllocations.end() || it->offset != allocation.offset || it->tiling == GfxResourceTiling::FREE)
+    {
+        throw std::runtime_error("Error freeing unknown memory allocation!");
+    }
+
+    it->tiling = GfxResourceTiling::FREE;
+    --block->usedCount;
+    block->usedBytes -= it->size;
+
+    //Merge with next and previous free ranges
+    if (it + 1 != subAllocations.end() && (it + 1)->tiling == GfxResourceTiling::FREE)
+    {
+        it->size += (it + 1)->size;
+        it = subAllocations.erase(it + 1) - 1;
+    }
+    if (it != subAllocations.begin() && (it - 1)->tiling == GfxResourceTiling::FREE)
+    {
+        (it - 1)->size += it->size;
+        subAllocations.erase(it);
+    }
+
+    //Keep one empty block per memory type around to avoid allocation ping-pong
+    std::vector<GfxMemoryBlock*>& pool = pools[block->memoryTypeIndex];
+    if (block->usedCount == 0 && pool.size() > 1)
+    {
+        pool.erase(std::find(pool.begin(), pool.end(), block));
+        DestroyBlock(block);
+    }
+
+    allocation = GfxAllocation{};
+}
+
+bool GfxMemoryAllocator::AllocateForMove(const GfxAllocation& current, const VkMemoryRequirements& memoryRequirements,
+    GfxAllocation& moved)
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    GfxMemoryBlock* sourceBlock = current.block;
+    if (sourceBlock == nullptr)
+    {
+        return false;
+    }
+
+    auto it = std::lower_bound(sourceBlock->subAllocations.begin(), sourceBlock->subAllocations.end(), current.offset,
+        [](const GfxSubAllocation& subAllocation, VkDeviceSize offset) { return subAllocation.offset < offset; });
+    if (it == sourceBlock->subAllocations.end() || it->offset != current.offset || it->tiling == GfxResourceTiling::FREE)
+    {
+        throw std::runtime_error("Error moving unknown memory allocation!");
+    }
+    GfxResourceTiling tiling = it->tiling;
+
+    //Strictly denser targets only, so moves always drain the sparse blocks and never ping-pong
+    std::vector<GfxMemoryBlock*> targets;
+    for (GfxMemoryBlock* block : pools[sourceBlock->memoryTypeIndex])
+    {
+        if (block != sourceBlock && block->usedBytes > sourceBlock->usedBytes &&
+            block->size - block->usedBytes >= memoryRequirements.size)
+        {
+            targets.push_back(block);
+        }
+    }
+    std::sort(targets.begin(), targets.end(),
+        [](const GfxMemoryBlock* a, const GfxMemoryBlock* b) { return a->usedBytes > b->usedBytes; });
+
+    for (GfxMemoryBlock* block : targets)
+    {
+        if (AllocateFromBlock(block, memoryRequirements.size, memoryRequirements.alignment, tiling, moved))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+float GfxMemoryAllocator::GetBlockOccupancy(const GfxAllocation& allocation)
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    if (allocation.block == nullptr)
+    {
+        return 1.0f;
+    }
+    return static_cast<float>(allocation.block->usedBytes) / static_cast<float>(allocation.block->size);
+}
+
+GfxFragmentationStats GfxMemoryAllocator::GetFragmentationStats()
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    GfxFragmentationStats stats{};
+    VkDeviceSize largestFreeRangeSum = 0;
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+    {
+        VkDeviceSize poolUsedBytes = 0;
+        for (GfxMemoryBlock* block : pools[i])
+        {
+            ++stats.blockCount;
+            stats.blockBytes += block->size;
+            stats.usedBytes += block->usedBytes;
+            poolUsedBytes += block->usedBytes;
+
+            VkDeviceSize largestFreeRange = 0;
+            for (const GfxSubAllocation& subAllocation : block->subAllocations)
+            {
+                if (subAllocation.tiling == GfxResourceTiling::FREE)
+                {
+                    ++stats.freeRangeCount;
+                    stats.freeBytes += subAllocation.size;
+                    largestFreeRange = std::max(largestFreeRange, subAllocation.size);
+                }
+            }
+            largestFreeRangeSum += largestFreeRange;
+        }
+
+        if (!pools[i].empty())
+        {
+            VkDeviceSize blockSize = pools[i].front()->size;
+            uint32_t packedBlocks = static_cast<uint32_t>(std::max<VkDeviceSize>((poolUsedBytes + blockSize - 1) / blockSize, 1));
+            stats.reclaimableBlocks += static_cast<uint32_t>(pools[i].size()) - std::min(packedBlocks, static_cast<uint32_t>(pools[i].size()));
+        }
+    }
+
+    if (stats.freeBytes > 0)
+    {
+        stats.fragmentation = 1.0f - static_cast<float>(largestFreeRangeSum) / static_cast<float>(stats.freeBytes);
+    }
+    return stats;
+}
+
+void GfxMemoryAllocator::PrintFragmentation(const char* label)
+{
+    GfxFragmentationStats stats = GetFragmentationStats();
+    float occupancy = stats.blockBytes > 0 ? static_cast<float>(stats.usedBytes) / static_cast<float>(stats.blockBytes) : 1.0f;
+    std::cout << CYAN_TEXT << "Memory fragmentation " << label << ": " << stats.blockCount << " blocks ("
+        << stats.blockBytes / (1024 * 1024) << "MB) " << occupancy * 100.0f << "% used, "
+        << stats.freeRangeCount << " free ranges, fragmentation " << stats.fragmentation * 100.0f << "%, "
+        << stats.reclaimableBlocks << " blocks reclaimable by compaction" << RESET_TEXT << std::endl;
+}
+
+GfxMemoryBlock* GfxMemoryAllocator::CreateBlock(uint32_t memoryTypeIndex, VkDeviceSize blockSize)
+{
+    GfxMemoryBlock* block = new GfxMemoryBlock();
+    block->size = blockSize;
+    block->memoryTypeIndex = memoryTypeIndex;
+
+    VkMemoryAllocateInfo allocateMemory{};
+    allocateMemory.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateMemory.allocationSize = blockSize;
+    allocateMemory.memoryTypeIndex = memoryTypeIndex;
+
+    if (vkAllocateMemory(device, &allocateMemory, gfxCtx->allocationCallbacks, &block->memory) != VK_SUCCESS)
+    {
+        delete block;
+        return nullptr;
+    }
+    if (IsHostVisible(memoryTypeIndex) && vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mappedData) != VK_SUCCESS)
+    {
+        vkFreeMemory(device, block->memory, gfxCtx->allocationCallbacks);
+        delete block;
+        throw std::runtime_error("Error mapping memory block!");
+    }
+    ++vkAllocateMemoryCalls;
+    AddHeapBytes(memoryTypeIndex, blockSize, true);
+
+    block->subAllocations.push_back({ 0, blockSize, GfxResourceTiling::FREE });
+
+    std::string blockName = "MemoryBlockType" + std::to_string(memoryTypeIndex) + "_" + std::to_string(pools[memoryTypeIndex].size());
+    DebugUtils::getInstance().SetVulkanObjectName(block->memory, blockName.c_str());
+
+    return block;
+}
+
+void GfxMemoryAllocator::DestroyBlock(GfxMemoryBlock* block)
+{
+    if (block->mappedData)
+    {
+        vkUnmapMemory(device, block->memory);
+    }
+    vkFreeMemory(device, block->memory, gfxCtx->allocationCallbacks);
+    AddHeapBytes(block->memoryTypeIndex, block->size, false);
+    delete block;
+}
+
+VkDeviceSize GfxMemoryAllocator::GetPreferredBlockSize(uint32_t memoryTypeIndex)
+{
+    //Small heaps (e.g. 256MB host visible device local) would be exhausted by a few 64MB blocks
+    VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+    return std::min<VkDeviceSize>(MEMORY_BLOCK_SIZE, heapSize / 8);
+}
+
+bool GfxMemoryAllocator::IsHostVisible(uint32_t memoryTypeIndex)
+{
+    return (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+void GfxMemoryAllocator::AddHeapBytes(uint32_t memoryTypeIndex, VkDeviceSize size, bool allocated)
+{
+    uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    if (allocated)
+    {
+        heapAllocatedBytes[heapIndex] += size;
+    }
+    else
+    {
+        heapAllocatedBytes[heapIndex] -= size;
+    }
+}
+
+void GfxMemoryAllocator::UpdateBudget()
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT memoryBudgetProperties{};
+    memoryBudgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    if (memoryBudgetSupported)
+    {
+        VkPhysicalDeviceMemoryProperties2KHR memoryProperties2{};
+        memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memoryProperties2.pNext = &memoryBudgetProperties;
+        getMemoryProperties2(physicalDevice, &memoryProperties2);
+    }
+
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+    {
+        GfxHeapBudget& heapBudget = heapBudgets[i];
+        heapBudget.size = memoryProperties.memoryHeaps[i].size;
+        if (memoryBudgetSupported)
+        {
+            //Usage covers the whole process and other apps show up as a smaller budget
+            heapBudget.budget = std::min(memoryBudgetProperties.heapBudget[i], heapBudget.size);
+            heapBudget.usage = memoryBudgetProperties.heapUsage[i];
+        }
+        else
+        {
+            heapBudget.budget = heapBudget.size * MEMORY_HEAP_BUDGET_PERCENT / 100;
+            heapBudget.usage = 0;
+        }
+        heapAllocatedBytesAtUpdate[i] = heapAllocatedBytes[i];
+    }
+}
+
+GfxHeapBudget GfxMemoryAllocator::GetHeapBudget_Locked(uint32_t heapIndex) const
+{
+    GfxHeapBudget heapBudget = heapBudgets[heapIndex];
+    if (memoryBudgetSupported)
+    {
+        //The reported usage is only as fresh as the last UpdateBudget, add what changed since
+        VkDeviceSize usage = heapBudget.usage + heapAllocatedBytes[heapIndex];
+        heapBudget.usage = usage > heapAllocatedBytesAtUpdate[heapIndex] ? usage - heapAllocatedBytesAtUpdate[heapIndex] : 0;
+    }
+    else
+    {
+        heapBudget.usage = heapAllocatedBytes[heapIndex];
+    }
+    return heapBudget;
+}
+
+GfxHeapBudget GfxMemoryAllocator::GetHeapBudget(uint32_t heapIndex)
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    return GetHeapBudget_Locked(heapIndex);
+}
+
+bool GfxMemoryAllocator::IsOverBudget(uint32_t heapIndex, VkDeviceSize extraBytes)
+{
+    GfxHeapBudget heapBudget = GetHeapBudget(heapIndex);
+    return heapBudget.usage + extraBytes > heapBudget.budget;
+}
+
+uint32_t GfxMemoryAllocator::GetHeapIndex(const GfxAllocation& allocation) const
+{
+    return memoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex;
+}
+
+bool GfxMemoryAllocator::IsDeviceLocal(const GfxAllocation& allocation) const
+{
+    return (memoryProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+}
+
+uint32_t GfxMemoryAllocator::FindMemoryTypeIndex(uint32_t typeFilter, VkMemoryPropertyFlags memoryFlags)
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    {
+        if (typeFilter & (1 << i) &&
+            (memoryProperties.memoryTypes[i].propertyFlags & memoryFlags) == memoryFlags)
+        {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Error finding memory type");
+}
+
+bool GfxMemoryAllocator::HasMemoryType(VkMemoryPropertyFlags memoryFlags) const
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    {
+        if ((memoryProperties.memoryTypes[i].propertyFlags & memoryFlags) == memoryFlags)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+VkDeviceSize GfxMemoryAllocator::GetCommittedBytes(const GfxAllocation& allocation) const
+{
+    if (!(memoryProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+    {
+        return allocation.size;
+    }
+
+    VkDeviceSize committedBytes = 0;
+    vkGetDeviceMemoryCommitment(device, allocation.memory, &committedBytes);
+    return committedBytes;
+}
+
+GfxMemoryStats GfxMemoryAllocator::GetStats()
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    GfxMemoryStats stats{};
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+    {
+        for (GfxMemoryBlock* block : pools[i])
+        {
+            ++stats.blockCount;
+            stats.blockBytes += block->size;
+            stats.usedBytes += block->usedBytes;
+            stats.allocationCount += block->usedCount;
+        }
+    }
+    stats.dedicatedCount = dedicatedCount;
+    stats.dedicatedBytes = dedicatedBytes;
+    stats.allocationCount += dedicatedCount;
+    stats.usedBytes += dedicatedBytes;
+    stats.vkAllocateMemoryCalls = vkAllocateMemoryCalls;
+    stats.fallbackCount = fallbackCount;
+
+    return stats;
+}
+
+void GfxMemoryAllocator::PrintStats()
+{
+    GfxMemoryStats stats = GetStats();
+    std::cout << CYAN_TEXT << "Memory allocator: " << stats.allocationCount << " allocations in "
+        << stats.blockCount << " blocks (" << stats.blockBytes / (1024 * 1024) << "MB) + "
+        << stats.dedicatedCount << " dedicated (" << stats.dedicatedBytes / (1024 * 1024) << "MB), "
+        << stats.usedBytes / 1024 << "KB used, " << stats.vkAllocateMemoryCalls << " vkAllocateMemory calls, "
+        << stats.fallbackCount << " heap fallbacks" << RESET_TEXT << std::endl;
+}
+
+void GfxMemoryAllocator::PrintBudget()
+{
+    std::cout << CYAN_TEXT << "Memory heaps (" << (memoryBudgetSupported ? "VK_EXT_memory_budget" : "estimated budget") << ")\n";
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+    {
+        GfxHeapBudget heapBudget = GetHeapBudget(i);
+        std::cout << '\t' << "Heap " << i << ((memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " device local" : " host")
+            << ": " << heapBudget.usage / (1024 * 1024) << "/" << heapBudget.budget / (1024 * 1024)
+            << "MB budget, " << heapBudget.size / (1024 * 1024) << "MB size\n";
+    }
+    std::cout << RESET_TEXT << std::flush;
+}
+
+struct BenchmarkBuffer
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    GfxAllocation allocation;
+    VkDeviceMemory directMemory = VK_NULL_HANDLE;
+};
+
+//Creates and destroys random sized buffers, once through the allocator and once with a vkAllocateMemory per buffer
+void RunMemoryAllocatorStressBenchmark()
+{
+    const uint32_t iterations = 20000;
+    const VkBufferUsageFlags usages[] = { VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+
+    GfxMemoryAllocator* allocator = gfxCtx->memoryAllocator;
+    //Direct path has to stay under maxMemoryAllocationCount (4096 on most drivers)
+    const uint32_t maxLiveBuffers = std::min<uint32_t>(2048, allocator->GetLimits().maxMemoryAllocationCount / 2);
+
+    for (int useAllocator = 1; useAllocator >= 0; --useAllocator)
+    {
+        std::mt19937 rndEngine(1234);
+        std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+        std::vector<BenchmarkBuffer> liveBuffers;
+        liveBuffers.reserve(maxLiveBuffers);
+
+        GfxMemoryStats startStats = allocator->GetStats();
+        uint32_t directAllocateCalls = 0;
+        uint32_t peakBlocks = 0;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            bool create = liveBuffers.empty() || (liveBuffers.size() < maxLiveBuffers && rndDist(rndEngine) < 0.6f);
+            if (create)
+            {
+                //Log distributed sizes between 256B and 1MB
+                VkDeviceSize size = static_cast<VkDeviceSize>(256.0f * std::pow(4096.0f, rndDist(rndEngine)));
+                VkMemoryPropertyFlags memoryFlags = rndDist(rndEngine) < 0.8f ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT :
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+                VkBufferCreateInfo createBuffer{};
+                createBuffer.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                createBuffer.size = size;
+                createBuffer.usage = usages[i % 4];
+                createBuffer.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+                BenchmarkBuffer benchmarkBuffer;
+                vkCreateBuffer(gfxCtx->logicalDevice, &createBuffer, gfxCtx->allocationCallbacks, &benchmarkBuffer.buffer);
+
+                if (useAllocator)
+                {
+                    allocator->AllocateBufferMemory(benchmarkBuffer.buffer, memoryFlags, benchmarkBuffer.allocation, "BenchmarkBuffer");
+                }
+                else
+                {
+                    VkMemoryRequirements bufferMemoryRequirements;
+                    vkGetBufferMemoryRequirements(gfxCtx->logicalDevice, benchmarkBuffer.buffer, &bufferMemoryRequirements);
+
+                    VkMemoryAllocateInfo allocateMemory{};
+                    allocateMemory.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+                    allocateMemory.allocationSize = bufferMemoryRequirements.size;
+                    allocateMemory.memoryTypeIndex = FindMemoryType_Internal(bufferMemoryRequirements.memoryTypeBits, memoryFlags);
+                    vkAllocateMemory(gfxCtx->logicalDevice, &allocateMemory, gfxCtx->allocationCallbacks, &benchmarkBuffer.directMemory);
+                    vkBindBufferMemory(gfxCtx->logicalDevice, benchmarkBuffer.buffer, benchmarkBuffer.directMemory, 0);
+                    ++directAllocateCalls;
+                }
+                liveBuffers.push_back(benchmarkBuffer);
+            }
+            else
+            {
+                size_t index = std::uniform_int_distribution<size_t>(0, liveBuffers.size() - 1)(rndEngine);
+                BenchmarkBuffer& benchmarkBuffer = liveBuffers[index];
+                vkDestroyBuffer(gfxCtx->logicalDevice, benchmarkBuffer.buffer, gfxCtx->allocationCallbacks);
+                if (useAllocator)
+                {
+                    allocator->Free(benchmarkBuffer.allocation);
+                }
+                else
+                {
+                    vkFreeMemory(gfxCtx->logicalDevice, benchmarkBuffer.directMemory, gfxCtx->allocationCallbacks);
+                }
+                liveBuffers[index] = liveBuffers.back();
+                liveBuffers.pop_back();
+            }
+
+            if (useAllocator && (i & 255) == 0)
+            {
+                peakBlocks = std::max(peakBlocks, allocator->GetStats().blockCount);
+            }
+        }
+
+        for (BenchmarkBuffer& benchmarkBuffer : liveBuffers)
+        {
+            vkDestroyBuffer(gfxCtx->logicalDevice, benchmarkBuffer.buffer, gfxCtx->allocationCallbacks);
+            if (useAllocator)
+            {
+                allocator->Free(benchmarkBuffer.allocation);
+            }
+            else
+            {
+                vkFreeMemory(gfxCtx->logicalDevice, benchmarkBuffer.directMemory, gfxCtx->allocationCallbacks);
+            }
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        float elapsedMs = std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count();
+
+        uint32_t allocateCalls = useAllocator ?
+            allocator->GetStats().vkAllocateMemoryCalls - startStats.vkAllocateMemoryCalls : directAllocateCalls;
+
+        std::cout << MAGENTA_TEXT << (useAllocator ? "[Sub-allocator] " : "[vkAllocateMemory per buffer] ")
+            << iterations << " create/destroy ops in " << elapsedMs << "ms ("
+            << (elapsedMs * 1000.0f) / iterations << "us/op), "
+            << allocateCalls << " vkAllocateMemory calls";
+        if (useAllocator)
+        {
+            std::cout << ", peak " << peakBlocks << " blocks";
+        }
+        std::cout << RESET_TEXT << std::endl;
+    }
+
+    allocator->PrintStats();
+}
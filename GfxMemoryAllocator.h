@@ -0,0 +1,187 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <mutex>
+
+//Default size of the VkDeviceMemory blocks each memory type pool sub-allocates from
+#define MEMORY_BLOCK_SIZE (64ull * 1024ull * 1024ull)
+//Images bigger than this fraction of a block get their own VkDeviceMemory
+#define DEDICATED_IMAGE_BLOCK_FRACTION 2
+
+//Memory budget the allocator aims for on heaps VK_EXT_memory_budget can't report on
+#define MEMORY_HEAP_BUDGET_PERCENT 80
+
+//What the resource is used for, the allocator picks the memory type and falls back when a heap is over budget
+enum class GfxMemoryUsage
+{
+	GPU_ONLY = 0,	//Render targets and GPU written buffers, always device local
+	GPU_STREAMED,	//Textures and meshes, device local while the heap has budget, host memory otherwise
+	CPU_TO_GPU,		//Rewritten every frame, device local host visible (ReBAR/UMA) when there is some
+	CPU_ONLY,		//Staging, host visible outside the device local heap
+	GPU_EVICTED		//Streamed resources pushed out of device local memory
+};
+
+enum class GfxResourceTiling
+{
+	FREE = 0,
+	LINEAR,		//Buffers and linear images
+	OPTIMAL		//Optimal tiling images
+};
+
+struct GfxMemoryBlock;
+
+struct GfxAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint32_t memoryTypeIndex = 0;
+	//Persistently mapped pointer (already offset), nullptr if memory is not host visible
+	void* mappedData = nullptr;
+	//nullptr for dedicated allocations
+	GfxMemoryBlock* block = nullptr;
+};
+
+struct GfxSubAllocation
+{
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	GfxResourceTiling tiling;
+};
+
+struct GfxMemoryBlock
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	uint32_t memoryTypeIndex = 0;
+	void* mappedData = nullptr;
+	//Sorted by offset, adjacent free ranges are always merged
+	std::vector<GfxSubAllocation> subAllocations;
+	uint32_t usedCount = 0;
+	VkDeviceSize usedBytes = 0;
+};
+
+struct GfxHeapBudget
+{
+	VkDeviceSize size = 0;
+	//Reported by VK_EXT_memory_budget when enabled, otherwise a percent of the heap and what this allocator owns
+	VkDeviceSize budget = 0;
+	VkDeviceSize usage = 0;
+};
+
+struct GfxMemoryStats
+{
+	uint32_t blockCount = 0;
+	uint32_t dedicatedCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t vkAllocateMemoryCalls = 0;
+	VkDeviceSize blockBytes = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	//GPU_STREAMED/CPU_TO_GPU allocations that did not get their preferred heap
+	uint32_t fallbackCount = 0;
+};
+
+struct GfxFragmentationStats
+{
+	uint32_t blockCount = 0;
+	VkDeviceSize blockBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize freeBytes = 0;
+	uint32_t freeRangeCount = 0;
+	//Blocks that would be released if every live allocation was packed
+	uint32_t reclaimableBlocks = 0;
+	//1 - (sum of each block largest free range) / free bytes, 0 when every block has its free space in one piece
+	float fragmentation = 0.0f;
+};
+
+class GfxMemoryAllocator
+{
+public:
+	//memoryBudgetSupported: VK_EXT_memory_budget is enabled on the device (needs VK_KHR_get_physical_device_properties2)
+	void Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice logicalDevice, bool memoryBudgetSupported);
+	void Cleanup();
+
+	void AllocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags memoryFlags, GfxAllocation& allocation,
+		const char* Name = "Unknown");
+	void AllocateBufferMemory(VkBuffer buffer, GfxMemoryUsage memoryUsage, GfxAllocation& allocation,
+		const char* Name = "Unknown");
+	void AllocateImageMemory(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags memoryFlags, GfxAllocation& allocation,
+		const char* Name = "Unknown", bool forceDedicated = false);
+	void AllocateImageMemory(VkImage image, VkImageTiling tiling, GfxMemoryUsage memoryUsage, GfxAllocation& allocation,
+		const char* Name = "Unknown");
+	void Free(GfxAllocation& allocation);
+
+	//Places a copy of a block allocation in a denser block of the same memory type, nothing is bound.
+	//False for dedicated allocations or when no denser block has room
+	bool AllocateForMove(const GfxAllocation& current, const VkMemoryRequirements& memoryRequirements, GfxAllocation& moved);
+	//usedBytes / size of the block holding the allocation, 1 for dedicated allocations
+	float GetBlockOccupancy(const GfxAllocation& allocation);
+	GfxFragmentationStats GetFragmentationStats();
+	void PrintFragmentation(const char* label);
+
+	//Queries VK_EXT_memory_budget again, once per frame is enough
+	void UpdateBudget();
+	GfxHeapBudget GetHeapBudget(uint32_t heapIndex);
+	bool IsOverBudget(uint32_t heapIndex, VkDeviceSize extraBytes = 0);
+	//Biggest device local heap, the one streamed resources compete for
+	uint32_t GetDeviceLocalHeapIndex() const { return deviceLocalHeapIndex; }
+	uint32_t GetHeapIndex(const GfxAllocation& allocation) const;
+	bool IsDeviceLocal(const GfxAllocation& allocation) const;
+
+	//First memory type with all the flags, uses the cached device properties
+	uint32_t FindMemoryTypeIndex(uint32_t typeFilter, VkMemoryPropertyFlags memoryFlags);
+
+	GfxMemoryStats GetStats();
+	void PrintStats();
+	void PrintBudget();
+
+	//True if some memory type has all the flags, e.g. VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT on tiled GPUs
+	bool HasMemoryType(VkMemoryPropertyFlags memoryFlags) const;
+	//Bytes actually backed by the device, only meaningful for lazily allocated memory
+	VkDeviceSize GetCommittedBytes(const GfxAllocation& allocation) const;
+
+	const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const { return memoryProperties; }
+	const VkPhysicalDeviceLimits& GetLimits() const { return limits; }
+
+private:
+	//False if vkAllocateMemory failed, the heap is then treated as full
+	bool Allocate(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex,
+		GfxResourceTiling tiling, bool dedicated, GfxAllocation& allocation, const char* Name);
+	void AllocateForUsage(const VkMemoryRequirements& memoryRequirements, GfxMemoryUsage memoryUsage,
+		GfxResourceTiling tiling, bool isImage, GfxAllocation& allocation, const char* Name);
+	//Lowest cost memory type for the usage, UINT32_MAX if none fits
+	uint32_t ChooseMemoryTypeIndex(uint32_t typeFilter, GfxMemoryUsage memoryUsage, VkDeviceSize size);
+	void AddHeapBytes(uint32_t memoryTypeIndex, VkDeviceSize size, bool allocated);
+	GfxHeapBudget GetHeapBudget_Locked(uint32_t heapIndex) const;
+	bool AllocateFromBlock(GfxMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment,
+		GfxResourceTiling tiling, GfxAllocation& allocation);
+	GfxMemoryBlock* CreateBlock(uint32_t memoryTypeIndex, VkDeviceSize blockSize);
+	void DestroyBlock(GfxMemoryBlock* block);
+	VkDeviceSize GetPreferredBlockSize(uint32_t memoryTypeIndex);
+	bool IsHostVisible(uint32_t memoryTypeIndex);
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr;
+	bool memoryBudgetSupported = false;
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkPhysicalDeviceLimits limits{};
+	VkDeviceSize bufferImageGranularity = 1;
+
+	std::vector<GfxMemoryBlock*> pools[VK_MAX_MEMORY_TYPES];
+	uint32_t dedicatedCount = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	uint32_t vkAllocateMemoryCalls = 0;
+	uint32_t fallbackCount = 0;
+
+	uint32_t deviceLocalHeapIndex = 0;
+	//Bytes of VkDeviceMemory this allocator owns per heap, now and when the budget was last queried
+	VkDeviceSize heapAllocatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+	VkDeviceSize heapAllocatedBytesAtUpdate[VK_MAX_MEMORY_HEAPS] = {};
+	GfxHeapBudget heapBudgets[VK_MAX_MEMORY_HEAPS];
+
+	std::mutex allocatorMutex;
+};
+
+void RunMemoryAllocatorStressBenchmark();
@@ -0,0 +1,194 @@
+#include "GfxParallelRecorder.h"
+#include "GfxJobPool.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+void GfxParallelRecorder::Init(GfxJobPool* jobPool, uint32_t framesInFlight, uint32_t passCount, uint32_t queueFamilyIndex)
+{
+    this->jobPool = jobPool;
+    workerCount = jobPool->GetWorkerCount();
+    this->framesInFlight = framesInFlight;
+    this->passCount = passCount;
+    currentFrame = 0;
+    stats = GfxParallelRecordingStats();
+    passCommandBuffers.assign(passCount, std::vector<VkCommandBuffer>());
+
+    workers.resize(workerCount);
+    for (Worker& worker : workers)
+    {
+        //Transient, everything in it is recorded once and reset with the whole pool
+        VkCommandPoolCreateInfo commandPoolCreateInfo{};
+        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+        worker.commandPools.resize(framesInFlight);
+        worker.commandBuffers.resize(static_cast<size_t>(framesInFlight) * passCount);
+        for (uint32_t frame = 0; frame < framesInFlight; ++frame)
+        {
+            if (vkCreateCommandPool(gfxCtx->logicalDevice, &commandPoolCreateInfo, gfxCtx->allocationCallbacks, &worker.commandPools[frame]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Error creating recording worker command pool!");
+            }
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandPool = worker.commandPools[frame];
+            allocInfo.commandBufferCount = passCount;
+
+            if (vkAllocateCommandBuffers(gfxCtx->logicalDevice, &allocInfo, &worker.commandBuffers[static_cast<size_t>(frame) * passCount]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Error allocating recording worker command buffers!");
+            }
+        }
+    }
+}
+
+void GfxParallelRecorder::Cleanup()
+{
+    for (Worker& worker : workers)
+    {
+        //Frees the secondary buffers allocated from them
+        for (VkCommandPool commandPool : worker.commandPools)
+        {
+            vkDestroyCommandPool(gfxCtx->logicalDevice, commandPool, gfxCtx->allocationCallbacks);
+        }
+    }
+    workers.clear();
+    passCommandBuffers.clear();
+    jobPool = nullptr;
+}
+
+void GfxParallelRecorder::BeginFrame(uint32_t frameIndex)
+{
+    currentFrame = frameIndex;
+    for (Worker& worker : workers)
+    {
+        vkResetCommandPool(gfxCtx->logicalDevice, worker.commandPools[frameIndex], 0);
+    }
+    for (std::vector<VkCommandBuffer>& commandBuffers : passCommandBuffers)
+    {
+        commandBuffers.clear();
+    }
+}
+
+void GfxParallelRecorder::RecordPass(uint32_t pass, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t drawCount, const GfxDrawRangeRecorder& recorder,
+    const VkCommandBuffer* workerCommandBuffers)
+{
+    uint32_t usedWorkers = std::min(workerCount, std::max(drawCount / PARALLEL_RECORDING_MIN_DRAWS_PER_WORKER, 1u));
+    uint32_t drawsPerWorker = (drawCount + usedWorkers - 1) / usedWorkers;
+
+    for (uint32_t i = 0; i < usedWorkers; ++i)
+    {
+        Task task;
+        task.begin = i * drawsPerWorker;
+        task.end = std::min(task.begin + drawsPerWorker, drawCount);
+        if (task.begin >= task.end)
+        {
+            break;
+        }
+        task.renderPass = renderPass;
+        task.framebuffer = framebuffer;
+        if (workerCommandBuffers != nullptr)
+        {
+            //Submitted again as long as the primary running it is cached
+            task.commandBuffer = workerCommandBuffers[i];
+            task.usageFlags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        }
+        else
+        {
+            task.commandBuffer = workers[i].commandBuffers[static_cast<size_t>(currentFrame) * passCount + pass];
+            task.usageFlags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        }
+        task.recorder = recorder;
+
+        workers[i].tasks.push_back(task);
+        passCommandBuffers[pass].push_back(task.commandBuffer);
+    }
+}
+
+void GfxParallelRecorder::Wait()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    //Each worker only records buffers of its own pools
+    try
+    {
+        jobPool->Run([this](uint32_t workerIndex)
+        {
+            for (const Task& task : workers[workerIndex].tasks)
+            {
+                RecordTask(task);
+            }
+        });
+    }
+    catch (...)
+    {
+        for (Worker& worker : workers)
+        {
+            worker.tasks.clear();
+        }
+        throw;
+    }
+
+    for (Worker& worker : workers)
+    {
+        worker.tasks.clear();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    ++stats.recordings;
+    stats.recordingMs += std::chrono::duration<double, std::milli>(end - start).count();
+    for (const std::vector<VkCommandBuffer>& commandBuffers : passCommandBuffers)
+    {
+        stats.secondaryBuffers += commandBuffers.size();
+    }
+}
+
+void GfxParallelRecorder::ExecutePass(VkCommandBuffer primaryCommandBuffer, uint32_t pass)
+{
+    const std::vector<VkCommandBuffer>& commandBuffers = passCommandBuffers[pass];
+    if (!commandBuffers.empty())
+    {
+        vkCmdExecuteCommands(primaryCommandBuffer, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    }
+}
+
+void GfxParallelRecorder::RecordTask(const Task& task)
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = task.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = task.framebuffer;
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo{};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = task.usageFlags;
+    commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if (vkBeginCommandBuffer(task.commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error beginning secondary command buffer!");
+    }
+
+    task.recorder(task.commandBuffer, task.begin, task.end);
+
+    if (vkEndCommandBuffer(task.commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error recording secondary command buffer!");
+    }
+}
+
+void GfxParallelRecorder::PrintStats()
+{
+    double averageMs = stats.recordings > 0 ? stats.recordingMs / stats.recordings : 0.0;
+    std::cout << CYAN_TEXT << "Parallel recording: " << workerCount << " workers, " << stats.recordings << " frames, "
+        << averageMs << "ms average, " << stats.secondaryBuffers << " secondary buffers" << RESET_TEXT << std::endl;
+}
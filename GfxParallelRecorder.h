@@ -0,0 +1,83 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+class GfxJobPool;
+
+//Below this many draws per worker the split costs more than it saves
+#define PARALLEL_RECORDING_MIN_DRAWS_PER_WORKER 64
+
+//Records draws [begin, end) of a pass into a secondary command buffer that already continues its render pass.
+//Runs on worker threads: only vkCmd* on commandBuffer and reads of data nobody writes while recording.
+typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end)> GfxDrawRangeRecorder;
+
+struct GfxParallelRecordingStats
+{
+	uint64_t recordings = 0;
+	uint64_t secondaryBuffers = 0;
+	double recordingMs = 0.0;
+};
+
+//Splits the draw lists of render passes across the workers of a GfxJobPool. Every worker owns a command pool
+//per frame in flight, reset as a whole when that frame slot begins again, and records one secondary
+//command buffer per pass. The primary buffer begins the pass with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+//and runs them in order with ExecutePass.
+class GfxParallelRecorder
+{
+public:
+	//Records with every worker of jobPool, a pool of 1 records everything on the calling thread
+	void Init(GfxJobPool* jobPool, uint32_t framesInFlight, uint32_t passCount, uint32_t queueFamilyIndex);
+	void Cleanup();
+
+	//After the fence of frameIndex has been waited, frees everything its secondary buffers held
+	void BeginFrame(uint32_t frameIndex);
+	//Queues the recording of drawCount draws for pass split in one range per worker, nothing is recorded yet.
+	//workerCommandBuffers, one per worker and each from a pool only that worker records into, replaces the buffers of the
+	//per frame pools so a primary kept across frames can run them again
+	void RecordPass(uint32_t pass, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t drawCount, const GfxDrawRangeRecorder& recorder,
+		const VkCommandBuffer* workerCommandBuffers = nullptr);
+	//Runs the queued ranges on the job pool and blocks until every queued pass is recorded
+	void Wait();
+	//Inside the render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+	void ExecutePass(VkCommandBuffer primaryCommandBuffer, uint32_t pass);
+
+	uint32_t GetWorkerCount() const { return workerCount; }
+	const GfxParallelRecordingStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	struct Task
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		VkCommandBufferUsageFlags usageFlags = 0;
+		uint32_t begin = 0;
+		uint32_t end = 0;
+		GfxDrawRangeRecorder recorder;
+	};
+
+	struct Worker
+	{
+		//[frame], the pool is only used by the thread of this worker
+		std::vector<VkCommandPool> commandPools;
+		//[frame * passCount + pass]
+		std::vector<VkCommandBuffer> commandBuffers;
+		std::vector<Task> tasks;
+	};
+
+	static void RecordTask(const Task& task);
+
+	GfxJobPool* jobPool = nullptr;
+	std::vector<Worker> workers;
+	uint32_t workerCount = 1;
+	uint32_t framesInFlight = 1;
+	uint32_t passCount = 1;
+	uint32_t currentFrame = 0;
+	//[pass], the secondary buffers recorded this frame
+	std::vector<std::vector<VkCommandBuffer>> passCommandBuffers;
+
+	GfxParallelRecordingStats stats;
+};
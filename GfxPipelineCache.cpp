@@ -0,0 +1,263 @@
+#include "GfxPipelineCache.h"
+#include "GfxCommandBufferCache.h"
+#include "DebugUtils.h"
+#include "MainDefines.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+
+//Layout every driver puts at the start of vkGetPipelineCacheData, VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+#define PIPELINE_CACHE_DRIVER_HEADER_SIZE (16u + VK_UUID_SIZE)
+
+static uint64_t HashData(const std::vector<uint8_t>& data)
+{
+    GfxRecordingHash hash;
+    hash.Add(data.data(), data.size());
+    return hash.value;
+}
+
+void GfxPipelineCache::Init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, const VkAllocationCallbacks* allocationCallbacks, const char* Path)
+{
+    this->logicalDevice = logicalDevice;
+    this->allocationCallbacks = allocationCallbacks;
+    path = Path;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+#if PIPELINE_CACHE
+    std::vector<uint8_t> data;
+    Load(data);
+
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
+    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.initialDataSize = data.size();
+    pipelineCacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    VkResult result = vkCreatePipelineCache(logicalDevice, &pipelineCacheCreateInfo, allocationCallbacks, &pipelineCache);
+    if (result != VK_SUCCESS && !data.empty())
+    {
+        std::cout << YELLOW_TEXT << "Pipeline cache: driver refused " << path << ", starting cold" << RESET_TEXT << std::endl;
+        warm = false;
+        pipelineCacheCreateInfo.initialDataSize = 0;
+        pipelineCacheCreateInfo.pInitialData = nullptr;
+        result = vkCreatePipelineCache(logicalDevice, &pipelineCacheCreateInfo, allocationCallbacks, &pipelineCache);
+    }
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating pipeline cache!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(pipelineCache, "enginePipelineCache");
+#endif//#if PIPELINE_CACHE
+}
+
+void GfxPipelineCache::Cleanup()
+{
+    if (pipelineCache == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    Save();
+    vkDestroyPipelineCache(logicalDevice, pipelineCache, allocationCallbacks);
+    pipelineCache = VK_NULL_HANDLE;
+}
+
+void GfxPipelineCache::Load(std::vector<uint8_t>& data)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    data.clear();
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        std::cout << CYAN_TEXT << "Pipeline cache: no " << path << " yet, starting cold" << RESET_TEXT << std::endl;
+        return;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    FileHeader header{};
+    const char* rejection = nullptr;
+    if (fileSize < sizeof(FileHeader) || !file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader)))
+    {
+        rejection = "file too small";
+    }
+    else if (header.magic != PIPELINE_CACHE_FILE_MAGIC || header.version != PIPELINE_CACHE_FILE_VERSION)
+    {
+        rejection = "unknown file format";
+    }
+    else if (header.vendorID != deviceProperties.vendorID || header.deviceID != deviceProperties.deviceID)
+    {
+        rejection = "saved for another GPU";
+    }
+    else if (header.driverVersion != deviceProperties.driverVersion ||
+        std::memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        rejection = "saved by another driver";
+    }
+    else if (header.dataSize != fileSize - sizeof(FileHeader))
+    {
+        rejection = "truncated";
+    }
+    else
+    {
+        data.resize(static_cast<size_t>(header.dataSize));
+        if (!file.read(reinterpret_cast<char*>(data.data()), data.size()) || HashData(data) != header.dataHash)
+        {
+            rejection = "checksum mismatch";
+        }
+        else if (!IsDriverHeaderValid(data))
+        {
+            rejection = "driver header does not match the device";
+        }
+    }
+
+    if (rejection != nullptr)
+    {
+        std::cout << YELLOW_TEXT << "Pipeline cache: ignoring " << path << " (" << rejection << "), starting cold" << RESET_TEXT << std::endl;
+        data.clear();
+        return;
+    }
+
+    warm = true;
+    coldPipelines = header.coldPipelines;
+    coldCreationMs = header.coldCreationMs;
+
+    auto end = std::chrono::high_resolution_clock::now();
+    stats.loadMs = std::chrono::duration<double, std::milli>(end - start).count();
+    stats.loadedBytes = data.size();
+}
+
+bool GfxPipelineCache::IsDriverHeaderValid(const std::vector<uint8_t>& data) const
+{
+    //Read field by field, the blob has no alignment guarantee and older headers lack VkPipelineCacheHeaderVersionOne
+    if (data.size() < PIPELINE_CACHE_DRIVER_HEADER_SIZE)
+    {
+        return false;
+    }
+    uint32_t fields[4];
+    std::memcpy(fields, data.data(), sizeof(fields));
+    return fields[0] >= PIPELINE_CACHE_DRIVER_HEADER_SIZE && fields[0] <= data.size() &&
+        fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        fields[2] == deviceProperties.vendorID && fields[3] == deviceProperties.deviceID &&
+        std::memcmp(data.data() + sizeof(fields), deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void GfxPipelineCache::Save()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+    {
+        std::cout << YELLOW_TEXT << "Pipeline cache: driver returned no data, " << path << " left as is" << RESET_TEXT << std::endl;
+        return;
+    }
+    std::vector<uint8_t> data(dataSize);
+    //VK_INCOMPLETE would mean a partial blob, not worth a file
+    if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+    {
+        std::cout << YELLOW_TEXT << "Pipeline cache: error reading the cache data, " << path << " left as is" << RESET_TEXT << std::endl;
+        return;
+    }
+    data.resize(dataSize);
+
+    FileHeader header{};
+    header.magic = PIPELINE_CACHE_FILE_MAGIC;
+    header.version = PIPELINE_CACHE_FILE_VERSION;
+    header.vendorID = deviceProperties.vendorID;
+    header.deviceID = deviceProperties.deviceID;
+    header.driverVersion = deviceProperties.driverVersion;
+    std::memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = data.size();
+    header.dataHash = HashData(data);
+    //A warm run keeps the reference of the cold one it started from
+    header.coldPipelines = warm ? coldPipelines : stats.startupPipelines;
+    header.coldCreationMs = warm ? coldCreationMs : stats.startupCreationMs;
+
+    //The old file stays in place until the new one is complete, rename replaces it in one step
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        file.close();
+        if (!file)
+        {
+            std::cout << YELLOW_TEXT << "Pipeline cache: error writing " << temporaryPath << RESET_TEXT << std::endl;
+            std::error_code removeError;
+            std::filesystem::remove(temporaryPath, removeError);
+            return;
+        }
+    }
+
+    std::error_code renameError;
+    std::filesystem::rename(temporaryPath, path, renameError);
+    if (renameError)
+    {
+        std::cout << YELLOW_TEXT << "Pipeline cache: error replacing " << path << " (" << renameError.message() << ")" << RESET_TEXT << std::endl;
+        std::error_code removeError;
+        std::filesystem::remove(temporaryPath, removeError);
+        return;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    stats.saveMs = std::chrono::duration<double, std::milli>(end - start).count();
+    stats.savedBytes = sizeof(header) + data.size();
+}
+
+VkResult GfxPipelineCache::CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline& pipeline)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    VkResult result = vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &createInfo, allocationCallbacks, &pipeline);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    ++stats.pipelines;
+    stats.creationMs += std::chrono::duration<double, std::milli>(end - start).count();
+    return result;
+}
+
+VkResult GfxPipelineCache::CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline& pipeline)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    VkResult result = vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &createInfo, allocationCallbacks, &pipeline);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    ++stats.pipelines;
+    stats.creationMs += std::chrono::duration<double, std::milli>(end - start).count();
+    return result;
+}
+
+void GfxPipelineCache::EndStartup()
+{
+    stats.startupPipelines = stats.pipelines;
+    stats.startupCreationMs = stats.creationMs;
+
+    if (pipelineCache == VK_NULL_HANDLE)
+    {
+        std::cout << CYAN_TEXT << "Pipeline cache off: " << stats.startupPipelines << " pipelines created in " << stats.startupCreationMs << "ms" << RESET_TEXT << std::endl;
+    }
+    else if (!warm)
+    {
+        std::cout << CYAN_TEXT << "Pipeline cache cold start: " << stats.startupPipelines << " pipelines created in " << stats.startupCreationMs << "ms" << RESET_TEXT << std::endl;
+    }
+    else
+    {
+        std::cout << CYAN_TEXT << "Pipeline cache warm start: " << stats.startupPipelines << " pipelines created in " << stats.startupCreationMs << "ms, cold start took "
+            << coldCreationMs << "ms for " << coldPipelines << " pipelines";
+        if (stats.startupCreationMs > 0.0)
+        {
+            std::cout << " (" << coldCreationMs / stats.startupCreationMs << "x faster)";
+        }
+        std::cout << ". Loaded " << stats.loadedBytes << " bytes in " << stats.loadMs << "ms" << RESET_TEXT << std::endl;
+    }
+}
+
+void GfxPipelineCache::PrintStats()
+{
+    std::cout << CYAN_TEXT << "Pipeline cache: " << stats.pipelines << " pipelines created in " << stats.creationMs << "ms, " << stats.loadedBytes
+        << " bytes loaded in " << stats.loadMs << "ms, " << stats.savedBytes << " bytes saved to " << path << " in " << stats.saveMs << "ms" << RESET_TEXT << std::endl;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//Next to the executable, written back on shutdown
+#define PIPELINE_CACHE_PATH "PipelineCache.bin"
+//'GPLC', bumped with PIPELINE_CACHE_FILE_VERSION whenever the file header changes
+#define PIPELINE_CACHE_FILE_MAGIC 0x434c5047u
+#define PIPELINE_CACHE_FILE_VERSION 1u
+
+struct GfxPipelineCacheStats
+{
+	uint32_t pipelines = 0;
+	double creationMs = 0.0;
+	//Snapshot taken by EndStartup
+	uint32_t startupPipelines = 0;
+	double startupCreationMs = 0.0;
+	uint64_t loadedBytes = 0;
+	uint64_t savedBytes = 0;
+	double loadMs = 0.0;
+	double saveMs = 0.0;
+};
+
+//Engine wide VkPipelineCache every pipeline is created through. Init loads the blob saved by the last run and only
+//hands it to the driver when our file header and the driver's own cache header match the device (vendor, device,
+//driver version and pipelineCacheUUID), anything else starts cold. Cleanup writes the cache to a temporary file and
+//renames it over the old one, so a crash while saving never leaves a torn cache behind.
+class GfxPipelineCache
+{
+public:
+	void Init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, const VkAllocationCallbacks* allocationCallbacks, const char* Path);
+	void Cleanup();
+
+	//VK_NULL_HANDLE when PIPELINE_CACHE is off
+	VkPipelineCache Get() const { return pipelineCache; }
+	//True when the data loaded from disk was accepted
+	bool IsWarm() const { return warm; }
+
+	//Same as the vkCreate*Pipelines calls with a single create info, timed
+	VkResult CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline& pipeline);
+	VkResult CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline& pipeline);
+
+	//Reports the pipelines created during init as a cold or a warm start, against the cold time of the run that filled the cache
+	void EndStartup();
+	const GfxPipelineCacheStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t dataHash;
+		//Startup of the run that began with an empty cache
+		uint32_t coldPipelines;
+		double coldCreationMs;
+	};
+
+	//Fills data with the driver blob, empty and a yellow reason in the log when the file can not be used
+	void Load(std::vector<uint8_t>& data);
+	bool IsDriverHeaderValid(const std::vector<uint8_t>& data) const;
+	void Save();
+
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkPhysicalDeviceProperties deviceProperties{};
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	std::string path;
+	bool warm = false;
+	uint32_t coldPipelines = 0;
+	double coldCreationMs = 0.0;
+
+	GfxPipelineCacheStats stats;
+};
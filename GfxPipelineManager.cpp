@@ -2,58 +2,28 @@
 #include "gfxMaths.h"
 #include "GfxContext.h"
 #include "DebugUtils.h"
+#include "GfxPipelineCache.h"
+#include "GfxMemoryAllocator.h"
+#include "GfxUploadContext.h"
 
 #include <string>
 
 VkCommandBuffer BeginSingleTimeCommandBuffer_Internal()
 {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    //TODO: Create a separate commandPool (VK_COMMAND_POOL_CREATE_TRANSIENT_BIT) for this short living buffers
-    allocInfo.commandPool = gfxCtx->commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(gfxCtx->logicalDevice, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo commandBufferBeginInfo{};
-    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-
-    return commandBuffer;
+    //Inside an upload batch this is the shared batch command buffer
+    return gfxCtx->uploadContext->BeginCommands();
 }
 
 void EndSingleTimeCommandBuffer_Internal(VkCommandBuffer commandBuffer)
 {
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    submitInfo.commandBufferCount = 1;
-    vkQueueSubmit(gfxCtx->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(gfxCtx->graphicsQueue);
-
-    vkFreeCommandBuffers(gfxCtx->logicalDevice, gfxCtx->commandPool, 1, &commandBuffer);
+    //Only submits and waits when no batch is recording
+    gfxCtx->uploadContext->EndCommands();
 }
 
 uint32_t FindMemoryType_Internal(uint32_t typeFilter, VkMemoryPropertyFlags memoryFlags)
 {
-    VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties{};
-    vkGetPhysicalDeviceMemoryProperties(gfxCtx->physicalDevice, &physicalDeviceMemoryProperties);
-
-    for (int i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; ++i)
-    {
-        if (typeFilter & (1 << i) && memoryFlags &&
-            (physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & memoryFlags) == memoryFlags)
-        {
-            return i;
-        }
-    }
-
-    throw std::runtime_error("Error finding memory type");
+    //Memory properties are cached by the allocator, resources should use a GfxMemoryUsage instead
+    return gfxCtx->memoryAllocator->FindMemoryTypeIndex(typeFilter, memoryFlags);
 }
 
 bool HasStencilComponent(VkFormat format)
@@ -227,18 +197,23 @@ void CreateGraphicsPipeline_Internal(const GraphicsPipelineInfo& graphicPipeline
     VkPipelineLayout& graphicPipelineLayout, VkPipeline& graphicPipeline, const char* VkPipelineName, const char* VkPipelineLayoutName)
 
 {
-    //TODO: this should come as argument too
-    VkVertexInputBindingDescription vertexBindingDescription = Vertex::GetBindingDesctiption();
-    std::array<VkVertexInputAttributeDescription, 4>
-        vertexAttributeDescription = Vertex::GetAttributeDescription();
+    std::vector<VkVertexInputBindingDescription> vertexBindingDescriptions = graphicPipelineInfo.vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions = graphicPipelineInfo.vertexAttributes;
+
+    if (graphicPipelineInfo.instanced)
+    {
+        vertexBindingDescriptions.push_back(InstanceData::GetBindingDesctiption());
+        std::array<VkVertexInputAttributeDescription, 5> instanceAttributeDescription = InstanceData::GetAttributeDescription();
+        vertexAttributeDescriptions.insert(vertexAttributeDescriptions.end(), instanceAttributeDescription.begin(), instanceAttributeDescription.end());
+    }
 
     VkPipelineVertexInputStateCreateInfo vertexStateCreateInfo{};
     vertexStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexStateCreateInfo.vertexBindingDescriptionCount = 1;
+    vertexStateCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexBindingDescriptions.size());
     vertexStateCreateInfo.vertexAttributeDescriptionCount =
-        static_cast<uint32_t>(vertexAttributeDescription.size());
-    vertexStateCreateInfo.pVertexBindingDescriptions = &vertexBindingDescription;
-    vertexStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescription.data();
+        static_cast<uint32_t>(vertexAttributeDescriptions.size());
+    vertexStateCreateInfo.pVertexBindingDescriptions = vertexBindingDescriptions.data();
+    vertexStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescriptions.data();
 
 
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyCreateInfo{};
@@ -336,15 +311,19 @@ void CreateGraphicsPipeline_Internal(const GraphicsPipelineInfo& graphicPipeline
     colorBlendStateCreateInfo.blendConstants[2] = 0.0f; // Optional
     colorBlendStateCreateInfo.blendConstants[3] = 0.0f; // Optional
 
-    //TODO
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = graphicPipelineInfo.pushConstantSize;
+
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCreateInfo.setLayoutCount = 1;
     pipelineLayoutCreateInfo.pSetLayouts = &graphicPipelineInfo.descriptorSetLayout;
-    pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-    pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = graphicPipelineInfo.pushConstantSize > 0 ? 1 : 0;
+    pipelineLayoutCreateInfo.pPushConstantRanges = graphicPipelineInfo.pushConstantSize > 0 ? &pushConstantRange : nullptr;
 
-    if (vkCreatePipelineLayout(gfxCtx->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &graphicPipelineLayout) != VK_SUCCESS)
+    if (vkCreatePipelineLayout(gfxCtx->logicalDevice, &pipelineLayoutCreateInfo, gfxCtx->allocationCallbacks, &graphicPipelineLayout) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating pipeline layuout!");
     }
@@ -373,8 +352,7 @@ void CreateGraphicsPipeline_Internal(const GraphicsPipelineInfo& graphicPipeline
     graphicsPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
     graphicsPipelineCreateInfo.basePipelineIndex = -1;
 
-    if (vkCreateGraphicsPipelines(gfxCtx->logicalDevice, VK_NULL_HANDLE, 1,
-        &graphicsPipelineCreateInfo, nullptr, &graphicPipeline) != VK_SUCCESS)
+    if (gfxCtx->pipelineCache->CreateGraphicsPipeline(graphicsPipelineCreateInfo, graphicPipeline) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating graphic pipeline!");
     }
@@ -382,8 +360,7 @@ void CreateGraphicsPipeline_Internal(const GraphicsPipelineInfo& graphicPipeline
     DebugUtils::getInstance().SetVulkanObjectName(graphicPipeline, VkPipelineName);
 }
 
-void CreateBuffer_Internal(VkDeviceSize size, VkBufferUsageFlags usageFlags,
-    VkMemoryPropertyFlags memoryFlags, VkBuffer& newBuffer, VkDeviceMemory& bufferMemory, const char* BufferName, const char* BufferMemoryName)
+static void CreateBufferHandle(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkBuffer& newBuffer, const char* BufferName)
 {
     VkBufferCreateInfo createBuffer{};
     createBuffer.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -391,31 +368,76 @@ void CreateBuffer_Internal(VkDeviceSize size, VkBufferUsageFlags usageFlags,
     createBuffer.usage = usageFlags;
     createBuffer.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    if (vkCreateBuffer(gfxCtx->logicalDevice, &createBuffer, nullptr, &newBuffer) != VK_SUCCESS)
+    if (vkCreateBuffer(gfxCtx->logicalDevice, &createBuffer, gfxCtx->allocationCallbacks, &newBuffer) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating vertex buffer!");
     }
 
     DebugUtils::getInstance().SetVulkanObjectName(newBuffer, BufferName);
+}
 
-    VkMemoryRequirements bufferMemoryRequirements;
-    vkGetBufferMemoryRequirements(gfxCtx->logicalDevice, newBuffer, &bufferMemoryRequirements);
+void CreateBuffer_Internal(VkDeviceSize size, VkBufferUsageFlags usageFlags,
+    VkMemoryPropertyFlags memoryFlags, VkBuffer& newBuffer, GfxAllocation& bufferAllocation, const char* BufferName, const char* BufferMemoryName)
+{
+    CreateBufferHandle(size, usageFlags, newBuffer, BufferName);
+
+    //Sub-allocated from a shared memory block, the memory name is only used for dedicated allocations
+    gfxCtx->memoryAllocator->AllocateBufferMemory(newBuffer, memoryFlags, bufferAllocation, BufferMemoryName);
+}
+
+void CreateBuffer_Internal(VkDeviceSize size, VkBufferUsageFlags usageFlags,
+    GfxMemoryUsage memoryUsage, VkBuffer& newBuffer, GfxAllocation& bufferAllocation, const char* BufferName, const char* BufferMemoryName)
+{
+    CreateBufferHandle(size, usageFlags, newBuffer, BufferName);
+
+    //The allocator picks the heap from the usage and the current budget
+    gfxCtx->memoryAllocator->AllocateBufferMemory(newBuffer, memoryUsage, bufferAllocation, BufferMemoryName);
+}
 
-    //FindMemoryType
-    VkMemoryAllocateInfo allocateMemory{};
-    allocateMemory.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateMemory.allocationSize = bufferMemoryRequirements.size;
-    allocateMemory.memoryTypeIndex = FindMemoryType_Internal(bufferMemoryRequirements.memoryTypeBits,
-        memoryFlags);
+void DestroyBuffer_Internal(VkBuffer& buffer, GfxAllocation& bufferAllocation)
+{
+    vkDestroyBuffer(gfxCtx->logicalDevice, buffer, gfxCtx->allocationCallbacks);
+    gfxCtx->memoryAllocator->Free(bufferAllocation);
+    buffer = VK_NULL_HANDLE;
+}
 
-    if (vkAllocateMemory(gfxCtx->logicalDevice, &allocateMemory, nullptr, &bufferMemory) != VK_SUCCESS)
+void CreateImage_Internal(uint32_t width, uint32_t height, uint32_t mipLevels,
+    VkSampleCountFlagBits numSample, VkFormat format, VkImageTiling tiling,
+    VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, GfxAllocation& imageAllocation,
+    const char* imageName)
+{
+    VkImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.extent.width = static_cast<uint32_t>(width);
+    imageCreateInfo.extent.height = static_cast<uint32_t>(height);
+    imageCreateInfo.extent.depth = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.mipLevels = mipLevels;
+    imageCreateInfo.format = format;
+    imageCreateInfo.tiling = tiling;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageCreateInfo.usage = usage;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.samples = numSample;
+    imageCreateInfo.flags = 0;
+
+    if (vkCreateImage(gfxCtx->logicalDevice, &imageCreateInfo, gfxCtx->allocationCallbacks, &image) != VK_SUCCESS)
     {
-        throw std::runtime_error("Error allocating vertex buffer memory");
+        throw std::runtime_error("Error creating image!");
     }
 
-    DebugUtils::getInstance().SetVulkanObjectName(bufferMemory, BufferMemoryName);
+    //Render targets bigger than half a memory block get a dedicated allocation
+    gfxCtx->memoryAllocator->AllocateImageMemory(image, tiling, properties, imageAllocation, imageName);
 
-    vkBindBufferMemory(gfxCtx->logicalDevice, newBuffer, bufferMemory, 0);
+    DebugUtils::getInstance().SetVulkanObjectName(image, imageName);
+}
+
+void DestroyImage_Internal(VkImage& image, GfxAllocation& imageAllocation)
+{
+    vkDestroyImage(gfxCtx->logicalDevice, image, gfxCtx->allocationCallbacks);
+    gfxCtx->memoryAllocator->Free(imageAllocation);
+    image = VK_NULL_HANDLE;
 }
 
 void CopyBuffer_Internal(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
@@ -466,7 +488,7 @@ void CopyImage_Internal(VkDevice device, VkImage srcImage, VkFormat srcFormat, i
 void CreateDescriptorSetLayout(VkDescriptorSetLayoutCreateInfo descriptorCreateInfo, VkDescriptorSetLayout &descriptorSetLayout, const char* Name)
 {
     if (vkCreateDescriptorSetLayout(gfxCtx->logicalDevice, &descriptorCreateInfo,
-        nullptr, &descriptorSetLayout) != VK_SUCCESS)
+        gfxCtx->allocationCallbacks, &descriptorSetLayout) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating descriptor set layout!");
     }
@@ -493,7 +515,7 @@ void AllocateDescriptorSets(VkDescriptorSetAllocateInfo descriptorSetInfo, std::
 void CreateDescriptorPool(VkDescriptorPoolCreateInfo descriptorPoolCreateInfo, VkDescriptorPool& descriptorPool, const char* Name)
 {
     if (vkCreateDescriptorPool(gfxCtx->logicalDevice, &descriptorPoolCreateInfo,
-        nullptr, &descriptorPool) != VK_SUCCESS)
+        gfxCtx->allocationCallbacks, &descriptorPool) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating descriptor pool!");
     }
@@ -503,7 +525,7 @@ void CreateDescriptorPool(VkDescriptorPoolCreateInfo descriptorPoolCreateInfo, V
 
 void CreateFrameBuffer(VkFramebufferCreateInfo frameBufferCreateInfo, VkFramebuffer& frameBuffer, const char* Name)
 {
-    if (vkCreateFramebuffer(gfxCtx->logicalDevice, &frameBufferCreateInfo, nullptr, &frameBuffer) != VK_SUCCESS)
+    if (vkCreateFramebuffer(gfxCtx->logicalDevice, &frameBufferCreateInfo, gfxCtx->allocationCallbacks, &frameBuffer) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating framebuffer!");
     }
@@ -513,7 +535,7 @@ void CreateFrameBuffer(VkFramebufferCreateInfo frameBufferCreateInfo, VkFramebuf
 
 void CreateRenderPass(VkRenderPassCreateInfo renderpassCreateInfo, VkRenderPass& renderpass, const char* Name)
 {
-    if (vkCreateRenderPass(gfxCtx->logicalDevice, &renderpassCreateInfo, nullptr, &renderpass) != VK_SUCCESS)
+    if (vkCreateRenderPass(gfxCtx->logicalDevice, &renderpassCreateInfo, gfxCtx->allocationCallbacks, &renderpass) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating renderpass!");
     }
@@ -2,6 +2,8 @@
 #include <vector>
 //#include "DebugUtils.h"
 class GfxContext;
+struct GfxAllocation;
+enum class GfxMemoryUsage;
 
 struct GraphicsPipelineInfo 
 {
@@ -10,6 +12,13 @@ struct GraphicsPipelineInfo
 	VkExtent2D viewportExtent;
 	VkSampleCountFlagBits msaaSamples;
 	VkRenderPass renderPass;
+	//Fixed function vertex input, both empty for vertex pulling shaders that read their vertices from a storage buffer
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	//Adds the per instance InstanceData binding next to the vertex ones
+	bool instanced = false;
+	//Bytes of vertex stage push constants, 0 for none
+	uint32_t pushConstantSize = 0;
 
 	GraphicsPipelineInfo() = default;
 };
@@ -29,7 +38,17 @@ void CreateGraphicsPipeline_Internal(const GraphicsPipelineInfo& graphicPipeline
 	VkPipelineLayout& graphicPipelineLayout, VkPipeline& graphicPipeline, const char* VkPipelineName = "Unknown", const char* VkPipelineLayoutName = "Unknown");
 
 void CreateBuffer_Internal(VkDeviceSize size, VkBufferUsageFlags usageFlags,
-	VkMemoryPropertyFlags memoryFlags, VkBuffer& newBuffer, VkDeviceMemory& bufferMemory, const char* BufferName = "Unknown", const char* BufferMemoryName = "Unknown");
+	VkMemoryPropertyFlags memoryFlags, VkBuffer& newBuffer, GfxAllocation& bufferAllocation, const char* BufferName = "Unknown", const char* BufferMemoryName = "Unknown");
+
+void CreateBuffer_Internal(VkDeviceSize size, VkBufferUsageFlags usageFlags,
+	GfxMemoryUsage memoryUsage, VkBuffer& newBuffer, GfxAllocation& bufferAllocation, const char* BufferName = "Unknown", const char* BufferMemoryName = "Unknown");
+
+void DestroyBuffer_Internal(VkBuffer& buffer, GfxAllocation& bufferAllocation);
+
+void CreateImage_Internal(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSample, VkFormat format, VkImageTiling tiling,
+	VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, GfxAllocation& imageAllocation, const char* imageName = "Unknown");
+
+void DestroyImage_Internal(VkImage& image, GfxAllocation& imageAllocation);
 
 void CopyBuffer_Internal(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
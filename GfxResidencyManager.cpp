@@ -0,0 +1,337 @@
+#include "GfxResidencyManager.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "DebugUtils.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+void GfxResidencyManager::Init(uint32_t framesInFlight)
+{
+    this->framesInFlight = framesInFlight;
+    frameNumber = 0;
+    stats = GfxResidencyStats();
+}
+
+void GfxResidencyManager::Cleanup()
+{
+    PrintStats();
+    streamables.clear();
+}
+
+void GfxResidencyManager::Register(GfxStreamable* streamable)
+{
+    streamable->lastUsedFrame = frameNumber;
+    streamables.push_back(streamable);
+}
+
+void GfxResidencyManager::Unregister(GfxStreamable* streamable)
+{
+    auto it = std::find(streamables.begin(), streamables.end(), streamable);
+    if (it != streamables.end())
+    {
+        streamables.erase(it);
+    }
+}
+
+void GfxResidencyManager::BeginFrame()
+{
+    ++frameNumber;
+
+    GfxMemoryAllocator* allocator = gfxCtx->memoryAllocator;
+    allocator->UpdateBudget();
+
+    //Textures and meshes compete in one LRU order, whatever was drawn least recently goes first
+    uint32_t heapIndex = allocator->GetDeviceLocalHeapIndex();
+    while (allocator->IsOverBudget(heapIndex) && EvictLeastRecentlyUsed())
+    {
+    }
+}
+
+void GfxResidencyManager::Touch(GfxStreamable* streamable)
+{
+    streamable->lastUsedFrame = frameNumber;
+    if (streamable->IsResident())
+    {
+        return;
+    }
+
+    //Evicted textures can still be sampled from host memory, they only come back if there is budget for them.
+    //Meshes have to be in the arena to be drawn.
+    if (streamable->GetStreamableType() == GfxStreamableType::TEXTURE)
+    {
+        GfxMemoryAllocator* allocator = gfxCtx->memoryAllocator;
+        uint32_t heapIndex = allocator->GetDeviceLocalHeapIndex();
+        VkDeviceSize bytes = streamable->GetResidentBytes();
+        while (allocator->IsOverBudget(heapIndex, bytes) && EvictLeastRecentlyUsed(GfxStreamableType::TEXTURE))
+        {
+        }
+        if (allocator->IsOverBudget(heapIndex, bytes))
+        {
+            return;
+        }
+    }
+
+    streamable->MakeResident();
+    if (streamable->IsResident())
+    {
+        ++stats.restores;
+        stats.restoredBytes += streamable->GetResidentBytes();
+    }
+}
+
+bool GfxResidencyManager::EvictLeastRecentlyUsed(GfxStreamableType type)
+{
+    return EvictLeastRecentlyUsed(&type);
+}
+
+bool GfxResidencyManager::EvictLeastRecentlyUsed()
+{
+    return EvictLeastRecentlyUsed(nullptr);
+}
+
+bool GfxResidencyManager::EvictLeastRecentlyUsed(const GfxStreamableType* type)
+{
+    //Linear scan, eviction is rare and the list is small compared to a frame of draws
+    while (true)
+    {
+        GfxStreamable* leastRecentlyUsed = nullptr;
+        for (GfxStreamable* streamable : streamables)
+        {
+            if ((type == nullptr || streamable->GetStreamableType() == *type) && CanEvict(streamable) &&
+                (leastRecentlyUsed == nullptr || streamable->lastUsedFrame < leastRecentlyUsed->lastUsedFrame))
+            {
+                leastRecentlyUsed = streamable;
+            }
+        }
+
+        if (leastRecentlyUsed == nullptr)
+        {
+            return false;
+        }
+
+        VkDeviceSize bytes = leastRecentlyUsed->GetResidentBytes();
+        if (leastRecentlyUsed->Evict())
+        {
+            ++stats.evictions;
+            stats.evictedBytes += bytes;
+            std::cout << YELLOW_TEXT << "Evicted " << leastRecentlyUsed->GetStreamableName() << " (" << bytes / 1024
+                << "KB), unused for " << frameNumber - leastRecentlyUsed->lastUsedFrame << " frames" << RESET_TEXT << std::endl;
+            return true;
+        }
+
+        //Nowhere to move it, don't pick it again until it is used
+        leastRecentlyUsed->lastUsedFrame = frameNumber;
+    }
+}
+
+bool GfxResidencyManager::CanEvict(const GfxStreamable* streamable) const
+{
+    //Frames up to frameNumber - framesInFlight have finished once the current frame fence is signaled
+    return streamable->IsResident() && streamable->lastUsedFrame + framesInFlight <= frameNumber;
+}
+
+void GfxResidencyManager::PrintStats()
+{
+    std::cout << CYAN_TEXT << "Residency manager: " << streamables.size() << " streamable resources, "
+        << stats.evictions << " evictions (" << stats.evictedBytes / 1024 << "KB), "
+        << stats.restores << " restores (" << stats.restoredBytes / 1024 << "KB)" << RESET_TEXT << std::endl;
+}
+
+void GfxStreamedImage::Create(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage,
+    const char* Name)
+{
+    this->width = width;
+    this->height = height;
+    this->mipLevels = mipLevels;
+    this->format = format;
+    this->usage = usage;
+    name = Name;
+
+    image = CreateImageHandle();
+    gfxCtx->memoryAllocator->AllocateImageMemory(image, VK_IMAGE_TILING_OPTIMAL, GfxMemoryUsage::GPU_STREAMED, allocation, name);
+    //Created over budget, it stays in host memory until there is room
+    resident = gfxCtx->memoryAllocator->IsDeviceLocal(allocation);
+}
+
+VkImage GfxStreamedImage::CreateImageHandle()
+{
+    VkImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.extent.width = width;
+    imageCreateInfo.extent.height = height;
+    imageCreateInfo.extent.depth = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.mipLevels = mipLevels;
+    imageCreateInfo.format = format;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageCreateInfo.usage = usage;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkImage newImage;
+    if (vkCreateImage(gfxCtx->logicalDevice, &imageCreateInfo, gfxCtx->allocationCallbacks, &newImage) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating streamed image!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(newImage, name);
+    return newImage;
+}
+
+void GfxStreamedImage::CreateView(const char* ViewName)
+{
+    viewName = ViewName;
+
+    VkImageViewCreateInfo imageViewCreateInfo{};
+    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCreateInfo.image = image;
+    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCreateInfo.format = format;
+    imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+    imageViewCreateInfo.subresourceRange.levelCount = mipLevels;
+    imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+    imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(gfxCtx->logicalDevice, &imageViewCreateInfo, gfxCtx->allocationCallbacks, &view) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating streamed image view!");
+    }
+    DebugUtils::getInstance().SetVulkanObjectName(view, viewName);
+}
+
+void GfxStreamedImage::Destroy()
+{
+    vkDestroyImageView(gfxCtx->logicalDevice, view, gfxCtx->allocationCallbacks);
+    view = VK_NULL_HANDLE;
+    DestroyImage_Internal(image, allocation);
+}
+
+bool GfxStreamedImage::Evict()
+{
+    return Relocate(GfxMemoryUsage::GPU_EVICTED);
+}
+
+void GfxStreamedImage::MakeResident()
+{
+    Relocate(GfxMemoryUsage::GPU_STREAMED);
+}
+
+bool GfxStreamedImage::Relocate(GfxMemoryUsage memoryUsage)
+{
+    VkImage newImage = CreateImageHandle();
+    GfxAllocation newAllocation;
+    gfxCtx->memoryAllocator->AllocateImageMemory(newImage, VK_IMAGE_TILING_OPTIMAL, memoryUsage, newAllocation, name);
+
+    bool newResident = gfxCtx->memoryAllocator->IsDeviceLocal(newAllocation);
+    if (newResident == resident)
+    {
+        //The device has no heap to move it to
+        DestroyImage_Internal(newImage, newAllocation);
+        return false;
+    }
+
+    VkCommandBuffer commandBuffer = BeginSingleTimeCommandBuffer_Internal();
+    RecordCopy(commandBuffer, newImage);
+    EndSingleTimeCommandBuffer_Internal(commandBuffer);
+
+    //Residency moves are rare, waiting for the device lets the old image go right away
+    vkDeviceWaitIdle(gfxCtx->logicalDevice);
+
+    vkDestroyImageView(gfxCtx->logicalDevice, view, gfxCtx->allocationCallbacks);
+    DestroyImage_Internal(image, allocation);
+
+    image = newImage;
+    allocation = newAllocation;
+    resident = newResident;
+    CreateView(viewName);
+    ++version;
+    return true;
+}
+
+VkMemoryRequirements GfxStreamedImage::GetMovableRequirements() const
+{
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(gfxCtx->logicalDevice, image, &memoryRequirements);
+    return memoryRequirements;
+}
+
+std::function<void()> GfxStreamedImage::Move(VkCommandBuffer commandBuffer, const GfxAllocation& newAllocation)
+{
+    VkImage newImage = CreateImageHandle();
+    if (vkBindImageMemory(gfxCtx->logicalDevice, newImage, newAllocation.memory, newAllocation.offset) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error binding moved image memory!");
+    }
+
+    RecordCopy(commandBuffer, newImage);
+
+    VkImage oldImage = image;
+    GfxAllocation oldAllocation = allocation;
+    VkImageView oldView = view;
+
+    image = newImage;
+    allocation = newAllocation;
+    CreateView(viewName);
+    ++version;
+
+    return [oldImage, oldAllocation, oldView]() mutable
+    {
+        vkDestroyImageView(gfxCtx->logicalDevice, oldView, gfxCtx->allocationCallbacks);
+        DestroyImage_Internal(oldImage, oldAllocation);
+    };
+}
+
+void GfxStreamedImage::RecordCopy(VkCommandBuffer commandBuffer, VkImage dstImage)
+{
+    std::vector<VkImageMemoryBarrier> barriers(2);
+    for (VkImageMemoryBarrier& barrier : barriers)
+    {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+    }
+    barriers[0].image = image;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[1].image = dstImage;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].srcAccessMask = 0;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    std::vector<VkImageCopy> copyRegions(mipLevels);
+    for (uint32_t mip = 0; mip < mipLevels; ++mip)
+    {
+        VkImageCopy& copyRegion = copyRegions[mip];
+        copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+        copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+        copyRegion.srcOffset = { 0, 0, 0 };
+        copyRegion.dstOffset = { 0, 0, 0 };
+        copyRegion.extent = { std::max(width >> mip, 1u), std::max(height >> mip, 1u), 1 };
+    }
+    vkCmdCopyImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+    barriers.resize(1);
+    barriers[0].image = dstImage;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, barriers.data());
+}
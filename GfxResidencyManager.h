@@ -0,0 +1,121 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <functional>
+#include "GfxMemoryAllocator.h"
+#include "GfxDefragmenter.h"
+
+enum class GfxStreamableType
+{
+	TEXTURE = 0,
+	MESH
+};
+
+//Resource that can leave device local memory when the budget runs out and come back when it is used again
+class GfxStreamable
+{
+public:
+	virtual ~GfxStreamable() = default;
+
+	virtual GfxStreamableType GetStreamableType() const = 0;
+	//Bytes Evict gives back
+	virtual VkDeviceSize GetResidentBytes() const = 0;
+	virtual bool IsResident() const = 0;
+	//Only called once no frame in flight uses it, false if there is nowhere to move it
+	virtual bool Evict() = 0;
+	virtual void MakeResident() = 0;
+	virtual const char* GetStreamableName() const = 0;
+
+	uint64_t lastUsedFrame = 0;
+};
+
+struct GfxResidencyStats
+{
+	uint32_t evictions = 0;
+	uint32_t restores = 0;
+	VkDeviceSize evictedBytes = 0;
+	VkDeviceSize restoredBytes = 0;
+};
+
+//Tracks when streamable textures and meshes were last drawn and pushes the least recently used ones
+//out of device local memory while the heap is over budget, instead of letting allocations fail.
+class GfxResidencyManager
+{
+public:
+	void Init(uint32_t framesInFlight);
+	void Cleanup();
+
+	void Register(GfxStreamable* streamable);
+	void Unregister(GfxStreamable* streamable);
+
+	//After the frame fence wait: refreshes the heap budgets and evicts the least recently used resources of any type
+	//while the device local heap is over budget
+	void BeginFrame();
+	//Marks the resource as used by the frame being recorded, brings it back first if it was evicted
+	void Touch(GfxStreamable* streamable);
+	//Evicts the least recently used resource of the type that no frame in flight uses, false if there is none
+	bool EvictLeastRecentlyUsed(GfxStreamableType type);
+	//Same over every type
+	bool EvictLeastRecentlyUsed();
+
+	uint64_t GetFrameNumber() const { return frameNumber; }
+	const GfxResidencyStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	bool CanEvict(const GfxStreamable* streamable) const;
+	//type nullptr for any type
+	bool EvictLeastRecentlyUsed(const GfxStreamableType* type);
+
+	std::vector<GfxStreamable*> streamables;
+	uint32_t framesInFlight = 1;
+	uint64_t frameNumber = 0;
+
+	GfxResidencyStats stats;
+};
+
+//Sampled 2D image that moves between device local and host memory, or between blocks when defragmenting,
+//with a GPU copy of every mip. The view is recreated on every move and the version bumped,
+//descriptors using it have to be rewritten before their next use.
+class GfxStreamedImage : public GfxStreamable, public GfxMovable
+{
+public:
+	//Needs VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT to be moved
+	void Create(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, const char* Name);
+	void CreateView(const char* ViewName);
+	void Destroy();
+
+	GfxStreamableType GetStreamableType() const override { return GfxStreamableType::TEXTURE; }
+	VkDeviceSize GetResidentBytes() const override { return allocation.size; }
+	bool IsResident() const override { return resident; }
+	bool Evict() override;
+	void MakeResident() override;
+	const char* GetStreamableName() const override { return name; }
+
+	const GfxAllocation& GetMovableAllocation() const override { return allocation; }
+	VkMemoryRequirements GetMovableRequirements() const override;
+	std::function<void()> Move(VkCommandBuffer commandBuffer, const GfxAllocation& newAllocation) override;
+	const char* GetMovableName() const override { return name; }
+
+	uint32_t GetVersion() const { return version; }
+
+	VkImage image = VK_NULL_HANDLE;
+	GfxAllocation allocation;
+	VkImageView view = VK_NULL_HANDLE;
+
+private:
+	bool Relocate(GfxMemoryUsage memoryUsage);
+	VkImage CreateImageHandle();
+	//Expects every mip of image in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, leaves dstImage mips the same way
+	void RecordCopy(VkCommandBuffer commandBuffer, VkImage dstImage);
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t mipLevels = 1;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkImageUsageFlags usage = 0;
+	const char* name = "Unknown";
+	const char* viewName = "Unknown";
+	bool resident = true;
+	uint32_t version = 0;
+};
@@ -0,0 +1,309 @@
+#include "GfxScene.h"
+#include "gfxMaths.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "GfxTransformBuffer.h"
+#include "GfxVertexPulling.h"
+#include "GfxUploadContext.h"
+
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+
+uint32_t GfxScene::AddMaterial(VkPipeline pipeline, VkPipelineLayout pipelineLayout, const char* Name)
+{
+    GfxSceneMaterial material;
+    material.pipeline = pipeline;
+    material.pipelineLayout = pipelineLayout;
+    material.name = Name;
+    materials.push_back(material);
+    return static_cast<uint32_t>(materials.size() - 1);
+}
+
+void GfxScene::SetMaterialDescriptorSets(uint32_t materialId, const std::vector<VkDescriptorSet>& descriptorSets)
+{
+    materials[materialId].descriptorSets = descriptorSets;
+}
+
+void GfxScene::SetMaterialPulledPipeline(uint32_t materialId, VkPipeline pipeline, VkPipelineLayout pipelineLayout)
+{
+    materials[materialId].pulledPipeline = pipeline;
+    materials[materialId].pulledPipelineLayout = pipelineLayout;
+}
+
+GfxSceneHandle GfxScene::Create(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const glm::mat4& modelMatrix,
+    uint32_t materialId, uint32_t objectFlags, const char* Name)
+{
+    if (vertices.empty() || indices.empty())
+    {
+        throw std::runtime_error(std::string("Error creating scene object ") + Name + " without geometry!");
+    }
+
+    glm::vec3 boundsMin = vertices[0].position;
+    glm::vec3 boundsMax = vertices[0].position;
+    for (const Vertex& vertex : vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+
+    //Scene objects can be drawn by vertex pulling materials, their packed copy goes next to the Vertex one
+    std::vector<GfxPackedVertex> packedVertices;
+    if (gfxCtx->geometryArena->HasPulledVertices())
+    {
+        PackVertices(vertices, packedVertices);
+    }
+
+    GfxMeshRange mesh = gfxCtx->geometryArena->AllocateMesh(vertices.data(), static_cast<uint32_t>(vertices.size()),
+        indices.data(), static_cast<uint32_t>(indices.size()), Name, packedVertices.empty() ? nullptr : packedVertices.data());
+    uploadedGeometryBytes += vertices.size() * sizeof(Vertex) + packedVertices.size() * sizeof(GfxPackedVertex) + indices.size() * sizeof(uint32_t);
+
+    GfxSceneHandle handle;
+    if (!freeSlots.empty())
+    {
+        handle.slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        handle.slot = static_cast<uint32_t>(slotIndices.size());
+        slotIndices.push_back(SCENE_INVALID_INDEX);
+        slotGenerations.push_back(0);
+    }
+    handle.generation = slotGenerations[handle.slot];
+
+    uint32_t index = GetObjectCount();
+    slotIndices[handle.slot] = index;
+    denseSlots.push_back(handle.slot);
+
+    transformIndices.push_back(gfxCtx->transformBuffer->Allocate());
+    meshes.push_back(mesh);
+    materialIds.push_back(materialId);
+    flags.push_back(objectFlags);
+    worldBoundingSpheres.emplace_back(0.0f);
+    worldBoundsMin.emplace_back(0.0f);
+    worldBoundsMax.emplace_back(0.0f);
+    modelMatrices.push_back(modelMatrix);
+    localBoundsMin.push_back(boundsMin);
+    localBoundsMax.push_back(boundsMax);
+    names.push_back(Name);
+
+    streamedMeshes.push_back(new GfxSceneMesh(this, handle, Name));
+    if (gfxCtx->residencyManager != nullptr)
+    {
+        gfxCtx->residencyManager->Register(streamedMeshes[index]);
+    }
+
+    gfxCtx->transformBuffer->Set(transformIndices[index], modelMatrix);
+    UpdateWorldBounds(index);
+    ++structureVersion;
+    return handle;
+}
+
+void GfxScene::Destroy(GfxSceneHandle handle)
+{
+    uint32_t index = GetIndex(handle);
+    if (index == SCENE_INVALID_INDEX)
+    {
+        return;
+    }
+
+    //Evicted meshes have no ranges left to free, their host copy goes with the streamable
+    if (gfxCtx->residencyManager != nullptr)
+    {
+        gfxCtx->residencyManager->Unregister(streamedMeshes[index]);
+    }
+    delete streamedMeshes[index];
+    gfxCtx->geometryArena->FreeMesh(meshes[index]);
+    gfxCtx->transformBuffer->Free(transformIndices[index]);
+
+    //Last object fills the hole, its slot now points at the new dense index
+    uint32_t last = GetObjectCount() - 1;
+    if (index != last)
+    {
+        transformIndices[index] = transformIndices[last];
+        meshes[index] = meshes[last];
+        materialIds[index] = materialIds[last];
+        flags[index] = flags[last];
+        worldBoundingSpheres[index] = worldBoundingSpheres[last];
+        worldBoundsMin[index] = worldBoundsMin[last];
+        worldBoundsMax[index] = worldBoundsMax[last];
+        modelMatrices[index] = modelMatrices[last];
+        localBoundsMin[index] = localBoundsMin[last];
+        localBoundsMax[index] = localBoundsMax[last];
+        names[index] = names[last];
+        streamedMeshes[index] = streamedMeshes[last];
+        denseSlots[index] = denseSlots[last];
+        slotIndices[denseSlots[index]] = index;
+    }
+
+    transformIndices.pop_back();
+    meshes.pop_back();
+    materialIds.pop_back();
+    flags.pop_back();
+    worldBoundingSpheres.pop_back();
+    worldBoundsMin.pop_back();
+    worldBoundsMax.pop_back();
+    modelMatrices.pop_back();
+    localBoundsMin.pop_back();
+    localBoundsMax.pop_back();
+    names.pop_back();
+    streamedMeshes.pop_back();
+    denseSlots.pop_back();
+
+    slotIndices[handle.slot] = SCENE_INVALID_INDEX;
+    ++slotGenerations[handle.slot];
+    freeSlots.push_back(handle.slot);
+
+    ++structureVersion;
+    ++boundsVersion;
+}
+
+void GfxScene::Cleanup()
+{
+    PrintStats();
+
+    while (!denseSlots.empty())
+    {
+        uint32_t slot = denseSlots.back();
+        Destroy({ slot, slotGenerations[slot] });
+    }
+    materials.clear();
+}
+
+bool GfxScene::IsValid(GfxSceneHandle handle) const
+{
+    return GetIndex(handle) != SCENE_INVALID_INDEX;
+}
+
+uint32_t GfxScene::GetIndex(GfxSceneHandle handle) const
+{
+    if (handle.slot >= slotIndices.size() || slotGenerations[handle.slot] != handle.generation)
+    {
+        return SCENE_INVALID_INDEX;
+    }
+    return slotIndices[handle.slot];
+}
+
+void GfxScene::SetModelMatrix(GfxSceneHandle handle, const glm::mat4& modelMatrix)
+{
+    uint32_t index = GetIndex(handle);
+    if (index == SCENE_INVALID_INDEX)
+    {
+        throw std::runtime_error("Error setting the model matrix of a destroyed scene object!");
+    }
+
+    modelMatrices[index] = modelMatrix;
+    gfxCtx->transformBuffer->Set(transformIndices[index], modelMatrix);
+    UpdateWorldBounds(index);
+}
+
+void GfxScene::SetFlags(GfxSceneHandle handle, uint32_t objectFlags)
+{
+    uint32_t index = GetIndex(handle);
+    if (index == SCENE_INVALID_INDEX)
+    {
+        throw std::runtime_error("Error setting the flags of a destroyed scene object!");
+    }
+
+    flags[index] = objectFlags;
+    ++structureVersion;
+}
+
+void GfxScene::TouchMeshes(const std::vector<uint32_t>& indices)
+{
+    for (uint32_t index : indices)
+    {
+        gfxCtx->residencyManager->Touch(streamedMeshes[index]);
+    }
+}
+
+void GfxScene::TouchMeshes()
+{
+    for (uint32_t index = 0; index < GetObjectCount(); ++index)
+    {
+        if ((flags[index] & SCENE_OBJECT_HIDDEN) == 0)
+        {
+            gfxCtx->residencyManager->Touch(streamedMeshes[index]);
+        }
+    }
+}
+
+void GfxScene::UpdateWorldBounds(uint32_t index)
+{
+    const glm::mat4& modelMatrix = modelMatrices[index];
+    glm::vec3 localCenter = (localBoundsMin[index] + localBoundsMax[index]) * 0.5f;
+    glm::vec3 localExtents = (localBoundsMax[index] - localBoundsMin[index]) * 0.5f;
+
+    //Box around the transformed box: each world extent sums the absolute contributions of every local axis
+    glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(localCenter, 1.0f));
+    glm::vec3 extents = glm::abs(glm::vec3(modelMatrix[0])) * localExtents.x +
+        glm::abs(glm::vec3(modelMatrix[1])) * localExtents.y +
+        glm::abs(glm::vec3(modelMatrix[2])) * localExtents.z;
+    worldBoundsMin[index] = center - extents;
+    worldBoundsMax[index] = center + extents;
+
+    float maxScale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+        std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    worldBoundingSpheres[index] = glm::vec4(center, glm::length(localExtents) * maxScale);
+
+    ++boundsVersion;
+}
+
+void GfxScene::PrintStats()
+{
+    std::cout << CYAN_TEXT << "Scene: " << GetObjectCount() << " objects, " << materials.size() << " materials, "
+        << slotIndices.size() << " slots, " << uploadedGeometryBytes / 1024 << " KB of geometry uploaded without a CPU copy kept"
+        << RESET_TEXT << std::endl;
+}
+
+GfxSceneMesh::GfxSceneMesh(GfxScene* scene, GfxSceneHandle handle, const char* Name)
+    :scene(scene), handle(handle), name(Name)
+{
+    const GfxMeshRange& mesh = scene->meshes[scene->GetIndex(handle)];
+    vertexCount = mesh.vertices.count;
+    indexCount = mesh.indices.count;
+    residentBytes = gfxCtx->geometryArena->GetMeshBytes(mesh);
+}
+
+GfxSceneMesh::~GfxSceneMesh()
+{
+    if (evictedBuffer != VK_NULL_HANDLE)
+    {
+        DestroyBuffer_Internal(evictedBuffer, evictedAllocation);
+    }
+}
+
+bool GfxSceneMesh::Evict()
+{
+    GfxMeshRange& mesh = scene->meshes[scene->GetIndex(handle)];
+    CreateBuffer_Internal(residentBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, GfxMemoryUsage::CPU_ONLY,
+        evictedBuffer, evictedAllocation, name, name);
+
+    GfxUploadTicket ticket = gfxCtx->uploadContext->GetRecordingTicket();
+    VkCommandBuffer commandBuffer = BeginSingleTimeCommandBuffer_Internal();
+    gfxCtx->geometryArena->RecordMeshReadback(commandBuffer, mesh, evictedBuffer);
+    EndSingleTimeCommandBuffer_Internal(commandBuffer);
+    //Inside an upload batch nothing was submitted yet, the ranges can only be handed out again once they are read
+    gfxCtx->uploadContext->Wait(ticket);
+
+    //Draws of an evicted mesh are skipped until it is touched again
+    gfxCtx->geometryArena->FreeMesh(mesh);
+    return true;
+}
+
+void GfxSceneMesh::MakeResident()
+{
+    const char* data = static_cast<const char*>(evictedAllocation.mappedData);
+    VkDeviceSize vertexBytes = static_cast<VkDeviceSize>(vertexCount) * gfxCtx->geometryArena->GetVertexStride();
+    VkDeviceSize pulledVertexBytes = static_cast<VkDeviceSize>(vertexCount) * gfxCtx->geometryArena->GetPulledVertexStride();
+
+    //Can evict other meshes no frame in flight draws to make room
+    GfxMeshRange mesh = gfxCtx->geometryArena->AllocateMesh(data, vertexCount, reinterpret_cast<const uint32_t*>(data + vertexBytes + pulledVertexBytes),
+        indexCount, name, pulledVertexBytes > 0 ? data + vertexBytes : nullptr);
+    scene->meshes[scene->GetIndex(handle)] = mesh;
+
+    //The staging ring copied the data out already
+    DestroyBuffer_Internal(evictedBuffer, evictedAllocation);
+}
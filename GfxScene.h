@@ -0,0 +1,150 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GfxGeometryArena.h"
+#include "GfxResidencyManager.h"
+
+struct Vertex;
+class GfxScene;
+
+#define SCENE_INVALID_INDEX UINT32_MAX
+
+enum GfxSceneObjectFlags : uint32_t
+{
+	SCENE_OBJECT_DEFAULT = 0,
+	//Kept in the scene with its geometry but not drawn by any pass
+	SCENE_OBJECT_HIDDEN = 1 << 0,
+	//Given to GfxStaticBatcher::Add, the object keeps its own draw and handle so it can still move
+	SCENE_OBJECT_NO_STATIC_BATCHING = 1 << 1
+};
+
+//Slot index plus the generation the slot had when the object was created, stale handles are rejected
+struct GfxSceneHandle
+{
+	uint32_t slot = SCENE_INVALID_INDEX;
+	uint32_t generation = 0;
+};
+
+//Pipeline and per frame descriptor sets shared by every object using it
+struct GfxSceneMaterial
+{
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	//Vertex pulling variant with the same descriptors, VK_NULL_HANDLE when the material has none
+	VkPipeline pulledPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout pulledPipelineLayout = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> descriptorSets;
+	const char* name = "Unknown";
+};
+
+//Geometry arena ranges of one scene object as a streamable. Evict copies them on the GPU to a host buffer and
+//frees them, MakeResident uploads that copy again through the staging ring into new ranges.
+class GfxSceneMesh : public GfxStreamable
+{
+public:
+	GfxSceneMesh(GfxScene* scene, GfxSceneHandle handle, const char* Name);
+	~GfxSceneMesh();
+
+	GfxStreamableType GetStreamableType() const override { return GfxStreamableType::MESH; }
+	VkDeviceSize GetResidentBytes() const override { return residentBytes; }
+	bool IsResident() const override { return evictedBuffer == VK_NULL_HANDLE; }
+	bool Evict() override;
+	void MakeResident() override;
+	const char* GetStreamableName() const override { return name; }
+
+private:
+	GfxScene* scene = nullptr;
+	GfxSceneHandle handle;
+	const char* name = "Unknown";
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	VkDeviceSize residentBytes = 0;
+
+	VkBuffer evictedBuffer = VK_NULL_HANDLE;
+	GfxAllocation evictedAllocation;
+};
+
+//Scene objects as parallel dense arrays, entry i of every array is object i. Per frame loops (culling,
+//draw list building, GPU uploads) walk only the arrays they need, destroying swaps the last object into
+//the hole so the arrays stay packed and handles go through a slot table instead.
+//Geometry is uploaded to the geometry arena on Create and no CPU copy is kept, the residency manager can push
+//meshes no frame draws back to host memory through their GfxSceneMesh.
+class GfxScene
+{
+	friend class GfxSceneMesh;
+
+public:
+	uint32_t AddMaterial(VkPipeline pipeline, VkPipelineLayout pipelineLayout, const char* Name = "Unknown");
+	void SetMaterialDescriptorSets(uint32_t materialId, const std::vector<VkDescriptorSet>& descriptorSets);
+	void SetMaterialPulledPipeline(uint32_t materialId, VkPipeline pipeline, VkPipelineLayout pipelineLayout);
+	const GfxSceneMaterial& GetMaterial(uint32_t materialId) const { return materials[materialId]; }
+
+	GfxSceneHandle Create(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const glm::mat4& modelMatrix,
+		uint32_t materialId, uint32_t flags = SCENE_OBJECT_DEFAULT, const char* Name = "Unknown");
+	//The caller has to make sure no frame in flight still draws the object
+	void Destroy(GfxSceneHandle handle);
+	void Cleanup();
+
+	bool IsValid(GfxSceneHandle handle) const;
+	//Dense index of a live object, SCENE_INVALID_INDEX for stale handles
+	uint32_t GetIndex(GfxSceneHandle handle) const;
+	void SetModelMatrix(GfxSceneHandle handle, const glm::mat4& modelMatrix);
+	void SetFlags(GfxSceneHandle handle, uint32_t objectFlags);
+	//Marks the meshes of the dense indices as drawn by the frame being recorded, evicted ones come back first
+	void TouchMeshes(const std::vector<uint32_t>& indices);
+	//Same for every object that isn't hidden, for passes culled on the GPU
+	void TouchMeshes();
+
+	uint32_t GetObjectCount() const { return static_cast<uint32_t>(meshes.size()); }
+	//Bumped when objects are created, destroyed or change flags, dense indices are only stable between two bumps
+	uint32_t GetStructureVersion() const { return structureVersion; }
+	//Bumped when any world bounds change
+	uint32_t GetBoundsVersion() const { return boundsVersion; }
+
+	//Hot arrays
+	const std::vector<uint32_t>& GetTransformIndices() const { return transformIndices; }
+	const std::vector<GfxMeshRange>& GetMeshes() const { return meshes; }
+	const std::vector<uint32_t>& GetMaterialIds() const { return materialIds; }
+	const std::vector<uint32_t>& GetFlags() const { return flags; }
+	//Center xyz and radius w
+	const std::vector<glm::vec4>& GetWorldBoundingSpheres() const { return worldBoundingSpheres; }
+	const std::vector<glm::vec3>& GetWorldBoundsMin() const { return worldBoundsMin; }
+	const std::vector<glm::vec3>& GetWorldBoundsMax() const { return worldBoundsMax; }
+	//Cold arrays, only read on changes
+	const std::vector<glm::mat4>& GetModelMatrices() const { return modelMatrices; }
+	const std::vector<glm::vec3>& GetLocalBoundsMin() const { return localBoundsMin; }
+	const std::vector<glm::vec3>& GetLocalBoundsMax() const { return localBoundsMax; }
+	const char* GetName(uint32_t index) const { return names[index]; }
+
+	void PrintStats();
+
+private:
+	void UpdateWorldBounds(uint32_t index);
+
+	std::vector<uint32_t> transformIndices;
+	std::vector<GfxMeshRange> meshes;
+	std::vector<uint32_t> materialIds;
+	std::vector<uint32_t> flags;
+	std::vector<glm::vec4> worldBoundingSpheres;
+	std::vector<glm::vec3> worldBoundsMin;
+	std::vector<glm::vec3> worldBoundsMax;
+	std::vector<glm::mat4> modelMatrices;
+	std::vector<glm::vec3> localBoundsMin;
+	std::vector<glm::vec3> localBoundsMax;
+	std::vector<const char*> names;
+	std::vector<GfxSceneMesh*> streamedMeshes;
+	//Dense index to slot, to fix the slot of the object moved by Destroy
+	std::vector<uint32_t> denseSlots;
+
+	std::vector<uint32_t> slotIndices;
+	std::vector<uint32_t> slotGenerations;
+	std::vector<uint32_t> freeSlots;
+
+	std::vector<GfxSceneMaterial> materials;
+
+	uint32_t structureVersion = 0;
+	uint32_t boundsVersion = 0;
+	uint64_t uploadedGeometryBytes = 0;
+};
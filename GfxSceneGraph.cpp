@@ -0,0 +1,400 @@
+#include "GfxSceneGraph.h"
+#include "GfxJobPool.h"
+#include "gfxMaths.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <chrono>
+
+void GfxSceneGraph::Init(GfxJobPool* jobPool)
+{
+    this->jobPool = jobPool;
+    workerCount = jobPool->GetWorkerCount();
+    stats = GfxSceneGraphStats();
+    workerRanges.assign(workerCount, std::vector<Range>());
+}
+
+void GfxSceneGraph::Cleanup()
+{
+    workerRanges.clear();
+    jobPool = nullptr;
+}
+
+uint32_t GfxSceneGraph::CreateNode(uint32_t parent, const glm::mat4& localMatrix, GfxSceneHandle object)
+{
+    uint32_t node = GetNodeCount();
+    if (parent != SCENE_GRAPH_INVALID_NODE && parent >= node)
+    {
+        throw std::runtime_error("Error creating a scene graph node under a parent that does not exist!");
+    }
+
+    nodeParents.push_back(parent);
+    firstChildren.push_back(SCENE_GRAPH_INVALID_NODE);
+    lastChildren.push_back(SCENE_GRAPH_INVALID_NODE);
+    nextSiblings.push_back(SCENE_GRAPH_INVALID_NODE);
+    if (parent != SCENE_GRAPH_INVALID_NODE)
+    {
+        if (lastChildren[parent] == SCENE_GRAPH_INVALID_NODE)
+        {
+            firstChildren[parent] = node;
+        }
+        else
+        {
+            nextSiblings[lastChildren[parent]] = node;
+        }
+        lastChildren[parent] = node;
+    }
+
+    //Appended after its parent so the arrays stay valid until Rebuild restores the preorder
+    nodeLayoutIndices.push_back(static_cast<uint32_t>(layoutNodes.size()));
+    parents.push_back(parent != SCENE_GRAPH_INVALID_NODE ? nodeLayoutIndices[parent] : SCENE_GRAPH_INVALID_NODE);
+    subtreeEnds.push_back(static_cast<uint32_t>(layoutNodes.size() + 1));
+    layoutNodes.push_back(node);
+    localMatrices.push_back(localMatrix);
+    worldMatrices.push_back(localMatrix);
+    objects.push_back(object);
+    dirtyFlags.push_back(0);
+    objectCount += object.slot != SCENE_INVALID_INDEX ? 1 : 0;
+
+    layoutDirty = true;
+    return node;
+}
+
+void GfxSceneGraph::SetLocalMatrix(uint32_t node, const glm::mat4& localMatrix)
+{
+    uint32_t index = nodeLayoutIndices[node];
+    localMatrices[index] = localMatrix;
+    if (dirtyFlags[index] == 0)
+    {
+        dirtyFlags[index] = 1;
+        dirtyIndices.push_back(index);
+    }
+}
+
+void GfxSceneGraph::Rebuild()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    uint32_t nodeCount = GetNodeCount();
+    std::vector<uint32_t> order;
+    order.reserve(nodeCount);
+    std::vector<uint32_t> newLayoutIndices(nodeCount);
+    std::vector<uint32_t> stack;
+    std::vector<uint32_t> children;
+
+    //Depth first, children pushed in reverse so they come out in creation order
+    for (uint32_t root = 0; root < nodeCount; ++root)
+    {
+        if (nodeParents[root] != SCENE_GRAPH_INVALID_NODE)
+        {
+            continue;
+        }
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            uint32_t node = stack.back();
+            stack.pop_back();
+            newLayoutIndices[node] = static_cast<uint32_t>(order.size());
+            order.push_back(node);
+
+            children.clear();
+            for (uint32_t child = firstChildren[node]; child != SCENE_GRAPH_INVALID_NODE; child = nextSiblings[child])
+            {
+                children.push_back(child);
+            }
+            stack.insert(stack.end(), children.rbegin(), children.rend());
+        }
+    }
+
+    std::vector<uint32_t> newParents(nodeCount);
+    std::vector<glm::mat4> newLocalMatrices(nodeCount);
+    std::vector<GfxSceneHandle> newObjects(nodeCount);
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        uint32_t node = order[i];
+        uint32_t oldIndex = nodeLayoutIndices[node];
+        newParents[i] = nodeParents[node] != SCENE_GRAPH_INVALID_NODE ? newLayoutIndices[nodeParents[node]] : SCENE_GRAPH_INVALID_NODE;
+        newLocalMatrices[i] = localMatrices[oldIndex];
+        newObjects[i] = objects[oldIndex];
+    }
+
+    //Children come after their parent, walking backwards adds every subtree size to its parent before the parent is read
+    subtreeEnds.assign(nodeCount, 1);
+    for (uint32_t i = nodeCount; i-- > 0;)
+    {
+        if (newParents[i] != SCENE_GRAPH_INVALID_NODE)
+        {
+            subtreeEnds[newParents[i]] += subtreeEnds[i];
+        }
+    }
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        subtreeEnds[i] += i;
+    }
+
+    parents.swap(newParents);
+    localMatrices.swap(newLocalMatrices);
+    objects.swap(newObjects);
+    layoutNodes.swap(order);
+    nodeLayoutIndices.swap(newLayoutIndices);
+    worldMatrices.resize(nodeCount);
+    dirtyFlags.assign(nodeCount, 0);
+    dirtyIndices.clear();
+    layoutDirty = false;
+
+    auto end = std::chrono::high_resolution_clock::now();
+    ++stats.rebuilds;
+    stats.rebuildMs += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void GfxSceneGraph::Update(GfxScene* scene)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    dirtyRanges.clear();
+    if (layoutDirty)
+    {
+        //Every node moved in the arrays, recompute them all once
+        Rebuild();
+        for (uint32_t i = 0; i < GetNodeCount(); i = subtreeEnds[i])
+        {
+            dirtyRanges.push_back({ i, subtreeEnds[i] });
+        }
+    }
+    else
+    {
+        //Sorted, a dirty node inside a subtree already queued is covered by it
+        std::sort(dirtyIndices.begin(), dirtyIndices.end());
+        uint32_t coveredEnd = 0;
+        for (uint32_t index : dirtyIndices)
+        {
+            dirtyFlags[index] = 0;
+            if (index >= coveredEnd)
+            {
+                dirtyRanges.push_back({ index, subtreeEnds[index] });
+                coveredEnd = subtreeEnds[index];
+            }
+        }
+        dirtyIndices.clear();
+    }
+
+    if (!dirtyRanges.empty())
+    {
+        ComputeRanges(scene);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    ++stats.updates;
+    stats.updateMs += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void GfxSceneGraph::UpdateAll(GfxScene* scene)
+{
+    if (layoutDirty)
+    {
+        Rebuild();
+    }
+    for (uint32_t index : dirtyIndices)
+    {
+        dirtyFlags[index] = 0;
+    }
+    dirtyIndices.clear();
+
+    dirtyRanges.clear();
+    for (uint32_t i = 0; i < GetNodeCount(); i = subtreeEnds[i])
+    {
+        dirtyRanges.push_back({ i, subtreeEnds[i] });
+    }
+    ComputeRanges(scene);
+}
+
+void GfxSceneGraph::ComputeRanges(GfxScene* scene)
+{
+    uint32_t nodeCount = 0;
+    for (const Range& range : dirtyRanges)
+    {
+        nodeCount += range.end - range.begin;
+    }
+    stats.recomputedNodes += nodeCount;
+    stats.dirtySubtrees += dirtyRanges.size();
+
+    uint32_t usedWorkers = std::min(workerCount, std::max(nodeCount / SCENE_GRAPH_MIN_NODES_PER_WORKER, 1u));
+    if (usedWorkers <= 1)
+    {
+        for (const Range& range : dirtyRanges)
+        {
+            ComputeRange(range);
+        }
+    }
+    else
+    {
+        //Subtrees bigger than a fraction of a worker share are split below their root. The root is computed
+        //here first, its children subtrees only read it and are independent of each other
+        uint32_t splitSize = std::max(nodeCount / (usedWorkers * 4), 1u);
+        std::vector<Range> pendingRanges(dirtyRanges);
+        splitRanges.clear();
+        while (!pendingRanges.empty())
+        {
+            Range range = pendingRanges.back();
+            pendingRanges.pop_back();
+            if (range.end - range.begin <= splitSize)
+            {
+                splitRanges.push_back(range);
+                continue;
+            }
+            ComputeRange({ range.begin, range.begin + 1 });
+            for (uint32_t child = range.begin + 1; child < range.end; child = subtreeEnds[child])
+            {
+                pendingRanges.push_back({ child, subtreeEnds[child] });
+            }
+        }
+
+        //Consecutive ranges until each worker has its share
+        for (std::vector<Range>& ranges : workerRanges)
+        {
+            ranges.clear();
+        }
+        uint32_t worker = 0;
+        uint32_t assignedCount = 0;
+        uint32_t workerShare = (nodeCount + usedWorkers - 1) / usedWorkers;
+        for (const Range& range : splitRanges)
+        {
+            workerRanges[worker].push_back(range);
+            assignedCount += range.end - range.begin;
+            if (assignedCount >= workerShare * (worker + 1) && worker + 1 < usedWorkers)
+            {
+                ++worker;
+            }
+        }
+
+        jobPool->Run([this](uint32_t workerIndex)
+        {
+            for (const Range& range : workerRanges[workerIndex])
+            {
+                ComputeRange(range);
+            }
+        });
+        ++stats.parallelUpdates;
+    }
+
+    //The scene is not thread safe, objects are moved from here once every world matrix is done
+    if (scene != nullptr && objectCount > 0)
+    {
+        for (const Range& range : dirtyRanges)
+        {
+            for (uint32_t i = range.begin; i < range.end; ++i)
+            {
+                if (objects[i].slot != SCENE_INVALID_INDEX && scene->IsValid(objects[i]))
+                {
+                    scene->SetModelMatrix(objects[i], worldMatrices[i]);
+                }
+            }
+        }
+    }
+}
+
+void GfxSceneGraph::ComputeRange(const Range& range)
+{
+    //The parent of range.begin is outside the range and already up to date, every other parent is inside and comes first
+    for (uint32_t i = range.begin; i < range.end; ++i)
+    {
+        uint32_t parent = parents[i];
+        worldMatrices[i] = parent != SCENE_GRAPH_INVALID_NODE ? worldMatrices[parent] * localMatrices[i] : localMatrices[i];
+    }
+}
+
+void GfxSceneGraph::PrintStats()
+{
+    uint64_t updates = std::max<uint64_t>(stats.updates, 1);
+    std::cout << CYAN_TEXT << "Scene graph: " << GetNodeCount() << " nodes, " << stats.updates << " updates, "
+        << stats.recomputedNodes / updates << " nodes in " << stats.dirtySubtrees / updates << " dirty subtrees recomputed per update, "
+        << stats.updateMs / updates << "ms average, " << stats.parallelUpdates << " parallel updates (" << workerCount << " workers), "
+        << stats.rebuilds << " layout rebuilds in " << stats.rebuildMs << "ms" << RESET_TEXT << std::endl;
+}
+
+void RunSceneGraphBenchmark()
+{
+    const uint32_t hierarchyCount = 1000;
+    const uint32_t nodesPerHierarchy = 100;
+    const uint32_t nodeCount = hierarchyCount * nodesPerHierarchy;
+    const uint32_t movingCount = nodeCount / 100;
+    const uint32_t frames = 100;
+
+    std::cout << MAGENTA_TEXT << "Scene graph benchmark (" << nodeCount << " nodes in " << hierarchyCount << " hierarchies, "
+        << movingCount << " moving per frame)" << RESET_TEXT << std::endl;
+
+    for (uint32_t workerCount = 1; workerCount <= SCENE_GRAPH_MAX_WORKERS; workerCount *= 2)
+    {
+        std::mt19937 rndEngine(1234);
+        std::uniform_real_distribution<float> positionDist(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> offsetDist(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> angleDist(-180.0f, 180.0f);
+
+        //Characters, vehicles and props: each node hangs from a random earlier node of its own hierarchy
+        GfxJobPool jobPool;
+        jobPool.Init(workerCount);
+        GfxSceneGraph graph;
+        graph.Init(&jobPool);
+        for (uint32_t hierarchy = 0; hierarchy < hierarchyCount; ++hierarchy)
+        {
+            uint32_t root = graph.CreateNode(SCENE_GRAPH_INVALID_NODE,
+                glm::translate(glm::mat4(1.0f), glm::vec3(positionDist(rndEngine), 0.0f, positionDist(rndEngine))));
+            for (uint32_t i = 1; i < nodesPerHierarchy; ++i)
+            {
+                uint32_t parent = root + static_cast<uint32_t>(rndEngine() % i);
+                graph.CreateNode(parent, glm::translate(glm::mat4(1.0f), glm::vec3(offsetDist(rndEngine), offsetDist(rndEngine), offsetDist(rndEngine))));
+            }
+        }
+        graph.Update(nullptr);
+        double rebuildMs = graph.GetStats().rebuildMs;
+
+        std::uniform_int_distribution<uint32_t> nodeDist(0, nodeCount - 1);
+        GfxSceneGraphStats before = graph.GetStats();
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            for (uint32_t i = 0; i < movingCount; ++i)
+            {
+                uint32_t node = nodeDist(rndEngine);
+                graph.SetLocalMatrix(node, glm::rotate(graph.GetLocalMatrix(node), glm::radians(angleDist(rndEngine)), glm::vec3(0.0f, 1.0f, 0.0f)));
+            }
+            graph.Update(nullptr);
+        }
+        const GfxSceneGraphStats& after = graph.GetStats();
+        double incrementalUs = (after.updateMs - before.updateMs) * 1000.0 / frames;
+        uint64_t recomputedPerFrame = (after.recomputedNodes - before.recomputedNodes) / frames;
+
+        std::vector<glm::mat4> incrementalWorldMatrices(nodeCount);
+        for (uint32_t node = 0; node < nodeCount; ++node)
+        {
+            incrementalWorldMatrices[node] = graph.GetWorldMatrix(node);
+        }
+
+        auto fullStart = std::chrono::high_resolution_clock::now();
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            graph.UpdateAll(nullptr);
+        }
+        double fullUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - fullStart).count() / frames;
+
+        for (uint32_t node = 0; node < nodeCount; ++node)
+        {
+            if (graph.GetWorldMatrix(node) != incrementalWorldMatrices[node])
+            {
+                throw std::runtime_error("Error incremental scene graph update differs from the full recompute!");
+            }
+        }
+
+        std::cout << "  " << workerCount << " workers: " << incrementalUs << "us incremental (" << recomputedPerFrame << " nodes recomputed), "
+            << fullUs << "us full recompute";
+        if (incrementalUs > 0.0)
+        {
+            std::cout << " (" << fullUs / incrementalUs << "x)";
+        }
+        std::cout << ", " << rebuildMs << "ms layout build" << std::endl;
+        graph.Cleanup();
+        jobPool.Cleanup();
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GfxScene.h"
+
+class GfxJobPool;
+
+#define SCENE_GRAPH_INVALID_NODE UINT32_MAX
+//Most job pool workers the benchmark updates with
+#define SCENE_GRAPH_MAX_WORKERS 4
+//Below this many dirty nodes per worker the update stays on the calling thread
+#define SCENE_GRAPH_MIN_NODES_PER_WORKER 4096
+
+struct GfxSceneGraphStats
+{
+	uint64_t updates = 0;
+	uint64_t recomputedNodes = 0;
+	uint64_t dirtySubtrees = 0;
+	uint64_t parallelUpdates = 0;
+	uint64_t rebuilds = 0;
+	double updateMs = 0.0;
+	double rebuildMs = 0.0;
+};
+
+//Parent-child transform hierarchy in flat arrays. Nodes are laid out in depth first preorder, so a parent
+//always comes before its children and the subtree of node i is the contiguous range [i, subtreeEnds[i]).
+//SetLocalMatrix only records the node as dirty, Update sorts the dirty nodes and recomputes each dirty
+//subtree once, in parallel when there is enough work. Node ids stay stable, creating nodes rebuilds the
+//layout on the next Update. A node can drive the model matrix of a scene object.
+class GfxSceneGraph
+{
+public:
+	//Big updates are split across the workers of jobPool
+	void Init(GfxJobPool* jobPool);
+	void Cleanup();
+
+	//parent SCENE_GRAPH_INVALID_NODE for a root, returns the node id
+	uint32_t CreateNode(uint32_t parent, const glm::mat4& localMatrix, GfxSceneHandle object = GfxSceneHandle());
+	void SetLocalMatrix(uint32_t node, const glm::mat4& localMatrix);
+	const glm::mat4& GetLocalMatrix(uint32_t node) const { return localMatrices[nodeLayoutIndices[node]]; }
+	//As of the last Update
+	const glm::mat4& GetWorldMatrix(uint32_t node) const { return worldMatrices[nodeLayoutIndices[node]]; }
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(nodeParents.size()); }
+
+	//Recomputes the dirty subtrees and sets the model matrix of their scene objects
+	void Update(GfxScene* scene);
+	//Recomputes every node, reference for the benchmark
+	void UpdateAll(GfxScene* scene);
+
+	const GfxSceneGraphStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	struct Range
+	{
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	void Rebuild();
+	void ComputeRanges(GfxScene* scene);
+	void ComputeRange(const Range& range);
+
+	//By node id
+	std::vector<uint32_t> nodeParents;
+	std::vector<uint32_t> firstChildren;
+	std::vector<uint32_t> lastChildren;
+	std::vector<uint32_t> nextSiblings;
+	std::vector<uint32_t> nodeLayoutIndices;
+
+	//By layout index
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> subtreeEnds;
+	std::vector<uint32_t> layoutNodes;
+	std::vector<glm::mat4> localMatrices;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<GfxSceneHandle> objects;
+	std::vector<uint8_t> dirtyFlags;
+
+	std::vector<uint32_t> dirtyIndices;
+	//Dirty subtrees of this Update, then the split of the big ones handed to the workers
+	std::vector<Range> dirtyRanges;
+	std::vector<Range> splitRanges;
+	bool layoutDirty = false;
+	uint32_t objectCount = 0;
+
+	//[worker], the split ranges each worker computes
+	std::vector<std::vector<Range>> workerRanges;
+	GfxJobPool* jobPool = nullptr;
+	uint32_t workerCount = 1;
+
+	GfxSceneGraphStats stats;
+};
+
+//Updates a 100k node forest with 1% of the nodes moving every frame, incrementally and with a full recompute
+void RunSceneGraphBenchmark();
@@ -0,0 +1,651 @@
+#include "GfxSoftwareOcclusion.h"
+#include "GfxJobPool.h"
+#include "gfxMaths.h"
+#include "ColorsDef.h"
+
+#include <immintrin.h>
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <cfloat>
+#include <cmath>
+#include <chrono>
+
+void GfxSoftwareOcclusion::Init(GfxJobPool* jobPool)
+{
+    this->jobPool = jobPool;
+    workerCount = std::min(jobPool->GetWorkerCount(), tilesY);
+    stats = GfxSoftwareOcclusionStats();
+    tiles.assign(static_cast<size_t>(tilesX) * tilesY, GfxOcclusionTile());
+
+    bandBegins.resize(workerCount + 1);
+    for (uint32_t i = 0; i <= workerCount; ++i)
+    {
+        bandBegins[i] = i * tilesY / workerCount;
+    }
+}
+
+void GfxSoftwareOcclusion::Cleanup()
+{
+    ClearOccluders();
+    jobPool = nullptr;
+}
+
+void GfxSoftwareOcclusion::AddOccluder(GfxSceneHandle handle, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+    Occluder occluder;
+    occluder.handle = handle;
+    occluder.positions = positions;
+    occluder.indices = indices;
+    occluders.push_back(occluder);
+}
+
+void GfxSoftwareOcclusion::AddOccluder(const glm::mat4& modelMatrix, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+    Occluder occluder;
+    occluder.modelMatrix = modelMatrix;
+    occluder.positions = positions;
+    occluder.indices = indices;
+    occluders.push_back(occluder);
+}
+
+void GfxSoftwareOcclusion::ClearOccluders()
+{
+    occluders.clear();
+    triangles.clear();
+}
+
+void GfxSoftwareOcclusion::GenerateBoxOccluder(const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+    positions.clear();
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        positions.push_back(glm::vec3((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z));
+    }
+
+    //Both faces are rasterized, the winding does not matter
+    indices =
+    {
+        0, 1, 3, 0, 3, 2,
+        4, 5, 7, 4, 7, 6,
+        0, 1, 5, 0, 5, 4,
+        2, 3, 7, 2, 7, 6,
+        0, 2, 6, 0, 6, 4,
+        1, 3, 7, 1, 7, 5
+    };
+}
+
+void GfxSoftwareOcclusion::Render(const glm::mat4& viewProjection, const GfxScene* scene)
+{
+    auto setupStart = std::chrono::high_resolution_clock::now();
+
+    this->viewProjection = viewProjection;
+    triangles.clear();
+    for (const Occluder& occluder : occluders)
+    {
+        glm::mat4 modelMatrix = occluder.modelMatrix;
+        if (occluder.handle.slot != SCENE_INVALID_INDEX)
+        {
+            uint32_t index = scene != nullptr ? scene->GetIndex(occluder.handle) : SCENE_INVALID_INDEX;
+            if (index == SCENE_INVALID_INDEX || (scene->GetFlags()[index] & SCENE_OBJECT_HIDDEN) != 0)
+            {
+                continue;
+            }
+            modelMatrix = scene->GetModelMatrices()[index];
+        }
+        SetupOccluder(occluder, viewProjection * modelMatrix);
+    }
+
+    auto rasterizationStart = std::chrono::high_resolution_clock::now();
+
+    //Pool workers past the tile rows have no band
+    jobPool->Run([this](uint32_t workerIndex)
+    {
+        if (workerIndex < workerCount)
+        {
+            RasterizeBand(workerIndex);
+        }
+    });
+
+    auto end = std::chrono::high_resolution_clock::now();
+    ++stats.frames;
+    stats.rasterizedTriangles += triangles.size();
+    stats.setupMs += std::chrono::duration<double, std::milli>(rasterizationStart - setupStart).count();
+    stats.rasterizationMs += std::chrono::duration<double, std::milli>(end - rasterizationStart).count();
+}
+
+void GfxSoftwareOcclusion::SetupOccluder(const Occluder& occluder, const glm::mat4& modelViewProjection)
+{
+    clipPositions.resize(occluder.positions.size());
+    for (size_t i = 0; i < occluder.positions.size(); ++i)
+    {
+        clipPositions[i] = modelViewProjection * glm::vec4(occluder.positions[i], 1.0f);
+    }
+
+    const float width = static_cast<float>(SOFTWARE_OCCLUSION_WIDTH);
+    const float height = static_cast<float>(SOFTWARE_OCCLUSION_HEIGHT);
+    for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3)
+    {
+        ++stats.occluderTriangles;
+        const glm::vec4* clip[3] = { &clipPositions[occluder.indices[i]], &clipPositions[occluder.indices[i + 1]], &clipPositions[occluder.indices[i + 2]] };
+
+        //Triangles crossing the near plane are dropped instead of clipped, an occluder missing is always safe
+        bool crossesNear = false;
+        bool allLeft = true, allRight = true, allBottom = true, allTop = true;
+        for (const glm::vec4* vertex : clip)
+        {
+            crossesNear |= vertex->z < 0.0f || vertex->w <= 0.0f;
+            allLeft &= vertex->x < -vertex->w;
+            allRight &= vertex->x > vertex->w;
+            allBottom &= vertex->y < -vertex->w;
+            allTop &= vertex->y > vertex->w;
+        }
+        if (crossesNear || allLeft || allRight || allBottom || allTop)
+        {
+            continue;
+        }
+
+        float x[3], y[3], z[3];
+        for (int v = 0; v < 3; ++v)
+        {
+            float invW = 1.0f / clip[v]->w;
+            x[v] = (clip[v]->x * invW * 0.5f + 0.5f) * width;
+            y[v] = (clip[v]->y * invW * 0.5f + 0.5f) * height;
+            z[v] = clip[v]->z * invW;
+        }
+
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (std::abs(area) < 1e-6f)
+        {
+            continue;
+        }
+
+        Triangle triangle;
+        //Edge i goes from vertex i to vertex i + 1, flipped for clockwise triangles so the inside is always positive
+        float orientation = area > 0.0f ? 1.0f : -1.0f;
+        for (int edge = 0; edge < 3; ++edge)
+        {
+            int next = (edge + 1) % 3;
+            float a = -(y[next] - y[edge]) * orientation;
+            float b = (x[next] - x[edge]) * orientation;
+            triangle.edgeA[edge] = a;
+            triangle.edgeB[edge] = b;
+            triangle.edgeC[edge] = -a * x[edge] - b * y[edge];
+        }
+
+        triangle.depthDx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+        triangle.depthDy = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+        triangle.depthBase = z[0] - triangle.depthDx * x[0] - triangle.depthDy * y[0];
+        triangle.maxDepth = std::max(std::max(z[0], z[1]), z[2]);
+
+        float minX = std::min(std::min(x[0], x[1]), x[2]);
+        float maxX = std::max(std::max(x[0], x[1]), x[2]);
+        float minY = std::min(std::min(y[0], y[1]), y[2]);
+        float maxY = std::max(std::max(y[0], y[1]), y[2]);
+        if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+        {
+            continue;
+        }
+        triangle.tileMinX = static_cast<int>(std::max(minX, 0.0f)) / SOFTWARE_OCCLUSION_TILE_WIDTH;
+        triangle.tileMinY = static_cast<int>(std::max(minY, 0.0f)) / SOFTWARE_OCCLUSION_TILE_HEIGHT;
+        triangle.tileMaxX = static_cast<int>(std::min(maxX, width - 1.0f)) / SOFTWARE_OCCLUSION_TILE_WIDTH;
+        triangle.tileMaxY = static_cast<int>(std::min(maxY, height - 1.0f)) / SOFTWARE_OCCLUSION_TILE_HEIGHT;
+
+        triangles.push_back(triangle);
+    }
+}
+
+void GfxSoftwareOcclusion::RasterizeBand(uint32_t workerIndex)
+{
+    const int bandBegin = static_cast<int>(bandBegins[workerIndex]);
+    const int bandEnd = static_cast<int>(bandBegins[workerIndex + 1]);
+
+    std::fill(tiles.begin() + static_cast<size_t>(bandBegin) * tilesX, tiles.begin() + static_cast<size_t>(bandEnd) * tilesX, GfxOcclusionTile());
+
+    const __m128 columnOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (const Triangle& triangle : triangles)
+    {
+        int tileMinY = std::max(triangle.tileMinY, bandBegin);
+        int tileMaxY = std::min(triangle.tileMaxY, bandEnd - 1);
+        if (tileMinY > tileMaxY)
+        {
+            continue;
+        }
+
+        __m128 edgeA[3];
+        for (int edge = 0; edge < 3; ++edge)
+        {
+            edgeA[edge] = _mm_set1_ps(triangle.edgeA[edge]);
+        }
+
+        for (int tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+        {
+            float tileTop = static_cast<float>(tileY * SOFTWARE_OCCLUSION_TILE_HEIGHT);
+            for (int tileX = triangle.tileMinX; tileX <= triangle.tileMaxX; ++tileX)
+            {
+                float tileLeft = static_cast<float>(tileX * SOFTWARE_OCCLUSION_TILE_WIDTH);
+
+                //Whole tile outside one edge when even the pixel center furthest along it is outside
+                bool outside = false;
+                for (int edge = 0; edge < 3 && !outside; ++edge)
+                {
+                    float cornerX = tileLeft + (triangle.edgeA[edge] >= 0.0f ? SOFTWARE_OCCLUSION_TILE_WIDTH - 0.5f : 0.5f);
+                    float cornerY = tileTop + (triangle.edgeB[edge] >= 0.0f ? SOFTWARE_OCCLUSION_TILE_HEIGHT - 0.5f : 0.5f);
+                    outside = triangle.edgeA[edge] * cornerX + triangle.edgeB[edge] * cornerY + triangle.edgeC[edge] < 0.0f;
+                }
+                if (outside)
+                {
+                    continue;
+                }
+
+                //Farthest depth of the triangle plane over the tile, never past the farthest vertex
+                float depthX = tileLeft + (triangle.depthDx >= 0.0f ? SOFTWARE_OCCLUSION_TILE_WIDTH : 0.0f);
+                float depthY = tileTop + (triangle.depthDy >= 0.0f ? SOFTWARE_OCCLUSION_TILE_HEIGHT : 0.0f);
+                float tileDepth = std::min(triangle.depthBase + triangle.depthDx * depthX + triangle.depthDy * depthY, triangle.maxDepth);
+
+                GfxOcclusionTile& tile = tiles[static_cast<size_t>(tileY) * tilesX + tileX];
+                if (tileDepth >= tile.referenceDepth)
+                {
+                    continue;
+                }
+
+                uint32_t coverageMask = 0;
+                for (int row = 0; row < SOFTWARE_OCCLUSION_TILE_HEIGHT; ++row)
+                {
+                    float pixelY = tileTop + row + 0.5f;
+                    for (int half = 0; half < SOFTWARE_OCCLUSION_TILE_WIDTH / 4; ++half)
+                    {
+                        __m128 pixelX = _mm_add_ps(_mm_set1_ps(tileLeft + half * 4), columnOffsets);
+                        __m128 inside = _mm_cmpeq_ps(zero, zero);
+                        for (int edge = 0; edge < 3; ++edge)
+                        {
+                            __m128 rowValue = _mm_set1_ps(triangle.edgeB[edge] * pixelY + triangle.edgeC[edge]);
+                            __m128 edgeValue = _mm_add_ps(_mm_mul_ps(edgeA[edge], pixelX), rowValue);
+                            inside = _mm_and_ps(inside, _mm_cmpge_ps(edgeValue, zero));
+                        }
+                        coverageMask |= static_cast<uint32_t>(_mm_movemask_ps(inside)) << (row * SOFTWARE_OCCLUSION_TILE_WIDTH + half * 4);
+                    }
+                }
+                if (coverageMask == 0)
+                {
+                    continue;
+                }
+
+                //Working layer dropped when the triangle is much nearer than it, always safe since referenceDepth still bounds every pixel
+                if (tile.workingDepth - tileDepth > tile.referenceDepth - tile.workingDepth)
+                {
+                    tile.workingDepth = 0.0f;
+                    tile.coverageMask = 0;
+                }
+                tile.workingDepth = std::max(tile.workingDepth, tileDepth);
+                tile.coverageMask |= coverageMask;
+
+                //A full working layer becomes the reference layer
+                if (tile.coverageMask == UINT32_MAX)
+                {
+                    tile.referenceDepth = std::min(tile.referenceDepth, tile.workingDepth);
+                    tile.workingDepth = 0.0f;
+                    tile.coverageMask = 0;
+                }
+            }
+        }
+    }
+}
+
+bool GfxSoftwareOcclusion::IsOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+    const float width = static_cast<float>(SOFTWARE_OCCLUSION_WIDTH);
+    const float height = static_cast<float>(SOFTWARE_OCCLUSION_HEIGHT);
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearestDepth = FLT_MAX;
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        glm::vec3 position((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+        glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+        if (clip.z < 0.0f || clip.w <= 0.0f)
+        {
+            return false;
+        }
+
+        float invW = 1.0f / clip.w;
+        float x = (clip.x * invW * 0.5f + 0.5f) * width;
+        float y = (clip.y * invW * 0.5f + 0.5f) * height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearestDepth = std::min(nearestDepth, clip.z * invW);
+    }
+
+    //Off screen is for frustum culling to decide
+    if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+    {
+        return false;
+    }
+
+    //Every pixel the rectangle touches, not only the ones whose center it covers
+    int pixelMinX = static_cast<int>(std::max(minX, 0.0f));
+    int pixelMinY = static_cast<int>(std::max(minY, 0.0f));
+    int pixelMaxX = static_cast<int>(std::min(maxX, width - 1.0f));
+    int pixelMaxY = static_cast<int>(std::min(maxY, height - 1.0f));
+
+    for (int tileY = pixelMinY / SOFTWARE_OCCLUSION_TILE_HEIGHT; tileY <= pixelMaxY / SOFTWARE_OCCLUSION_TILE_HEIGHT; ++tileY)
+    {
+        int rowBegin = std::max(pixelMinY - tileY * SOFTWARE_OCCLUSION_TILE_HEIGHT, 0);
+        int rowEnd = std::min(pixelMaxY - tileY * SOFTWARE_OCCLUSION_TILE_HEIGHT, SOFTWARE_OCCLUSION_TILE_HEIGHT - 1);
+        for (int tileX = pixelMinX / SOFTWARE_OCCLUSION_TILE_WIDTH; tileX <= pixelMaxX / SOFTWARE_OCCLUSION_TILE_WIDTH; ++tileX)
+        {
+            const GfxOcclusionTile& tile = tiles[static_cast<size_t>(tileY) * tilesX + tileX];
+            if (nearestDepth > tile.referenceDepth)
+            {
+                continue;
+            }
+
+            int columnBegin = std::max(pixelMinX - tileX * SOFTWARE_OCCLUSION_TILE_WIDTH, 0);
+            int columnEnd = std::min(pixelMaxX - tileX * SOFTWARE_OCCLUSION_TILE_WIDTH, SOFTWARE_OCCLUSION_TILE_WIDTH - 1);
+            uint32_t columnBits = ((2u << columnEnd) - 1u) & ~((1u << columnBegin) - 1u);
+            uint32_t rectangleMask = 0;
+            for (int row = rowBegin; row <= rowEnd; ++row)
+            {
+                rectangleMask |= columnBits << (row * SOFTWARE_OCCLUSION_TILE_WIDTH);
+            }
+
+            //Only the working layer is nearer, it hides the object when it covers all of its pixels in the tile
+            if ((rectangleMask & ~tile.coverageMask) == 0 && nearestDepth > tile.workingDepth)
+            {
+                continue;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t GfxSoftwareOcclusion::CullOccluded(const GfxScene& scene, std::vector<uint32_t>& visibleIndices)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const std::vector<glm::vec3>& boundsMin = scene.GetWorldBoundsMin();
+    const std::vector<glm::vec3>& boundsMax = scene.GetWorldBoundsMax();
+    size_t keptCount = 0;
+    for (uint32_t index : visibleIndices)
+    {
+        if (!IsOccluded(boundsMin[index], boundsMax[index]))
+        {
+            visibleIndices[keptCount++] = index;
+        }
+    }
+    uint32_t occludedCount = static_cast<uint32_t>(visibleIndices.size() - keptCount);
+    stats.testedObjects += visibleIndices.size();
+    stats.occludedObjects += occludedCount;
+    visibleIndices.resize(keptCount);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    stats.testMs += std::chrono::duration<double, std::milli>(end - start).count();
+    return occludedCount;
+}
+
+float GfxSoftwareOcclusion::GetPixelDepth(uint32_t x, uint32_t y) const
+{
+    const GfxOcclusionTile& tile = tiles[static_cast<size_t>(y / SOFTWARE_OCCLUSION_TILE_HEIGHT) * tilesX + x / SOFTWARE_OCCLUSION_TILE_WIDTH];
+    uint32_t bit = 1u << ((y % SOFTWARE_OCCLUSION_TILE_HEIGHT) * SOFTWARE_OCCLUSION_TILE_WIDTH + x % SOFTWARE_OCCLUSION_TILE_WIDTH);
+    return (tile.coverageMask & bit) != 0 ? std::min(tile.workingDepth, tile.referenceDepth) : tile.referenceDepth;
+}
+
+void GfxSoftwareOcclusion::DumpToImage(const char* path) const
+{
+    std::vector<float> depths(static_cast<size_t>(SOFTWARE_OCCLUSION_WIDTH) * SOFTWARE_OCCLUSION_HEIGHT);
+    float nearestDepth = 1.0f;
+    float farthestDepth = 0.0f;
+    for (uint32_t y = 0; y < SOFTWARE_OCCLUSION_HEIGHT; ++y)
+    {
+        for (uint32_t x = 0; x < SOFTWARE_OCCLUSION_WIDTH; ++x)
+        {
+            float depth = GetPixelDepth(x, y);
+            depths[static_cast<size_t>(y) * SOFTWARE_OCCLUSION_WIDTH + x] = depth;
+            if (depth < 1.0f)
+            {
+                nearestDepth = std::min(nearestDepth, depth);
+                farthestDepth = std::max(farthestDepth, depth);
+            }
+        }
+    }
+
+    //Perspective depth bunches up near 1, the written range is stretched over the gray levels
+    float range = std::max(farthestDepth - nearestDepth, 1e-6f);
+    std::vector<unsigned char> pixels(depths.size());
+    for (size_t i = 0; i < depths.size(); ++i)
+    {
+        pixels[i] = depths[i] >= 1.0f ? 0 : static_cast<unsigned char>(255.0f - 191.0f * (depths[i] - nearestDepth) / range);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << YELLOW_TEXT << "Could not write occlusion buffer to " << path << RESET_TEXT << std::endl;
+        return;
+    }
+    file << "P5\n" << SOFTWARE_OCCLUSION_WIDTH << " " << SOFTWARE_OCCLUSION_HEIGHT << "\n255\n";
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    std::cout << MAGENTA_TEXT << "Occlusion buffer written to " << path << RESET_TEXT << std::endl;
+}
+
+void GfxSoftwareOcclusion::PrintStats()
+{
+    uint64_t frames = std::max<uint64_t>(stats.frames, 1);
+    double occludedPercent = stats.testedObjects > 0 ? 100.0 * stats.occludedObjects / stats.testedObjects : 0.0;
+    std::cout << CYAN_TEXT << "Software occlusion: " << stats.frames << " frames, " << stats.rasterizedTriangles / frames << "/"
+        << stats.occluderTriangles / frames << " occluder triangles rasterized per frame, " << stats.setupMs / frames << "ms setup, "
+        << stats.rasterizationMs / frames << "ms rasterization (" << workerCount << " workers), " << stats.testMs / frames << "ms testing, "
+        << occludedPercent << "% of the tested objects occluded" << RESET_TEXT << std::endl;
+}
+
+//Per pixel depth of the same triangles one pixel at a time, the masked buffer must never be nearer than it
+static void RasterizeReference(const std::vector<glm::vec3>& worldTriangles, const glm::mat4& viewProjection, std::vector<float>& depths)
+{
+    const float width = static_cast<float>(SOFTWARE_OCCLUSION_WIDTH);
+    const float height = static_cast<float>(SOFTWARE_OCCLUSION_HEIGHT);
+    depths.assign(static_cast<size_t>(SOFTWARE_OCCLUSION_WIDTH) * SOFTWARE_OCCLUSION_HEIGHT, 1.0f);
+
+    for (size_t i = 0; i + 2 < worldTriangles.size(); i += 3)
+    {
+        float x[3], y[3], z[3];
+        bool crossesNear = false;
+        for (int v = 0; v < 3; ++v)
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(worldTriangles[i + v], 1.0f);
+            crossesNear |= clip.z < 0.0f || clip.w <= 0.0f;
+            float invW = 1.0f / clip.w;
+            x[v] = (clip.x * invW * 0.5f + 0.5f) * width;
+            y[v] = (clip.y * invW * 0.5f + 0.5f) * height;
+            z[v] = clip.z * invW;
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (crossesNear || std::abs(area) < 1e-6f)
+        {
+            continue;
+        }
+
+        float orientation = area > 0.0f ? 1.0f : -1.0f;
+        float edgeA[3], edgeB[3], edgeC[3];
+        for (int edge = 0; edge < 3; ++edge)
+        {
+            int next = (edge + 1) % 3;
+            edgeA[edge] = -(y[next] - y[edge]) * orientation;
+            edgeB[edge] = (x[next] - x[edge]) * orientation;
+            edgeC[edge] = -edgeA[edge] * x[edge] - edgeB[edge] * y[edge];
+        }
+
+        int minX = std::max(static_cast<int>(std::floor(std::min(std::min(x[0], x[1]), x[2]))), 0);
+        int maxX = std::min(static_cast<int>(std::ceil(std::max(std::max(x[0], x[1]), x[2]))), SOFTWARE_OCCLUSION_WIDTH - 1);
+        int minY = std::max(static_cast<int>(std::floor(std::min(std::min(y[0], y[1]), y[2]))), 0);
+        int maxY = std::min(static_cast<int>(std::ceil(std::max(std::max(y[0], y[1]), y[2]))), SOFTWARE_OCCLUSION_HEIGHT - 1);
+        for (int pixelY = minY; pixelY <= maxY; ++pixelY)
+        {
+            for (int pixelX = minX; pixelX <= maxX; ++pixelX)
+            {
+                float centerX = pixelX + 0.5f;
+                float centerY = pixelY + 0.5f;
+                float edgeValue[3];
+                for (int edge = 0; edge < 3; ++edge)
+                {
+                    edgeValue[edge] = edgeA[edge] * centerX + (edgeB[edge] * centerY + edgeC[edge]);
+                }
+                if (edgeValue[0] < 0.0f || edgeValue[1] < 0.0f || edgeValue[2] < 0.0f)
+                {
+                    continue;
+                }
+
+                //Barycentric depth, edge i is opposite to vertex i + 2
+                float depth = (edgeValue[1] * z[0] + edgeValue[2] * z[1] + edgeValue[0] * z[2]) / std::abs(area);
+                float& pixelDepth = depths[static_cast<size_t>(pixelY) * SOFTWARE_OCCLUSION_WIDTH + pixelX];
+                pixelDepth = std::min(pixelDepth, depth);
+            }
+        }
+    }
+}
+
+void RunSoftwareOcclusionBenchmark()
+{
+    const uint32_t objectCount = 100000;
+    const uint32_t iterations = 100;
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), static_cast<float>(SOFTWARE_OCCLUSION_WIDTH) / SOFTWARE_OCCLUSION_HEIGHT, 0.1f, 500.0f);
+    projection[1][1] *= -1;
+    glm::mat4 viewProjection = projection * view;
+
+    //Wall of 8x4 buildings 20m away with streets between them, plus a few rotated ones in front
+    std::vector<glm::mat4> occluderMatrices;
+    for (int column = 0; column < 8; ++column)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            glm::vec3 position(-14.0f + column * 4.0f, -6.0f + row * 4.0f, -20.0f);
+            occluderMatrices.push_back(glm::translate(glm::mat4(1.0f), position) * glm::scale(glm::mat4(1.0f), glm::vec3(3.2f, 3.6f, 2.0f)));
+        }
+    }
+    for (int i = 0; i < 6; ++i)
+    {
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-10.0f + i * 4.0f, -3.0f, -10.0f));
+        modelMatrix = glm::rotate(modelMatrix, glm::radians(25.0f * i), glm::vec3(0.0f, 1.0f, 0.0f));
+        occluderMatrices.push_back(glm::scale(modelMatrix, glm::vec3(1.5f, 2.0f, 0.5f)));
+    }
+
+    std::vector<glm::vec3> boxPositions;
+    std::vector<uint32_t> boxIndices;
+    GfxSoftwareOcclusion::GenerateBoxOccluder(glm::vec3(-0.5f), glm::vec3(0.5f), boxPositions, boxIndices);
+    std::vector<glm::vec3> worldTriangles;
+    for (const glm::mat4& modelMatrix : occluderMatrices)
+    {
+        for (uint32_t index : boxIndices)
+        {
+            worldTriangles.push_back(glm::vec3(modelMatrix * glm::vec4(boxPositions[index], 1.0f)));
+        }
+    }
+
+    std::mt19937 rndEngine(1234);
+    std::uniform_real_distribution<float> depthDist(12.0f, 200.0f);
+    std::uniform_real_distribution<float> spreadDist(-0.6f, 0.6f);
+    std::uniform_real_distribution<float> extentDist(0.1f, 1.0f);
+    std::vector<glm::vec3> boundsMin(objectCount);
+    std::vector<glm::vec3> boundsMax(objectCount);
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        float depth = depthDist(rndEngine);
+        glm::vec3 center(spreadDist(rndEngine) * depth, spreadDist(rndEngine) * depth * 0.6f, -depth);
+        glm::vec3 extents(extentDist(rndEngine));
+        boundsMin[i] = center - extents;
+        boundsMax[i] = center + extents;
+    }
+
+    std::cout << MAGENTA_TEXT << "Software occlusion benchmark (" << SOFTWARE_OCCLUSION_WIDTH << "x" << SOFTWARE_OCCLUSION_HEIGHT << ", "
+        << worldTriangles.size() / 3 << " occluder triangles, " << objectCount << " objects)" << RESET_TEXT << std::endl;
+
+    GfxJobPool jobPool;
+    GfxSoftwareOcclusion occlusion;
+    for (uint32_t workerCount = 1; workerCount <= SOFTWARE_OCCLUSION_MAX_WORKERS; workerCount *= 2)
+    {
+        jobPool.Init(workerCount);
+        occlusion.Init(&jobPool);
+        for (const glm::mat4& modelMatrix : occluderMatrices)
+        {
+            occlusion.AddOccluder(modelMatrix, boxPositions, boxIndices);
+        }
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            occlusion.Render(viewProjection, nullptr);
+        }
+        const GfxSoftwareOcclusionStats& stats = occlusion.GetStats();
+        std::cout << "  " << occlusion.GetWorkerCount() << " workers: " << stats.setupMs / iterations << "ms setup, "
+            << stats.rasterizationMs / iterations << "ms rasterization" << std::endl;
+        if (workerCount * 2 <= SOFTWARE_OCCLUSION_MAX_WORKERS)
+        {
+            occlusion.Cleanup();
+            jobPool.Cleanup();
+        }
+    }
+
+    auto testStart = std::chrono::high_resolution_clock::now();
+    std::vector<bool> occluded(objectCount);
+    uint32_t occludedCount = 0;
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        occluded[i] = occlusion.IsOccluded(boundsMin[i], boundsMax[i]);
+        occludedCount += occluded[i] ? 1 : 0;
+    }
+    double testMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - testStart).count();
+
+    auto referenceStart = std::chrono::high_resolution_clock::now();
+    std::vector<float> referenceDepths;
+    RasterizeReference(worldTriangles, viewProjection, referenceDepths);
+    double referenceMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - referenceStart).count();
+
+    //Same rectangle as IsOccluded against the per pixel depths
+    uint32_t referenceOccludedCount = 0;
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float nearestDepth = FLT_MAX;
+        bool crossesNear = false;
+        for (uint32_t corner = 0; corner < 8; ++corner)
+        {
+            glm::vec3 position((corner & 1) ? boundsMax[i].x : boundsMin[i].x, (corner & 2) ? boundsMax[i].y : boundsMin[i].y,
+                (corner & 4) ? boundsMax[i].z : boundsMin[i].z);
+            glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+            crossesNear |= clip.z < 0.0f || clip.w <= 0.0f;
+            minX = std::min(minX, (clip.x / clip.w * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_WIDTH);
+            maxX = std::max(maxX, (clip.x / clip.w * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_WIDTH);
+            minY = std::min(minY, (clip.y / clip.w * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_HEIGHT);
+            maxY = std::max(maxY, (clip.y / clip.w * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_HEIGHT);
+            nearestDepth = std::min(nearestDepth, clip.z / clip.w);
+        }
+        bool onScreen = maxX >= 0.0f && maxY >= 0.0f && minX < SOFTWARE_OCCLUSION_WIDTH && minY < SOFTWARE_OCCLUSION_HEIGHT;
+        bool referenceOccluded = !crossesNear && onScreen;
+        for (int y = std::max(static_cast<int>(minY), 0); referenceOccluded && y <= std::min(static_cast<int>(maxY), SOFTWARE_OCCLUSION_HEIGHT - 1); ++y)
+        {
+            for (int x = std::max(static_cast<int>(minX), 0); referenceOccluded && x <= std::min(static_cast<int>(maxX), SOFTWARE_OCCLUSION_WIDTH - 1); ++x)
+            {
+                referenceOccluded = nearestDepth > referenceDepths[static_cast<size_t>(y) * SOFTWARE_OCCLUSION_WIDTH + x];
+            }
+        }
+        referenceOccludedCount += referenceOccluded ? 1 : 0;
+
+        if (occluded[i] && !referenceOccluded)
+        {
+            throw std::runtime_error("Error software occlusion culled an object the per pixel reference sees!");
+        }
+    }
+
+    std::cout << "  " << objectCount << " objects tested in " << testMs << "ms (" << objectCount / std::max(testMs * 1000.0, 1e-6) << " objects/us), "
+        << occludedCount << " occluded, " << referenceOccludedCount << " with per pixel depth (" << referenceMs << "ms scalar reference rasterization)" << std::endl;
+
+    occlusion.DumpToImage("SoftwareOcclusionBenchmark.pgm");
+    occlusion.Cleanup();
+    jobPool.Cleanup();
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GfxScene.h"
+
+class GfxJobPool;
+
+//Occlusion buffer resolution, multiples of the tile size. Low on purpose, it only has to hide whole objects
+#define SOFTWARE_OCCLUSION_WIDTH 320
+#define SOFTWARE_OCCLUSION_HEIGHT 192
+//One 32 bit coverage mask per tile, a row of 8 pixels is two SSE registers
+#define SOFTWARE_OCCLUSION_TILE_WIDTH 8
+#define SOFTWARE_OCCLUSION_TILE_HEIGHT 4
+//Most job pool workers the benchmark rasterizes with
+#define SOFTWARE_OCCLUSION_MAX_WORKERS 4
+
+struct GfxSoftwareOcclusionStats
+{
+	uint64_t frames = 0;
+	uint64_t occluderTriangles = 0;
+	uint64_t rasterizedTriangles = 0;
+	uint64_t testedObjects = 0;
+	uint64_t occludedObjects = 0;
+	double setupMs = 0.0;
+	double rasterizationMs = 0.0;
+	double testMs = 0.0;
+};
+
+//Masked occlusion tile: pixels in coverageMask are no farther than workingDepth and every pixel of the
+//tile is no farther than referenceDepth. Bit y * 8 + x is the pixel at x, y inside the tile.
+struct GfxOcclusionTile
+{
+	uint32_t coverageMask = 0;
+	float workingDepth = 0.0f;
+	float referenceDepth = 1.0f;
+};
+
+//CPU occlusion culling for the draw path that cannot wait for a GPU readback. Low poly occluder proxies are
+//rasterized into a tiled masked depth buffer (coverage sampled at pixel centers with SSE, one conservative
+//depth per triangle and tile), each worker owning a band of tile rows so no tile is shared between threads.
+//Objects are then tested with the screen rectangle and nearest depth of their world bounds.
+//Depth is Vulkan clip space depth, 0 near and 1 far.
+class GfxSoftwareOcclusion
+{
+public:
+	//Rasterizes with the workers of jobPool, at most one per tile row
+	void Init(GfxJobPool* jobPool);
+	void Cleanup();
+
+	//Object space proxy drawn with the model matrix of the object, it has to fit inside the object so it never hides what the object does not
+	void AddOccluder(GfxSceneHandle handle, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+	//Proxy placed once in world space
+	void AddOccluder(const glm::mat4& modelMatrix, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+	void ClearOccluders();
+	//12 triangles, a flat box (boxMin.y == boxMax.y) works as a quad
+	static void GenerateBoxOccluder(const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices);
+
+	//Clears the buffer and rasterizes every occluder, handles that are no longer valid are skipped
+	void Render(const glm::mat4& viewProjection, const GfxScene* scene);
+	//Against the last Render, bounds crossing the near plane are never occluded
+	bool IsOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+	//Removes the occluded scene objects from visibleIndices keeping the order, returns how many were removed
+	uint32_t CullOccluded(const GfxScene& scene, std::vector<uint32_t>& visibleIndices);
+
+	//Binary PGM of the resolved buffer, nearest depth white and empty pixels black
+	void DumpToImage(const char* path) const;
+
+	uint32_t GetWidth() const { return SOFTWARE_OCCLUSION_WIDTH; }
+	uint32_t GetHeight() const { return SOFTWARE_OCCLUSION_HEIGHT; }
+	uint32_t GetWorkerCount() const { return workerCount; }
+	//Farthest depth the buffer allows at a pixel
+	float GetPixelDepth(uint32_t x, uint32_t y) const;
+	const GfxSoftwareOcclusionStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	struct Occluder
+	{
+		GfxSceneHandle handle;
+		glm::mat4 modelMatrix = glm::mat4(1.0f);
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+	};
+
+	//Screen space triangle ready to rasterize, edges are positive inside
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		//Depth plane z = depthBase + depthDx * x + depthDy * y
+		float depthBase;
+		float depthDx;
+		float depthDy;
+		float maxDepth;
+		//Inclusive tile bounds
+		int tileMinX;
+		int tileMinY;
+		int tileMaxX;
+		int tileMaxY;
+	};
+
+	void SetupOccluder(const Occluder& occluder, const glm::mat4& modelViewProjection);
+	void RasterizeBand(uint32_t workerIndex);
+
+	static const uint32_t tilesX = SOFTWARE_OCCLUSION_WIDTH / SOFTWARE_OCCLUSION_TILE_WIDTH;
+	static const uint32_t tilesY = SOFTWARE_OCCLUSION_HEIGHT / SOFTWARE_OCCLUSION_TILE_HEIGHT;
+
+	std::vector<Occluder> occluders;
+	//Scratch of SetupOccluder
+	std::vector<glm::vec4> clipPositions;
+	std::vector<Triangle> triangles;
+	std::vector<GfxOcclusionTile> tiles;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+
+	//Worker i rasterizes tile rows [bandBegins[i], bandBegins[i + 1])
+	std::vector<uint32_t> bandBegins;
+	GfxJobPool* jobPool = nullptr;
+	uint32_t workerCount = 1;
+
+	GfxSoftwareOcclusionStats stats;
+};
+
+//Rasterizes a wall of box occluders and tests 100k objects behind and around it with 1 to SOFTWARE_OCCLUSION_MAX_WORKERS
+//threads, checks every occluded object against a per pixel scalar reference and dumps the buffer to SoftwareOcclusionBenchmark.pgm
+void RunSoftwareOcclusionBenchmark();
@@ -0,0 +1,306 @@
+#include "GfxStagingRing.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void GfxStagingRing::Init(VkDeviceSize ringSize)
+{
+    const VkPhysicalDeviceLimits& limits = gfxCtx->memoryAllocator->GetLimits();
+    //Also keeps every region aligned to any texel size up to 16 bytes for buffer to image copies
+    alignment = std::max<VkDeviceSize>(16, limits.optimalBufferCopyOffsetAlignment);
+
+    this->ringSize = AlignUp(ringSize, alignment);
+    CreateBuffer_Internal(this->ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GfxMemoryUsage::CPU_ONLY,
+        buffer, bufferAllocation, "StagingRingBuffer", "StagingRingBufferMemory");
+
+    if (bufferAllocation.mappedData == nullptr)
+    {
+        throw std::runtime_error("Error staging ring buffer is not mapped!");
+    }
+
+    //Copies go to the dedicated transfer queue when there is one, the graphics queue acquires the results
+    copyContext = gfxCtx->transferContext != nullptr ? gfxCtx->transferContext : gfxCtx->uploadContext;
+    ownershipTransfer = copyContext->GetQueueFamilyIndex() != gfxCtx->uploadContext->GetQueueFamilyIndex();
+
+    head = 0;
+    tail = 0;
+    stats = GfxStagingStats();
+}
+
+void GfxStagingRing::Cleanup()
+{
+    WaitIdle();
+
+    DestroyBuffer_Internal(buffer, bufferAllocation);
+}
+
+void GfxStagingRing::UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+    const VkDeviceSize maxChunkSize = std::min<VkDeviceSize>(STAGING_RING_MAX_CHUNK, ringSize / 2);
+    const char* srcData = static_cast<const char*>(data);
+
+    ++stats.uploadCount;
+    stats.uploadedBytes += size;
+
+    VkDeviceSize uploaded = 0;
+    while (uploaded < size)
+    {
+        VkDeviceSize chunkSize = std::min(size - uploaded, maxChunkSize);
+        Chunk chunk = Reserve(chunkSize);
+        memcpy(chunk.data, srcData + uploaded, static_cast<size_t>(chunkSize));
+
+        VkCommandBuffer commandBuffer = copyContext->GetCommandBuffer();
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = chunk.offset;
+        copyRegion.dstOffset = dstOffset + uploaded;
+        copyRegion.size = chunkSize;
+        vkCmdCopyBuffer(commandBuffer, chunk.buffer, dstBuffer, 1, &copyRegion);
+
+        if (chunk.buffer == buffer)
+        {
+            TrackRegion();
+        }
+        uploaded += chunkSize;
+    }
+
+    if (ownershipTransfer)
+    {
+        VkBufferMemoryBarrier bufferBarrier{};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcQueueFamilyIndex = copyContext->GetQueueFamilyIndex();
+        bufferBarrier.dstQueueFamilyIndex = gfxCtx->uploadContext->GetQueueFamilyIndex();
+        bufferBarrier.buffer = dstBuffer;
+        bufferBarrier.offset = dstOffset;
+        bufferBarrier.size = size;
+
+        //Release on the transfer queue
+        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(copyContext->GetCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+        //Acquire on the graphics queue, its submit waits on the transfer semaphore
+        bufferBarrier.srcAccessMask = 0;
+        bufferBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(gfxCtx->uploadContext->GetCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+    }
+
+    gfxCtx->uploadContext->Flush();
+}
+
+void GfxStagingRing::UploadImage(VkImage dstImage, uint32_t width, uint32_t height, uint32_t texelSize, uint32_t mipLevels, const void* data)
+{
+    const VkDeviceSize maxChunkSize = std::min<VkDeviceSize>(STAGING_RING_MAX_CHUNK, ringSize / 2);
+    const VkDeviceSize rowPitch = static_cast<VkDeviceSize>(width) * texelSize;
+    const uint32_t rowsPerChunk = static_cast<uint32_t>(std::min<VkDeviceSize>(maxChunkSize / rowPitch, height));
+
+    if (rowsPerChunk == 0)
+    {
+        throw std::runtime_error("Error image row doesn't fit in the staging ring!");
+    }
+
+    const char* srcData = static_cast<const char*>(data);
+
+    ++stats.uploadCount;
+    stats.uploadedBytes += rowPitch * height;
+
+    VkImageMemoryBarrier imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.image = dstImage;
+    imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageBarrier.subresourceRange.baseMipLevel = 0;
+    imageBarrier.subresourceRange.levelCount = mipLevels;
+    imageBarrier.subresourceRange.baseArrayLayer = 0;
+    imageBarrier.subresourceRange.layerCount = 1;
+
+    //The transition happens on the queue doing the copy so it doesn't depend on graphics work
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.srcAccessMask = 0;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(copyContext->GetCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+    //Big images are copied in horizontal bands of whole rows
+    for (uint32_t row = 0; row < height; row += rowsPerChunk)
+    {
+        uint32_t rowCount = std::min(rowsPerChunk, height - row);
+        VkDeviceSize chunkSize = rowPitch * rowCount;
+        Chunk chunk = Reserve(chunkSize);
+        memcpy(chunk.data, srcData + rowPitch * row, static_cast<size_t>(chunkSize));
+
+        VkCommandBuffer commandBuffer = copyContext->GetCommandBuffer();
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = chunk.offset;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+
+        region.imageOffset = { 0, static_cast<int32_t>(row), 0 };
+        region.imageExtent.width = width;
+        region.imageExtent.height = rowCount;
+        region.imageExtent.depth = 1;
+
+        vkCmdCopyBufferToImage(commandBuffer, chunk.buffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        if (chunk.buffer == buffer)
+        {
+            TrackRegion();
+        }
+    }
+
+    if (ownershipTransfer)
+    {
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrier.srcQueueFamilyIndex = copyContext->GetQueueFamilyIndex();
+        imageBarrier.dstQueueFamilyIndex = gfxCtx->uploadContext->GetQueueFamilyIndex();
+
+        imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageBarrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(copyContext->GetCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+        imageBarrier.srcAccessMask = 0;
+        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(gfxCtx->uploadContext->GetCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+    }
+
+    gfxCtx->uploadContext->Flush();
+}
+
+void GfxStagingRing::WaitIdle()
+{
+    while (!inFlight.empty() || !overflows.empty())
+    {
+        if (!overflows.empty())
+        {
+            copyContext->Wait(overflows.back().ticket);
+        }
+        RetireCompleted(true);
+    }
+}
+
+void GfxStagingRing::PrintStats()
+{
+    std::cout << CYAN_TEXT << "Staging ring: " << stats.uploadCount << " uploads, "
+        << stats.chunkCount << " chunks, " << stats.uploadedBytes << " bytes, "
+        << stats.fenceWaits << " waits for free space, " << stats.overflowChunks << " overflow chunks" << RESET_TEXT << std::endl;
+}
+
+GfxStagingRing::Chunk GfxStagingRing::Reserve(VkDeviceSize size)
+{
+    RetireCompleted(false);
+
+    while (true)
+    {
+        if (inFlight.empty())
+        {
+            //Nothing is being read, restart from the beginning to avoid wrapping
+            head = 0;
+            tail = 0;
+        }
+
+        VkDeviceSize start = AlignUp(head, alignment);
+        VkDeviceSize physicalOffset = start % ringSize;
+        //Regions never wrap around the end of the buffer, skip the leftover space
+        if (physicalOffset + size > ringSize)
+        {
+            start += ringSize - physicalOffset;
+        }
+
+        if (start + size - tail <= ringSize)
+        {
+            head = start + size;
+            VkDeviceSize offset = start % ringSize;
+            return { buffer, offset, static_cast<char*>(bufferAllocation.mappedData) + offset };
+        }
+
+        //Waiting would submit the command buffer a single time command buffer is still recording into
+        if (inFlight.front().ticket == copyContext->GetRecordingTicket() && copyContext->IsRecordingCommands())
+        {
+            return ReserveOverflow(size);
+        }
+
+        RetireCompleted(true);
+    }
+}
+
+GfxStagingRing::Chunk GfxStagingRing::ReserveOverflow(VkDeviceSize size)
+{
+    GfxStagingOverflow overflow;
+    overflow.ticket = copyContext->GetRecordingTicket();
+    CreateBuffer_Internal(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GfxMemoryUsage::CPU_ONLY,
+        overflow.buffer, overflow.allocation, "StagingOverflowBuffer", "StagingOverflowBufferMemory");
+
+    if (overflow.allocation.mappedData == nullptr)
+    {
+        throw std::runtime_error("Error staging overflow buffer is not mapped!");
+    }
+
+    overflows.push_back(overflow);
+    ++stats.overflowChunks;
+    ++stats.chunkCount;
+    return { overflow.buffer, 0, static_cast<char*>(overflow.allocation.mappedData) };
+}
+
+void GfxStagingRing::RetireCompleted(bool waitOldest)
+{
+    if (waitOldest && !inFlight.empty())
+    {
+        //Submits the batch being recorded if the oldest region belongs to it
+        copyContext->Wait(inFlight.front().ticket);
+        ++stats.fenceWaits;
+    }
+
+    while (!inFlight.empty() && copyContext->IsComplete(inFlight.front().ticket))
+    {
+        tail = inFlight.front().end;
+        inFlight.pop_front();
+    }
+
+    while (!overflows.empty() && copyContext->IsComplete(overflows.front().ticket))
+    {
+        DestroyBuffer_Internal(overflows.front().buffer, overflows.front().allocation);
+        overflows.pop_front();
+    }
+}
+
+void GfxStagingRing::TrackRegion()
+{
+    GfxUploadTicket ticket = copyContext->GetRecordingTicket();
+    //Consecutive copies in the same submission share one region
+    if (!inFlight.empty() && inFlight.back().ticket == ticket)
+    {
+        inFlight.back().end = head;
+    }
+    else
+    {
+        GfxStagingRegion region;
+        region.ticket = ticket;
+        region.end = head;
+        inFlight.push_back(region);
+    }
+
+    ++stats.chunkCount;
+}
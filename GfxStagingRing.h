@@ -0,0 +1,90 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <deque>
+#include "GfxMemoryAllocator.h"
+#include "GfxUploadContext.h"
+
+//Size of the persistently mapped staging ring shared by every upload
+#define STAGING_RING_SIZE (32ull * 1024ull * 1024ull)
+//Uploads bigger than this are split so the next chunk can be filled while the previous one is copied
+#define STAGING_RING_MAX_CHUNK (STAGING_RING_SIZE / 2)
+
+struct GfxStagingRegion
+{
+	GfxUploadTicket ticket = 0;
+	//Virtual ring position (monotonic) where this region ends, tail moves here when the ticket completes
+	VkDeviceSize end = 0;
+};
+
+//One time staging buffer for a chunk the ring can't take without submitting a single time command buffer still recording
+struct GfxStagingOverflow
+{
+	GfxUploadTicket ticket = 0;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	GfxAllocation allocation;
+};
+
+struct GfxStagingStats
+{
+	uint32_t uploadCount = 0;
+	uint32_t chunkCount = 0;
+	uint32_t fenceWaits = 0;
+	uint32_t overflowChunks = 0;
+	VkDeviceSize uploadedBytes = 0;
+};
+
+//Host visible ring buffer for all the buffer/image uploads.
+//Copies are recorded in the upload context command buffer, so inside an upload batch they are submitted together.
+//Regions are handed out in order and reused once the ticket of the submission that read them completes.
+//When the ring is full of copies of a single time command buffer that is still recording, so waiting would need
+//a submit in the middle of it, the chunk goes through an overflow buffer freed once that submission completes.
+class GfxStagingRing
+{
+public:
+	void Init(VkDeviceSize ringSize = STAGING_RING_SIZE);
+	void Cleanup();
+
+	//dstBuffer needs VK_BUFFER_USAGE_TRANSFER_DST_BIT
+	void UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+	//Writes mip 0 of a color image with undefined contents, every mip ends in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+	//owned by the graphics queue
+	void UploadImage(VkImage dstImage, uint32_t width, uint32_t height, uint32_t texelSize, uint32_t mipLevels, const void* data);
+
+	//Blocks until every copy submitted so far has finished
+	void WaitIdle();
+
+	const GfxStagingStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	struct Chunk
+	{
+		VkBuffer buffer;
+		VkDeviceSize offset;
+		char* data;
+	};
+
+	Chunk Reserve(VkDeviceSize size);
+	Chunk ReserveOverflow(VkDeviceSize size);
+	void RetireCompleted(bool waitOldest);
+	void TrackRegion();
+
+	//Dedicated transfer queue context if the device has one, the graphics one otherwise
+	GfxUploadContext* copyContext = nullptr;
+	bool ownershipTransfer = false;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	GfxAllocation bufferAllocation;
+	VkDeviceSize ringSize = 0;
+	VkDeviceSize alignment = 16;
+
+	//Monotonic positions, physical offset is position % ringSize
+	VkDeviceSize head = 0;
+	VkDeviceSize tail = 0;
+
+	std::deque<GfxStagingRegion> inFlight;
+	std::deque<GfxStagingOverflow> overflows;
+
+	GfxStagingStats stats;
+};
@@ -0,0 +1,147 @@
+#include "GfxStaticBatcher.h"
+#include "gfxMaths.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+bool GfxStaticBatcher::BatchKey::operator<(const BatchKey& other) const
+{
+    if (materialId != other.materialId)
+    {
+        return materialId < other.materialId;
+    }
+    if (flags != other.flags)
+    {
+        return flags < other.flags;
+    }
+    return std::lexicographical_compare(chunk, chunk + 3, other.chunk, other.chunk + 3);
+}
+
+GfxSceneHandle GfxStaticBatcher::Add(GfxScene& scene, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const glm::mat4& modelMatrix,
+    uint32_t materialId, uint32_t flags, const char* Name)
+{
+    ++stats.addedObjects;
+    //Nothing to draw, and Build needs a vertex to start the bounds from
+    if (vertices.empty() || indices.empty())
+    {
+        ++stats.emptyObjects;
+        std::cout << YELLOW_TEXT << "Static batching: skipped empty mesh " << Name << RESET_TEXT << std::endl;
+        return GfxSceneHandle();
+    }
+    //A hidden object merged into a batch would show up with it
+    if ((flags & (SCENE_OBJECT_NO_STATIC_BATCHING | SCENE_OBJECT_HIDDEN)) != 0)
+    {
+        ++stats.optedOutObjects;
+        return scene.Create(vertices, indices, modelMatrix, materialId, flags, Name);
+    }
+
+    PendingObject object;
+    object.vertices = vertices;
+    object.indices = indices;
+    object.modelMatrix = modelMatrix;
+    object.materialId = materialId;
+    object.flags = flags;
+    pendingObjects.push_back(object);
+    return GfxSceneHandle();
+}
+
+void GfxStaticBatcher::Build(GfxScene& scene)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    //Chunk of the world bounds center, objects spanning several chunks grow the bounds of the one they land in
+    std::map<BatchKey, std::vector<uint32_t>> groups;
+    for (uint32_t i = 0; i < pendingObjects.size(); ++i)
+    {
+        const PendingObject& object = pendingObjects[i];
+        glm::vec3 boundsMin = glm::vec3(object.modelMatrix * glm::vec4(object.vertices[0].position, 1.0f));
+        glm::vec3 boundsMax = boundsMin;
+        for (const Vertex& vertex : object.vertices)
+        {
+            glm::vec3 position = glm::vec3(object.modelMatrix * glm::vec4(vertex.position, 1.0f));
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+
+        BatchKey key;
+        key.materialId = object.materialId;
+        key.flags = object.flags;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            key.chunk[axis] = static_cast<int>(std::floor(center[axis] / STATIC_BATCH_CHUNK_SIZE));
+        }
+        groups[key].push_back(i);
+    }
+
+    std::vector<Vertex> batchVertices;
+    std::vector<uint32_t> batchIndices;
+    for (const std::pair<const BatchKey, std::vector<uint32_t>>& group : groups)
+    {
+        ++stats.chunks;
+        batchVertices.clear();
+        batchIndices.clear();
+        for (uint32_t objectIndex : group.second)
+        {
+            const PendingObject& object = pendingObjects[objectIndex];
+            if (!batchVertices.empty() && batchVertices.size() + object.vertices.size() > STATIC_BATCH_MAX_VERTICES)
+            {
+                CreateBatch(scene, group.first, batchVertices, batchIndices);
+            }
+
+            //Normals go through the inverse transpose, mirroring transforms flip the winding back
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.modelMatrix)));
+            bool mirrored = glm::determinant(glm::mat3(object.modelMatrix)) < 0.0f;
+
+            uint32_t firstVertex = static_cast<uint32_t>(batchVertices.size());
+            for (const Vertex& vertex : object.vertices)
+            {
+                Vertex bakedVertex = vertex;
+                bakedVertex.position = glm::vec3(object.modelMatrix * glm::vec4(vertex.position, 1.0f));
+                bakedVertex.normal = glm::normalize(normalMatrix * vertex.normal);
+                batchVertices.push_back(bakedVertex);
+            }
+            for (size_t i = 0; i + 2 < object.indices.size(); i += 3)
+            {
+                batchIndices.push_back(firstVertex + object.indices[i]);
+                batchIndices.push_back(firstVertex + object.indices[i + (mirrored ? 2 : 1)]);
+                batchIndices.push_back(firstVertex + object.indices[i + (mirrored ? 1 : 2)]);
+            }
+            ++stats.batchedObjects;
+        }
+        CreateBatch(scene, group.first, batchVertices, batchIndices);
+    }
+
+    pendingObjects.clear();
+    pendingObjects.shrink_to_fit();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    stats.buildMs += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void GfxStaticBatcher::CreateBatch(GfxScene& scene, const BatchKey& key, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    batchNames.push_back("StaticBatch_" + std::to_string(key.materialId) + "_" + std::to_string(key.chunk[0]) + "_" +
+        std::to_string(key.chunk[1]) + "_" + std::to_string(key.chunk[2]) + "_" + std::to_string(stats.batches));
+    scene.Create(vertices, indices, glm::mat4(1.0f), key.materialId, key.flags, batchNames.back().c_str());
+
+    ++stats.batches;
+    stats.batchedVertices += vertices.size();
+    stats.batchedIndices += indices.size();
+    vertices.clear();
+    indices.clear();
+}
+
+void GfxStaticBatcher::PrintStats()
+{
+    //One draw per object without batching, one per batch plus the opted out objects with it
+    uint32_t unbatchedDraws = stats.batchedObjects + stats.optedOutObjects;
+    uint32_t batchedDraws = stats.batches + stats.optedOutObjects;
+    std::cout << CYAN_TEXT << "Static batching: " << batchedDraws << " draws instead of " << unbatchedDraws << ", " << stats.batchedObjects
+        << " objects merged into " << stats.batches << " batches over " << stats.chunks << " chunks, " << stats.optedOutObjects << "/" << stats.addedObjects
+        << " objects opted out, " << stats.emptyObjects << " empty skipped, " << stats.batchedVertices << " vertices and " << stats.batchedIndices
+        << " indices baked in " << stats.buildMs << "ms" << RESET_TEXT << std::endl;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <deque>
+#include <string>
+#include <glm/glm.hpp>
+#include "GfxScene.h"
+
+struct Vertex;
+
+//World space cell size static objects are grouped by, a batch never mixes cells so it can still be culled
+#define STATIC_BATCH_CHUNK_SIZE 16.0f
+//A cell with more geometry than this is split over several batches
+#define STATIC_BATCH_MAX_VERTICES (64u * 1024u)
+//Cubes STATIC_BATCHING_BENCHMARK places on the plane, all of them merge with it
+#define STATIC_BATCHING_BENCHMARK_CRATE_COUNT 16
+
+struct GfxStaticBatchStats
+{
+	uint32_t addedObjects = 0;
+	uint32_t optedOutObjects = 0;
+	//Meshes without vertices or indices, never created
+	uint32_t emptyObjects = 0;
+	uint32_t batchedObjects = 0;
+	uint32_t batches = 0;
+	uint32_t chunks = 0;
+	uint64_t batchedVertices = 0;
+	uint64_t batchedIndices = 0;
+	double buildMs = 0.0;
+};
+
+//Load time merge of static scene objects. Objects sharing material, flags and chunk (cell of their world
+//bounds center) are baked to world space and concatenated into one scene object with an identity model
+//matrix, so they cost one draw and one cull test. Batched objects have no handle of their own.
+class GfxStaticBatcher
+{
+public:
+	//Queues the object for Build and returns an invalid handle. Objects with SCENE_OBJECT_NO_STATIC_BATCHING or
+	//SCENE_OBJECT_HIDDEN are created in the scene right away and their handle is returned. Empty meshes are skipped
+	GfxSceneHandle Add(GfxScene& scene, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const glm::mat4& modelMatrix,
+		uint32_t materialId, uint32_t flags = SCENE_OBJECT_DEFAULT, const char* Name = "Unknown");
+	//Creates the batches in the scene and drops the queued geometry
+	void Build(GfxScene& scene);
+
+	const GfxStaticBatchStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	struct PendingObject
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		glm::mat4 modelMatrix;
+		uint32_t materialId = 0;
+		uint32_t flags = SCENE_OBJECT_DEFAULT;
+	};
+
+	struct BatchKey
+	{
+		uint32_t materialId;
+		uint32_t flags;
+		int chunk[3];
+
+		bool operator<(const BatchKey& other) const;
+	};
+
+	void CreateBatch(GfxScene& scene, const BatchKey& key, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	std::vector<PendingObject> pendingObjects;
+	//The scene keeps the name pointers, a deque never moves its elements
+	std::deque<std::string> batchNames;
+
+	GfxStaticBatchStats stats;
+};
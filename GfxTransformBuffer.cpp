@@ -0,0 +1,117 @@
+#include "GfxTransformBuffer.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static GfxCompactTransform CompactTransform(const glm::mat4& modelMatrix)
+{
+    //glm is column major, row i gathers element i of every column
+    GfxCompactTransform transform;
+    for (int row = 0; row < 3; ++row)
+    {
+        transform.rows[row] = glm::vec4(modelMatrix[0][row], modelMatrix[1][row], modelMatrix[2][row], modelMatrix[3][row]);
+    }
+    return transform;
+}
+
+void GfxTransformBuffer::Init(uint32_t maxTransforms, uint32_t framesInFlight, const char* Name)
+{
+    name = Name;
+    this->maxTransforms = maxTransforms;
+    transforms.clear();
+    transforms.reserve(maxTransforms);
+    freeIndices.clear();
+
+    buffers.resize(framesInFlight);
+    bufferAllocations.resize(framesInFlight);
+    bufferVersions.assign(framesInFlight, 0);
+    version = 1;
+    stats = GfxTransformBufferStats();
+
+    for (uint32_t i = 0; i < framesInFlight; ++i)
+    {
+        std::string bufferName = std::string(Name) + std::to_string(i + 1);
+        std::string memoryName = bufferName + "Memory";
+        CreateBuffer_Internal(GetBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GfxMemoryUsage::CPU_TO_GPU,
+            buffers[i], bufferAllocations[i], bufferName.c_str(), memoryName.c_str());
+
+        if (bufferAllocations[i].mappedData == nullptr)
+        {
+            throw std::runtime_error("Error transform buffer is not mapped!");
+        }
+    }
+}
+
+void GfxTransformBuffer::Cleanup()
+{
+    PrintStats();
+
+    for (uint32_t i = 0; i < buffers.size(); ++i)
+    {
+        DestroyBuffer_Internal(buffers[i], bufferAllocations[i]);
+    }
+    buffers.clear();
+    bufferAllocations.clear();
+}
+
+uint32_t GfxTransformBuffer::Allocate()
+{
+    uint32_t index = 0;
+    if (!freeIndices.empty())
+    {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+    }
+    else
+    {
+        if (transforms.size() >= maxTransforms)
+        {
+            throw std::runtime_error(std::string("Error too many transforms in ") + name + "!");
+        }
+        index = static_cast<uint32_t>(transforms.size());
+        transforms.emplace_back();
+    }
+
+    Set(index, glm::mat4(1.0f));
+    return index;
+}
+
+void GfxTransformBuffer::Free(uint32_t index)
+{
+    freeIndices.push_back(index);
+}
+
+void GfxTransformBuffer::Set(uint32_t index, const glm::mat4& modelMatrix)
+{
+    transforms[index] = CompactTransform(modelMatrix);
+    ++version;
+}
+
+void GfxTransformBuffer::BeginFrame(uint32_t frameIndex)
+{
+    ++stats.frames;
+
+    //The slot fence was waited, no frame in flight reads this buffer anymore
+    if (bufferVersions[frameIndex] != version)
+    {
+        size_t bytes = transforms.size() * sizeof(GfxCompactTransform);
+        memcpy(bufferAllocations[frameIndex].mappedData, transforms.data(), bytes);
+        bufferVersions[frameIndex] = version;
+
+        ++stats.uploads;
+        stats.uploadedBytes += bytes;
+    }
+}
+
+void GfxTransformBuffer::PrintStats()
+{
+    std::cout << CYAN_TEXT << name << ": " << transforms.size() - freeIndices.size() << " transforms, "
+        << stats.uploads << " uploads in " << stats.frames << " frames, "
+        << stats.uploadedBytes / std::max<uint64_t>(stats.uploads, 1) << " bytes per upload" << RESET_TEXT << std::endl;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GfxMemoryAllocator.h"
+
+//Transforms the scene can hold, 3 MB per frame in flight
+#define TRANSFORM_BUFFER_MAX_TRANSFORMS 65536
+
+//Affine model matrix stored as its first three rows, 48 bytes instead of 64.
+//Matches ObjectTransform in the shaders, the last row is always (0,0,0,1).
+struct GfxCompactTransform
+{
+	glm::vec4 rows[3];
+};
+
+struct GfxTransformBufferStats
+{
+	uint64_t frames = 0;
+	uint64_t uploads = 0;
+	uint64_t uploadedBytes = 0;
+};
+
+//Model matrices of every object in a storage buffer per frame in flight, drawn objects index it with a push constant.
+//Moving an object only rewrites its 48 bytes on the CPU copy, each frame slot gets a single memcpy of the
+//used range when any transform changed since that slot was last written.
+class GfxTransformBuffer
+{
+public:
+	void Init(uint32_t maxTransforms, uint32_t framesInFlight, const char* Name = "TransformBuffer");
+	void Cleanup();
+
+	//Returns the index to pass to the shaders, starts as identity
+	uint32_t Allocate();
+	void Free(uint32_t index);
+	void Set(uint32_t index, const glm::mat4& modelMatrix);
+
+	//After the fence of frameIndex has been waited, brings the buffer of that slot up to date
+	void BeginFrame(uint32_t frameIndex);
+
+	VkBuffer GetBuffer(uint32_t frameIndex) const { return buffers[frameIndex]; }
+	VkDeviceSize GetBufferSize() const { return static_cast<VkDeviceSize>(maxTransforms) * sizeof(GfxCompactTransform); }
+	uint32_t GetTransformCount() const { return static_cast<uint32_t>(transforms.size()); }
+	void PrintStats();
+
+private:
+	std::vector<GfxCompactTransform> transforms;
+	std::vector<uint32_t> freeIndices;
+	uint32_t maxTransforms = 0;
+
+	std::vector<VkBuffer> buffers;
+	std::vector<GfxAllocation> bufferAllocations;
+	//Transforms version each frame slot buffer holds
+	std::vector<uint32_t> bufferVersions;
+	uint32_t version = 0;
+
+	GfxTransformBufferStats stats;
+	const char* name = "TransformBuffer";
+};
@@ -0,0 +1,321 @@
+#include "GfxUploadContext.h"
+#include "GfxPipelineManager.h"
+#include "GfxContext.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <stdexcept>
+
+void GfxUploadContext::Init(uint32_t queueFamilyIndex, VkQueue queue)
+{
+    this->queue = queue;
+    this->queueFamilyIndex = queueFamilyIndex;
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo{};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+    if (vkCreateCommandPool(gfxCtx->logicalDevice, &commandPoolCreateInfo, gfxCtx->allocationCallbacks, &commandPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating upload command pool!");
+    }
+
+    stats = GfxUploadStats();
+}
+
+void GfxUploadContext::Cleanup()
+{
+    if (recordingCommandBuffer != VK_NULL_HANDLE)
+    {
+        Submit();
+    }
+    WaitIdle();
+
+    if (producer != nullptr)
+    {
+        //The semaphores below could still be pending a signal from it
+        producer->WaitIdle();
+        producer->consumer = nullptr;
+        producer = nullptr;
+    }
+
+    for (VkFence fence : freeFences)
+    {
+        vkDestroyFence(gfxCtx->logicalDevice, fence, gfxCtx->allocationCallbacks);
+    }
+    freeFences.clear();
+    freeCommandBuffers.clear();
+
+    for (VkSemaphore semaphore : freeSemaphores)
+    {
+        vkDestroySemaphore(gfxCtx->logicalDevice, semaphore, gfxCtx->allocationCallbacks);
+    }
+    for (VkSemaphore semaphore : pendingWaitSemaphores)
+    {
+        vkDestroySemaphore(gfxCtx->logicalDevice, semaphore, gfxCtx->allocationCallbacks);
+    }
+    freeSemaphores.clear();
+    pendingWaitSemaphores.clear();
+
+    //Frees every command buffer allocated from it
+    vkDestroyCommandPool(gfxCtx->logicalDevice, commandPool, gfxCtx->allocationCallbacks);
+}
+
+void GfxUploadContext::SetProducer(GfxUploadContext* transferContext)
+{
+    producer = transferContext;
+    transferContext->consumer = this;
+}
+
+void GfxUploadContext::BeginBatch()
+{
+    ++batchDepth;
+}
+
+GfxUploadTicket GfxUploadContext::EndBatch()
+{
+    if (batchDepth == 0)
+    {
+        throw std::runtime_error("Error EndBatch called without BeginBatch!");
+    }
+
+    --batchDepth;
+    if (batchDepth > 0)
+    {
+        return GetRecordingTicket();
+    }
+
+    if (recordingCommandBuffer != VK_NULL_HANDLE)
+    {
+        return Submit();
+    }
+    return lastSubmittedTicket;
+}
+
+VkCommandBuffer GfxUploadContext::BeginCommands()
+{
+    ++commandsDepth;
+    return GetCommandBuffer();
+}
+
+void GfxUploadContext::EndCommands()
+{
+    --commandsDepth;
+    if (commandsDepth > 0 || IsBatching())
+    {
+        ++stats.queueWaitsAvoided;
+        return;
+    }
+
+    Wait(Submit());
+}
+
+VkCommandBuffer GfxUploadContext::GetCommandBuffer()
+{
+    if (recordingCommandBuffer != VK_NULL_HANDLE)
+    {
+        return recordingCommandBuffer;
+    }
+
+    RetireCompleted();
+
+    if (!freeCommandBuffers.empty())
+    {
+        recordingCommandBuffer = freeCommandBuffers.back();
+        freeCommandBuffers.pop_back();
+    }
+    else
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(gfxCtx->logicalDevice, &allocInfo, &recordingCommandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error allocating upload command buffer!");
+        }
+    }
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo{};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(recordingCommandBuffer, &commandBufferBeginInfo);
+
+    return recordingCommandBuffer;
+}
+
+GfxUploadTicket GfxUploadContext::Submit()
+{
+    if (recordingCommandBuffer == VK_NULL_HANDLE)
+    {
+        return lastSubmittedTicket;
+    }
+
+    if (commandsDepth > 0)
+    {
+        throw std::runtime_error("Error submitting upload commands while a single time command buffer is recording!");
+    }
+
+    //Binary semaphores have to be signaled by an earlier submit than the one waiting on them
+    if (producer != nullptr)
+    {
+        producer->Submit();
+    }
+
+    //Make the uploads visible to whatever is submitted after them, nobody waits for the fence to use the data
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(recordingCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    vkEndCommandBuffer(recordingCommandBuffer);
+
+    VkFence fence;
+    if (!freeFences.empty())
+    {
+        fence = freeFences.back();
+        freeFences.pop_back();
+    }
+    else
+    {
+        VkFenceCreateInfo fenceCreateInfo{};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(gfxCtx->logicalDevice, &fenceCreateInfo, gfxCtx->allocationCallbacks, &fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error creating upload fence!");
+        }
+    }
+
+    VkSemaphore signalSemaphore = VK_NULL_HANDLE;
+    if (consumer != nullptr)
+    {
+        signalSemaphore = consumer->AcquireSemaphore();
+    }
+    std::vector<VkPipelineStageFlags> waitStages(pendingWaitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &recordingCommandBuffer;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(pendingWaitSemaphores.size());
+    submitInfo.pWaitSemaphores = pendingWaitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error submitting upload command buffer!");
+    }
+
+    if (signalSemaphore != VK_NULL_HANDLE)
+    {
+        consumer->pendingWaitSemaphores.push_back(signalSemaphore);
+    }
+
+    GfxUploadSubmit submit;
+    submit.ticket = ++lastSubmittedTicket;
+    submit.fence = fence;
+    submit.commandBuffer = recordingCommandBuffer;
+    submit.waitSemaphores.swap(pendingWaitSemaphores);
+    inFlight.push_back(submit);
+
+    recordingCommandBuffer = VK_NULL_HANDLE;
+    ++stats.submitCount;
+
+    return submit.ticket;
+}
+
+void GfxUploadContext::Flush()
+{
+    if (batchDepth == 0 && commandsDepth == 0)
+    {
+        Submit();
+    }
+}
+
+bool GfxUploadContext::IsComplete(GfxUploadTicket ticket)
+{
+    RetireCompleted();
+    return ticket <= lastCompletedTicket;
+}
+
+void GfxUploadContext::Wait(GfxUploadTicket ticket)
+{
+    //Waiting on what is still being recorded means it has to go now
+    if (ticket > lastSubmittedTicket && recordingCommandBuffer != VK_NULL_HANDLE)
+    {
+        Submit();
+    }
+
+    if (IsComplete(ticket))
+    {
+        return;
+    }
+
+    for (const GfxUploadSubmit& submit : inFlight)
+    {
+        if (submit.ticket >= ticket)
+        {
+            //A fence signal also covers everything submitted before it on the same queue
+            vkWaitForFences(gfxCtx->logicalDevice, 1, &submit.fence, VK_TRUE, UINT64_MAX);
+            ++stats.blockingWaits;
+            break;
+        }
+    }
+
+    RetireCompleted();
+}
+
+void GfxUploadContext::WaitIdle()
+{
+    if (!inFlight.empty())
+    {
+        Wait(inFlight.back().ticket);
+    }
+}
+
+void GfxUploadContext::PrintStats()
+{
+    std::cout << CYAN_TEXT << "Upload context: " << stats.submitCount << " submits, "
+        << stats.queueWaitsAvoided << " queue waits removed, "
+        << stats.blockingWaits << " blocking waits" << RESET_TEXT << std::endl;
+}
+
+void GfxUploadContext::RetireCompleted()
+{
+    while (!inFlight.empty() && vkGetFenceStatus(gfxCtx->logicalDevice, inFlight.front().fence) == VK_SUCCESS)
+    {
+        GfxUploadSubmit& submit = inFlight.front();
+        vkResetFences(gfxCtx->logicalDevice, 1, &submit.fence);
+        freeFences.push_back(submit.fence);
+        freeCommandBuffers.push_back(submit.commandBuffer);
+        freeSemaphores.insert(freeSemaphores.end(), submit.waitSemaphores.begin(), submit.waitSemaphores.end());
+        lastCompletedTicket = submit.ticket;
+        inFlight.pop_front();
+    }
+}
+
+VkSemaphore GfxUploadContext::AcquireSemaphore()
+{
+    if (!freeSemaphores.empty())
+    {
+        VkSemaphore semaphore = freeSemaphores.back();
+        freeSemaphores.pop_back();
+        return semaphore;
+    }
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo{};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(gfxCtx->logicalDevice, &semaphoreCreateInfo, gfxCtx->allocationCallbacks, &semaphore) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error creating upload semaphore!");
+    }
+    return semaphore;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <deque>
+
+//Identifies one submission of the upload context, tickets grow monotonically
+typedef uint64_t GfxUploadTicket;
+
+struct GfxUploadSubmit
+{
+	GfxUploadTicket ticket = 0;
+	VkFence fence = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	//Recycled when the fence signals
+	std::vector<VkSemaphore> waitSemaphores;
+};
+
+struct GfxUploadStats
+{
+	uint32_t submitCount = 0;
+	//Single time command buffers that ended without a submit + wait of their own
+	uint32_t queueWaitsAvoided = 0;
+	//Times the CPU actually blocked on an upload fence
+	uint32_t blockingWaits = 0;
+};
+
+//Records copies, layout transitions and mip blits on a transient command pool.
+//Between BeginBatch/EndBatch every single time command buffer is the same one and gets submitted once,
+//outside a batch they keep the old submit and wait behaviour.
+//A second context on a dedicated transfer queue can be linked as producer: it is always submitted first
+//and its submits signal a semaphore the next submit of this context waits on (ownership acquires live here).
+class GfxUploadContext
+{
+public:
+	void Init(uint32_t queueFamilyIndex, VkQueue queue);
+	void Cleanup();
+
+	void SetProducer(GfxUploadContext* transferContext);
+	uint32_t GetQueueFamilyIndex() const { return queueFamilyIndex; }
+
+	void BeginBatch();
+	//Submits everything recorded since BeginBatch, wait on the ticket before reading the results on the CPU
+	GfxUploadTicket EndBatch();
+	bool IsBatching() const { return batchDepth > 0; }
+	//The recording command buffer can't be submitted before the outermost EndCommands
+	bool IsRecordingCommands() const { return commandsDepth > 0; }
+
+	//Used by BeginSingleTimeCommandBuffer_Internal/EndSingleTimeCommandBuffer_Internal, they can nest
+	VkCommandBuffer BeginCommands();
+	void EndCommands();
+
+	//Command buffer being recorded, opened if needed
+	VkCommandBuffer GetCommandBuffer();
+	//Ticket the command buffer being recorded will get when submitted
+	GfxUploadTicket GetRecordingTicket() const { return lastSubmittedTicket + 1; }
+	GfxUploadTicket Submit();
+	//Submits right away unless a batch or single time command buffer is still recording
+	void Flush();
+
+	bool IsComplete(GfxUploadTicket ticket);
+	void Wait(GfxUploadTicket ticket);
+	void WaitIdle();
+
+	const GfxUploadStats& GetStats() const { return stats; }
+	void PrintStats();
+
+private:
+	void RetireCompleted();
+	VkSemaphore AcquireSemaphore();
+
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t queueFamilyIndex = 0;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+
+	VkCommandBuffer recordingCommandBuffer = VK_NULL_HANDLE;
+	uint32_t batchDepth = 0;
+	uint32_t commandsDepth = 0;
+
+	GfxUploadTicket lastSubmittedTicket = 0;
+	GfxUploadTicket lastCompletedTicket = 0;
+
+	std::deque<GfxUploadSubmit> inFlight;
+	std::vector<VkFence> freeFences;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+
+	GfxUploadContext* producer = nullptr;
+	GfxUploadContext* consumer = nullptr;
+	//Signaled by the producer, waited by the next submit
+	std::vector<VkSemaphore> pendingWaitSemaphores;
+	std::vector<VkSemaphore> freeSemaphores;
+
+	GfxUploadStats stats;
+};
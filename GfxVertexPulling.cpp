@@ -0,0 +1,250 @@
+#include "GfxVertexPulling.h"
+#include "ModelLoader.h"
+#include "BasicPolygons.h"
+#include "ColorsDef.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+
+//Round to nearest even, out of range values become infinity
+static uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t floatExponent = (bits >> 23) & 0xffu;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (floatExponent == 0xffu)
+    {
+        return static_cast<uint16_t>(sign | 0x7c00u | (mantissa != 0 ? 0x200u : 0u));
+    }
+
+    int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+    if (exponent >= 31)
+    {
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    }
+
+    if (exponent <= 0)
+    {
+        //Denormal half, too small ones flush to zero
+        if (exponent < -10)
+        {
+            return static_cast<uint16_t>(sign);
+        }
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u) != 0))
+        {
+            ++half;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    //A carry out of the mantissa moves to the next exponent, which is still the right rounding
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u) != 0))
+    {
+        ++half;
+    }
+    return static_cast<uint16_t>(half);
+}
+
+static float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = (static_cast<uint32_t>(half) & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign != 0 ? -value : value;
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static int16_t FloatToSnorm16(float value)
+{
+    return static_cast<int16_t>(std::round(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+}
+
+static uint32_t FloatToUnorm8(float value)
+{
+    return static_cast<uint32_t>(std::round(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+}
+
+//Sphere folded onto the octahedron and unfolded onto the [-1, 1] square
+static uint32_t EncodeOctahedral(const glm::vec3& normal)
+{
+    float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (length == 0.0f)
+    {
+        return 0;
+    }
+
+    glm::vec2 octahedral = glm::vec2(normal.x / length, normal.y / length);
+    if (normal.z < 0.0f)
+    {
+        glm::vec2 folded = glm::vec2(1.0f - std::abs(octahedral.y), 1.0f - std::abs(octahedral.x));
+        octahedral.x = octahedral.x >= 0.0f ? folded.x : -folded.x;
+        octahedral.y = octahedral.y >= 0.0f ? folded.y : -folded.y;
+    }
+
+    uint32_t x = static_cast<uint16_t>(FloatToSnorm16(octahedral.x));
+    uint32_t y = static_cast<uint16_t>(FloatToSnorm16(octahedral.y));
+    return x | (y << 16);
+}
+
+static glm::vec3 DecodeOctahedral(uint32_t packed)
+{
+    float x = std::max(static_cast<float>(static_cast<int16_t>(packed & 0xffffu)) / 32767.0f, -1.0f);
+    float y = std::max(static_cast<float>(static_cast<int16_t>(packed >> 16)) / 32767.0f, -1.0f);
+
+    glm::vec3 normal = glm::vec3(x, y, 1.0f - std::abs(x) - std::abs(y));
+    float t = std::min(std::max(-normal.z, 0.0f), 1.0f);
+    normal.x += normal.x >= 0.0f ? -t : t;
+    normal.y += normal.y >= 0.0f ? -t : t;
+    return glm::normalize(normal);
+}
+
+GfxPackedVertex PackVertex(const Vertex& vertex)
+{
+    GfxPackedVertex packedVertex;
+    packedVertex.position[0] = vertex.position.x;
+    packedVertex.position[1] = vertex.position.y;
+    packedVertex.position[2] = vertex.position.z;
+    packedVertex.normal = EncodeOctahedral(vertex.normal);
+    packedVertex.texCoord = static_cast<uint32_t>(FloatToHalf(vertex.texCoord.x)) | (static_cast<uint32_t>(FloatToHalf(vertex.texCoord.y)) << 16);
+    packedVertex.color = FloatToUnorm8(vertex.color.x) | (FloatToUnorm8(vertex.color.y) << 8) | (FloatToUnorm8(vertex.color.z) << 16) | (255u << 24);
+    return packedVertex;
+}
+
+void UnpackVertex(const GfxPackedVertex& packedVertex, Vertex& vertex)
+{
+    vertex.position = glm::vec3(packedVertex.position[0], packedVertex.position[1], packedVertex.position[2]);
+    vertex.normal = DecodeOctahedral(packedVertex.normal);
+    vertex.texCoord = glm::vec2(HalfToFloat(static_cast<uint16_t>(packedVertex.texCoord & 0xffffu)),
+        HalfToFloat(static_cast<uint16_t>(packedVertex.texCoord >> 16)));
+    vertex.color = glm::vec3(static_cast<float>(packedVertex.color & 0xffu), static_cast<float>((packedVertex.color >> 8) & 0xffu),
+        static_cast<float>((packedVertex.color >> 16) & 0xffu)) / 255.0f;
+}
+
+void PackVertices(const std::vector<Vertex>& vertices, std::vector<GfxPackedVertex>& packedVertices)
+{
+    packedVertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        packedVertices[i] = PackVertex(vertices[i]);
+    }
+}
+
+static void BenchmarkMesh(const char* Name, const std::vector<Vertex>& vertices, uint32_t iterations)
+{
+    std::vector<GfxPackedVertex> packedVertices;
+    PackVertices(vertices, packedVertices);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        PackVertices(vertices, packedVertices);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double packMs = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+    //Half floats keep 11 significant bits, the other attributes are fixed point
+    float maxNormalError = 0.0f;
+    float maxTexCoordError = 0.0f;
+    float maxColorError = 0.0f;
+    uint32_t zeroNormals = 0;
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const Vertex& vertex = vertices[i];
+        Vertex decodedVertex;
+        UnpackVertex(packedVertices[i], decodedVertex);
+
+        if (decodedVertex.position != vertex.position)
+        {
+            throw std::runtime_error(std::string("Error vertex pulling benchmark ") + Name + " position " + std::to_string(i) + " not exact!");
+        }
+
+        float normalLength = glm::length(vertex.normal);
+        if (normalLength > 0.0f)
+        {
+            maxNormalError = std::max(maxNormalError, glm::length(decodedVertex.normal - vertex.normal / normalLength));
+        }
+        else
+        {
+            ++zeroNormals;
+        }
+
+        for (int axis = 0; axis < 2; ++axis)
+        {
+            float error = std::abs(decodedVertex.texCoord[axis] - vertex.texCoord[axis]);
+            float allowedError = std::max(std::abs(vertex.texCoord[axis]), std::ldexp(1.0f, -14)) * std::ldexp(1.0f, -11);
+            if (error > allowedError)
+            {
+                throw std::runtime_error(std::string("Error vertex pulling benchmark ") + Name + " texCoord " + std::to_string(i) + " off by " + std::to_string(error) + "!");
+            }
+            maxTexCoordError = std::max(maxTexCoordError, error);
+        }
+
+        for (int channel = 0; channel < 3; ++channel)
+        {
+            float clampedColor = std::min(std::max(vertex.color[channel], 0.0f), 1.0f);
+            maxColorError = std::max(maxColorError, std::abs(decodedVertex.color[channel] - clampedColor));
+        }
+    }
+
+    if (maxNormalError > 1e-3f || maxColorError > 0.5f / 255.0f + 1e-6f)
+    {
+        throw std::runtime_error(std::string("Error vertex pulling benchmark ") + Name + " normal or color error too large!");
+    }
+
+    std::cout << CYAN_TEXT << Name << ": " << vertices.size() << " vertices, " << vertices.size() * sizeof(Vertex) << " bytes as Vertex, "
+        << packedVertices.size() * sizeof(GfxPackedVertex) << " packed, packed in " << packMs << "ms (" << packMs * 1e6 / std::max<size_t>(vertices.size(), 1)
+        << "ns per vertex). Max error normal " << maxNormalError << ", texCoord " << maxTexCoordError << ", color " << maxColorError;
+    if (zeroNormals > 0)
+    {
+        std::cout << ", " << zeroNormals << " vertices without normal";
+    }
+    std::cout << RESET_TEXT << std::endl;
+}
+
+void RunVertexPullingBenchmark()
+{
+    std::cout << MAGENTA_TEXT << "Vertex pulling benchmark, " << sizeof(Vertex) << " byte Vertex against " << sizeof(GfxPackedVertex)
+        << " byte GfxPackedVertex" << RESET_TEXT << std::endl;
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+
+    GfxSphere::GenerateMesh(20, 20, 1.0f, vertices, indices);
+    BenchmarkMesh("Sphere", vertices, 1000);
+
+    GfxLoader loader;
+    loader.LoadObj(MODEL_PATH, vertices, indices);
+    BenchmarkMesh(MODEL_PATH.c_str(), vertices, 100);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+struct Vertex;
+
+//Bytes vertex pulling shaders step per vertex, see baseShader.hlsl VERTEX_PULLING
+#define PACKED_VERTEX_STRIDE 24
+//OBJ models VERTEX_PULLING_BENCHMARK adds to the scene, and frames drawn in each mode before it switches
+#define VERTEX_PULLING_BENCHMARK_OBJ_COUNT 64
+#define VERTEX_PULLING_BENCHMARK_FRAMES 120
+
+//Vertex as the vertex pulling shaders read it from the geometry arena, 24 bytes instead of the 44 of Vertex.
+//The shader decodes it itself, so the encoding does not have to be a format the input assembler understands.
+struct GfxPackedVertex
+{
+	float position[3];
+	//Octahedral unit vector, x in the low snorm16 and y in the high one
+	uint32_t normal;
+	//Two half floats, u in the low bits
+	uint32_t texCoord;
+	//RGBA unorm8, r in the low byte
+	uint32_t color;
+};
+static_assert(sizeof(GfxPackedVertex) == PACKED_VERTEX_STRIDE, "GfxPackedVertex has to match the shader stride");
+
+GfxPackedVertex PackVertex(const Vertex& vertex);
+//Same decoding as the shader, a zero normal comes back as +Z
+void UnpackVertex(const GfxPackedVertex& packedVertex, Vertex& vertex);
+void PackVertices(const std::vector<Vertex>& vertices, std::vector<GfxPackedVertex>& packedVertices);
+
+//Packs the sphere and the OBJ model, reports the time and size against Vertex and checks the decoded error of every vertex
+void RunVertexPullingBenchmark();
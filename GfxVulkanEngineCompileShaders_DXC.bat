@@ -4,6 +4,18 @@ C:\DXC\bin\x64\dxc.exe -P -Fi Shaders/PreprocessedShaders/baseShaderfragment_pre
 C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/baseShaderfragment_preprocessed.hlsl -T ps_6_2 -E PSMain -Fo CompiledShaders/frag.spv
 copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\vert.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
 copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\frag.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+C:\DXC\bin\x64\dxc.exe -P -D INSTANCED=1 -Fi Shaders/PreprocessedShaders/baseShaderInstancedVertex_preprocessed.hlsl Shaders/baseShader.hlsl
+C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/baseShaderInstancedVertex_preprocessed.hlsl -T vs_6_2 -E VSMain -Fo CompiledShaders/instancedVert.spv
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\instancedVert.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+C:\DXC\bin\x64\dxc.exe -P -D INDIRECT=1 -Fi Shaders/PreprocessedShaders/baseShaderIndirectVertex_preprocessed.hlsl Shaders/baseShader.hlsl
+C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/baseShaderIndirectVertex_preprocessed.hlsl -T vs_6_2 -E VSMain -Fo CompiledShaders/indirectVert.spv
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\indirectVert.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+C:\DXC\bin\x64\dxc.exe -P -D VERTEX_PULLING=1 -Fi Shaders/PreprocessedShaders/baseShaderPulledVertex_preprocessed.hlsl Shaders/baseShader.hlsl
+C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/baseShaderPulledVertex_preprocessed.hlsl -T vs_6_2 -E VSMain -Fo CompiledShaders/pulledVert.spv
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\pulledVert.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+C:\DXC\bin\x64\dxc.exe -P -D VERTEX_PULLING=1 -D INDIRECT=1 -Fi Shaders/PreprocessedShaders/baseShaderPulledIndirectVertex_preprocessed.hlsl Shaders/baseShader.hlsl
+C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/baseShaderPulledIndirectVertex_preprocessed.hlsl -T vs_6_2 -E VSMain -Fo CompiledShaders/pulledIndirectVert.spv
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\pulledIndirectVert.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
 ::C:\DXC\bin\x64\dxc.exe -spirv Shaders/baseShader.hlsl -T vs_6_0 -E VSMain -Fo GFXVulkanEngine/x64/Debug/CompiledShaders/vert.spv
 ::C:\DXC\bin\x64\dxc.exe -spirv Shaders/baseShader.hlsl -T ps_6_0 -E PSMain -Fo GFXVulkanEngine/x64/Debug/CompiledShaders/frag.spv
 ::pause
@@ -14,6 +26,12 @@ C:\DXC\bin\x64\dxc.exe -P -Fi Shaders/PreprocessedShaders/shadowMapFragment_prep
 C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/shadowMapFragment_preprocessed.hlsl -T ps_6_2 -E PSMain -Fo CompiledShaders/shadowMapFrag.spv
 copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\shadowMapVert.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
 copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\shadowMapFrag.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+C:\DXC\bin\x64\dxc.exe -P -D INSTANCED=1 -Fi Shaders/PreprocessedShaders/shadowMapInstancedVertex_preprocessed.hlsl Shaders/dirShadowMapDepth.hlsl
+C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/shadowMapInstancedVertex_preprocessed.hlsl -T vs_6_2 -E VSMain -Fo CompiledShaders/shadowMapInstancedVert.spv
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\shadowMapInstancedVert.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+C:\DXC\bin\x64\dxc.exe -P -D INDIRECT=1 -Fi Shaders/PreprocessedShaders/shadowMapIndirectVertex_preprocessed.hlsl Shaders/dirShadowMapDepth.hlsl
+C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/shadowMapIndirectVertex_preprocessed.hlsl -T vs_6_2 -E VSMain -Fo CompiledShaders/shadowMapIndirectVert.spv
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\shadowMapIndirectVert.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
 
 C:\DXC\bin\x64\dxc.exe -P -Fi Shaders/PreprocessedShaders/postProcessPresent_preprocessed.hlsl Shaders/postProcessPresent.hlsl
 C:\DXC\bin\x64\dxc.exe -spirv -Zi -O3 Shaders/PreprocessedShaders/postProcessPresent_preprocessed.hlsl -T vs_6_2 -E VSMain -Fo CompiledShaders/postProcessPresentVert.spv
@@ -25,4 +43,15 @@ copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShader
 
 C:\DXC\bin\x64\dxc.exe -P -Fi Shaders/PreprocessedShaders/cs_blur_preprocessed.hlsl Shaders/cs_blur.hlsl
 C:\DXC\bin\x64\dxc.exe -T cs_6_0 -E main -spirv -Fo CompiledShaders/cs_blur.spv -Zi -O3 Shaders/PreprocessedShaders/cs_blur_preprocessed.hlsl
-copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\cs_blur.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
\ No newline at end of file
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\cs_blur.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+
+C:\DXC\bin\x64\dxc.exe -P -Fi Shaders/PreprocessedShaders/cullObjects_preprocessed.hlsl Shaders/cullObjects.hlsl
+C:\DXC\bin\x64\dxc.exe -T cs_6_0 -E main -spirv -Fo CompiledShaders/cullObjects.spv -Zi -O3 Shaders/PreprocessedShaders/cullObjects_preprocessed.hlsl
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\cullObjects.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+
+C:\DXC\bin\x64\dxc.exe -P -Fi Shaders/PreprocessedShaders/depthPyramid_preprocessed.hlsl Shaders/depthPyramid.hlsl
+C:\DXC\bin\x64\dxc.exe -T cs_6_0 -E main -spirv -Fo CompiledShaders/depthPyramid.spv -Zi -O3 Shaders/PreprocessedShaders/depthPyramid_preprocessed.hlsl
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\depthPyramid.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
+C:\DXC\bin\x64\dxc.exe -P -D MSAA_SOURCE=1 -Fi Shaders/PreprocessedShaders/depthPyramidMsaa_preprocessed.hlsl Shaders/depthPyramid.hlsl
+C:\DXC\bin\x64\dxc.exe -T cs_6_0 -E main -spirv -Fo CompiledShaders/depthPyramidMsaa.spv -Zi -O3 Shaders/PreprocessedShaders/depthPyramidMsaa_preprocessed.hlsl
+copy "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\CompiledShaders\depthPyramidMsaa.spv" "C:\Users\nicob\source\repos\GFXVulkanEngine\GFXVulkanEngine\GFXVulkanEngine\x64\Debug\CompiledShaders\"
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "ComputeObjectsManager.h"
 #include "GfxContext.h"
 #include "BasicPolygons.h"
+#include "GfxFrustum.h"
+#include "GfxVertexPulling.h"
 
 
 void HelloTriangleApp::Run()
@@ -36,6 +38,7 @@ void HelloTriangleApp::InitWindow()
 
 void HelloTriangleApp::InitVulkan()
 {
+    CreateHostAllocator();
     CreateInstance();
     SetupDebugMessenger();
     CreateSurface();
@@ -44,6 +47,12 @@ void HelloTriangleApp::InitVulkan()
     GetLogicalDeviceQueues();
     CreateSwapChain();
     DebugUtils::getInstance().Init();
+    CreatePipelineCache();
+    CreateJobPool();
+    CreateMemoryAllocator();
+#if MEMORY_ALLOCATOR_BENCHMARK
+    RunMemoryAllocatorStressBenchmark();
+#endif//#if MEMORY_ALLOCATOR_BENCHMARK
     CreateSwapChainImageViews();
     CreateShadowMapRenderPass();
     CreateColorRenderPass();
@@ -53,8 +62,13 @@ void HelloTriangleApp::InitVulkan()
     CreatePostProcessDescriptorSetLayout();
     CreateGraphicsPipeline();
     CreateCommandPool();
+    CreateUploadContext();
+    CreateStagingRing();
+    //Every copy, layout transition and mip blit until EndBatch goes in the same submit
+    gfxCtx->uploadContext->BeginBatch();
     CreateColorResources();
     CreateDepthResources();
+    ReportTransientAttachmentSavings();
     CreateShadowMapResources();
     CreatePostProcessResources();
     CreateShadowMapFramebuffers();
@@ -64,10 +78,15 @@ void HelloTriangleApp::InitVulkan()
     CreateTextureImageView();
     CreateTextureSampler();
     gfxLoader.LoadModel();
+    CreateGeometryArena();
+    CreateTransformBuffer();
     PopulateObjects();
+    CreateInstancedMeshes();
     CreateUniformBuffers();
     CreateShaderStorageBuffers();
     CreatePostProcessingQuadBuffer();
+    gfxCtx->uploadContext->EndBatch();
+    gfxCtx->uploadContext->PrintStats();
     CreateShadowMapDescriptorPool();
     CreateColorPassDescriptorPool();
     CreatePostProcessDescriptorPool();
@@ -75,10 +94,31 @@ void HelloTriangleApp::InitVulkan()
     CreateDescriptorSets();
     CreatePostProcessDescriptorSets();
     CreateCommandBuffers();
+    CreateParallelRecorder();
+    CreateCulling();
     CreateSyncObjects();
     SetDescriptorsToObjects();
     UpdateComputeDescriptorSets();
     inputHandler.Init();
+#if PARALLEL_RECORDING_BENCHMARK
+    RunParallelRecordingBenchmark();
+#endif//#if PARALLEL_RECORDING_BENCHMARK
+#if FRUSTUM_CULLING_BENCHMARK
+    RunFrustumCullingBenchmark();
+#endif//#if FRUSTUM_CULLING_BENCHMARK
+#if SOFTWARE_OCCLUSION_BENCHMARK
+    RunSoftwareOcclusionBenchmark();
+#endif//#if SOFTWARE_OCCLUSION_BENCHMARK
+#if SCENE_GRAPH_BENCHMARK
+    RunSceneGraphBenchmark();
+#endif//#if SCENE_GRAPH_BENCHMARK
+#if VERTEX_PULLING_BENCHMARK
+    RunVertexPullingBenchmark();
+#endif//#if VERTEX_PULLING_BENCHMARK
+    gfxCtx->pipelineCache->EndStartup();
+#if HOST_ALLOCATOR
+    gfxCtx->hostAllocator->PrintStats("after init");
+#endif//#if HOST_ALLOCATOR
 }
 
 void HelloTriangleApp::CreateInstance()
@@ -106,6 +146,14 @@ void HelloTriangleApp::CreateInstance()
         //requiredExtensions.push_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
     }
 
+    //Optional, VK_EXT_memory_budget is read through vkGetPhysicalDeviceMemoryProperties2KHR on Vulkan 1.0
+    std::vector<const char*> optionalExtension{ VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME };
+    physicalDeviceProperties2Supported = InstanceHasRequiredExtensions(optionalExtension);
+    if (physicalDeviceProperties2Supported)
+    {
+        requiredExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
     if (logDebug == LogVerbosity::VERBOSE)
     {
         std::cout << "Required instance extensions" << '\n';
@@ -142,7 +190,7 @@ void HelloTriangleApp::CreateInstance()
         instanceInfo.pNext = nullptr;
     }
     
-    if (vkCreateInstance(&instanceInfo, nullptr, &instance) != VK_SUCCESS)
+    if (vkCreateInstance(&instanceInfo, gfxCtx->allocationCallbacks, &instance) != VK_SUCCESS)
     {
         throw std::runtime_error("Failed creating instance");
     }
@@ -251,7 +299,7 @@ void HelloTriangleApp::SetupDebugMessenger()
     VkDebugUtilsMessengerCreateInfoEXT debugMessengerCreateInfo {};
     PopulateDebugMessengerCreateInfo(debugMessengerCreateInfo);
 
-    if (CreateDebugUtilsMessengerEXT(instance, &debugMessengerCreateInfo, nullptr, &debugMessenger) != VK_SUCCESS) 
+    if (CreateDebugUtilsMessengerEXT(instance, &debugMessengerCreateInfo, gfxCtx->allocationCallbacks, &debugMessenger) != VK_SUCCESS) 
     {
         throw std::runtime_error("Unable creating debug messenger");
     }
@@ -289,7 +337,7 @@ void HelloTriangleApp::DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebu
 
 void HelloTriangleApp::CreateSurface()
 {
-    if(glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
+    if(glfwCreateWindowSurface(instance, window, gfxCtx->allocationCallbacks, &surface) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating VkSurface");
     }
@@ -387,6 +435,23 @@ bool HelloTriangleApp::CheckDeviceExtensionSupport(VkPhysicalDevice requestedPhy
     return requiredExtensions.empty();
 }
 
+bool HelloTriangleApp::HasDeviceExtension(VkPhysicalDevice requestedPhysicalDevice, const char* extensionName)
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(requestedPhysicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(requestedPhysicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const VkExtensionProperties& extension : availableExtensions)
+    {
+        if (strcmp(extension.extensionName, extensionName) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 QueueFamilyIndices HelloTriangleApp::FindQueueFamilies(VkPhysicalDevice requestedPhysicalDevice)
 {
     QueueFamilyIndices queueFamilyIndices;
@@ -424,6 +489,27 @@ QueueFamilyIndices HelloTriangleApp::FindQueueFamilies(VkPhysicalDevice requeste
         ++i;
     }
 
+    //Prefer a transfer only family (DMA engines), then any non graphics family that can copy
+    for (uint32_t familyIndex = 0; familyIndex < queueFamilyCount; ++familyIndex)
+    {
+        VkQueueFlags queueFlags = queueFamilyProperties[familyIndex].queueFlags;
+        if (!(queueFlags & VK_QUEUE_TRANSFER_BIT) || (queueFlags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            continue;
+        }
+
+        if (!(queueFlags & VK_QUEUE_COMPUTE_BIT))
+        {
+            queueFamilyIndices.transferFamily = familyIndex;
+            break;
+        }
+
+        if (!queueFamilyIndices.transferFamily.has_value())
+        {
+            queueFamilyIndices.transferFamily = familyIndex;
+        }
+    }
+
     return queueFamilyIndices;
 }
 
@@ -459,14 +545,19 @@ void HelloTriangleApp::CreateLogicalDevice()
         queueFamilyIndices.graphicsFamily.value(), 
         queueFamilyIndices.presentationFamily.value()
     };
+    if (queueFamilyIndices.transferFamily.has_value())
+    {
+        queueIndices.insert(queueFamilyIndices.transferFamily.value());
+    }
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    //Has to outlive the loop, vkCreateDevice reads it through pQueuePriorities
+    float queuePriority = 1.0f;
     for (uint32_t index : queueIndices) 
     {
         VkDeviceQueueCreateInfo deviceQueueCreateInfo{};
         deviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         deviceQueueCreateInfo.queueFamilyIndex = index;
         deviceQueueCreateInfo.queueCount = 1;
-        float queuePriority = 1.0f;
         deviceQueueCreateInfo.pQueuePriorities = &queuePriority;
         queueCreateInfos.push_back(deviceQueueCreateInfo);
     }
@@ -484,9 +575,30 @@ void HelloTriangleApp::CreateLogicalDevice()
     physicalDeviceFeatures.sampleRateShading = VK_TRUE;
     physicalDeviceFeatures.shaderStorageImageReadWithoutFormat = VK_TRUE;
 
+    //Indirect draws, multi draw and a non zero firstInstance are optional in Vulkan 1.0
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(gfxCtx->physicalDevice, &supportedFeatures);
+    physicalDeviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    physicalDeviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    gfxCtx->multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+    drawIndirectFirstInstanceSupported = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+
+    std::vector<const char*> deviceExtensions(deviceExtensionsRequired.begin(), deviceExtensionsRequired.end());
+    bool drawIndirectCountSupported = HasDeviceExtension(gfxCtx->physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (drawIndirectCountSupported)
+    {
+        deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+    memoryBudgetSupported = physicalDeviceProperties2Supported &&
+        HasDeviceExtension(gfxCtx->physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memoryBudgetSupported)
+    {
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
     logicalDeviceCreateInfo.pEnabledFeatures = &physicalDeviceFeatures;
-    logicalDeviceCreateInfo.ppEnabledExtensionNames = deviceExtensionsRequired.data();
-    logicalDeviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensionsRequired.size());
+    logicalDeviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    logicalDeviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
     
     if(enableValidationLayers)
     {
@@ -498,10 +610,16 @@ void HelloTriangleApp::CreateLogicalDevice()
         logicalDeviceCreateInfo.enabledLayerCount = 0;
     }
 
-    if (vkCreateDevice(gfxCtx->physicalDevice, &logicalDeviceCreateInfo, nullptr, &gfxCtx->logicalDevice) != VK_SUCCESS)
+    if (vkCreateDevice(gfxCtx->physicalDevice, &logicalDeviceCreateInfo, gfxCtx->allocationCallbacks, &gfxCtx->logicalDevice) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating logical device");
     }
+
+    if (drawIndirectCountSupported)
+    {
+        gfxCtx->cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr(gfxCtx->logicalDevice, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
 }
 
 void HelloTriangleApp::GetLogicalDeviceQueues()
@@ -510,6 +628,72 @@ void HelloTriangleApp::GetLogicalDeviceQueues()
     vkGetDeviceQueue(gfxCtx->logicalDevice, queueFamilyIndices.graphicsFamily.value(), 0, &gfxCtx->graphicsQueue);
     vkGetDeviceQueue(gfxCtx->logicalDevice, queueFamilyIndices.presentationFamily.value(), 0, &presentationQueue);
     vkGetDeviceQueue(gfxCtx->logicalDevice, queueFamilyIndices.graphicsAndComputeFamily.value(), 0, &computeQueue);
+    if (queueFamilyIndices.transferFamily.has_value())
+    {
+        vkGetDeviceQueue(gfxCtx->logicalDevice, queueFamilyIndices.transferFamily.value(), 0, &gfxCtx->transferQueue);
+    }
+}
+
+void HelloTriangleApp::CreateHostAllocator()
+{
+#if HOST_ALLOCATOR
+    //Has to exist before the instance, everything created with it is destroyed with the same callbacks
+    gfxCtx->hostAllocator = new GfxHostAllocator();
+    gfxCtx->allocationCallbacks = gfxCtx->hostAllocator->GetCallbacks();
+#endif//#if HOST_ALLOCATOR
+}
+
+void HelloTriangleApp::CreatePipelineCache()
+{
+    gfxCtx->pipelineCache = new GfxPipelineCache();
+    gfxCtx->pipelineCache->Init(gfxCtx->physicalDevice, gfxCtx->logicalDevice, gfxCtx->allocationCallbacks, PIPELINE_CACHE_PATH);
+}
+
+void HelloTriangleApp::CreateJobPool()
+{
+    jobPool.Init(std::min(std::max(std::thread::hardware_concurrency(), 1u), static_cast<uint32_t>(JOB_POOL_MAX_WORKERS)));
+}
+
+void HelloTriangleApp::CreateMemoryAllocator()
+{
+    gfxCtx->memoryAllocator = new GfxMemoryAllocator();
+    gfxCtx->memoryAllocator->Init(instance, gfxCtx->physicalDevice, gfxCtx->logicalDevice, memoryBudgetSupported);
+    gfxCtx->memoryAllocator->PrintBudget();
+
+    gfxCtx->residencyManager = new GfxResidencyManager();
+    gfxCtx->residencyManager->Init(MAX_FRAMES_IN_FLIGHT);
+
+    gfxCtx->defragmenter = new GfxDefragmenter();
+    gfxCtx->defragmenter->Init(MAX_FRAMES_IN_FLIGHT, DEFRAG_BYTES_PER_FRAME);
+}
+
+void HelloTriangleApp::CreateUploadContext()
+{
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(gfxCtx->physicalDevice);
+
+    gfxCtx->uploadContext = new GfxUploadContext();
+    gfxCtx->uploadContext->Init(queueFamilyIndices.graphicsFamily.value(), gfxCtx->graphicsQueue);
+
+    if (queueFamilyIndices.transferFamily.has_value())
+    {
+        gfxCtx->transferContext = new GfxUploadContext();
+        gfxCtx->transferContext->Init(queueFamilyIndices.transferFamily.value(), gfxCtx->transferQueue);
+        gfxCtx->uploadContext->SetProducer(gfxCtx->transferContext);
+
+        std::cout << CYAN_TEXT << "Staging copies use the dedicated transfer queue family "
+            << queueFamilyIndices.transferFamily.value() << RESET_TEXT << std::endl;
+    }
+    else
+    {
+        std::cout << YELLOW_TEXT << "No dedicated transfer queue family, staging copies use the graphics queue"
+            << RESET_TEXT << std::endl;
+    }
+}
+
+void HelloTriangleApp::CreateStagingRing()
+{
+    gfxCtx->stagingRing = new GfxStagingRing();
+    gfxCtx->stagingRing->Init(STAGING_RING_SIZE);
 }
 
 void HelloTriangleApp::CreateSwapChain()
@@ -565,7 +749,7 @@ void HelloTriangleApp::CreateSwapChain()
     //TODO RECREATE SWAPCHAIN (resize?)
     createSwapChainInfo.oldSwapchain = VK_NULL_HANDLE;
 
-    if (vkCreateSwapchainKHR(gfxCtx->logicalDevice, &createSwapChainInfo, nullptr, &swapChain) != VK_SUCCESS) 
+    if (vkCreateSwapchainKHR(gfxCtx->logicalDevice, &createSwapChainInfo, gfxCtx->allocationCallbacks, &swapChain) != VK_SUCCESS) 
     {
         throw std::runtime_error("Error creating SwapChain");
     }
@@ -654,7 +838,7 @@ VkImageView HelloTriangleApp::CreateImageView(VkImage image, VkFormat format,
     imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
     imageViewCreateInfo.subresourceRange.layerCount = 1;
 
-    if (vkCreateImageView(gfxCtx->logicalDevice, &imageViewCreateInfo, nullptr, &newImageView) != VK_SUCCESS)
+    if (vkCreateImageView(gfxCtx->logicalDevice, &imageViewCreateInfo, gfxCtx->allocationCallbacks, &newImageView) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating image view");
     }
@@ -723,7 +907,8 @@ void HelloTriangleApp::CreateColorRenderPass()
     colorAttachmentDescr.format = swapChainImageFormat;
     colorAttachmentDescr.samples = msaaSamples;
     colorAttachmentDescr.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; 
-    colorAttachmentDescr.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    //Only the resolve attachment is read after the pass, unless the occlusion culling second phase draws on top of it
+    colorAttachmentDescr.storeOp = IsDepthPyramidBuildSupported() ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentDescr.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentDescr.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentDescr.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -739,7 +924,8 @@ void HelloTriangleApp::CreateColorRenderPass()
     depthAttachmentDescr.format = FindDepthFormat();
     depthAttachmentDescr.samples = msaaSamples;
     depthAttachmentDescr.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachmentDescr.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    //Kept for the depth pyramid build, dropped otherwise so the attachment can stay transient
+    depthAttachmentDescr.storeOp = IsDepthPyramidBuildSupported() ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachmentDescr.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthAttachmentDescr.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachmentDescr.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -794,6 +980,38 @@ void HelloTriangleApp::CreateColorRenderPass()
     renderPassCreateInfo.pDependencies = &subpassDependency;
 
     CreateRenderPass(renderPassCreateInfo, renderPass, "colorRenderPass");
+
+    if (!IsDepthPyramidBuildSupported())
+    {
+        return;
+    }
+
+    //Occlusion culling second phase: same attachments (compatible with the color framebuffers and pipelines), drawn over the first phase
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    //Left by the depth pyramid build in the layout the first phase ends in
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    //Resolved again from the whole color attachment
+    attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkSubpassDependency secondPhaseDependency{};
+    secondPhaseDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    secondPhaseDependency.dstSubpass = 0;
+    secondPhaseDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    secondPhaseDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    secondPhaseDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    secondPhaseDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    renderPassCreateInfo.pDependencies = &secondPhaseDependency;
+
+    CreateRenderPass(renderPassCreateInfo, secondPhaseRenderPass, "secondPhaseColorRenderPass");
 }
 
 void HelloTriangleApp::CreatePostProcessRenderPass()
@@ -843,12 +1061,19 @@ void HelloTriangleApp::CreateShadowMapDescriptorSetLayout()
 {
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
 
-    std::array<VkDescriptorSetLayoutBinding, 1> bindings = { uboLayoutBinding };
+    VkDescriptorSetLayoutBinding transformsLayoutBinding{};
+    transformsLayoutBinding.binding = 1;
+    transformsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    transformsLayoutBinding.descriptorCount = 1;
+    transformsLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    transformsLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, transformsLayoutBinding };
     VkDescriptorSetLayoutCreateInfo descriptorSetCreateInfo{};
     descriptorSetCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     descriptorSetCreateInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -861,7 +1086,7 @@ void HelloTriangleApp::CreateDescriptorSetLayouts()
 {
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -887,8 +1112,25 @@ void HelloTriangleApp::CreateDescriptorSetLayouts()
     depthShadowImageLayoutBinding.pImmutableSamplers = nullptr;
     depthShadowImageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 4> bindings = {uboLayoutBinding, 
-        samplerLayoutBinding, sampledImageLayoutBinding, depthShadowImageLayoutBinding };
+    VkDescriptorSetLayoutBinding transformsLayoutBinding{};
+    transformsLayoutBinding.binding = 4;
+    transformsLayoutBinding.descriptorCount = 1;
+    transformsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    transformsLayoutBinding.pImmutableSamplers = nullptr;
+    transformsLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {uboLayoutBinding, 
+        samplerLayoutBinding, sampledImageLayoutBinding, depthShadowImageLayoutBinding, transformsLayoutBinding };
+#if VERTEX_PULLING
+    //Packed vertex stream of the geometry arena, only read by the vertex pulling pipelines
+    VkDescriptorSetLayoutBinding pulledVerticesLayoutBinding{};
+    pulledVerticesLayoutBinding.binding = 5;
+    pulledVerticesLayoutBinding.descriptorCount = 1;
+    pulledVerticesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pulledVerticesLayoutBinding.pImmutableSamplers = nullptr;
+    pulledVerticesLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings.push_back(pulledVerticesLayoutBinding);
+#endif//#if VERTEX_PULLING
     VkDescriptorSetLayoutCreateInfo descriptorSetCreateInfo{};
     descriptorSetCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     descriptorSetCreateInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -901,7 +1143,7 @@ void HelloTriangleApp::CreateDescriptorSetLayouts()
     std::array<VkDescriptorSetLayoutBinding, 3> layoutBindings{};
     layoutBindings[0].binding = 0;
     layoutBindings[0].descriptorCount = 1;
-    layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     layoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
     layoutBindings[0].pImmutableSamplers = nullptr;
 
@@ -930,7 +1172,7 @@ void HelloTriangleApp::CreatePostProcessDescriptorSetLayout()
 {
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -961,6 +1203,10 @@ void HelloTriangleApp::CreatePostProcessDescriptorSetLayout()
 
 void HelloTriangleApp::CreateGraphicsPipeline()
 {
+#if HOST_ALLOCATOR
+    GfxHostAllocatorStats hostStatsBefore = gfxCtx->hostAllocator->GetStats();
+#endif//#if HOST_ALLOCATOR
+
     inputHandler.CompileShaders();
 
     std::vector<char> vertexShader = ReadFile("CompiledShaders/vert.spv");
@@ -985,6 +1231,11 @@ void HelloTriangleApp::CreateGraphicsPipeline()
 
     std::vector<VkPipelineShaderStageCreateInfo>  shaderStages {vertexPipelineCreateInfo,
         fragmentPipelineCreateInfo};
+
+    //Fixed function Vertex input shared by every pipeline that does not pull its vertices
+    std::vector<VkVertexInputBindingDescription> vertexBindings = { Vertex::GetBindingDesctiption() };
+    std::array<VkVertexInputAttributeDescription, 4> vertexAttributeDescription = Vertex::GetAttributeDescription();
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes(vertexAttributeDescription.begin(), vertexAttributeDescription.end());
     
     GraphicsPipelineInfo graphicPipelineInfo{};
     graphicPipelineInfo.descriptorSetLayout = descriptorSetLayout;
@@ -992,6 +1243,9 @@ void HelloTriangleApp::CreateGraphicsPipeline()
     graphicPipelineInfo.renderPass = renderPass;
     graphicPipelineInfo.msaaSamples = msaaSamples;
     graphicPipelineInfo.viewportExtent = swapChainExtent;
+    graphicPipelineInfo.vertexBindings = vertexBindings;
+    graphicPipelineInfo.vertexAttributes = vertexAttributes;
+    graphicPipelineInfo.pushConstantSize = sizeof(uint32_t);
 
     CreateGraphicsPipeline_Internal(graphicPipelineInfo, graphicsPipelineLayout, graphicsPipeline, "graphicsPipeline", "GraphicsPipelineLayout");
 
@@ -1025,9 +1279,94 @@ void HelloTriangleApp::CreateGraphicsPipeline()
     shadowMapGraphicPipelineInfo.renderPass = shadowMapRenderPass;
     shadowMapGraphicPipelineInfo.msaaSamples = VK_SAMPLE_COUNT_1_BIT;
     shadowMapGraphicPipelineInfo.viewportExtent = swapChainExtent;
+    shadowMapGraphicPipelineInfo.vertexBindings = vertexBindings;
+    shadowMapGraphicPipelineInfo.vertexAttributes = vertexAttributes;
+    shadowMapGraphicPipelineInfo.pushConstantSize = sizeof(uint32_t);
 
     CreateGraphicsPipeline_Internal(shadowMapGraphicPipelineInfo, shadowMapPipelineLayout, shadowMapPipeline, "shadowMapPipeline", "shadowMapPipelineLayout");
 
+    //Instanced variants, same fragment shaders and layouts with the transform and color read per instance
+    std::vector<char> instancedVertexShader = ReadFile("CompiledShaders/instancedVert.spv");
+    std::vector<char> shadowMapInstancedVertexShader = ReadFile("CompiledShaders/shadowMapInstancedVert.spv");
+
+    VkShaderModule instancedVertexShaderModule = CreateShaderModule(instancedVertexShader, "instancedVertexShaderModule");
+    VkShaderModule shadowMapInstancedVertexShaderModule = CreateShaderModule(shadowMapInstancedVertexShader, "shadowMapInstancedVertexShaderModule");
+
+    VkPipelineShaderStageCreateInfo instancedVertexPipelineCreateInfo = vertexPipelineCreateInfo;
+    instancedVertexPipelineCreateInfo.module = instancedVertexShaderModule;
+
+    VkPipelineShaderStageCreateInfo shadowMapInstancedVertexPipelineCreateInfo = shadowMapVertexPipelineCreateInfo;
+    shadowMapInstancedVertexPipelineCreateInfo.module = shadowMapInstancedVertexShaderModule;
+
+    GraphicsPipelineInfo instancedGraphicPipelineInfo = graphicPipelineInfo;
+    instancedGraphicPipelineInfo.shaderStages = { instancedVertexPipelineCreateInfo, fragmentPipelineCreateInfo };
+    instancedGraphicPipelineInfo.instanced = true;
+
+    CreateGraphicsPipeline_Internal(instancedGraphicPipelineInfo, instancedPipelineLayout, instancedPipeline, "instancedPipeline", "instancedPipelineLayout");
+
+    GraphicsPipelineInfo shadowMapInstancedGraphicPipelineInfo = shadowMapGraphicPipelineInfo;
+    shadowMapInstancedGraphicPipelineInfo.shaderStages = { shadowMapInstancedVertexPipelineCreateInfo, shadowMapFragmentPipelineCreateInfo };
+    shadowMapInstancedGraphicPipelineInfo.instanced = true;
+
+    CreateGraphicsPipeline_Internal(shadowMapInstancedGraphicPipelineInfo, shadowMapInstancedPipelineLayout, shadowMapInstancedPipeline,
+        "shadowMapInstancedPipeline", "shadowMapInstancedPipelineLayout");
+
+    //GPU culled variants, the transform index comes from firstInstance instead of the push constant
+    std::vector<char> indirectVertexShader = ReadFile("CompiledShaders/indirectVert.spv");
+    std::vector<char> shadowMapIndirectVertexShader = ReadFile("CompiledShaders/shadowMapIndirectVert.spv");
+
+    VkShaderModule indirectVertexShaderModule = CreateShaderModule(indirectVertexShader, "indirectVertexShaderModule");
+    VkShaderModule shadowMapIndirectVertexShaderModule = CreateShaderModule(shadowMapIndirectVertexShader, "shadowMapIndirectVertexShaderModule");
+
+    VkPipelineShaderStageCreateInfo indirectVertexPipelineCreateInfo = vertexPipelineCreateInfo;
+    indirectVertexPipelineCreateInfo.module = indirectVertexShaderModule;
+
+    VkPipelineShaderStageCreateInfo shadowMapIndirectVertexPipelineCreateInfo = shadowMapVertexPipelineCreateInfo;
+    shadowMapIndirectVertexPipelineCreateInfo.module = shadowMapIndirectVertexShaderModule;
+
+    GraphicsPipelineInfo indirectGraphicPipelineInfo = graphicPipelineInfo;
+    indirectGraphicPipelineInfo.shaderStages = { indirectVertexPipelineCreateInfo, fragmentPipelineCreateInfo };
+
+    CreateGraphicsPipeline_Internal(indirectGraphicPipelineInfo, indirectPipelineLayout, indirectPipeline, "indirectPipeline", "indirectPipelineLayout");
+
+    GraphicsPipelineInfo shadowMapIndirectGraphicPipelineInfo = shadowMapGraphicPipelineInfo;
+    shadowMapIndirectGraphicPipelineInfo.shaderStages = { shadowMapIndirectVertexPipelineCreateInfo, shadowMapFragmentPipelineCreateInfo };
+
+    CreateGraphicsPipeline_Internal(shadowMapIndirectGraphicPipelineInfo, shadowMapIndirectPipelineLayout, shadowMapIndirectPipeline,
+        "shadowMapIndirectPipeline", "shadowMapIndirectPipelineLayout");
+
+#if VERTEX_PULLING
+    //Vertex pulling variants of the color pass, no vertex input so one pipeline would serve any vertex format.
+    //The shadow pass keeps the fixed function ones
+    std::vector<char> pulledVertexShader = ReadFile("CompiledShaders/pulledVert.spv");
+    std::vector<char> pulledIndirectVertexShader = ReadFile("CompiledShaders/pulledIndirectVert.spv");
+
+    VkShaderModule pulledVertexShaderModule = CreateShaderModule(pulledVertexShader, "pulledVertexShaderModule");
+    VkShaderModule pulledIndirectVertexShaderModule = CreateShaderModule(pulledIndirectVertexShader, "pulledIndirectVertexShaderModule");
+
+    VkPipelineShaderStageCreateInfo pulledVertexPipelineCreateInfo = vertexPipelineCreateInfo;
+    pulledVertexPipelineCreateInfo.module = pulledVertexShaderModule;
+
+    VkPipelineShaderStageCreateInfo pulledIndirectVertexPipelineCreateInfo = vertexPipelineCreateInfo;
+    pulledIndirectVertexPipelineCreateInfo.module = pulledIndirectVertexShaderModule;
+
+    GraphicsPipelineInfo pulledGraphicPipelineInfo = graphicPipelineInfo;
+    pulledGraphicPipelineInfo.shaderStages = { pulledVertexPipelineCreateInfo, fragmentPipelineCreateInfo };
+    pulledGraphicPipelineInfo.vertexBindings.clear();
+    pulledGraphicPipelineInfo.vertexAttributes.clear();
+
+    CreateGraphicsPipeline_Internal(pulledGraphicPipelineInfo, pulledPipelineLayout, pulledPipeline, "pulledPipeline", "pulledPipelineLayout");
+
+    GraphicsPipelineInfo pulledIndirectGraphicPipelineInfo = pulledGraphicPipelineInfo;
+    pulledIndirectGraphicPipelineInfo.shaderStages = { pulledIndirectVertexPipelineCreateInfo, fragmentPipelineCreateInfo };
+
+    CreateGraphicsPipeline_Internal(pulledIndirectGraphicPipelineInfo, pulledIndirectPipelineLayout, pulledIndirectPipeline,
+        "pulledIndirectPipeline", "pulledIndirectPipelineLayout");
+
+    vkDestroyShaderModule(gfxCtx->logicalDevice, pulledVertexShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, pulledIndirectVertexShaderModule, gfxCtx->allocationCallbacks);
+#endif//#if VERTEX_PULLING
+
     //Post process present pipeline
     std::vector<char> postProcessPresentVertexShader = ReadFile("CompiledShaders/postProcessPresentVert.spv");
     std::vector<char> postProcessPresentFragmentShader = ReadFile("CompiledShaders/PostProcessPresentFrag.spv");
@@ -1058,6 +1397,8 @@ void HelloTriangleApp::CreateGraphicsPipeline()
     postProcessPresentGraphicPipelineInfo.renderPass = postProcessRenderPass;
     postProcessPresentGraphicPipelineInfo.msaaSamples = VK_SAMPLE_COUNT_1_BIT;
     postProcessPresentGraphicPipelineInfo.viewportExtent = swapChainExtent;
+    postProcessPresentGraphicPipelineInfo.vertexBindings = vertexBindings;
+    postProcessPresentGraphicPipelineInfo.vertexAttributes = vertexAttributes;
 
     CreateGraphicsPipeline_Internal(postProcessPresentGraphicPipelineInfo, postProcessPipelineLayout, postProcessPipeline, "postProcessPipeline", "postProcessPipelineLayout");
 
@@ -1085,13 +1426,21 @@ void HelloTriangleApp::CreateGraphicsPipeline()
     CreateGraphicsPipeline_Internal(brdfGraphicPipelineInfo,
         brdfPipelineLayout, brdfPipeline);*/
 
-    vkDestroyShaderModule(gfxCtx->logicalDevice, vertexShaderModule, nullptr);
-    vkDestroyShaderModule(gfxCtx->logicalDevice, fragmentShaderModule, nullptr);    
-    vkDestroyShaderModule(gfxCtx->logicalDevice, shadowMapVertexShaderModule, nullptr);
-    vkDestroyShaderModule(gfxCtx->logicalDevice, shadowMapFragmentShaderModule, nullptr);
-    vkDestroyShaderModule(gfxCtx->logicalDevice, postProcessPresentVertexShaderModule, nullptr);
-    vkDestroyShaderModule(gfxCtx->logicalDevice, postProcessPresentFragmentShaderModule, nullptr);
-   // vkDestroyShaderModule(gfxCtx->logicalDevice, brdfFragmentShaderModule, nullptr);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, vertexShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, fragmentShaderModule, gfxCtx->allocationCallbacks);    
+    vkDestroyShaderModule(gfxCtx->logicalDevice, shadowMapVertexShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, shadowMapFragmentShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, instancedVertexShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, shadowMapInstancedVertexShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, indirectVertexShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, shadowMapIndirectVertexShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, postProcessPresentVertexShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, postProcessPresentFragmentShaderModule, gfxCtx->allocationCallbacks);
+   // vkDestroyShaderModule(gfxCtx->logicalDevice, brdfFragmentShaderModule, gfxCtx->allocationCallbacks);
+
+#if HOST_ALLOCATOR
+    gfxCtx->hostAllocator->PrintDelta("pipeline creation", hostStatsBefore);
+#endif//#if HOST_ALLOCATOR
 
 #if COMPUTE_FEATURE
 
@@ -1110,7 +1459,7 @@ void HelloTriangleApp::CreateGraphicsPipeline()
     computePipelineLayoutInfo.pSetLayouts = &computeDescriptorSetLayout;
 
     if (vkCreatePipelineLayout(gfxCtx->logicalDevice,
-        &computePipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS)
+        &computePipelineLayoutInfo, gfxCtx->allocationCallbacks, &computePipelineLayout) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating compute pipeline layout!");
     }
@@ -1120,13 +1469,12 @@ void HelloTriangleApp::CreateGraphicsPipeline()
     computePipelineInfo.layout = computePipelineLayout;
     computePipelineInfo.stage = computePipelineCreateInfo;
 
-    if(vkCreateComputePipelines(gfxCtx->logicalDevice, VK_NULL_HANDLE, 1, 
-        &computePipelineInfo, nullptr, &computePipeline) != VK_SUCCESS)
+    if(gfxCtx->pipelineCache->CreateComputePipeline(computePipelineInfo, computePipeline) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating compute pipeline!");
     }
 
-    vkDestroyShaderModule(gfxCtx->logicalDevice, computeShaderModule, nullptr);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, computeShaderModule, gfxCtx->allocationCallbacks);
 #endif//#if COMPUTE_FEATURE
 }
 
@@ -1213,7 +1561,7 @@ void HelloTriangleApp::CreateCommandPool()
     commandoPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     commandoPoolCreateInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
-    if (vkCreateCommandPool(gfxCtx->logicalDevice, &commandoPoolCreateInfo, nullptr, &gfxCtx->commandPool) != VK_SUCCESS)
+    if (vkCreateCommandPool(gfxCtx->logicalDevice, &commandoPoolCreateInfo, gfxCtx->allocationCallbacks, &gfxCtx->commandPool) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating command pool!");
     }
@@ -1221,7 +1569,7 @@ void HelloTriangleApp::CreateCommandPool()
 #if COMPUTE_FEATURE
     commandoPoolCreateInfo.queueFamilyIndex = queueFamilyIndices.graphicsAndComputeFamily.value();
 
-    if (vkCreateCommandPool(gfxCtx->logicalDevice, &commandoPoolCreateInfo, nullptr, &computeCommandPool) != VK_SUCCESS)
+    if (vkCreateCommandPool(gfxCtx->logicalDevice, &commandoPoolCreateInfo, gfxCtx->allocationCallbacks, &computeCommandPool) != VK_SUCCESS)
     {
         throw std::runtime_error("Error creating compute command pool!");
     }
@@ -1263,18 +1611,31 @@ void HelloTriangleApp::CreateColorResources()
 {
 
     VkFormat colorFormat = swapChainImageFormat;
-    CreateImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, 
-        colorFormat, VK_IMAGE_TILING_OPTIMAL, 
-        VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        colorImage, colorImageMemory, "sceneColorImage");
+    if (IsDepthPyramidBuildSupported())
+    {
+        //Loaded again by the occlusion culling second phase pass, it has to be backed by real memory
+        CreateImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples,
+            colorFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            colorImage, colorImageAllocation, "sceneColorImage");
+    }
+    else
+    {
+        //Only lives inside the color pass (resolved at the end), tiled GPUs keep it on chip
+        CreateImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples,
+            colorFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+            GetTransientAttachmentMemoryFlags(),
+            colorImage, colorImageAllocation, "sceneColorImage");
+    }
     colorImageView = CreateImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, "sceneColorImageView");
 
     CreateImage(swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT,
         colorFormat, VK_IMAGE_TILING_OPTIMAL,
         VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        resolveColorImage, resolveColorImageMemory, "resolveColorImage");
+        resolveColorImage, resolveColorImageAllocation, "resolveColorImage");
     resolveColorImageView = CreateImageView(resolveColorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, "resolveColorImageView");
 
     TransitionImageLayout(resolveColorImage, colorFormat,
@@ -1285,7 +1646,7 @@ void HelloTriangleApp::CreateColorResources()
         blurImageFormat, VK_IMAGE_TILING_LINEAR,
         VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        blurImage, blurImageMemory, "blurImage");
+        blurImage, blurImageAllocation, "blurImage");
     blurImageView = CreateImageView(blurImage, blurImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, "blurImageView");
 
     TransitionImageLayout(blurImage, blurImageFormat,
@@ -1296,16 +1657,127 @@ void HelloTriangleApp::CreateDepthResources()
 {
     VkFormat depthFormat = FindDepthFormat();
 
-    CreateImage(swapChainExtent.width, swapChainExtent.height, 1,
-        msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, 
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        depthImage, depthImageMemory, "depthImage");
+    if (IsDepthPyramidBuildSupported())
+    {
+        //Read by the depth pyramid build after the color pass, it has to be backed by real memory
+        CreateImage(swapChainExtent.width, swapChainExtent.height, 1,
+            msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            depthImage, depthImageAllocation, "depthImage");
+    }
+    else
+    {
+        CreateImage(swapChainExtent.width, swapChainExtent.height, 1,
+            msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, 
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, 
+            GetTransientAttachmentMemoryFlags(),
+            depthImage, depthImageAllocation, "depthImage");
+    }
 
     depthImageView = CreateImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, "depthImageView");
 
-    TransitionImageLayout(depthImage, depthFormat,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+    //No layout transition, the color pass starts from UNDEFINED and a barrier could force the lazy memory to commit
+}
+
+VkMemoryPropertyFlags HelloTriangleApp::GetTransientAttachmentMemoryFlags()
+{
+    VkMemoryPropertyFlags lazyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    if (gfxCtx->memoryAllocator->HasMemoryType(lazyFlags))
+    {
+        return lazyFlags;
+    }
+    return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+}
+
+bool HelloTriangleApp::IsDepthPyramidBuildSupported()
+{
+#if HIZ_OCCLUSION_CULLING && GPU_DRIVEN_RENDERING
+    if (!drawIndirectFirstInstanceSupported)
+    {
+        return false;
+    }
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(gfxCtx->physicalDevice, FindDepthFormat(), &formatProperties);
+    const VkPhysicalDeviceLimits& limits = gfxCtx->memoryAllocator->GetLimits();
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0 &&
+        (limits.sampledImageDepthSampleCounts & msaaSamples) != 0;
+#else
+    return false;
+#endif//#if HIZ_OCCLUSION_CULLING && GPU_DRIVEN_RENDERING
+}
+
+void HelloTriangleApp::ReportTransientAttachmentSavings()
+{
+    //The depth pyramid build samples depth after the first color pass and the second phase pass loads both attachments again
+    if (IsDepthPyramidBuildSupported())
+    {
+        std::cout << YELLOW_TEXT << "No transient MSAA attachments, color and depth are kept for the occlusion culling second phase" << RESET_TEXT << std::endl;
+        return;
+    }
+
+    bool hasLazyMemory = gfxCtx->memoryAllocator->HasMemoryType(VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    VkPhysicalDeviceLimits limits = gfxCtx->memoryAllocator->GetLimits();
+    VkSampleCountFlags sampleCounts = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+
+    std::cout << (hasLazyMemory ? CYAN_TEXT : YELLOW_TEXT) << "Transient MSAA attachments at "
+        << swapChainExtent.width << "x" << swapChainExtent.height
+        << (hasLazyMemory ? ", lazily allocated memory available" : ", no lazily allocated memory, savings only on tiled GPUs")
+        << RESET_TEXT << std::endl;
+
+    //Query the real size of the transient attachments the color pass would need at every sample count
+    VkImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    for (VkSampleCountFlags samples = VK_SAMPLE_COUNT_2_BIT; samples <= VK_SAMPLE_COUNT_64_BIT; samples <<= 1)
+    {
+        if (!(sampleCounts & samples))
+        {
+            continue;
+        }
+
+        imageCreateInfo.samples = static_cast<VkSampleCountFlagBits>(samples);
+        VkDeviceSize attachmentBytes = 0;
+
+        std::vector<std::pair<VkFormat, VkImageUsageFlags>> attachments =
+        {
+            { swapChainImageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT },
+            { FindDepthFormat(), VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT }
+        };
+        for (const std::pair<VkFormat, VkImageUsageFlags>& attachment : attachments)
+        {
+            imageCreateInfo.format = attachment.first;
+            imageCreateInfo.usage = attachment.second;
+
+            VkImage image;
+            if (vkCreateImage(gfxCtx->logicalDevice, &imageCreateInfo, gfxCtx->allocationCallbacks, &image) != VK_SUCCESS)
+            {
+                continue;
+            }
+            VkMemoryRequirements memoryRequirements;
+            vkGetImageMemoryRequirements(gfxCtx->logicalDevice, image, &memoryRequirements);
+            attachmentBytes += memoryRequirements.size;
+            vkDestroyImage(gfxCtx->logicalDevice, image, gfxCtx->allocationCallbacks);
+        }
+
+        std::cout << '\t' << samples << "x MSAA: " << attachmentBytes / (1024 * 1024) << " MB of color + depth "
+            << (hasLazyMemory ? "never committed" : "would stay on chip");
+        if (samples == msaaSamples)
+        {
+            VkDeviceSize committedBytes = gfxCtx->memoryAllocator->GetCommittedBytes(colorImageAllocation) +
+                gfxCtx->memoryAllocator->GetCommittedBytes(depthImageAllocation);
+            std::cout << " (in use, " << committedBytes / (1024 * 1024) << " MB committed)";
+        }
+        std::cout << '\n';
+    }
 }
 
 void HelloTriangleApp::CreateShadowMapResources() 
@@ -1316,7 +1788,7 @@ void HelloTriangleApp::CreateShadowMapResources()
         VK_SAMPLE_COUNT_1_BIT, depthFormat, VK_IMAGE_TILING_OPTIMAL,
         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        dirShadowMapDepthImage, dirShadowMapDepthMemory, "dirShadowMapDepthImage");
+        dirShadowMapDepthImage, dirShadowMapDepthAllocation, "dirShadowMapDepthImage");
 
     dirShadowMapDepthImageView = CreateImageView(dirShadowMapDepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, "dirShadowMapDepthImageView");
 
@@ -1331,7 +1803,7 @@ void HelloTriangleApp::CreatePostProcessResources()
         colorFormat, VK_IMAGE_TILING_OPTIMAL,
         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        postProcessImage, postProcessImageMemory, "postProcessImage");
+        postProcessImage, postProcessImageAllocation, "postProcessImage");
     postProcessImageView = CreateImageView(postProcessImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, "postProcessImageView");
 }
 
@@ -1372,47 +1844,10 @@ void HelloTriangleApp::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_
 
 void HelloTriangleApp::CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, 
     VkSampleCountFlagBits numSample, VkFormat format, VkImageTiling tiling, 
-    VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory,
+    VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, GfxAllocation& imageAllocation,
     const char* imageName)
 {
-    VkImageCreateInfo imageCreateInfo{};
-    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageCreateInfo.extent.width = static_cast<uint32_t>(width);
-    imageCreateInfo.extent.height = static_cast<uint32_t>(height);
-    imageCreateInfo.extent.depth = 1;
-    imageCreateInfo.arrayLayers = 1;
-    imageCreateInfo.mipLevels = mipLevels;
-    imageCreateInfo.format = format;
-    imageCreateInfo.tiling = tiling;
-    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageCreateInfo.usage = usage;
-    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    imageCreateInfo.samples = numSample;
-    imageCreateInfo.flags = 0;
-
-    if (vkCreateImage(gfxCtx->logicalDevice, &imageCreateInfo, nullptr, &image) != VK_SUCCESS)
-    {
-        throw std::runtime_error("Error creating image!");
-    }
-
-    VkMemoryRequirements memoryRequirements;
-    vkGetImageMemoryRequirements(gfxCtx->logicalDevice, image, &memoryRequirements);
-
-    VkMemoryAllocateInfo memoryAllocateInfo{};
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = FindMemoryType(memoryRequirements.memoryTypeBits,
-        properties);
-
-    if (vkAllocateMemory(gfxCtx->logicalDevice, &memoryAllocateInfo, nullptr, &imageMemory) != VK_SUCCESS)
-    {
-        throw std::runtime_error("Error allocating memory for created image!");
-    }
-
-    vkBindImageMemory(gfxCtx->logicalDevice, image, imageMemory, 0);
-
-    DebugUtils::getInstance().SetVulkanObjectName(image, imageName);
+    CreateImage_Internal(width, height, mipLevels, numSample, format, tiling, usage, properties, image, imageAllocation, imageName);
 }
 
 void HelloTriangleApp::CreateTextureImage()
@@ -1433,36 +1868,21 @@ void HelloTriangleApp::CreateTextureImage()
         throw std::runtime_error("Error loading image!");
     }
 
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
-    VkBuffer stagingBuffer;
-    VkDeviceMemory staginBufferMemory;
-    CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        stagingBuffer, staginBufferMemory, "textureStagingBuffer");
-
-    void* data;
-    vkMapMemory(gfxCtx->logicalDevice, staginBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(gfxCtx->logicalDevice, staginBufferMemory);
-
-    gfxLoader.FreeTextureArrayInfo(pixels);
-
-    CreateImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT,
-        VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+    //Streamed: device local while there is budget, moved to host memory when unused and over budget
+    texture.Create(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_SRGB,
         VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | 
-        VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        textureImage, textureImageMemory, "textureImage");
+        VK_IMAGE_USAGE_SAMPLED_BIT, "textureImage");
 
-    //TODO: make this operations in one command buffer async, now are various command buffers with single task
+    //Pixels are copied into the staging ring before returning so they can be freed right away
+    //The ring leaves every mip in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL for the blits
+    gfxCtx->stagingRing->UploadImage(texture.image,
+        static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 4, mipLevels, pixels);
+    gfxLoader.FreeTextureArrayInfo(pixels);
 
-    TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-    CopyBufferToImage(stagingBuffer, textureImage, 
-        static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-    GenerateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
+    GenerateMipmaps(texture.image, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
 
-    vkDestroyBuffer(gfxCtx->logicalDevice, stagingBuffer, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, staginBufferMemory, nullptr);
+    gfxCtx->residencyManager->Register(&texture);
+    gfxCtx->defragmenter->Register(&texture);
 }
 
 void HelloTriangleApp::GenerateMipmaps(VkImage image, VkFormat format, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels)
@@ -1561,8 +1981,8 @@ void HelloTriangleApp::GenerateMipmaps(VkImage image, VkFormat format, uint32_t
 
 void HelloTriangleApp::CreateTextureImageView()
 {    
-    textureImageView = CreateImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, "AssetTextureImageView");
+    //Owned by the streamed image, recreated when it moves between heaps
+    texture.CreateView("AssetTextureImageView");
 }
 
 void HelloTriangleApp::CreateTextureSampler()
@@ -1596,81 +2016,151 @@ void HelloTriangleApp::CreateTextureSampler()
     samplerCreateInfo.maxLod = static_cast<float>(mipLevels);
     samplerCreateInfo.minLod = 0.0f;
 
-    if (vkCreateSampler(gfxCtx->logicalDevice, &samplerCreateInfo, nullptr, &textureSampler) != VK_SUCCESS) 
+    if (vkCreateSampler(gfxCtx->logicalDevice, &samplerCreateInfo, gfxCtx->allocationCallbacks, &textureSampler) != VK_SUCCESS) 
     {
         throw std::runtime_error("Error creating sampler!");
     }
 
 }
 
-void HelloTriangleApp::PopulateObjects()
+void HelloTriangleApp::CreateGeometryArena()
 {
-    objects.push_back(new GfxCube(graphicsPipeline, graphicsPipelineLayout));
-    objects.push_back(new GfxSphere(graphicsPipeline, graphicsPipelineLayout));
-    objects.push_back(new GfxPlane(graphicsPipeline, graphicsPipelineLayout));
+    gfxCtx->geometryArena = new GfxGeometryArena();
+    //Scene objects also get a packed copy of their vertices for the vertex pulling pipelines
+    gfxCtx->geometryArena->Init(GEOMETRY_ARENA_VERTEX_CAPACITY, GEOMETRY_ARENA_INDEX_CAPACITY, sizeof(Vertex),
+        VERTEX_PULLING ? PACKED_VERTEX_STRIDE : 0);
 }
 
-void HelloTriangleApp::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, 
-    VkMemoryPropertyFlags memoryFlags, VkBuffer& newBuffer, VkDeviceMemory& bufferMemory, const char* BufferName, const char* BufferMemoryName)
+void HelloTriangleApp::CreateTransformBuffer()
 {
-    CreateBuffer_Internal(size, usageFlags, memoryFlags, newBuffer, bufferMemory, BufferName, BufferMemoryName);
+    gfxCtx->transformBuffer = new GfxTransformBuffer();
+    gfxCtx->transformBuffer->Init(TRANSFORM_BUFFER_MAX_TRANSFORMS, MAX_FRAMES_IN_FLIGHT);
 }
 
-void HelloTriangleApp::CreateUniformBuffers()
+void HelloTriangleApp::PopulateObjects()
 {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    defaultMaterialId = scene.AddMaterial(graphicsPipeline, graphicsPipelineLayout, "defaultMaterial");
+#if VERTEX_PULLING
+    scene.SetMaterialPulledPipeline(defaultMaterialId, pulledPipeline, pulledPipelineLayout);
+#endif//#if VERTEX_PULLING
+    sceneGraph.Init(&jobPool);
 
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    //Generated geometry only lives until it is in the geometry arena
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
 
-    std::string uniformBufferDebugName = "UniformBuffer";
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) 
+    //Software occlusion proxies, each one fits inside the object it stands for
+    std::vector<glm::vec3> occluderPositions;
+    std::vector<uint32_t> occluderIndices;
+
+    //Static objects are merged by material and chunk in Build, batched objects get no handle so their proxies are placed in world space
+    const uint32_t staticFlags = STATIC_BATCHING ? SCENE_OBJECT_DEFAULT : SCENE_OBJECT_NO_STATIC_BATCHING;
+
+    GfxCube::GenerateMesh(vertices, indices);
+    glm::mat4 cubeMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-2, 0, 0));
+    staticBatcher.Add(scene, vertices, indices, cubeMatrix, defaultMaterialId, staticFlags, "Cube");
+    GfxSoftwareOcclusion::GenerateBoxOccluder(glm::vec3(-0.5f), glm::vec3(0.5f), occluderPositions, occluderIndices);
+    softwareOcclusion.AddOccluder(cubeMatrix, occluderPositions, occluderIndices);
+
+    //Kept out of the batches so it can still be moved through its scene graph node
+    GfxSphere::GenerateMesh(20, 20, 1.0f, vertices, indices);
+    GfxSceneHandle sphere = staticBatcher.Add(scene, vertices, indices, glm::mat4(1.0f), defaultMaterialId, SCENE_OBJECT_NO_STATIC_BATCHING, "Sphere");
+    sphereNode = sceneGraph.CreateNode(SCENE_GRAPH_INVALID_NODE, glm::mat4(1.0f), sphere);
+    //Box inside the tessellated unit sphere
+    GfxSoftwareOcclusion::GenerateBoxOccluder(glm::vec3(-0.55f), glm::vec3(0.55f), occluderPositions, occluderIndices);
+    softwareOcclusion.AddOccluder(sphere, occluderPositions, occluderIndices);
+
+    //Vertices sit at y=0.5, the plane ends up at y=-3. Y scale is kept at 1 so the normal survives the model matrix
+    GfxPlane::GenerateMesh(vertices, indices);
+    glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0, -3.5, 0));
+    glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(25, 1, 25));
+    staticBatcher.Add(scene, vertices, indices, translationMatrix * scaleMatrix, defaultMaterialId, staticFlags, "Plane");
+    GfxSoftwareOcclusion::GenerateBoxOccluder(glm::vec3(-0.5f, 0.5f, -0.5f), glm::vec3(0.5f, 0.5f, 0.5f), occluderPositions, occluderIndices);
+    softwareOcclusion.AddOccluder(translationMatrix * scaleMatrix, occluderPositions, occluderIndices);
+
+#if STATIC_BATCHING_BENCHMARK
+    //Crates on the plane, same material and chunk as it so all of them end up in the plane batch
+    GfxCube::GenerateMesh(vertices, indices);
+    for (uint32_t i = 0; i < STATIC_BATCHING_BENCHMARK_CRATE_COUNT; ++i)
     {
-        uniformBufferDebugName += std::to_string(i + 1);
+        glm::vec3 position = glm::vec3(3.0f + static_cast<float>(i % 4) * 1.5f, -2.75f, 3.0f + static_cast<float>(i / 4) * 1.5f);
+        glm::mat4 crateMatrix = glm::translate(glm::mat4(1.0f), position) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+        staticBatcher.Add(scene, vertices, indices, crateMatrix, defaultMaterialId, staticFlags, "StaticBatchingBenchmarkCrate");
+    }
+#endif//#if STATIC_BATCHING_BENCHMARK
+
+#if VERTEX_PULLING_BENCHMARK
+    //Rows of OBJ models behind the scene, enough vertices for the vertex input to show up in the color pass time
+    GfxLoader objLoader;
+    objLoader.LoadObj(MODEL_PATH, vertices, indices);
+    for (uint32_t i = 0; i < VERTEX_PULLING_BENCHMARK_OBJ_COUNT; ++i)
+    {
+        glm::vec3 position = glm::vec3(static_cast<float>(i % 8) * 3.0f - 10.5f, -2.5f, -6.0f - static_cast<float>(i / 8) * 3.0f);
+        glm::mat4 objMatrix = glm::translate(glm::mat4(1.0f), position) * glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1, 0, 0));
+        staticBatcher.Add(scene, vertices, indices, objMatrix, defaultMaterialId, SCENE_OBJECT_NO_STATIC_BATCHING, "VertexPullingBenchmarkObj");
+    }
+#endif//#if VERTEX_PULLING_BENCHMARK
+
+    staticBatcher.Build(scene);
+    staticBatcher.PrintStats();
+}
+
+void HelloTriangleApp::CreateInstancedMeshes()
+{
+    std::vector<Vertex> sphereVertices;
+    std::vector<uint32_t> sphereIndices;
+    GfxSphere::GenerateMesh(8, 8, 1.0f, sphereVertices, sphereIndices);
 
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-            uniformBuffers[i], uniformBuffersMemory[i], uniformBufferDebugName.c_str());
+    instancedSpheres.Init(sphereVertices, sphereIndices, INSTANCED_SPHERE_COUNT, MAX_FRAMES_IN_FLIGHT, "instancedSpheres");
 
-        vkMapMemory(gfxCtx->logicalDevice, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+    //Grid of small spheres resting on the plane
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(INSTANCED_SPHERE_COUNT))));
+    float spacing = 24.0f / static_cast<float>(side);
+    float radius = spacing * 0.3f;
+    for (uint32_t i = 0; i < INSTANCED_SPHERE_COUNT; ++i)
+    {
+        uint32_t x = i % side;
+        uint32_t z = i / side;
+        glm::vec3 position(-12.0f + (x + 0.5f) * spacing, -3.0f + radius, -12.0f + (z + 0.5f) * spacing);
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), position) * glm::scale(glm::mat4(1.0f), glm::vec3(radius));
+        glm::vec4 color(static_cast<float>(x) / side, 0.5f, static_cast<float>(z) / side, 1.0f);
+        instancedSpheres.AddInstance(modelMatrix, color);
     }
+}
 
+void HelloTriangleApp::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, 
+    VkMemoryPropertyFlags memoryFlags, VkBuffer& newBuffer, GfxAllocation& bufferAllocation, const char* BufferName, const char* BufferMemoryName)
+{
+    CreateBuffer_Internal(size, usageFlags, memoryFlags, newBuffer, bufferAllocation, BufferName, BufferMemoryName);
+}
+
+void HelloTriangleApp::CreateUniformBuffers()
+{
+    //Per frame constants are bump-allocated every frame and bound with dynamic offsets
+    gfxCtx->frameAllocator = new GfxFrameAllocator();
+    gfxCtx->frameAllocator->Init(MAX_FRAMES_IN_FLIGHT, FRAME_ALLOCATOR_SIZE,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, "FrameUniformBuffer");
 }
 
 void HelloTriangleApp::CreateShaderStorageBuffers()
 {
     shaderStorageBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    shaderStorageBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    shaderStorageBuffersAllocation.resize(MAX_FRAMES_IN_FLIGHT);
 
     std::vector <TestComputeClass> objects = InitializeRandomClass();
 
     VkDeviceSize bufferSize = sizeof(TestComputeClass) * objects.size();
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(gfxCtx->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, objects.data(), bufferSize);
-    vkUnmapMemory(gfxCtx->logicalDevice, stagingBufferMemory);
-
     std::string shaderStorageDebugName = "ShaderStorageBuffers";
     for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i)
     {
         shaderStorageDebugName += std::to_string(i + 1);
         CreateBuffer(bufferSize, 
             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shaderStorageBuffers[i], shaderStorageBuffersMemory[i], shaderStorageDebugName.c_str());
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shaderStorageBuffers[i], shaderStorageBuffersAllocation[i], shaderStorageDebugName.c_str());
 
-        CopyBuffer(stagingBuffer, shaderStorageBuffers[i], bufferSize);
+        gfxCtx->stagingRing->UploadBuffer(shaderStorageBuffers[i], 0, objects.data(), bufferSize);
     }
-
-    vkDestroyBuffer(gfxCtx->logicalDevice, stagingBuffer, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, stagingBufferMemory, nullptr);
 }
 
 void HelloTriangleApp::CreatePostProcessingQuadBuffer()
@@ -1678,54 +2168,29 @@ void HelloTriangleApp::CreatePostProcessingQuadBuffer()
     //Vertex
     VkDeviceSize bufferSize = sizeof(Vertex) * quadVertices.size();
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(gfxCtx->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, quadVertices.data(), bufferSize);
-    vkUnmapMemory(gfxCtx->logicalDevice, stagingBufferMemory);
-
     CreateBuffer(bufferSize,
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, postProcessQuadBuffer, postProcessQuadBufferMemory, "postProcessQuadVertexBuffer", "postProcessQuadBufferMemory");
-
-    CopyBuffer(stagingBuffer, postProcessQuadBuffer, bufferSize);
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, postProcessQuadBuffer, postProcessQuadBufferAllocation, "postProcessQuadVertexBuffer", "postProcessQuadBufferMemory");
 
-    vkDestroyBuffer(gfxCtx->logicalDevice, stagingBuffer, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, stagingBufferMemory, nullptr);
+    gfxCtx->stagingRing->UploadBuffer(postProcessQuadBuffer, 0, quadVertices.data(), bufferSize);
 
     //Indices
     bufferSize = sizeof(Vertex) * quadIndices.size();
 
-    VkBuffer stagingBufferIndices;
-    VkDeviceMemory stagingBufferIndicesMemory;
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        stagingBufferIndices, stagingBufferIndicesMemory);
-
-    vkMapMemory(gfxCtx->logicalDevice, stagingBufferIndicesMemory, 0, bufferSize, 0, &data);
-    memcpy(data, quadIndices.data(), bufferSize);
-    vkUnmapMemory(gfxCtx->logicalDevice, stagingBufferIndicesMemory);
-
     CreateBuffer(bufferSize,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, postProcessQuadIndicesBuffer, postProcessQuadIndicesBufferMemory, "postProcessQuadIndicesBuffer", "postProcessQuadIndicesBufferMemory");
-
-    CopyBuffer(stagingBufferIndices, postProcessQuadIndicesBuffer, bufferSize);
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, postProcessQuadIndicesBuffer, postProcessQuadIndicesBufferAllocation, "postProcessQuadIndicesBuffer", "postProcessQuadIndicesBufferMemory");
 
-    vkDestroyBuffer(gfxCtx->logicalDevice, stagingBufferIndices, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, stagingBufferIndicesMemory, nullptr);
+    gfxCtx->stagingRing->UploadBuffer(postProcessQuadIndicesBuffer, 0, quadIndices.data(), sizeof(uint32_t) * quadIndices.size());
 }
 
 void HelloTriangleApp::CreateShadowMapDescriptorPool()
 {
-    std::array<VkDescriptorPoolSize, 1> descriptorPoolSize;
-    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    std::array<VkDescriptorPoolSize, 2> descriptorPoolSize;
+    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorPoolSize[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorPoolSize[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
     VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
     descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -1738,8 +2203,8 @@ void HelloTriangleApp::CreateShadowMapDescriptorPool()
 
 void HelloTriangleApp::CreateColorPassDescriptorPool()
 {
-    std::array<VkDescriptorPoolSize, 4> descriptorPoolSize;
-    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    std::array<VkDescriptorPoolSize, 5> descriptorPoolSize;
+    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorPoolSize[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
     descriptorPoolSize[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
@@ -1747,6 +2212,9 @@ void HelloTriangleApp::CreateColorPassDescriptorPool()
     descriptorPoolSize[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     descriptorPoolSize[3].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
     descriptorPoolSize[3].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    descriptorPoolSize[4].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    //Transforms, and the pulled vertices with VERTEX_PULLING
+    descriptorPoolSize[4].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * (VERTEX_PULLING ? 2 : 1);
 
     VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
     descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -1759,7 +2227,7 @@ void HelloTriangleApp::CreateColorPassDescriptorPool()
     //Compute
 #if COMPUTE_FEATURE
     std::array<VkDescriptorPoolSize, 3> computeDescriptorPoolSize;
-    computeDescriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    computeDescriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     computeDescriptorPoolSize[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     computeDescriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
     computeDescriptorPoolSize[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
@@ -1780,7 +2248,7 @@ void HelloTriangleApp::CreatePostProcessDescriptorPool()
 {
 //postProcessDescriptorPool
     std::array<VkDescriptorPoolSize, 3> descriptorPoolSize;
-    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorPoolSize[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
     descriptorPoolSize[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
@@ -1811,19 +2279,32 @@ void HelloTriangleApp::CreateShadowMapDescriptorSets()
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
+        bufferInfo.buffer = gfxCtx->frameAllocator->GetBuffer();
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(UniformBufferObject);
 
-        std::array<VkWriteDescriptorSet, 1> writeDescriptorSet{};
+        VkDescriptorBufferInfo transformsInfo{};
+        transformsInfo.buffer = gfxCtx->transformBuffer->GetBuffer(i);
+        transformsInfo.offset = 0;
+        transformsInfo.range = gfxCtx->transformBuffer->GetBufferSize();
+
+        std::array<VkWriteDescriptorSet, 2> writeDescriptorSet{};
         writeDescriptorSet[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         writeDescriptorSet[0].dstSet = shadowMapDescriptorSets[i];
         writeDescriptorSet[0].dstBinding = 0;
         writeDescriptorSet[0].dstArrayElement = 0;
-        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         writeDescriptorSet[0].descriptorCount = 1;
         writeDescriptorSet[0].pBufferInfo = &bufferInfo;
 
+        writeDescriptorSet[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSet[1].dstSet = shadowMapDescriptorSets[i];
+        writeDescriptorSet[1].dstBinding = 1;
+        writeDescriptorSet[1].dstArrayElement = 0;
+        writeDescriptorSet[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeDescriptorSet[1].descriptorCount = 1;
+        writeDescriptorSet[1].pBufferInfo = &transformsInfo;
+
         vkUpdateDescriptorSets(gfxCtx->logicalDevice, static_cast<uint32_t>(writeDescriptorSet.size()),
             writeDescriptorSet.data(), 0, nullptr);
     }
@@ -1857,16 +2338,16 @@ void HelloTriangleApp::CreateDescriptorSets()
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
+        bufferInfo.buffer = gfxCtx->frameAllocator->GetBuffer();
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(UniformBufferObject);
 
-        std::array<VkWriteDescriptorSet, 4> writeDescriptorSet{};
+        std::array<VkWriteDescriptorSet, 5> writeDescriptorSet{};
         writeDescriptorSet[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         writeDescriptorSet[0].dstSet = descriptorSets[i];
         writeDescriptorSet[0].dstBinding = 0;
         writeDescriptorSet[0].dstArrayElement = 0;
-        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         writeDescriptorSet[0].descriptorCount = 1;
         writeDescriptorSet[0].pBufferInfo = &bufferInfo;
 
@@ -1884,7 +2365,7 @@ void HelloTriangleApp::CreateDescriptorSets()
         writeDescriptorSet[1].pImageInfo = &samplerInfo;
 
         VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageView = textureImageView;
+        imageInfo.imageView = texture.view;
         imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         imageInfo.sampler = nullptr;
 
@@ -1909,8 +2390,25 @@ void HelloTriangleApp::CreateDescriptorSets()
         writeDescriptorSet[3].descriptorCount = 1;
         writeDescriptorSet[3].pImageInfo = &imageInfo2;
 
+        VkDescriptorBufferInfo transformsInfo{};
+        transformsInfo.buffer = gfxCtx->transformBuffer->GetBuffer(i);
+        transformsInfo.offset = 0;
+        transformsInfo.range = gfxCtx->transformBuffer->GetBufferSize();
+
+        writeDescriptorSet[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSet[4].dstSet = descriptorSets[i];
+        writeDescriptorSet[4].dstBinding = 4;
+        writeDescriptorSet[4].dstArrayElement = 0;
+        writeDescriptorSet[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeDescriptorSet[4].descriptorCount = 1;
+        writeDescriptorSet[4].pBufferInfo = &transformsInfo;
+
         vkUpdateDescriptorSets(gfxCtx->logicalDevice, static_cast<uint32_t>(writeDescriptorSet.size()),
             writeDescriptorSet.data(), 0, nullptr);
+
+#if VERTEX_PULLING
+        UpdatePulledVertexDescriptors(i);
+#endif//#if VERTEX_PULLING
     }
 }
 
@@ -1934,7 +2432,7 @@ void HelloTriangleApp::UpdatePostProcessDescriptorSets()
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
+        bufferInfo.buffer = gfxCtx->frameAllocator->GetBuffer();
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(UniformBufferObject);
 
@@ -1943,7 +2441,7 @@ void HelloTriangleApp::UpdatePostProcessDescriptorSets()
         writeDescriptorSet[0].dstSet = postProcessDescriptorSets[i];
         writeDescriptorSet[0].dstBinding = 0;
         writeDescriptorSet[0].dstArrayElement = 0;
-        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         writeDescriptorSet[0].descriptorCount = 1;
         writeDescriptorSet[0].pBufferInfo = &bufferInfo;
 
@@ -1983,7 +2481,7 @@ void HelloTriangleApp::UpdateDescriptorSets()
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
+        bufferInfo.buffer = gfxCtx->frameAllocator->GetBuffer();
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(UniformBufferObject);
 
@@ -1992,7 +2490,7 @@ void HelloTriangleApp::UpdateDescriptorSets()
         writeDescriptorSet[0].dstSet = shadowMapDescriptorSets[i];
         writeDescriptorSet[0].dstBinding = 0;
         writeDescriptorSet[0].dstArrayElement = 0;
-        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         writeDescriptorSet[0].descriptorCount = 1;
         writeDescriptorSet[0].pBufferInfo = &bufferInfo;
 
@@ -2003,7 +2501,7 @@ void HelloTriangleApp::UpdateDescriptorSets()
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
+        bufferInfo.buffer = gfxCtx->frameAllocator->GetBuffer();
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(UniformBufferObject);
 
@@ -2012,7 +2510,7 @@ void HelloTriangleApp::UpdateDescriptorSets()
         writeDescriptorSet[0].dstSet = descriptorSets[i];
         writeDescriptorSet[0].dstBinding = 0;
         writeDescriptorSet[0].dstArrayElement = 0;
-        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writeDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         writeDescriptorSet[0].descriptorCount = 1;
         writeDescriptorSet[0].pBufferInfo = &bufferInfo;
 
@@ -2030,7 +2528,7 @@ void HelloTriangleApp::UpdateDescriptorSets()
         writeDescriptorSet[1].pImageInfo = &samplerInfo;
 
         VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageView = textureImageView;
+        imageInfo.imageView = texture.view;
         imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         imageInfo.sampler = nullptr;
 
@@ -2065,7 +2563,7 @@ void HelloTriangleApp::UpdateComputeDescriptorSets()
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
+        bufferInfo.buffer = gfxCtx->frameAllocator->GetBuffer();
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(UniformBufferObject);
 
@@ -2084,7 +2582,7 @@ void HelloTriangleApp::UpdateComputeDescriptorSets()
         computeWriteDescriptorSet[0].dstSet = computeDescriptorSets[i];
         computeWriteDescriptorSet[0].dstBinding = 0;
         computeWriteDescriptorSet[0].dstArrayElement = 0;
-        computeWriteDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        computeWriteDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         computeWriteDescriptorSet[0].descriptorCount = 1;
         computeWriteDescriptorSet[0].pBufferInfo = &bufferInfo;
 
@@ -2113,15 +2611,6 @@ void HelloTriangleApp::UpdateComputeDescriptorSets()
 void HelloTriangleApp::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
 {
     CopyBuffer_Internal(srcBuffer, dstBuffer, size);
-    VkCommandBuffer commandBuffer = BeginSingleTimeCommandBuffer();
-
-    VkBufferCopy copyRegion{};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-    EndSingleTimeCommandBuffer(commandBuffer);
 }
 
 void HelloTriangleApp::CreateCommandBuffers()
@@ -2166,21 +2655,58 @@ void HelloTriangleApp::CreateSyncObjects()
 
     for(int i =0; i<MAX_FRAMES_IN_FLIGHT;++i)
     {
-        if (vkCreateSemaphore(gfxCtx->logicalDevice, &semaphoreCreateInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(gfxCtx->logicalDevice, &semaphoreCreateInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(gfxCtx->logicalDevice, &fenceCreateInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+        if (vkCreateSemaphore(gfxCtx->logicalDevice, &semaphoreCreateInfo, gfxCtx->allocationCallbacks, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(gfxCtx->logicalDevice, &semaphoreCreateInfo, gfxCtx->allocationCallbacks, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+            vkCreateFence(gfxCtx->logicalDevice, &fenceCreateInfo, gfxCtx->allocationCallbacks, &inFlightFences[i]) != VK_SUCCESS)
         {
             throw std::runtime_error("Error creating sync objects!");
         }
     }
 }
 
+void HelloTriangleApp::UpdateTextureDescriptors(uint32_t frameIndex)
+{
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView = texture.view;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.sampler = nullptr;
+
+    VkWriteDescriptorSet writeDescriptorSet{};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.dstSet = descriptorSets[frameIndex];
+    writeDescriptorSet.dstBinding = 2;
+    writeDescriptorSet.dstArrayElement = 0;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(gfxCtx->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+    textureDescriptorVersions[frameIndex] = texture.GetVersion();
+}
+
+void HelloTriangleApp::UpdatePulledVertexDescriptors(uint32_t frameIndex)
+{
+    VkDescriptorBufferInfo pulledVerticesInfo{};
+    pulledVerticesInfo.buffer = gfxCtx->geometryArena->GetPulledVertexBuffer();
+    pulledVerticesInfo.offset = 0;
+    pulledVerticesInfo.range = gfxCtx->geometryArena->GetPulledVertexBufferSize();
+
+    VkWriteDescriptorSet writeDescriptorSet{};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.dstSet = descriptorSets[frameIndex];
+    writeDescriptorSet.dstBinding = 5;
+    writeDescriptorSet.dstArrayElement = 0;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.pBufferInfo = &pulledVerticesInfo;
+
+    vkUpdateDescriptorSets(gfxCtx->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+    pulledVertexDescriptorBuffers[frameIndex] = pulledVerticesInfo.buffer;
+}
+
 void HelloTriangleApp::SetDescriptorsToObjects()
 {
-    for(GfxObject* object : objects)
-    {
-        object->SetDescriptorSetAndLayout(descriptorSets, descriptorSetLayout);
-    }
+    scene.SetMaterialDescriptorSets(defaultMaterialId, descriptorSets);
 }
 
 void HelloTriangleApp::RecordComputeCommandBuffer(VkCommandBuffer commandBuffer)
@@ -2198,7 +2724,7 @@ void HelloTriangleApp::RecordComputeCommandBuffer(VkCommandBuffer commandBuffer)
 
     //vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
     //vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-    //    computePipelineLayout, 0, 1, &computeDescriptorSets[currentFrame], 0, 0);
+    //    computePipelineLayout, 0, 1, &computeDescriptorSets[currentFrame], 1, &frameUniformOffset);
 
     //vkCmdDispatch(commandBuffer, OBJECT_COUNT / 256, 1, 1);
 
@@ -2211,6 +2737,16 @@ void HelloTriangleApp::RecordComputeCommandBuffer(VkCommandBuffer commandBuffer)
 
 void HelloTriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
+    //Draws of both passes go to secondary buffers first, the primary buffer only runs them
+#if CACHED_COMMAND_BUFFERS
+    //The cached primary runs them again on later frames, so they come from its cache entry instead of the pools reset every frame
+    RecordScenePasses(parallelRecorder, imageIndex, shadowDrawList, colorDrawList,
+        commandBufferCache.GetSecondaryCommandBuffers(imageIndex, currentFrame, RECORDING_PASS_SHADOW),
+        commandBufferCache.GetSecondaryCommandBuffers(imageIndex, currentFrame, RECORDING_PASS_COLOR));
+#else
+    RecordScenePasses(parallelRecorder, imageIndex, shadowDrawList, colorDrawList);
+#endif//#if CACHED_COMMAND_BUFFERS
+
     VkCommandBufferBeginInfo commandBufferBeginInfo{};
     commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     commandBufferBeginInfo.flags = 0;
@@ -2221,6 +2757,14 @@ void HelloTriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32
         throw std::runtime_error("Error creating command buffer!");
     }
 
+    if (gpuDrivenRendering)
+    {
+        gpuCulling.RecordCulling(commandBuffer, currentFrame, RECORDING_PASS_SHADOW);
+        gpuCulling.RecordCulling(commandBuffer, currentFrame, RECORDING_PASS_COLOR);
+        gpuCulling.RecordDrawBarrier(commandBuffer);
+    }
+    gpuTimer.RecordReset(commandBuffer, currentFrame);
+
     //Shadowmap renderpass
     VkRenderPassBeginInfo shadowMapRenderPassBeginInfo{};
     shadowMapRenderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -2234,39 +2778,8 @@ void HelloTriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32
     shadowMapRenderPassBeginInfo.clearValueCount = static_cast<uint32_t>(shadowMapClearValues.size());
     shadowMapRenderPassBeginInfo.pClearValues = shadowMapClearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &shadowMapRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        shadowMapPipeline);
-
-    for (GfxObject* object : objects)
-    {
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(swapChainExtent.width);
-        viewport.height = static_cast<float>(swapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor{};
-        scissor.extent = swapChainExtent;
-        scissor.offset = { 0, 0 };
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-        VkBuffer vertexBuffers[] = { object->vertexBuffer };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-
-        vkCmdBindIndexBuffer(commandBuffer, object->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-            shadowMapPipelineLayout, 0, 1, &shadowMapDescriptorSets[currentFrame], 0, nullptr);
-
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(object->indices.size()), 1, 0, 0, 0);
-    }
-
+    vkCmdBeginRenderPass(commandBuffer, &shadowMapRenderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    parallelRecorder.ExecutePass(commandBuffer, RECORDING_PASS_SHADOW);
     vkCmdEndRenderPass(commandBuffer);
 
     //Color lighting renderpass
@@ -2285,40 +2798,36 @@ void HelloTriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32
     renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassBeginInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    gpuTimer.RecordStart(commandBuffer, currentFrame, GPU_TIMER_COLOR_PASS);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    parallelRecorder.ExecutePass(commandBuffer, RECORDING_PASS_COLOR);
+    vkCmdEndRenderPass(commandBuffer);
 
-    for(GfxObject* object : objects)
+    //Occlusion second phase: the pyramid of what the last frame visible objects drew, the rest culled against it and drawn on top.
+    //Inside the timed range, the occlusion culled bucket pays for the pyramid and the second cull
+    if (gpuDrivenRendering && frameOcclusionCulled[currentFrame])
     {
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-            object->graphicsPipeline );
-
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(swapChainExtent.width);
-        viewport.height = static_cast<float>(swapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor{};
-        scissor.extent = swapChainExtent;
-        scissor.offset = {0, 0};
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-        VkBuffer vertexBuffers[] = { object->vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        VkFormat depthFormat = FindDepthFormat();
+        VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT | (HasStencilComponent(depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+        depthPyramid.RecordBuild(commandBuffer, depthImage, depthAspect);
+        gpuCulling.RecordSecondPhaseCulling(commandBuffer, currentFrame);
+        gpuCulling.RecordDrawBarrier(commandBuffer);
 
-        vkCmdBindIndexBuffer(commandBuffer, object->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        VkRenderPassBeginInfo secondPhaseBeginInfo{};
+        secondPhaseBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        secondPhaseBeginInfo.renderPass = secondPhaseRenderPass;
+        secondPhaseBeginInfo.framebuffer = swapchainFramebuffers[imageIndex];
+        secondPhaseBeginInfo.renderArea.offset = { 0,0 };
+        secondPhaseBeginInfo.renderArea.extent = swapChainExtent;
+        secondPhaseBeginInfo.clearValueCount = 0;
+        secondPhaseBeginInfo.pClearValues = nullptr;
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-            object->graphicsPipelineLayout , 0, 1, &object->descriptorSet[currentFrame], 0, nullptr);
-
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(object->indices.size()), 1, 0, 0, 0);
+        //A single indirect draw, not worth secondary buffers
+        vkCmdBeginRenderPass(commandBuffer, &secondPhaseBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        secondPhaseDrawList.Record(commandBuffer, 0, secondPhaseDrawList.GetDrawCount(), swapChainExtent);
+        vkCmdEndRenderPass(commandBuffer);
     }
-
-    vkCmdEndRenderPass(commandBuffer);
+    gpuTimer.RecordEnd(commandBuffer, currentFrame, GPU_TIMER_COLOR_PASS);
 
     //TransitionImageLayout(resolveColorImage, swapChainImageFormat,
     //    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, true,commandBuffer);
@@ -2334,7 +2843,7 @@ void HelloTriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-        computePipelineLayout, 0, 1, &computeDescriptorSets[currentFrame], 0, 0);
+        computePipelineLayout, 0, 1, &computeDescriptorSets[currentFrame], 1, &frameUniformOffset);
 
     unsigned int groupCountX = (swapChainExtent.width + 15) / 16;
     unsigned int groupCountY = (swapChainExtent.height + 15) / 16;
@@ -2369,7 +2878,7 @@ void HelloTriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32
 
     // Bind descriptor sets (for screen texture)
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        postProcessPipelineLayout, 0, 1, &postProcessDescriptorSets[currentFrame], 0, nullptr);
+        postProcessPipelineLayout, 0, 1, &postProcessDescriptorSets[currentFrame], 1, &frameUniformOffset);
 
     vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(quadIndices.size()), 1, 0, 0, 0);
 
@@ -2384,6 +2893,294 @@ void HelloTriangleApp::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32
     }
 }
 
+uint64_t HelloTriangleApp::ComputeRecordingKey()
+{
+    //Buffer contents (constants, cull views, transforms, instances, culled commands) are rewritten every frame and stay out of the key.
+    //Only versions of what the draw lists would be built from are hashed, never the lists themselves
+    GfxRecordingHash hash;
+    hash.Add(swapChainExtent.width);
+    hash.Add(swapChainExtent.height);
+    hash.Add(frameUniformOffset);
+    //Rewriting a bound descriptor set invalidates the buffers that bound it
+    hash.Add(textureDescriptorVersions[currentFrame]);
+#if VERTEX_PULLING
+    hash.Add(pulledVertexDescriptorBuffers[currentFrame]);
+#endif//#if VERTEX_PULLING
+    hash.Add(frameVertexPulled[currentFrame]);
+    hash.Add(gfxCtx->defragmenter->GetStats().moves);
+    hash.Add(gfxCtx->geometryArena->GetRangesVersion());
+    hash.Add(scene.GetStructureVersion());
+    hash.Add(instancedSpheres.GetBatchesVersion());
+    //Both lists are sorted from these views
+    hash.Add(lightViewMatrix);
+    hash.Add(cameraViewMatrix);
+    hash.Add(gpuDrivenRendering);
+    if (gpuDrivenRendering)
+    {
+        //Sizes the cull dispatches
+        hash.Add(gpuCulling.GetMaxDrawCount());
+        //Adds the pyramid build, the second phase cull and its pass
+        hash.Add(frameOcclusionCulled[currentFrame]);
+    }
+    else
+    {
+        hash.Add(ComputeVisibilityKey());
+    }
+    return hash.value;
+}
+
+uint64_t HelloTriangleApp::ComputeVisibilityKey()
+{
+    GfxRecordingHash hash;
+    hash.Add(scene.GetStructureVersion());
+    hash.Add(scene.GetBoundsVersion());
+    hash.Add(lightSpaceMatrix);
+    hash.Add(cameraViewProjectionMatrix);
+#if SOFTWARE_OCCLUSION_CULLING
+    hash.Add(occlusionCullingEnabled);
+#endif//#if SOFTWARE_OCCLUSION_CULLING
+    return hash.value;
+}
+
+void HelloTriangleApp::CreateParallelRecorder()
+{
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(gfxCtx->physicalDevice);
+    parallelRecorder.Init(&jobPool, MAX_FRAMES_IN_FLIGHT, RECORDING_PASS_COUNT, queueFamilyIndices.graphicsFamily.value());
+#if CACHED_COMMAND_BUFFERS
+    commandBufferCache.Init(static_cast<uint32_t>(swapChainImages.size()), MAX_FRAMES_IN_FLIGHT, queueFamilyIndices.graphicsFamily.value(),
+        RECORDING_PASS_COUNT, parallelRecorder.GetWorkerCount());
+#endif//#if CACHED_COMMAND_BUFFERS
+}
+
+void HelloTriangleApp::CreateCulling()
+{
+    //The color pass cost is what occlusion culling saves
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(gfxCtx->physicalDevice);
+    gpuTimer.Init(MAX_FRAMES_IN_FLIGHT, GPU_TIMER_COUNT, queueFamilyIndices.graphicsFamily.value());
+
+    //CPU culling serves the draw lists whenever the GPU driven path is off
+    cpuCulling.Init(RECORDING_PASS_COUNT);
+#if BVH_CULLING
+    sceneBvh.SetScene(scene);
+#endif//#if BVH_CULLING
+    softwareOcclusion.Init(&jobPool);
+
+#if GPU_DRIVEN_RENDERING
+    if (!drawIndirectFirstInstanceSupported)
+    {
+        std::cout << YELLOW_TEXT << "drawIndirectFirstInstance not supported, scene objects are culled and drawn from the CPU" << RESET_TEXT << std::endl;
+        return;
+    }
+
+    std::vector<char> cullShader = ReadFile("CompiledShaders/cullObjects.spv");
+    VkShaderModule cullShaderModule = CreateShaderModule(cullShader, "cullObjectsShaderModule");
+
+    gpuCulling.Init(cullShaderModule, TRANSFORM_BUFFER_MAX_TRANSFORMS, MAX_FRAMES_IN_FLIGHT, RECORDING_PASS_COUNT);
+    gpuCulling.SetScene(&scene);
+    gpuDrivenRendering = true;
+
+    vkDestroyShaderModule(gfxCtx->logicalDevice, cullShaderModule, gfxCtx->allocationCallbacks);
+
+    //Always created so the cull sets have a pyramid to bind, only built when the depth buffer can be sampled
+    std::vector<char> pyramidShader = ReadFile("CompiledShaders/depthPyramid.spv");
+    std::vector<char> pyramidMsaaShader = ReadFile("CompiledShaders/depthPyramidMsaa.spv");
+    VkShaderModule pyramidShaderModule = CreateShaderModule(pyramidShader, "depthPyramidShaderModule");
+    VkShaderModule pyramidMsaaShaderModule = CreateShaderModule(pyramidMsaaShader, "depthPyramidMsaaShaderModule");
+
+    depthPyramidBuildSupported = IsDepthPyramidBuildSupported();
+    depthPyramid.Init(pyramidShaderModule, pyramidMsaaShaderModule);
+    depthPyramid.CreateResources(depthPyramidBuildSupported ? depthImageView : VK_NULL_HANDLE,
+        swapChainExtent.width, swapChainExtent.height, msaaSamples);
+    gpuCulling.SetDepthPyramid(&depthPyramid);
+
+    vkDestroyShaderModule(gfxCtx->logicalDevice, pyramidShaderModule, gfxCtx->allocationCallbacks);
+    vkDestroyShaderModule(gfxCtx->logicalDevice, pyramidMsaaShaderModule, gfxCtx->allocationCallbacks);
+
+#if HIZ_OCCLUSION_CULLING
+    if (!depthPyramidBuildSupported)
+    {
+        std::cout << YELLOW_TEXT << "Depth buffer cannot be sampled at " << msaaSamples << " samples, no occlusion culling" << RESET_TEXT << std::endl;
+    }
+#endif//#if HIZ_OCCLUSION_CULLING
+#endif//#if GPU_DRIVEN_RENDERING
+}
+
+void HelloTriangleApp::BuildDrawLists(GfxDrawList& shadowList, GfxDrawList& colorList, bool useGpuCulling, const std::vector<uint32_t>* drawnObjects)
+{
+    //Same depth ranges as the projections in UpdateUniformBuffers
+    shadowList.Begin(RECORDING_PASS_SHADOW, lightViewMatrix, -50.0f, 50.0f);
+    colorList.Begin(RECORDING_PASS_COLOR, cameraViewMatrix, 0.1f, 500.0f);
+
+    if (useGpuCulling)
+    {
+        //One indirect draw per pass whatever the object count, the compute pass recorded before fills them
+        shadowList.AddIndirect(gpuCulling.GetIndirectBuffer(currentFrame, RECORDING_PASS_SHADOW), gpuCulling.GetCountBuffer(currentFrame, RECORDING_PASS_SHADOW),
+            gpuCulling.GetMaxDrawCount(), shadowMapIndirectPipeline, shadowMapIndirectPipelineLayout, shadowMapDescriptorSets[currentFrame], frameUniformOffset);
+        VkPipeline colorPipeline = frameVertexPulled[currentFrame] ? pulledIndirectPipeline : indirectPipeline;
+        VkPipelineLayout colorPipelineLayout = frameVertexPulled[currentFrame] ? pulledIndirectPipelineLayout : indirectPipelineLayout;
+        colorList.AddIndirect(gpuCulling.GetIndirectBuffer(currentFrame, RECORDING_PASS_COLOR), gpuCulling.GetCountBuffer(currentFrame, RECORDING_PASS_COLOR),
+            gpuCulling.GetMaxDrawCount(), colorPipeline, colorPipelineLayout, descriptorSets[currentFrame], frameUniformOffset);
+
+        //Objects the first phase skipped and the pyramid of its depth does not hide
+        secondPhaseDrawList.Begin(RECORDING_PASS_COLOR, cameraViewMatrix, 0.1f, 500.0f);
+        if (frameOcclusionCulled[currentFrame])
+        {
+            secondPhaseDrawList.AddIndirect(gpuCulling.GetSecondPhaseIndirectBuffer(currentFrame), gpuCulling.GetSecondPhaseCountBuffer(currentFrame),
+                gpuCulling.GetMaxDrawCount(), colorPipeline, colorPipelineLayout, descriptorSets[currentFrame], frameUniformOffset);
+        }
+    }
+    else
+    {
+        //Shadow casters are culled against the light volume, not the camera
+        uint64_t visibilityKey = ComputeVisibilityKey();
+        if (drawnObjects != nullptr)
+        {
+            shadowVisibleObjects = *drawnObjects;
+            colorVisibleObjects = *drawnObjects;
+            visibleObjectsKey = 0;
+        }
+        else if (visibleObjectsKey != visibilityKey)
+        {
+            //Nothing culling reads changed otherwise, the lists of the last cull are still right
+            GfxFrustum lightFrustum = GfxFrustum::FromViewProjection(lightSpaceMatrix);
+            GfxFrustum cameraFrustum = GfxFrustum::FromViewProjection(cameraViewProjectionMatrix);
+#if BVH_CULLING
+            //Refit when objects moved, rebuilt when objects were created or destroyed
+            sceneBvh.SetScene(scene);
+            sceneBvh.QueryFrustum(lightFrustum, shadowVisibleObjects);
+            sceneBvh.QueryFrustum(cameraFrustum, colorVisibleObjects);
+#else
+            cpuCulling.SetScene(scene);
+            cpuCulling.Cull(RECORDING_PASS_SHADOW, lightFrustum, shadowVisibleObjects);
+            cpuCulling.Cull(RECORDING_PASS_COLOR, cameraFrustum, colorVisibleObjects);
+#endif//#if BVH_CULLING
+
+#if SOFTWARE_OCCLUSION_CULLING
+            //Rasterized from this frame camera, hidden objects are dropped without waiting on the GPU
+            if (occlusionCullingEnabled)
+            {
+                softwareOcclusion.Render(cameraViewProjectionMatrix, &scene);
+                softwareOcclusion.CullOccluded(scene, colorVisibleObjects);
+            }
+#endif//#if SOFTWARE_OCCLUSION_CULLING
+            visibleObjectsKey = visibilityKey;
+        }
+
+        //Evicted meshes come back before their ranges are read
+        scene.TouchMeshes(shadowVisibleObjects);
+        scene.TouchMeshes(colorVisibleObjects);
+
+        //Only the scene arrays a draw needs are read, indexed by the visible dense indices
+        const std::vector<GfxMeshRange>& meshes = scene.GetMeshes();
+        const std::vector<uint32_t>& transformIndices = scene.GetTransformIndices();
+        const std::vector<uint32_t>& materialIds = scene.GetMaterialIds();
+        const std::vector<uint32_t>& flags = scene.GetFlags();
+        const std::vector<glm::vec4>& spheres = scene.GetWorldBoundingSpheres();
+        for (uint32_t index : shadowVisibleObjects)
+        {
+            if ((flags[index] & SCENE_OBJECT_HIDDEN) == 0)
+            {
+                shadowList.Add(meshes[index], transformIndices[index], glm::vec3(spheres[index]), shadowMapPipeline, shadowMapPipelineLayout,
+                    shadowMapDescriptorSets[currentFrame], frameUniformOffset);
+            }
+        }
+        for (uint32_t index : colorVisibleObjects)
+        {
+            if ((flags[index] & SCENE_OBJECT_HIDDEN) == 0)
+            {
+                const GfxSceneMaterial& material = scene.GetMaterial(materialIds[index]);
+                bool pulled = frameVertexPulled[currentFrame] && material.pulledPipeline != VK_NULL_HANDLE;
+                colorList.Add(meshes[index], transformIndices[index], glm::vec3(spheres[index]), pulled ? material.pulledPipeline : material.pipeline,
+                    pulled ? material.pulledPipelineLayout : material.pipelineLayout, material.descriptorSets[currentFrame], frameUniformOffset);
+            }
+        }
+    }
+
+    //One draw per batch, transforms come from the instance buffer
+    VkBuffer instanceBuffer = instancedSpheres.GetInstanceBuffer(currentFrame);
+    for (const GfxInstanceBatch& batch : instancedSpheres.GetBatches())
+    {
+        shadowList.AddInstanced(instancedSpheres, batch, instanceBuffer, shadowMapInstancedPipeline, shadowMapInstancedPipelineLayout,
+            shadowMapDescriptorSets[currentFrame], frameUniformOffset);
+        colorList.AddInstanced(instancedSpheres, batch, instanceBuffer, instancedPipeline, instancedPipelineLayout,
+            descriptorSets[currentFrame], frameUniformOffset);
+    }
+
+    shadowList.Sort();
+    colorList.Sort();
+}
+
+void HelloTriangleApp::RecordScenePasses(GfxParallelRecorder& recorder, uint32_t imageIndex, GfxDrawList& shadowList, GfxDrawList& colorList,
+    const VkCommandBuffer* shadowCommandBuffers, const VkCommandBuffer* colorCommandBuffers)
+{
+    //Secondary buffers inherit no state, each range binds what it needs
+    recorder.RecordPass(RECORDING_PASS_SHADOW, shadowMapRenderPass, shadowMapFramebuffers[imageIndex], shadowList.GetDrawCount(),
+        [this, &shadowList](VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end) { shadowList.Record(commandBuffer, begin, end, swapChainExtent); },
+        shadowCommandBuffers);
+    recorder.RecordPass(RECORDING_PASS_COLOR, renderPass, swapchainFramebuffers[imageIndex], colorList.GetDrawCount(),
+        [this, &colorList](VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end) { colorList.Record(commandBuffer, begin, end, swapChainExtent); },
+        colorCommandBuffers);
+
+    recorder.Wait();
+}
+
+void HelloTriangleApp::RunParallelRecordingBenchmark()
+{
+    //Records the scene draws repeated up to drawCount without submitting anything, CPU time only
+    const uint32_t drawCounts[] = { 1000, 10000, 100000 };
+    const uint32_t threadCounts[] = { 1, 2, 4, 8 };
+    const uint32_t iterations = 10;
+
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(gfxCtx->physicalDevice);
+    uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::cout << MAGENTA_TEXT << "Parallel recording benchmark (shadow + color pass, " << iterations << " iterations)" << RESET_TEXT << std::endl;
+    for (uint32_t drawCount : drawCounts)
+    {
+        std::vector<uint32_t> drawList(drawCount);
+        for (uint32_t i = 0; i < drawCount; ++i)
+        {
+            drawList[i] = i % scene.GetObjectCount();
+        }
+
+        double singleThreadMs = 0.0;
+        for (uint32_t threadCount : threadCounts)
+        {
+            if (threadCount > maxThreads)
+            {
+                break;
+            }
+
+            GfxJobPool pool;
+            pool.Init(threadCount);
+            GfxParallelRecorder recorder;
+            recorder.Init(&pool, 1, RECORDING_PASS_COUNT, queueFamilyIndices.graphicsFamily.value());
+            GfxDrawList shadowList;
+            GfxDrawList colorList;
+            for (uint32_t i = 0; i < iterations; ++i)
+            {
+                recorder.BeginFrame(0);
+                BuildDrawLists(shadowList, colorList, false, &drawList);
+                RecordScenePasses(recorder, 0, shadowList, colorList);
+            }
+            double averageMs = recorder.GetStats().recordingMs / iterations;
+            recorder.Cleanup();
+            pool.Cleanup();
+
+            if (threadCount == 1)
+            {
+                singleThreadMs = averageMs;
+            }
+            std::cout << "  " << drawCount << " objects, " << threadCount << " threads: " << averageMs << "ms";
+            if (threadCount > 1 && averageMs > 0.0)
+            {
+                std::cout << " (" << singleThreadMs / averageMs << "x)";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
 uint32_t HelloTriangleApp::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags memoryFlags)
 {
     return FindMemoryType_Internal(typeFilter, memoryFlags);
@@ -2397,7 +3194,7 @@ VkShaderModule HelloTriangleApp::CreateShaderModule(const std::vector<char>& cod
     shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
     VkShaderModule shaderModule;
-    if (vkCreateShaderModule(gfxCtx->logicalDevice, &shaderModuleCreateInfo, nullptr, &shaderModule) != VK_SUCCESS) 
+    if (vkCreateShaderModule(gfxCtx->logicalDevice, &shaderModuleCreateInfo, gfxCtx->allocationCallbacks, &shaderModule) != VK_SUCCESS) 
     {
         throw std::runtime_error("Error creating shader module!");
     }
@@ -2433,6 +3230,7 @@ void HelloTriangleApp::UpdateUniformBuffers(uint32_t currentImage)
     glm::vec3 eyePos = inputHandler.GetPosition();
     ubo.viewPos = eyePos;
     ubo.viewM = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    cameraViewMatrix = ubo.viewM;
     ubo.projM = glm::perspective(glm::radians(45.0f), 
         swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 500.0f);
     ubo.projM[1][1] *= -1;
@@ -2448,8 +3246,12 @@ void HelloTriangleApp::UpdateUniformBuffers(uint32_t currentImage)
     glm::mat4 lightProjection = glm::ortho(left, right, bottom, top, near, far);
     lightProjection[1][1] *= -1;
     ubo.lightSpaceMatrix =  lightProjection * lightView;
+    lightViewMatrix = lightView;
+    lightSpaceMatrix = ubo.lightSpaceMatrix;
+    cameraViewProjectionMatrix = ubo.projM * ubo.viewM;
 
-    memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    //Model matrices live in the transform buffer, every draw shares this block
+    frameUniformOffset = gfxCtx->frameAllocator->Push(ubo);
 }
 
 void HelloTriangleApp::DrawFrame()
@@ -2472,8 +3274,100 @@ void HelloTriangleApp::DrawFrame()
 
     vkResetFences(gfxCtx->logicalDevice, 1, &inFlightFences[currentFrame]);
 
+    //Frames older than MAX_FRAMES_IN_FLIGHT are done, their resources can be evicted if over budget
+    gfxCtx->residencyManager->BeginFrame();
+    gfxCtx->residencyManager->Touch(&texture);
+
+    if (inputHandler.WantToDefragment())
+    {
+        gfxCtx->defragmenter->Start();
+    }
+    gfxCtx->defragmenter->Update();
+
+    //Only this frame slot set is idle, the other slot catches up when its fence is waited
+    if (textureDescriptorVersions[currentFrame] != texture.GetVersion())
+    {
+        UpdateTextureDescriptors(currentFrame);
+    }
+#if VERTEX_PULLING
+    if (pulledVertexDescriptorBuffers[currentFrame] != gfxCtx->geometryArena->GetPulledVertexBuffer())
+    {
+        UpdatePulledVertexDescriptors(currentFrame);
+    }
+#endif//#if VERTEX_PULLING
+
+    //The fence guarantees the GPU is done reading this slot constants
+    gfxCtx->frameAllocator->BeginFrame(currentFrame);
+    parallelRecorder.BeginFrame(currentFrame);
+    instancedSpheres.BeginFrame(currentFrame);
+#if SCENE_GRAPH_BENCHMARK
+    //Bobs the sphere so the scene graph, the transform buffer and the culling bounds see a moving object every frame
+    static auto sceneGraphStartTime = std::chrono::high_resolution_clock::now();
+    float sceneGraphTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - sceneGraphStartTime).count();
+    sceneGraph.SetLocalMatrix(sphereNode, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.5f * std::sin(sceneGraphTime), 0.0f)));
+#endif//#if SCENE_GRAPH_BENCHMARK
+    //Moved nodes set the model matrix of their objects before the transform buffer of this slot is copied
+    sceneGraph.Update(&scene);
+    gfxCtx->transformBuffer->BeginFrame(currentFrame);
+    if (gpuDrivenRendering)
+    {
+        //Any object can pass the GPU cull, evicted meshes come back before the object ranges are uploaded
+        scene.TouchMeshes();
+        gpuCulling.BeginFrame(currentFrame);
+    }
     UpdateUniformBuffers(currentFrame);
 
+    //The slot last color pass time goes to the bucket of the culling it ran with
+    gpuTimer.BeginFrame(currentFrame);
+    double colorPassFrameMs = 0.0;
+    if (gpuTimer.GetLastMs(GPU_TIMER_COLOR_PASS, colorPassFrameMs))
+    {
+        uint32_t bucket = frameOcclusionCulled[currentFrame] ? 1 : 0;
+        colorPassMs[bucket] += colorPassFrameMs;
+        ++colorPassFrames[bucket];
+
+        uint32_t vertexPullingBucket = frameVertexPulled[currentFrame] ? 1 : 0;
+        vertexPullingColorPassMs[vertexPullingBucket] += colorPassFrameMs;
+        ++vertexPullingColorPassFrames[vertexPullingBucket];
+    }
+
+    if (inputHandler.WantToToggleOcclusionCulling())
+    {
+        occlusionCullingEnabled = !occlusionCullingEnabled;
+        std::cout << MAGENTA_TEXT << "Occlusion culling " << (occlusionCullingEnabled ? "on" : "off") << RESET_TEXT << std::endl;
+    }
+#if VERTEX_PULLING
+#if VERTEX_PULLING_BENCHMARK
+    //Alternating keeps both modes under the same camera and clocks
+    bool toggleVertexPulling = ++vertexPullingModeFrames >= VERTEX_PULLING_BENCHMARK_FRAMES;
+    if (toggleVertexPulling)
+    {
+        vertexPullingModeFrames = 0;
+    }
+#else//#if VERTEX_PULLING_BENCHMARK
+    bool toggleVertexPulling = inputHandler.WantToToggleVertexPulling();
+#endif//#else//#if VERTEX_PULLING_BENCHMARK
+    if (toggleVertexPulling)
+    {
+        vertexPullingEnabled = !vertexPullingEnabled;
+        std::cout << MAGENTA_TEXT << "Vertex pulling " << (vertexPullingEnabled ? "on" : "off") << RESET_TEXT << std::endl;
+    }
+#endif//#if VERTEX_PULLING
+    frameVertexPulled[currentFrame] = vertexPullingEnabled;
+    if (gpuDrivenRendering)
+    {
+        gpuCulling.SetView(currentFrame, RECORDING_PASS_SHADOW, lightSpaceMatrix, false);
+        gpuCulling.SetView(currentFrame, RECORDING_PASS_COLOR, cameraViewProjectionMatrix, occlusionCullingEnabled && depthPyramidBuildSupported);
+        frameOcclusionCulled[currentFrame] = gpuCulling.IsOcclusionActive(currentFrame, RECORDING_PASS_COLOR);
+    }
+#if SOFTWARE_OCCLUSION_CULLING
+    else
+    {
+        //The CPU path occludes with the software rasterizer, whether this frame records or reuses a recording
+        frameOcclusionCulled[currentFrame] = occlusionCullingEnabled;
+    }
+#endif//#if SOFTWARE_OCCLUSION_CULLING
+
     VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
     VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
@@ -2496,9 +3390,41 @@ void HelloTriangleApp::DrawFrame()
     //}
 #endif//#if COMPUTE_FEATURE
 
-    vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+    if (inputHandler.WantToDumpOcclusionBuffer())
+    {
+        if (gpuDrivenRendering)
+        {
+            std::cout << YELLOW_TEXT << "Software occlusion only runs on the CPU draw path" << RESET_TEXT << std::endl;
+        }
+        else
+        {
+            softwareOcclusion.DumpToImage("OcclusionBuffer.pgm");
+        }
+    }
 
-    RecordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+#if CACHED_COMMAND_BUFFERS
+    //Static frames skip recording and submit what this image and slot recorded last time
+    bool needsRecording = false;
+    VkCommandBuffer commandBuffer = commandBufferCache.Acquire(imageIndex, currentFrame, ComputeRecordingKey(), needsRecording);
+    if (needsRecording)
+    {
+        auto recordingStart = std::chrono::high_resolution_clock::now();
+        BuildDrawLists(shadowDrawList, colorDrawList, gpuDrivenRendering);
+        RecordCommandBuffer(commandBuffer, imageIndex);
+        commandBufferCache.AddRecordingTime(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordingStart).count());
+    }
+    else if (!gpuDrivenRendering)
+    {
+        //No culling or draw lists this frame, the meshes the recording draws still count as used
+        scene.TouchMeshes(shadowVisibleObjects);
+        scene.TouchMeshes(colorVisibleObjects);
+    }
+#else
+    BuildDrawLists(shadowDrawList, colorDrawList, gpuDrivenRendering);
+    VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+    vkResetCommandBuffer(commandBuffer, 0);
+    RecordCommandBuffer(commandBuffer, imageIndex);
+#endif//#if CACHED_COMMAND_BUFFERS
 
     VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame]};
     VkSubmitInfo submitInfo{};
@@ -2507,7 +3433,7 @@ void HelloTriangleApp::DrawFrame()
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+    submitInfo.pCommandBuffers = &commandBuffer;
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
@@ -2516,6 +3442,10 @@ void HelloTriangleApp::DrawFrame()
     {
         throw std::runtime_error("Error submitting draw command buffer!");
     }
+    if (gpuDrivenRendering && frameOcclusionCulled[currentFrame])
+    {
+        depthPyramid.MarkBuilt();
+    }
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -2542,6 +3472,52 @@ void HelloTriangleApp::DrawFrame()
     EndFrame();
 }
 
+void HelloTriangleApp::ReportOcclusionCullingSavings()
+{
+    if (!gpuTimer.IsSupported())
+    {
+        return;
+    }
+
+    double withoutMs = colorPassFrames[0] > 0 ? colorPassMs[0] / colorPassFrames[0] : 0.0;
+    double withMs = colorPassFrames[1] > 0 ? colorPassMs[1] / colorPassFrames[1] : 0.0;
+    std::cout << CYAN_TEXT << "Color pass GPU time: " << withMs << "ms with occlusion culling (" << colorPassFrames[1] << " frames), "
+        << withoutMs << "ms without (" << colorPassFrames[0] << " frames)";
+    if (colorPassFrames[0] > 0 && colorPassFrames[1] > 0)
+    {
+        std::cout << ", " << withoutMs - withMs << "ms saved per frame";
+    }
+    else
+    {
+        std::cout << ", toggle with O to compare";
+    }
+    std::cout << RESET_TEXT << std::endl;
+}
+
+void HelloTriangleApp::ReportVertexPullingTimes()
+{
+#if VERTEX_PULLING
+    if (!gpuTimer.IsSupported())
+    {
+        return;
+    }
+
+    double fixedFunctionMs = vertexPullingColorPassFrames[0] > 0 ? vertexPullingColorPassMs[0] / vertexPullingColorPassFrames[0] : 0.0;
+    double pulledMs = vertexPullingColorPassFrames[1] > 0 ? vertexPullingColorPassMs[1] / vertexPullingColorPassFrames[1] : 0.0;
+    std::cout << CYAN_TEXT << "Color pass GPU time: " << pulledMs << "ms with vertex pulling (" << vertexPullingColorPassFrames[1] << " frames), "
+        << fixedFunctionMs << "ms with the fixed function vertex input (" << vertexPullingColorPassFrames[0] << " frames)";
+    if (vertexPullingColorPassFrames[0] > 0 && vertexPullingColorPassFrames[1] > 0)
+    {
+        std::cout << ", " << pulledMs - fixedFunctionMs << "ms difference per frame";
+    }
+    else
+    {
+        std::cout << ", toggle with V to compare";
+    }
+    std::cout << RESET_TEXT << std::endl;
+#endif//#if VERTEX_PULLING
+}
+
 void HelloTriangleApp::EndFrameLayoutTransitions(VkCommandBuffer commandBuffer)
 {
     TransitionImageLayout(resolveColorImage, swapChainImageFormat,
@@ -2564,6 +3540,9 @@ void HelloTriangleApp::RecreateSwapChain()
     }
     
     vkDeviceWaitIdle(gfxCtx->logicalDevice);
+#if HOST_ALLOCATOR
+    GfxHostAllocatorStats hostStatsBefore = gfxCtx->hostAllocator->GetStats();
+#endif//#if HOST_ALLOCATOR
 
     //Clear swpachain resources
     CleanupSwapChain();
@@ -2579,81 +3558,120 @@ void HelloTriangleApp::RecreateSwapChain()
     UpdateDescriptorSets();
     UpdateComputeDescriptorSets();
     UpdatePostProcessDescriptorSets();
+    if (gpuDrivenRendering)
+    {
+        //Sized after the new depth buffer, occlusion culling restarts once it was built again
+        depthPyramid.DestroyResources();
+        depthPyramid.CreateResources(depthPyramidBuildSupported ? depthImageView : VK_NULL_HANDLE,
+            swapChainExtent.width, swapChainExtent.height, msaaSamples);
+        gpuCulling.SetDepthPyramid(&depthPyramid);
+    }
+#if CACHED_COMMAND_BUFFERS
+    //Framebuffers and descriptor sets were recreated, the image count may have changed too
+    commandBufferCache.Invalidate("swapchain recreated");
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(gfxCtx->physicalDevice);
+    commandBufferCache.Cleanup();
+    commandBufferCache.Init(static_cast<uint32_t>(swapChainImages.size()), MAX_FRAMES_IN_FLIGHT, queueFamilyIndices.graphicsFamily.value(),
+        RECORDING_PASS_COUNT, parallelRecorder.GetWorkerCount());
+#endif//#if CACHED_COMMAND_BUFFERS
+#if HOST_ALLOCATOR
+    gfxCtx->hostAllocator->PrintDelta("swapchain recreation", hostStatsBefore);
+#endif//#if HOST_ALLOCATOR
 }
 
 void HelloTriangleApp::CleanupSwapChain()
 {
-    vkDestroyImageView(gfxCtx->logicalDevice, dirShadowMapDepthImageView, nullptr);
-    vkDestroyImage(gfxCtx->logicalDevice, dirShadowMapDepthImage, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, dirShadowMapDepthMemory, nullptr);
+    vkDestroyImageView(gfxCtx->logicalDevice, dirShadowMapDepthImageView, gfxCtx->allocationCallbacks);
+    DestroyImage_Internal(dirShadowMapDepthImage, dirShadowMapDepthAllocation);
 
-    vkDestroyImageView(gfxCtx->logicalDevice, depthImageView, nullptr);
-    vkDestroyImage(gfxCtx->logicalDevice, depthImage, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, depthImageMemory, nullptr);
+    vkDestroyImageView(gfxCtx->logicalDevice, depthImageView, gfxCtx->allocationCallbacks);
+    DestroyImage_Internal(depthImage, depthImageAllocation);
 
-    vkDestroyImageView(gfxCtx->logicalDevice, colorImageView, nullptr);
-    vkDestroyImage(gfxCtx->logicalDevice, colorImage, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, colorImageMemory, nullptr);
+    vkDestroyImageView(gfxCtx->logicalDevice, colorImageView, gfxCtx->allocationCallbacks);
+    DestroyImage_Internal(colorImage, colorImageAllocation);
 
-    vkDestroyImageView(gfxCtx->logicalDevice, resolveColorImageView, nullptr);
-    vkDestroyImage(gfxCtx->logicalDevice, resolveColorImage, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, resolveColorImageMemory, nullptr);
+    vkDestroyImageView(gfxCtx->logicalDevice, resolveColorImageView, gfxCtx->allocationCallbacks);
+    DestroyImage_Internal(resolveColorImage, resolveColorImageAllocation);
 
-    vkDestroyImageView(gfxCtx->logicalDevice, blurImageView, nullptr);
-    vkDestroyImage(gfxCtx->logicalDevice, blurImage, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, blurImageMemory, nullptr);
+    vkDestroyImageView(gfxCtx->logicalDevice, blurImageView, gfxCtx->allocationCallbacks);
+    DestroyImage_Internal(blurImage, blurImageAllocation);
 
-    vkDestroyImageView(gfxCtx->logicalDevice, postProcessImageView, nullptr);
-    vkDestroyImage(gfxCtx->logicalDevice, postProcessImage, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, postProcessImageMemory, nullptr);
+    vkDestroyImageView(gfxCtx->logicalDevice, postProcessImageView, gfxCtx->allocationCallbacks);
+    DestroyImage_Internal(postProcessImage, postProcessImageAllocation);
 
     for (VkFramebuffer framebuffer : swapchainFramebuffers)
     {
-        vkDestroyFramebuffer(gfxCtx->logicalDevice, framebuffer, nullptr);
+        vkDestroyFramebuffer(gfxCtx->logicalDevice, framebuffer, gfxCtx->allocationCallbacks);
     }
     for (VkFramebuffer framebuffer : shadowMapFramebuffers)
     {
-        vkDestroyFramebuffer(gfxCtx->logicalDevice, framebuffer, nullptr);
+        vkDestroyFramebuffer(gfxCtx->logicalDevice, framebuffer, gfxCtx->allocationCallbacks);
     }    
     for (VkFramebuffer framebuffer : postProcessFramebuffers)
     {
-        vkDestroyFramebuffer(gfxCtx->logicalDevice, framebuffer, nullptr);
+        vkDestroyFramebuffer(gfxCtx->logicalDevice, framebuffer, gfxCtx->allocationCallbacks);
     }
     for (VkImageView imageView : swapChainImageViews)
     {
-        vkDestroyImageView(gfxCtx->logicalDevice, imageView, nullptr);
+        vkDestroyImageView(gfxCtx->logicalDevice, imageView, gfxCtx->allocationCallbacks);
     }
-    vkDestroySwapchainKHR(gfxCtx->logicalDevice, swapChain, nullptr);
+    vkDestroySwapchainKHR(gfxCtx->logicalDevice, swapChain, gfxCtx->allocationCallbacks);
 }
 
 void HelloTriangleApp::CleanupBuffers()
 {
-    for(GfxObject* object : objects)
+    sceneGraph.PrintStats();
+    sceneGraph.Cleanup();
+    scene.Cleanup();
+    instancedSpheres.Cleanup();
+    gfxCtx->geometryArena->Cleanup();
+    delete gfxCtx->geometryArena;
+    gfxCtx->geometryArena = nullptr;
+
+    if (gpuDrivenRendering)
     {
-        vkDestroyBuffer(gfxCtx->logicalDevice, object->vertexBuffer, nullptr);
-        vkFreeMemory(gfxCtx->logicalDevice, object->vertexBufferMemory, nullptr);
-        vkDestroyBuffer(gfxCtx->logicalDevice, object->indexBuffer, nullptr);
-        vkFreeMemory(gfxCtx->logicalDevice, object->indexBufferMemory, nullptr);
+        const char* passNames[RECORDING_PASS_COUNT] = { "shadow", "color" };
+        gpuCulling.PrintStats(passNames);
+        gpuCulling.Cleanup();
+        depthPyramid.PrintStats();
+        depthPyramid.Cleanup();
     }
+    ReportOcclusionCullingSavings();
+    ReportVertexPullingTimes();
+    gpuTimer.Cleanup();
+
+    gfxCtx->transformBuffer->Cleanup();
+    delete gfxCtx->transformBuffer;
+    gfxCtx->transformBuffer = nullptr;
 
     for (int i = 0; i < shaderStorageBuffers.size(); i++)
     {
-        vkDestroyBuffer(gfxCtx->logicalDevice, shaderStorageBuffers[i], nullptr);
-    }
-    for (int i = 0; i < shaderStorageBuffersMemory.size(); i++)
-    {
-        vkFreeMemory(gfxCtx->logicalDevice, shaderStorageBuffersMemory[i], nullptr);
+        DestroyBuffer_Internal(shaderStorageBuffers[i], shaderStorageBuffersAllocation[i]);
     }
 
-    vkDestroyBuffer(gfxCtx->logicalDevice, postProcessQuadBuffer, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, postProcessQuadBufferMemory, nullptr);
-    vkDestroyBuffer(gfxCtx->logicalDevice, postProcessQuadIndicesBuffer, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, postProcessQuadIndicesBufferMemory, nullptr);
+    DestroyBuffer_Internal(postProcessQuadBuffer, postProcessQuadBufferAllocation);
+    DestroyBuffer_Internal(postProcessQuadIndicesBuffer, postProcessQuadIndicesBufferAllocation);
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) 
+    gfxCtx->frameAllocator->Cleanup();
+    delete gfxCtx->frameAllocator;
+    gfxCtx->frameAllocator = nullptr;
+
+    gfxCtx->stagingRing->PrintStats();
+    gfxCtx->stagingRing->Cleanup();
+    delete gfxCtx->stagingRing;
+    gfxCtx->stagingRing = nullptr;
+
+    //The graphics context submits and waits the transfer one before releasing the shared semaphores
+    gfxCtx->uploadContext->PrintStats();
+    gfxCtx->uploadContext->Cleanup();
+    delete gfxCtx->uploadContext;
+    gfxCtx->uploadContext = nullptr;
+
+    if (gfxCtx->transferContext != nullptr)
     {
-        vkDestroyBuffer(gfxCtx->logicalDevice, uniformBuffers[i], nullptr);
-        vkFreeMemory(gfxCtx->logicalDevice, uniformBuffersMemory[i], nullptr);
+        gfxCtx->transferContext->Cleanup();
+        delete gfxCtx->transferContext;
+        gfxCtx->transferContext = nullptr;
     }
 }
 
@@ -2661,51 +3679,115 @@ void HelloTriangleApp::Cleanup()
 {
     CleanupSwapChain();
 
-    vkDestroySampler(gfxCtx->logicalDevice, textureSampler, nullptr);
-    vkDestroyImageView(gfxCtx->logicalDevice, textureImageView, nullptr);
-    vkDestroyImage(gfxCtx->logicalDevice, textureImage, nullptr);
-    vkFreeMemory(gfxCtx->logicalDevice, textureImageMemory, nullptr);
+    vkDestroySampler(gfxCtx->logicalDevice, textureSampler, gfxCtx->allocationCallbacks);
+    gfxCtx->residencyManager->Unregister(&texture);
+    gfxCtx->defragmenter->Unregister(&texture);
+    texture.Destroy();
 
     CleanupBuffers();
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) 
     {
-        vkDestroySemaphore(gfxCtx->logicalDevice, imageAvailableSemaphores[i], nullptr);
-        vkDestroySemaphore(gfxCtx->logicalDevice, renderFinishedSemaphores[i], nullptr);
-        vkDestroyFence(gfxCtx->logicalDevice, inFlightFences[i], nullptr);
+        vkDestroySemaphore(gfxCtx->logicalDevice, imageAvailableSemaphores[i], gfxCtx->allocationCallbacks);
+        vkDestroySemaphore(gfxCtx->logicalDevice, renderFinishedSemaphores[i], gfxCtx->allocationCallbacks);
+        vkDestroyFence(gfxCtx->logicalDevice, inFlightFences[i], gfxCtx->allocationCallbacks);
     }
     
-    vkDestroyCommandPool(gfxCtx->logicalDevice, gfxCtx->commandPool, nullptr);
-    vkDestroyDescriptorPool(gfxCtx->logicalDevice, descriptorPool, nullptr);
-    vkDestroyDescriptorPool(gfxCtx->logicalDevice, shadowMapDescriptorPool, nullptr);
-    vkDestroyDescriptorPool(gfxCtx->logicalDevice, postProcessDescriptorPool, nullptr);
-    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, descriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, shadowMapDescriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, postProcessDescriptorSetLayout, nullptr);
-    vkDestroyPipeline(gfxCtx->logicalDevice, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(gfxCtx->logicalDevice, graphicsPipelineLayout, nullptr);
-    vkDestroyPipeline(gfxCtx->logicalDevice, shadowMapPipeline, nullptr);
-    vkDestroyPipelineLayout(gfxCtx->logicalDevice, shadowMapPipelineLayout, nullptr);
-    vkDestroyPipeline(gfxCtx->logicalDevice, postProcessPipeline, nullptr);
-    vkDestroyPipelineLayout(gfxCtx->logicalDevice, postProcessPipelineLayout, nullptr);
-    vkDestroyRenderPass(gfxCtx->logicalDevice, renderPass, nullptr);
-    vkDestroyRenderPass(gfxCtx->logicalDevice, shadowMapRenderPass, nullptr);
-    vkDestroyRenderPass(gfxCtx->logicalDevice, postProcessRenderPass, nullptr);
+    parallelRecorder.PrintStats();
+    parallelRecorder.Cleanup();
+#if CACHED_COMMAND_BUFFERS
+    commandBufferCache.PrintStats();
+    commandBufferCache.Cleanup();
+#endif//#if CACHED_COMMAND_BUFFERS
+    if (!gpuDrivenRendering)
+    {
+#if BVH_CULLING
+        sceneBvh.PrintStats("scene");
+#else
+        const char* passNames[RECORDING_PASS_COUNT] = { "shadow", "color" };
+        cpuCulling.PrintStats(passNames);
+#endif//#if BVH_CULLING
+#if SOFTWARE_OCCLUSION_CULLING
+        softwareOcclusion.PrintStats();
+#endif//#if SOFTWARE_OCCLUSION_CULLING
+    }
+    softwareOcclusion.Cleanup();
+    //Every user of the workers is cleaned up by now
+    jobPool.Cleanup();
+    shadowDrawList.PrintStats("Shadow");
+    colorDrawList.PrintStats("Color");
+    secondPhaseDrawList.PrintStats("Color second phase");
+    vkDestroyCommandPool(gfxCtx->logicalDevice, gfxCtx->commandPool, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorPool(gfxCtx->logicalDevice, descriptorPool, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorPool(gfxCtx->logicalDevice, shadowMapDescriptorPool, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorPool(gfxCtx->logicalDevice, postProcessDescriptorPool, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, descriptorSetLayout, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, shadowMapDescriptorSetLayout, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, postProcessDescriptorSetLayout, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, graphicsPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, graphicsPipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, shadowMapPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, shadowMapPipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, instancedPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, instancedPipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, shadowMapInstancedPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, shadowMapInstancedPipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, indirectPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, indirectPipelineLayout, gfxCtx->allocationCallbacks);
+#if VERTEX_PULLING
+    vkDestroyPipeline(gfxCtx->logicalDevice, pulledPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, pulledPipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, pulledIndirectPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, pulledIndirectPipelineLayout, gfxCtx->allocationCallbacks);
+#endif//#if VERTEX_PULLING
+    vkDestroyPipeline(gfxCtx->logicalDevice, shadowMapIndirectPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, shadowMapIndirectPipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, postProcessPipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, postProcessPipelineLayout, gfxCtx->allocationCallbacks);
+    vkDestroyRenderPass(gfxCtx->logicalDevice, renderPass, gfxCtx->allocationCallbacks);
+    vkDestroyRenderPass(gfxCtx->logicalDevice, secondPhaseRenderPass, gfxCtx->allocationCallbacks);
+    vkDestroyRenderPass(gfxCtx->logicalDevice, shadowMapRenderPass, gfxCtx->allocationCallbacks);
+    vkDestroyRenderPass(gfxCtx->logicalDevice, postProcessRenderPass, gfxCtx->allocationCallbacks);
 
 #if COMPUTE_FEATURE
-    vkDestroyCommandPool(gfxCtx->logicalDevice, computeCommandPool, nullptr);
-    vkDestroyDescriptorPool(gfxCtx->logicalDevice, computeDescriptorPool, nullptr);
-    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, computeDescriptorSetLayout, nullptr);
-    vkDestroyPipeline(gfxCtx->logicalDevice, computePipeline, nullptr);
-    vkDestroyPipelineLayout(gfxCtx->logicalDevice, computePipelineLayout, nullptr);
+    vkDestroyCommandPool(gfxCtx->logicalDevice, computeCommandPool, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorPool(gfxCtx->logicalDevice, computeDescriptorPool, gfxCtx->allocationCallbacks);
+    vkDestroyDescriptorSetLayout(gfxCtx->logicalDevice, computeDescriptorSetLayout, gfxCtx->allocationCallbacks);
+    vkDestroyPipeline(gfxCtx->logicalDevice, computePipeline, gfxCtx->allocationCallbacks);
+    vkDestroyPipelineLayout(gfxCtx->logicalDevice, computePipelineLayout, gfxCtx->allocationCallbacks);
 #endif//#if COMPUTE_FEATURE
 
-    vkDestroyDevice(gfxCtx->logicalDevice, nullptr);
+    //Every pipeline is destroyed by now, saving is the last thing the cache does
+    gfxCtx->pipelineCache->Cleanup();
+    gfxCtx->pipelineCache->PrintStats();
+    delete gfxCtx->pipelineCache;
+    gfxCtx->pipelineCache = nullptr;
+
+    gfxCtx->residencyManager->Cleanup();
+    delete gfxCtx->residencyManager;
+    gfxCtx->residencyManager = nullptr;
+
+    gfxCtx->defragmenter->Cleanup();
+    delete gfxCtx->defragmenter;
+    gfxCtx->defragmenter = nullptr;
+
+    gfxCtx->memoryAllocator->PrintBudget();
+    gfxCtx->memoryAllocator->Cleanup();
+    delete gfxCtx->memoryAllocator;
+
+    vkDestroyDevice(gfxCtx->logicalDevice, gfxCtx->allocationCallbacks);
     if (enableValidationLayers) 
     {
-        DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
-    }
-    vkDestroySurfaceKHR(instance, surface, nullptr);
-    vkDestroyInstance(instance, nullptr);
+        DestroyDebugUtilsMessengerEXT(instance, debugMessenger, gfxCtx->allocationCallbacks);
+    }
+    vkDestroySurfaceKHR(instance, surface, gfxCtx->allocationCallbacks);
+    vkDestroyInstance(instance, gfxCtx->allocationCallbacks);
+#if HOST_ALLOCATOR
+    //Live bytes left here are driver allocations never given back
+    gfxCtx->hostAllocator->PrintStats("at shutdown");
+    delete gfxCtx->hostAllocator;
+    gfxCtx->hostAllocator = nullptr;
+    gfxCtx->allocationCallbacks = nullptr;
+#endif//#if HOST_ALLOCATOR
     glfwDestroyWindow(window);
     glfwTerminate();
 }
\ No newline at end of file
@@ -16,6 +16,29 @@
 
 #include "ModelLoader.h"
 #include "DebugUtils.h"
+#include "GfxMemoryAllocator.h"
+#include "GfxFrameAllocator.h"
+#include "GfxStagingRing.h"
+#include "GfxUploadContext.h"
+#include "GfxResidencyManager.h"
+#include "GfxDefragmenter.h"
+#include "GfxHostAllocator.h"
+#include "GfxPipelineCache.h"
+#include "GfxJobPool.h"
+#include "GfxParallelRecorder.h"
+#include "GfxCommandBufferCache.h"
+#include "GfxDepthPyramid.h"
+#include "GfxGpuTimer.h"
+#include "GfxDrawList.h"
+#include "GfxInstancedMesh.h"
+#include "GfxTransformBuffer.h"
+#include "GfxGpuCulling.h"
+#include "GfxCpuCulling.h"
+#include "GfxBvh.h"
+#include "GfxSoftwareOcclusion.h"
+#include "GfxScene.h"
+#include "GfxStaticBatcher.h"
+#include "GfxSceneGraph.h"
 #include "GfxPipelineManager.h";
 void CreateGraphicsPipeline_Internal(const GraphicsPipelineInfo& graphicPipelineInfo,
     VkPipelineLayout& graphicPipelineLayout, VkPipeline& graphicPipeline, const char* VkPipelineName, const char* VkPipelineLayoutName);
@@ -29,6 +52,21 @@ void CreateGraphicsPipeline_Internal(const GraphicsPipelineInfo& graphicPipeline
 
 #define MAX_FRAMES_IN_FLIGHT 2
 
+//Passes whose draws are recorded by the parallel recorder
+enum RecordingPass
+{
+    RECORDING_PASS_SHADOW = 0,
+    RECORDING_PASS_COLOR,
+    RECORDING_PASS_COUNT
+};
+
+//GPU durations measured every frame
+enum GpuTimer
+{
+    GPU_TIMER_COLOR_PASS = 0,
+    GPU_TIMER_COUNT
+};
+
 enum LogVerbosity 
 {
     NONE = 0,
@@ -59,6 +97,8 @@ struct QueueFamilyIndices
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentationFamily;
     std::optional<uint32_t> graphicsAndComputeFamily;
+    //Only set when the device exposes a family that can copy but not draw, it's optional
+    std::optional<uint32_t> transferFamily;
 
     bool IsComplete() 
     {
@@ -74,17 +114,16 @@ struct SwapChainSupportDetails
     std::vector<VkPresentModeKHR> presentModes;
 };
 
-class GfxObject;
-
-//TODO: Add/Create memory allocator
-//https://gpuopen-librariesandsdks.github.io/VulkanMemoryAllocator/html/
-
 class HelloTriangleApp
 {
 //Variables
 private:
     GLFWwindow *window;
     VkInstance instance;
+    bool physicalDeviceProperties2Supported = false;
+    bool memoryBudgetSupported = false;
+    //firstInstance of indirect draws carries the transform index, the GPU driven path needs it
+    bool drawIndirectFirstInstanceSupported = false;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkQueue presentationQueue;
     VkQueue computeQueue;
@@ -97,6 +136,8 @@ private:
 
     VkRenderPass shadowMapRenderPass;
     VkRenderPass renderPass;
+    //Loads what renderPass drew, only created when occlusion culling can build the depth pyramid
+    VkRenderPass secondPhaseRenderPass = VK_NULL_HANDLE;
     VkRenderPass postProcessRenderPass;
 
     VkDescriptorSetLayout shadowMapDescriptorSetLayout;
@@ -110,6 +151,25 @@ private:
     VkPipelineLayout graphicsPipelineLayout;
     VkPipeline graphicsPipeline;
 
+    VkPipelineLayout instancedPipelineLayout;
+    VkPipeline instancedPipeline;
+
+    VkPipelineLayout shadowMapInstancedPipelineLayout;
+    VkPipeline shadowMapInstancedPipeline;
+
+    VkPipelineLayout indirectPipelineLayout;
+    VkPipeline indirectPipeline;
+
+    VkPipelineLayout shadowMapIndirectPipelineLayout;
+    VkPipeline shadowMapIndirectPipeline;
+
+    //Vertex pulling variants of the color pass pipelines, no vertex input, see VERTEX_PULLING
+    VkPipelineLayout pulledPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pulledPipeline = VK_NULL_HANDLE;
+
+    VkPipelineLayout pulledIndirectPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pulledIndirectPipeline = VK_NULL_HANDLE;
+
     VkPipelineLayout postProcessPipelineLayout;
     VkPipeline postProcessPipeline;
 
@@ -126,18 +186,20 @@ private:
 
     //Depth
     VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
+    GfxAllocation depthImageAllocation;
     VkImageView depthImageView;
 
     //DirShadowMapDepth
     VkImage dirShadowMapDepthImage;
-    VkDeviceMemory dirShadowMapDepthMemory;
+    GfxAllocation dirShadowMapDepthAllocation;
     VkImageView dirShadowMapDepthImageView;
 
     //First texture
-    VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
-    VkImageView textureImageView;
+    GfxStreamedImage texture;
+    //Texture version each frame slot descriptor set points at
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> textureDescriptorVersions{};
+    //Pulled vertex buffer each frame slot descriptor set points at
+    std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT> pulledVertexDescriptorBuffers{};
     uint32_t mipLevels;
     //TODO: Make sampler not related with texture
     VkSampler textureSampler;
@@ -145,39 +207,35 @@ private:
     VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 
     VkImage colorImage;
-    VkDeviceMemory colorImageMemory;
+    GfxAllocation colorImageAllocation;
     VkImageView colorImageView;
 
     VkImage resolveColorImage;
-    VkDeviceMemory resolveColorImageMemory;
+    GfxAllocation resolveColorImageAllocation;
     VkImageView resolveColorImageView;
 
     //Blur
     VkImage blurImage;
-    VkDeviceMemory blurImageMemory;
+    GfxAllocation blurImageAllocation;
     VkImageView blurImageView;
 
     //PostProcess present
     VkImage postProcessImage;
-    VkDeviceMemory postProcessImageMemory;
+    GfxAllocation postProcessImageAllocation;
     VkImageView postProcessImageView;
 
     //PostProcess quad
     VkBuffer postProcessQuadBuffer;
-    VkDeviceMemory postProcessQuadBufferMemory;
+    GfxAllocation postProcessQuadBufferAllocation;
     VkBuffer postProcessQuadIndicesBuffer;
-    VkDeviceMemory postProcessQuadIndicesBufferMemory;
-
-    //TODO: store vertex + index in the same buffer for memory aliasing
-    //https://developer.nvidia.com/vulkan-memory-management 
+    GfxAllocation postProcessQuadIndicesBufferAllocation;
 
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
-    std::vector<void*> uniformBuffersMapped;
+    //Dynamic offset of the shared frame constants used by the compute and post process passes
+    uint32_t frameUniformOffset = 0;
 
     //Compute
     std::vector<VkBuffer> shaderStorageBuffers;
-    std::vector<VkDeviceMemory> shaderStorageBuffersMemory;
+    std::vector<GfxAllocation> shaderStorageBuffersAllocation;
 
     VkDescriptorPool shadowMapDescriptorPool;
     VkDescriptorPool descriptorPool;
@@ -191,6 +249,55 @@ private:
 
     std::vector<VkCommandBuffer> commandBuffers;
     std::vector<VkCommandBuffer> computeCommandBuffers;
+    //Shadow and color pass draws, recorded into secondary buffers by worker threads
+    GfxParallelRecorder parallelRecorder;
+    //Frames recorded once per swapchain image and frame slot, submitted again while nothing they record changed
+    GfxCommandBufferCache commandBufferCache;
+    //Rebuilt and state sorted every frame
+    GfxDrawList shadowDrawList;
+    GfxDrawList colorDrawList;
+    //Indirect draws of the objects uncovered by the occlusion culling second phase, recorded inline after the pyramid build
+    GfxDrawList secondPhaseDrawList;
+    //Views the draw lists sort front to back with, set in UpdateUniformBuffers
+    glm::mat4 cameraViewMatrix = glm::mat4(1.0f);
+    glm::mat4 lightViewMatrix = glm::mat4(1.0f);
+    //Frustums the GPU culling tests against
+    glm::mat4 cameraViewProjectionMatrix = glm::mat4(1.0f);
+    glm::mat4 lightSpaceMatrix = glm::mat4(1.0f);
+    //Scene objects culled and drawn with indirect commands written by a compute shader
+    GfxGpuCulling gpuCulling;
+    bool gpuDrivenRendering = false;
+    //Frustum culling of the CPU draw path, one visible list per pass
+    GfxCpuCulling cpuCulling;
+    //Hierarchical alternative to cpuCulling, see BVH_CULLING
+    GfxBvh sceneBvh;
+    std::vector<uint32_t> shadowVisibleObjects;
+    std::vector<uint32_t> colorVisibleObjects;
+    //ComputeVisibilityKey of the culling that filled the visible lists, 0 when they came from elsewhere
+    uint64_t visibleObjectsKey = 0;
+    //Worker threads shared by the parallel recorder, software occlusion and the scene graph
+    GfxJobPool jobPool;
+    //Occluder proxies of the big scene objects rasterized on the CPU, removes hidden objects from colorVisibleObjects
+    GfxSoftwareOcclusion softwareOcclusion;
+    //Farthest depth of the first phase color pass, the second phase culling of the same frame tests against it
+    GfxDepthPyramid depthPyramid;
+    //The color and depth attachments are only stored, and depth sampled, when the pyramid is built from them
+    bool depthPyramidBuildSupported = false;
+    //Toggled with O to compare the color pass cost with and without it
+    bool occlusionCullingEnabled = true;
+    GfxGpuTimer gpuTimer;
+    //Whether the last frame submitted in each slot was occlusion culled, to bucket its color pass time
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> frameOcclusionCulled{};
+    //[0] without occlusion culling, [1] with it
+    double colorPassMs[2] = {};
+    uint64_t colorPassFrames[2] = {};
+    //Toggled with V, or every VERTEX_PULLING_BENCHMARK_FRAMES frames by the benchmark, to compare with the fixed function vertex input
+    bool vertexPullingEnabled = false;
+    uint32_t vertexPullingModeFrames = 0;
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> frameVertexPulled{};
+    //[0] fixed function vertex input, [1] vertex pulling
+    double vertexPullingColorPassMs[2] = {};
+    uint64_t vertexPullingColorPassFrames[2] = {};
 
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
@@ -200,7 +307,15 @@ private:
 
     InputHandler inputHandler;
     GfxLoader gfxLoader;
-    std::vector<GfxObject*> objects;
+    GfxScene scene;
+    uint32_t defaultMaterialId = 0;
+    //Merges the static objects of PopulateObjects, see STATIC_BATCHING
+    GfxStaticBatcher staticBatcher;
+    //Transform hierarchy of the objects that can move, world matrices go to their scene objects on Update
+    GfxSceneGraph sceneGraph;
+    //Moved every frame under SCENE_GRAPH_BENCHMARK, static otherwise
+    uint32_t sphereNode = SCENE_GRAPH_INVALID_NODE;
+    GfxInstancedMesh instancedSpheres;
 
 //Methods
 public:
@@ -224,10 +339,17 @@ private:
     void PickPhysicalDevice();
     bool IsSuitableDevice(VkPhysicalDevice requestedPhysicalDevice);
     bool CheckDeviceExtensionSupport(VkPhysicalDevice requestedPhysicalDevice);
+    bool HasDeviceExtension(VkPhysicalDevice requestedPhysicalDevice, const char* extensionName);
     QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice requestedPhysicalDevice);
     SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
     void CreateLogicalDevice();
     void GetLogicalDeviceQueues();
+    void CreateHostAllocator();
+    void CreatePipelineCache();
+    void CreateJobPool();
+    void CreateMemoryAllocator();
+    void CreateUploadContext();
+    void CreateStagingRing();
     void CreateSwapChain();
     VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
     VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
@@ -259,20 +381,29 @@ private:
     VkFormat FindDepthFormat();
     void CreateColorResources();
     void CreateDepthResources();
+    VkMemoryPropertyFlags GetTransientAttachmentMemoryFlags();
+    //Hi-Z needs the GPU driven path and a depth format that can be sampled at the MSAA sample count
+    bool IsDepthPyramidBuildSupported();
+    void ReportOcclusionCullingSavings();
+    void ReportVertexPullingTimes();
+    void ReportTransientAttachmentSavings();
     void CreateShadowMapResources();
     void CreatePostProcessResources();
     VkCommandBuffer BeginSingleTimeCommandBuffer();
     void EndSingleTimeCommandBuffer(VkCommandBuffer commandBuffer);
     void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
     void CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSample, VkFormat format, VkImageTiling tiling,
-        VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, const char* imageName = "Unknown");
+        VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, GfxAllocation& imageAllocation, const char* imageName = "Unknown");
     void CreateTextureImage();
     void GenerateMipmaps(VkImage image, VkFormat format, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels );
     void CreateTextureImageView();
     void CreateTextureSampler();
+    void CreateGeometryArena();
+    void CreateTransformBuffer();
     void PopulateObjects();
+    void CreateInstancedMeshes();
     void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, 
-        VkMemoryPropertyFlags memoryFlags, VkBuffer& newBuffer, VkDeviceMemory& bufferMemory, const char* BufferName = "Unknown", const char* BufferMemoryName = "Unknown");
+        VkMemoryPropertyFlags memoryFlags, VkBuffer& newBuffer, GfxAllocation& bufferAllocation, const char* BufferName = "Unknown", const char* BufferMemoryName = "Unknown");
     void CreateUniformBuffers();
     void CreateShaderStorageBuffers();
     void CreatePostProcessingQuadBuffer();
@@ -280,8 +411,28 @@ private:
     void CreateCommandBuffers();
     void CreateSyncObjects();
     void SetDescriptorsToObjects();
+    //The streamed texture view changes when it moves, rewritten per frame slot once the slot is idle
+    void UpdateTextureDescriptors(uint32_t frameIndex);
+    //Same for the pulled vertex buffer when the defragmenter moves it
+    void UpdatePulledVertexDescriptors(uint32_t frameIndex);
     void RecordComputeCommandBuffer(VkCommandBuffer commandBuffer);
+    //Records the draw lists built this frame into worker secondaries the primary buffer executes
     void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    //Hash of the versions, matrices and toggles RecordCommandBuffer bakes into the commands of this frame slot,
+    //cheap enough that a static frame is recognized without building its draw lists
+    uint64_t ComputeRecordingKey();
+    //Hash of what the CPU culling reads, equal keys give the same visible objects
+    uint64_t ComputeVisibilityKey();
+    void CreateParallelRecorder();
+    void CreateCulling();
+    //With useGpuCulling scene objects come from gpuCulling indirect buffers instead of one draw each.
+    //drawnObjects skips CPU culling and draws those scene indices in both passes, the benchmark repeats objects with it
+    void BuildDrawLists(GfxDrawList& shadowList, GfxDrawList& colorList, bool useGpuCulling, const std::vector<uint32_t>* drawnObjects = nullptr);
+    //Queues the shadow and color draw lists on recorder and waits for the secondary buffers.
+    //The command buffer arrays, one per worker, replace the recorder per frame buffers (see GfxCommandBufferCache)
+    void RecordScenePasses(GfxParallelRecorder& recorder, uint32_t imageIndex, GfxDrawList& shadowList, GfxDrawList& colorList,
+        const VkCommandBuffer* shadowCommandBuffers = nullptr, const VkCommandBuffer* colorCommandBuffers = nullptr);
+    void RunParallelRecordingBenchmark();
     uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags memoryFlags);
     VkShaderModule CreateShaderModule(const std::vector<char>& code, const char* Name = "Unknown");
     void MainLoop();
@@ -53,6 +53,62 @@ void InputHandler::ReactToEvents(GLFWwindow &window)
 		}
 	}
 
+	static bool defragmentInputPressed;
+	if (glfwGetKey(&window, GLFW_KEY_F) == GLFW_PRESS)
+	{
+		defragmentInputPressed = true;
+	}
+	if (glfwGetKey(&window, GLFW_KEY_F) == GLFW_RELEASE)
+	{
+		if (defragmentInputPressed)
+		{
+			wantToDefragment = true;
+			defragmentInputPressed = false;
+		}
+	}
+
+	static bool occlusionInputPressed;
+	if (glfwGetKey(&window, GLFW_KEY_O) == GLFW_PRESS)
+	{
+		occlusionInputPressed = true;
+	}
+	if (glfwGetKey(&window, GLFW_KEY_O) == GLFW_RELEASE)
+	{
+		if (occlusionInputPressed)
+		{
+			wantToToggleOcclusionCulling = true;
+			occlusionInputPressed = false;
+		}
+	}
+
+	static bool dumpOcclusionInputPressed;
+	if (glfwGetKey(&window, GLFW_KEY_P) == GLFW_PRESS)
+	{
+		dumpOcclusionInputPressed = true;
+	}
+	if (glfwGetKey(&window, GLFW_KEY_P) == GLFW_RELEASE)
+	{
+		if (dumpOcclusionInputPressed)
+		{
+			wantToDumpOcclusionBuffer = true;
+			dumpOcclusionInputPressed = false;
+		}
+	}
+
+	static bool vertexPullingInputPressed;
+	if (glfwGetKey(&window, GLFW_KEY_V) == GLFW_PRESS)
+	{
+		vertexPullingInputPressed = true;
+	}
+	if (glfwGetKey(&window, GLFW_KEY_V) == GLFW_RELEASE)
+	{
+		if (vertexPullingInputPressed)
+		{
+			wantToToggleVertexPulling = true;
+			vertexPullingInputPressed = false;
+		}
+	}
+
 	if (glfwGetKey(&window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 	{
 		wantToExit = true;
@@ -83,3 +139,31 @@ bool InputHandler::WantToExit()
 {
 	return wantToExit;
 }
+
+bool InputHandler::WantToDefragment()
+{
+	bool defragment = wantToDefragment;
+	wantToDefragment = false;
+	return defragment;
+}
+
+bool InputHandler::WantToToggleOcclusionCulling()
+{
+	bool toggle = wantToToggleOcclusionCulling;
+	wantToToggleOcclusionCulling = false;
+	return toggle;
+}
+
+bool InputHandler::WantToDumpOcclusionBuffer()
+{
+	bool dump = wantToDumpOcclusionBuffer;
+	wantToDumpOcclusionBuffer = false;
+	return dump;
+}
+
+bool InputHandler::WantToToggleVertexPulling()
+{
+	bool toggle = wantToToggleVertexPulling;
+	wantToToggleVertexPulling = false;
+	return toggle;
+}
@@ -11,10 +11,22 @@ class InputHandler
 	glm::vec3 GetPosition();
 	bool IsDebugEnabled();
 	bool WantToExit();
+	//True once per F key release
+	bool WantToDefragment();
+	//True once per O key release
+	bool WantToToggleOcclusionCulling();
+	//True once per P key release
+	bool WantToDumpOcclusionBuffer();
+	//True once per V key release
+	bool WantToToggleVertexPulling();
 
 	private:
 	glm::vec3 position;
 	bool isDebugEnabled = false;
 	bool wantToExit = false;
+	bool wantToDefragment = false;
+	bool wantToToggleOcclusionCulling = false;
+	bool wantToDumpOcclusionBuffer = false;
+	bool wantToToggleVertexPulling = false;
 };
 
@@ -1 +1,18 @@
-#define COMPUTE_FEATURE 1
\ No newline at end of file
+#define COMPUTE_FEATURE 1
+#define MEMORY_ALLOCATOR_BENCHMARK 0
+#define HOST_ALLOCATOR 1
+#define PARALLEL_RECORDING_BENCHMARK 0
+#define INSTANCED_SPHERE_COUNT 1024
+#define GPU_DRIVEN_RENDERING 1
+#define FRUSTUM_CULLING_BENCHMARK 0
+#define BVH_CULLING 1
+#define CACHED_COMMAND_BUFFERS 1
+#define HIZ_OCCLUSION_CULLING 1
+#define SOFTWARE_OCCLUSION_CULLING 1
+#define SOFTWARE_OCCLUSION_BENCHMARK 0
+#define STATIC_BATCHING 1
+#define STATIC_BATCHING_BENCHMARK 0
+#define SCENE_GRAPH_BENCHMARK 0
+#define VERTEX_PULLING 1
+#define VERTEX_PULLING_BENCHMARK 0
+#define PIPELINE_CACHE 1
\ No newline at end of file
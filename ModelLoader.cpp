@@ -66,11 +66,19 @@ void GfxLoader::LoadModel()
 		return;
 	}
 
+	LoadObj(MODEL_PATH, vertices, indices);
+}
+
+void GfxLoader::LoadObj(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
 	tinyobj::attrib_t attribute;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
 	std::string errStr, wrnStr;
-	if (!tinyobj::LoadObj(&attribute, &shapes, &materials, &errStr, MODEL_PATH.c_str()))
+	if (!tinyobj::LoadObj(&attribute, &shapes, &materials, &errStr, path.c_str()))
 	{
 		throw std::runtime_error(errStr);
 	}
@@ -95,6 +103,17 @@ void GfxLoader::LoadModel()
 				1 - attribute.texcoords[2 * index.texcoord_index + 1],
 			};
 
+			//Lit with the file normals when it has them
+			if (index.normal_index >= 0)
+			{
+				vertex.normal =
+				{
+					attribute.normals[3 * index.normal_index + 0],
+					attribute.normals[3 * index.normal_index + 1],
+					attribute.normals[3 * index.normal_index + 2]
+				};
+			}
+
 			vertex.color = { 1.0f, 1.0f, 1.0f };
 
 			if (uniqueVertices.count(vertex) == 0) 
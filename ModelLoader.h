@@ -10,6 +10,8 @@ class GfxLoader
 {
 public:
 	void LoadModel();
+	//Vertices deduplicated, indices relative to the first vertex
+	void LoadObj(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
 	unsigned char* LoadTexture(int* width, int* height, int* channels);
 	void FreeTextureArrayInfo(unsigned char* pixels);
 
@@ -30,23 +30,110 @@ SamplerState mySampler : register(s1);
 Texture2D imageTexture : register(t2);
 Texture2D<float> depthShadowTexture : register(t3);
 
+//Object model matrices as their first three rows, see GfxCompactTransform
+struct ObjectTransform
+{
+    float4 rows[3];
+};
+StructuredBuffer<ObjectTransform> objectTransforms : register(t4);
+
+struct ObjectConstants
+{
+    uint transformIndex;
+};
+[[vk::push_constant]] ObjectConstants objectConstants;
+
 #include "brdf.hlsl"
 #define SAMPLE_TEXTURE 0
 #define SIMPLE_COLOR 0
 #define SHADOW_MAP 1
 #define SHADOWMAP_DRAW_IN_GEOMETRY 0
 #define USE_PCF_SHADOWS 1
-
-PSInput VSMain(float4 inPosition : SV_POSITION, float3 inColor : COLOR, 
-    float2 inTexCoord : TEXCOORD, float3 inNormal : NORMAL)
+//Compiled with -D INSTANCED=1 for instanced meshes, model matrix and color come per instance
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif //#ifndef INSTANCED
+//Compiled with -D INDIRECT=1 for GPU culled draws, firstInstance carries the transform index
+#ifndef INDIRECT
+#define INDIRECT 0
+#endif //#ifndef INDIRECT
+//Compiled with -D VERTEX_PULLING=1 for pipelines without vertex input, vertices are read from the geometry arena packed stream
+#ifndef VERTEX_PULLING
+#define VERTEX_PULLING 0
+#endif //#ifndef VERTEX_PULLING
+
+#if VERTEX_PULLING
+//GfxPackedVertex: float3 position, octahedral normal as two snorm16, texCoord as two halves, color as rgba8
+#define PACKED_VERTEX_STRIDE 24
+ByteAddressBuffer pulledVertices : register(t5);
+
+float3 DecodeOctahedral(uint packed)
+{
+    //Sign extended from the low and high 16 bits
+    float2 octahedral = max(float2(int(packed << 16) >> 16, int(packed) >> 16) / 32767.0f, -1.0f);
+    float3 normal = float3(octahedral, 1.0f - abs(octahedral.x) - abs(octahedral.y));
+    float t = saturate(-normal.z);
+    normal.x += normal.x >= 0.0f ? -t : t;
+    normal.y += normal.y >= 0.0f ? -t : t;
+    return normalize(normal);
+}
+#endif //#if VERTEX_PULLING
+
+PSInput VSMain(
+#if VERTEX_PULLING
+    uint vertexID : SV_VertexID
+#else //#if VERTEX_PULLING
+    //Explicit because the instance inputs are, DXC rejects a partial location assignment. Same order as Vertex::GetAttributeDescription
+    [[vk::location(0)]] float4 inPosition : SV_POSITION, [[vk::location(1)]] float3 inColor : COLOR, 
+    [[vk::location(2)]] float2 inTexCoord : TEXCOORD, [[vk::location(3)]] float3 inNormal : NORMAL
+#endif //#else //#if VERTEX_PULLING
+#if INSTANCED
+    , [[vk::location(4)]] float4 instanceModel0 : INSTANCE_MODEL0
+    , [[vk::location(5)]] float4 instanceModel1 : INSTANCE_MODEL1
+    , [[vk::location(6)]] float4 instanceModel2 : INSTANCE_MODEL2
+    , [[vk::location(7)]] float4 instanceModel3 : INSTANCE_MODEL3
+    , [[vk::location(8)]] float4 instanceColor : INSTANCE_COLOR
+#endif //#if INSTANCED
+#if INDIRECT
+    , uint instanceID : SV_InstanceID
+#endif //#if INDIRECT
+    )
 {
     PSInput result;
+
+#if VERTEX_PULLING
+    //SV_VertexID already includes the vertexOffset of the draw, so it indexes the whole arena
+    uint address = vertexID * PACKED_VERTEX_STRIDE;
+    float4 inPosition = float4(asfloat(pulledVertices.Load3(address)), 1.0f);
+    uint3 packedAttributes = pulledVertices.Load3(address + 12);
+    float3 inNormal = DecodeOctahedral(packedAttributes.x);
+    float2 inTexCoord = f16tof32(uint2(packedAttributes.y & 0xffff, packedAttributes.y >> 16));
+    float3 inColor = float3(packedAttributes.z & 0xff, (packedAttributes.z >> 8) & 0xff, (packedAttributes.z >> 16) & 0xff) / 255.0f;
+#endif //#if VERTEX_PULLING
     
-    float4x4 MVP = (mul(mul(ubo.projM, ubo.viewM),ubo.modelM)); 
+#if INSTANCED
+    //Attributes are the matrix columns
+    float4x4 modelM = transpose(float4x4(instanceModel0, instanceModel1, instanceModel2, instanceModel3));
+    float3 vertexColor = inColor * instanceColor.rgb;
+    float3 normal = mul((float3x3)modelM, inNormal);
+#else //#if INSTANCED
+#if INDIRECT
+    //Without -fvk-support-nonzero-base-instance SV_InstanceID includes firstInstance
+    uint transformIndex = instanceID;
+#else //#if INDIRECT
+    uint transformIndex = objectConstants.transformIndex;
+#endif //#else //#if INDIRECT
+    ObjectTransform transform = objectTransforms[transformIndex];
+    float4x4 modelM = float4x4(transform.rows[0], transform.rows[1], transform.rows[2], float4(0.0f, 0.0f, 0.0f, 1.0f));
+    float3 vertexColor = inColor;
+    float3 normal = mul((float3x3)modelM, inNormal);
+#endif //#else //#if INSTANCED
+
+    float4x4 MVP = (mul(mul(ubo.projM, ubo.viewM),modelM)); 
     result.position = mul(MVP, inPosition);
-    result.fragColor = float4(inColor,1.0f);
-    result.normal = normalize(inNormal);
-    result.fragPos = mul(ubo.modelM, inPosition);
+    result.fragColor = float4(vertexColor,1.0f);
+    result.normal = normalize(normal);
+    result.fragPos = mul(modelM, inPosition);
     //result.viewPosF = ubo.inViewPosF;
     //result.debugUtilF = ubo.debugUtil;
     result.fragTexCoord = float3(inTexCoord, 1.0f);
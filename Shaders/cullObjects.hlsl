@@ -0,0 +1,192 @@
+//Must match GfxGpuCullObject
+struct CullObject
+{
+    float4 boundingSphere;
+    uint transformIndex;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+};
+
+//Object model matrices as their first three rows, see GfxCompactTransform
+struct ObjectTransform
+{
+    float4 rows[3];
+};
+
+//VkDrawIndexedIndirectCommand
+struct DrawIndexedIndirectCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+//Must match GfxGpuCullConstants
+struct CullConstants
+{
+    float4 frustumPlanes[6];
+    float4x4 occlusionViewProjection;
+    uint objectCount;
+    uint occlusionEnabled;
+    uint depthWidth;
+    uint depthHeight;
+    uint pyramidWidth;
+    uint pyramidHeight;
+    uint pyramidLevelCount;
+    uint phase;
+};
+
+//Must match GfxGpuCullingCounter
+#define COUNTER_DRAW_COUNT 0
+#define COUNTER_FRUSTUM_CULLED 1
+#define COUNTER_OCCLUSION_CULLED 2
+#define COUNTER_LAST_FRAME_VISIBLE 3
+
+//Must match GfxGpuCullingPhase
+#define PHASE_FIRST 0
+#define PHASE_SECOND 1
+
+StructuredBuffer<CullObject> cullObjects : register(t0);
+StructuredBuffer<ObjectTransform> objectTransforms : register(t1);
+RWStructuredBuffer<DrawIndexedIndirectCommand> drawCommands : register(u2);
+RWStructuredBuffer<uint> counters : register(u3);
+StructuredBuffer<CullConstants> constantsBuffer : register(t4);
+//Per transform index, 1 when the object passed the occlusion test last frame, rewritten by the second phase
+RWStructuredBuffer<uint> lastFrameVisibility : register(u5);
+//Farthest depth mip chain, level 0 is half the depth buffer size, built from the first phase draws of this frame
+Texture2D<float> depthPyramid : register(t6);
+
+//True when the sphere box lies entirely behind the depth the pyramid holds where it projects
+bool IsOccluded(CullConstants cullConstants, float3 center, float radius)
+{
+    float2 uvMin = float2(1.0f, 1.0f);
+    float2 uvMax = float2(0.0f, 0.0f);
+    float nearestDepth = 1.0f;
+    for (uint corner = 0; corner < 8; ++corner)
+    {
+        float3 offset = float3((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+        float4 clip = mul(cullConstants.occlusionViewProjection, float4(center + offset, 1.0f));
+        //Crossing the camera plane, the projected box is unbounded
+        if (clip.w <= 0.0f)
+        {
+            return false;
+        }
+        float3 ndc = clip.xyz / clip.w;
+        float2 uv = ndc.xy * 0.5f + 0.5f;
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+    if (nearestDepth <= 0.0f)
+    {
+        return false;
+    }
+
+    //Depth buffer pixels covered, level L texel x covers pixels [x << (L + 1), (x + 1) << (L + 1)) plus the leftovers of odd sizes at the edges
+    float2 depthSize = float2(cullConstants.depthWidth, cullConstants.depthHeight);
+    uint2 pixelMin = uint2(clamp(uvMin * depthSize, 0.0f, depthSize - 1.0f));
+    uint2 pixelMax = uint2(clamp(uvMax * depthSize, 0.0f, depthSize - 1.0f));
+
+    //Coarsest level where the box spans at most two texels per axis, four loads cover it
+    uint2 pixelSpan = pixelMax - pixelMin + 1;
+    uint level = uint(max(ceil(log2(float(max(pixelSpan.x, pixelSpan.y)))) - 1.0f, 0.0f));
+    level = min(level, cullConstants.pyramidLevelCount - 1);
+
+    uint2 levelSize = max(uint2(cullConstants.pyramidWidth, cullConstants.pyramidHeight) >> level, uint2(1, 1));
+    uint2 texelMin = min(pixelMin >> (level + 1), levelSize - 1);
+    uint2 texelMax = min(pixelMax >> (level + 1), levelSize - 1);
+
+    float farthestDepth = max(max(depthPyramid.Load(int3(texelMin.x, texelMin.y, level)), depthPyramid.Load(int3(texelMax.x, texelMin.y, level))),
+        max(depthPyramid.Load(int3(texelMin.x, texelMax.y, level)), depthPyramid.Load(int3(texelMax.x, texelMax.y, level))));
+    return nearestDepth > farthestDepth;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+    CullConstants cullConstants = constantsBuffer[0];
+    uint index = DTid.x;
+    if (index >= cullConstants.objectCount)
+    {
+        return;
+    }
+
+    CullObject object = cullObjects[index];
+    //Evicted mesh, nothing to draw until it is resident again
+    if (object.indexCount == 0)
+    {
+        return;
+    }
+
+    ObjectTransform transform = objectTransforms[object.transformIndex];
+    float4 localCenter = float4(object.boundingSphere.xyz, 1.0f);
+    float3 center = float3(dot(transform.rows[0], localCenter), dot(transform.rows[1], localCenter), dot(transform.rows[2], localCenter));
+
+    //Largest axis scale keeps the sphere conservative under non uniform scale
+    float scaleX = length(float3(transform.rows[0].x, transform.rows[1].x, transform.rows[2].x));
+    float scaleY = length(float3(transform.rows[0].y, transform.rows[1].y, transform.rows[2].y));
+    float scaleZ = length(float3(transform.rows[0].z, transform.rows[1].z, transform.rows[2].z));
+    float radius = object.boundingSphere.w * max(scaleX, max(scaleY, scaleZ));
+
+    for (int i = 0; i < 6; ++i)
+    {
+        float4 plane = cullConstants.frustumPlanes[i];
+        if (dot(plane.xyz, center) + plane.w < -radius)
+        {
+            //Counted once, the second phase tests the same planes
+            if (cullConstants.phase == PHASE_SECOND)
+            {
+                lastFrameVisibility[object.transformIndex] = 0;
+            }
+            else
+            {
+                InterlockedAdd(counters[COUNTER_FRUSTUM_CULLED], 1);
+            }
+            return;
+        }
+    }
+
+    if (cullConstants.occlusionEnabled != 0)
+    {
+        bool visibleLastFrame = lastFrameVisibility[object.transformIndex] != 0;
+        if (cullConstants.phase == PHASE_FIRST)
+        {
+            //Drawn untested, their depth is what the pyramid is built from. The rest waits for the second phase
+            if (!visibleLastFrame)
+            {
+                return;
+            }
+            InterlockedAdd(counters[COUNTER_LAST_FRAME_VISIBLE], 1);
+        }
+        else
+        {
+            //Every object in the frustum is tested for next frame, only the ones the first phase skipped are drawn now
+            bool occluded = IsOccluded(cullConstants, center, radius);
+            lastFrameVisibility[object.transformIndex] = occluded ? 0 : 1;
+            if (visibleLastFrame)
+            {
+                return;
+            }
+            if (occluded)
+            {
+                InterlockedAdd(counters[COUNTER_OCCLUSION_CULLED], 1);
+                return;
+            }
+        }
+    }
+
+    uint drawIndex;
+    InterlockedAdd(counters[COUNTER_DRAW_COUNT], 1, drawIndex);
+
+    //The indirect vertex shaders read the transform index back as SV_InstanceID
+    DrawIndexedIndirectCommand command;
+    command.indexCount = object.indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = object.firstIndex;
+    command.vertexOffset = object.vertexOffset;
+    command.firstInstance = object.transformIndex;
+    drawCommands[drawIndex] = command;
+}
@@ -0,0 +1,64 @@
+//Must match GfxDepthPyramidConstants
+struct PyramidConstants
+{
+    uint2 sourceSize;
+    uint2 destinationSize;
+    uint sampleCount;
+};
+[[vk::push_constant]] PyramidConstants pyramidConstants;
+
+//Level 0 reads the depth buffer, every other level the level above it
+#ifdef MSAA_SOURCE
+Texture2DMS<float> sourceDepth : register(t0);
+#else
+Texture2D<float> sourceDepth : register(t0);
+#endif
+[[vk::image_format("r32f")]] RWTexture2D<float> destinationDepth : register(u1);
+
+float LoadSource(uint2 coord)
+{
+#ifdef MSAA_SOURCE
+    //Farthest sample, a texel may only claim what every sample under it hides
+    float depth = 0.0f;
+    for (uint i = 0; i < pyramidConstants.sampleCount; ++i)
+    {
+        depth = max(depth, sourceDepth.Load(int2(coord), i));
+    }
+    return depth;
+#else
+    return sourceDepth.Load(int3(coord, 0));
+#endif
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+    uint2 coord = DTid.xy;
+    if (coord.x >= pyramidConstants.destinationSize.x || coord.y >= pyramidConstants.destinationSize.y)
+    {
+        return;
+    }
+
+    //Destination sizes are the source ones halved and rounded down, the last row and column also
+    //take the leftover source texel of odd sizes so every source texel lands in some destination one
+    uint2 first = coord * 2;
+    uint2 last = min(first + 1, pyramidConstants.sourceSize - 1);
+    if (coord.x == pyramidConstants.destinationSize.x - 1)
+    {
+        last.x = pyramidConstants.sourceSize.x - 1;
+    }
+    if (coord.y == pyramidConstants.destinationSize.y - 1)
+    {
+        last.y = pyramidConstants.sourceSize.y - 1;
+    }
+
+    float depth = 0.0f;
+    for (uint y = first.y; y <= last.y; ++y)
+    {
+        for (uint x = first.x; x <= last.x; ++x)
+        {
+            depth = max(depth, LoadSource(uint2(x, y)));
+        }
+    }
+    destinationDepth[coord] = depth;
+}
@@ -19,11 +19,56 @@ cbuffer MyConstantBuffer : register(b0)
    UniformBufferObject ubo;
 };
 
-PSInput VSMain(float4 inPosition : SV_POSITION)
+//Object model matrices as their first three rows, see GfxCompactTransform
+struct ObjectTransform
+{
+    float4 rows[3];
+};
+StructuredBuffer<ObjectTransform> objectTransforms : register(t1);
+
+struct ObjectConstants
+{
+    uint transformIndex;
+};
+[[vk::push_constant]] ObjectConstants objectConstants;
+
+//Compiled with -D INSTANCED=1 for instanced meshes, the model matrix comes per instance
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif //#ifndef INSTANCED
+//Compiled with -D INDIRECT=1 for GPU culled draws, firstInstance carries the transform index
+#ifndef INDIRECT
+#define INDIRECT 0
+#endif //#ifndef INDIRECT
+
+//Explicit because the instance inputs are, DXC rejects a partial location assignment
+PSInput VSMain([[vk::location(0)]] float4 inPosition : SV_POSITION
+#if INSTANCED
+    , [[vk::location(4)]] float4 instanceModel0 : INSTANCE_MODEL0
+    , [[vk::location(5)]] float4 instanceModel1 : INSTANCE_MODEL1
+    , [[vk::location(6)]] float4 instanceModel2 : INSTANCE_MODEL2
+    , [[vk::location(7)]] float4 instanceModel3 : INSTANCE_MODEL3
+#endif //#if INSTANCED
+#if INDIRECT
+    , uint instanceID : SV_InstanceID
+#endif //#if INDIRECT
+    )
 {
     PSInput result;
+#if INSTANCED
+    float4x4 modelM = transpose(float4x4(instanceModel0, instanceModel1, instanceModel2, instanceModel3));
+#else //#if INSTANCED
+#if INDIRECT
+    //Without -fvk-support-nonzero-base-instance SV_InstanceID includes firstInstance
+    uint transformIndex = instanceID;
+#else //#if INDIRECT
+    uint transformIndex = objectConstants.transformIndex;
+#endif //#else //#if INDIRECT
+    ObjectTransform transform = objectTransforms[transformIndex];
+    float4x4 modelM = float4x4(transform.rows[0], transform.rows[1], transform.rows[2], float4(0.0f, 0.0f, 0.0f, 1.0f));
+#endif //#else //#if INSTANCED
     //result.position = mul(ubo.lightSpaceMatrix, mul(ubo.modelM, inPosition));
-    result.position = mul(mul(ubo.lightSpaceMatrix, ubo.modelM), inPosition);
+    result.position = mul(mul(ubo.lightSpaceMatrix, modelM), inPosition);
     return result;
 }
 
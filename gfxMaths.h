@@ -68,6 +68,43 @@ struct Vertex
 };
 
 
+//Per instance vertex data of instanced meshes, binding 1 advanced once per instance
+struct InstanceData
+{
+	glm::mat4 modelMatrix;
+	glm::vec4 color;
+
+	static VkVertexInputBindingDescription GetBindingDesctiption()
+	{
+		VkVertexInputBindingDescription vertexInputBindingDescription{};
+		vertexInputBindingDescription.binding = 1;
+		vertexInputBindingDescription.stride = sizeof(InstanceData);
+		vertexInputBindingDescription.inputRate = VkVertexInputRate::VK_VERTEX_INPUT_RATE_INSTANCE;
+		return vertexInputBindingDescription;
+	}
+
+	//Locations 4-7 are the matrix columns, 8 the color
+	static std::array<VkVertexInputAttributeDescription, 5> GetAttributeDescription()
+	{
+		std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+		for (uint32_t column = 0; column < 4; ++column)
+		{
+			attributeDescriptions[column].binding = 1;
+			attributeDescriptions[column].location = 4 + column;
+			attributeDescriptions[column].format = VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[column].offset = offsetof(InstanceData, modelMatrix) + sizeof(glm::vec4) * column;
+		}
+
+		attributeDescriptions[4].binding = 1;
+		attributeDescriptions[4].location = 8;
+		attributeDescriptions[4].format = VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[4].offset = offsetof(InstanceData, color);
+
+		return attributeDescriptions;
+	}
+};
+
+
 namespace std
 {
 	template<> struct hash<Vertex> 